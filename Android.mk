@@ -16,19 +16,31 @@ Source/drawutils.c \
 Source/gametimer.c \
 Source/input.c \
 Source/linkedlist.c \
+Source/lz4.c \
+Source/map_streamer.c \
 Source/object.c \
+Source/pixel_convert.c \
 Source/png_loader.c \
+Source/preloader.c \
 Source/renderer.c \
 Source/scene.c \
 Source/shader.c \
 Source/sprite.c \
 Source/texture.c \
 Source/texture_atlas.c \
+Source/texture_cache.c \
+Source/texture_loader.c \
+Source/texture_manager.c \
+Source/texture_packer.c \
 Source/tmx_map.c \
 Source/util.c \
-Source/sound_android.c \
+Source/vfs.c \
 Source/dictionary.c \
 Source/json.c \
+Source/json_document.c \
+Source/json_query.c \
+Source/json_writer.c \
+Source/ktx_loader.c \
 Source/primitive_types.c \
 Source/world.c \
 Source/luacontext.c \
@@ -100,8 +112,18 @@ Dependencies/Chipmunk/src/cpSweep1D.c \
 Dependencies/Chipmunk/src/cpVect.c \
 dynamo_wrap.c
 
+# Sound goes through OpenSL, or through OpenAL with streamed BGM when building with DYNAMO_AUDIO=openal
+# (Which needs prebuilt OpenAL Soft, libogg & libvorbis)
+ifeq ($(DYNAMO_AUDIO),openal)
+LOCAL_SRC_FILES += Source/ogg_loader.c Source/sound_openal.c Source/sound_other.c
+AUDIO_LDLIBS := -lopenal -lvorbisfile -lvorbis -logg
+else
+LOCAL_SRC_FILES += Source/sound_android.c
+AUDIO_LDLIBS := -lOpenSLES
+endif
+
 LIBS+=bps screen EGL GLESv2 freetype
-LOCAL_LDLIBS := -lz -llog -ldl -lGLESv2 -lOpenSLES -L$(DEPS_PATH)/LuaJIT -lluajit_android
+LOCAL_LDLIBS := -lz -llog -ldl -lEGL -lGLESv2 $(AUDIO_LDLIBS) -L$(DEPS_PATH)/LuaJIT -lluajit_android
 
 include $(BUILD_SHARED_LIBRARY)
 
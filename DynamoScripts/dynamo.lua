@@ -38,7 +38,7 @@ typedef void (*RenderableDisplayCallback_t)(Renderer_t *aRenderer, void *aOwner,
 typedef struct _Renderable { _Obj_guts _guts; RenderableDisplayCallback_t displayCallback; int luaDisplayCallback; } Renderable_t;
 extern Class_t Class_Renderable;
 struct _Renderer { _Obj_guts _guts; GLuint frameBufferId; vec2_t viewportSize; vec3_t cameraOffset; matrix_stack_t
-*worldMatrixStack; matrix_stack_t *projectionMatrixStack; LinkedList_t *renderables;  };
+*worldMatrixStack; matrix_stack_t *projectionMatrixStack; LinkedList_t *renderables; GLMFloat lastDisplayDuration; };
 extern Renderer_t *renderer_create(vec2_t aViewPortSize, vec3_t aCameraOffset);
 extern void renderer_display(Renderer_t *aRenderer, GLMFloat aTimeSinceLastFrame, GLMFloat aInterpolation);
 extern void renderer_pushRenderable(Renderer_t *aRenderer, void *aRenderable);
@@ -53,26 +53,74 @@ extern bool scene_insertRenderable(Scene_t *aScene, void *aRenderableToInsert, v
 extern bool scene_deleteRenderable(Scene_t *aScene, void *aRenderable);
 typedef struct _GameTimer GameTimer_t;
 typedef void (*GameTimer_updateCallback_t)(GameTimer_t *aTimer);
-struct _GameTimer { _Obj_guts _guts; GLMFloat elapsed; GLMFloat timeSinceLastUpdate; GLMFloat desiredInterval; GLMFloat resetAt; short status; long ticks; GameTimer_updateCallback_t updateCallback; int luaUpdateCallback; LinkedList_t *scheduledCallbacks;};
+struct _GameTimer { _Obj_guts _guts; GLMFloat elapsed; GLMFloat timeSinceLastUpdate; GLMFloat desiredInterval; GLMFloat resetAt; short status; long ticks; GameTimer_updateCallback_t updateCallback; void *updateContext; int luaUpdateCallback; LinkedList_t *scheduledCallbacks; bool isThreaded; bool shouldStopThread; GLMFloat lastThreadedUpdateAt; void *simulationThread; };
 extern GameTimer_t *gameTimer_create(GLMFloat aFps, GameTimer_updateCallback_t aUpdateCallback);
 extern void gameTimer_step(GameTimer_t *aTimer, GLMFloat elapsed);
 extern GLMFloat gameTimer_interpolationSinceLastUpdate(GameTimer_t *aTimer);
 extern void gameTimer_pause(GameTimer_t *aTimer);
 extern void gameTimer_resume(GameTimer_t *aTimer);
 extern void gameTimer_reset(GameTimer_t *aTimer);
+extern bool gameTimer_startSimulationThread(GameTimer_t *aTimer);
+extern void gameTimer_stopSimulationThread(GameTimer_t *aTimer);
+extern void gameTimer_lockSimulation(GameTimer_t *aTimer);
+extern void gameTimer_unlockSimulation(GameTimer_t *aTimer);
 typedef struct _GameTimer_ScheduledCallback GameTimer_ScheduledCallback_t;
 extern GameTimer_ScheduledCallback_t *gameTimer_afterDelay_luaCallback(GameTimer_t *aTimer, GLMFloat aDelay, int aCallback, bool aRepeats);
 bool gameTimer_unscheduleCallback(GameTimer_t *aTimer, GameTimer_ScheduledCallback_t *aCallback);
 extern GLMFloat dynamo_globalTime();
 extern GLMFloat dynamo_time();
-typedef struct _Texture { _Obj_guts _guts; RenderableDisplayCallback_t displayCallback; int luaDisplayCallback; vec3_t location;  GLuint id; vec2_t size; vec2_t pxAlignInset; void *subtextures; } Texture_t;
+typedef enum { kTexturePixelFormat_Auto, kTexturePixelFormat_RGBA4444, kTexturePixelFormat_RGBA5551, kTexturePixelFormat_RGB565 } TexturePixelFormat_t;
 typedef union _TextureRect { vec4_t v; float *f; struct {     vec2_t origin;     vec2_t size; }; struct {     float u, v;     float w, h; }; } TextureRect_t;
+typedef struct _SubTexture { char name[33]; vec2_t origin; vec2_t size; TextureRect_t rect; bool isRotated; bool isTrimmed; vec2_t sourceSize; vec2_t trimOffset; } SubTexture_t;
+typedef struct _Texture { _Obj_guts _guts; RenderableDisplayCallback_t displayCallback; int luaDisplayCallback; vec3_t location;  GLuint id; vec2_t size; vec2_t pxAlignInset; int numberOfSubtextures; SubTexture_t *subtextures; void *cacheEntry; bool isLoading; char *sourcePath; bool repeatHorizontal, repeatVertical; size_t byteSize; unsigned long lastUsedFrame; bool isEvicted; struct _Texture *lessRecentlyUsed, *moreRecentlyUsed; TexturePixelFormat_t pixelFormat; bool premultipliesAlpha; } Texture_t;
 extern const TextureRect_t kTextureRectEntire;
+extern Texture_t *texture_load(const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical);
 extern Texture_t *texture_loadFromPng(const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical);
+extern Texture_t *texture_loadFromPngWithFormat(const char *aPath, TexturePixelFormat_t aFormat, bool aPremultiplyAlpha, bool aRepeatHorizontal, bool aRepeatVertical);
+extern Texture_t *texture_loadFromKtx(const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical);
+extern Texture_t *texture_createFromData(const unsigned char *aData, int aWidth, int aHeight, bool aHasAlpha, bool aRepeatHorizontal, bool aRepeatVertical);
+typedef struct _TextureCacheStats { unsigned long hits; unsigned long misses; int residentTextures; size_t bytesResident; } TextureCacheStats_t;
+extern Texture_t *texCache_loadPng(const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical);
+extern Texture_t *texCache_preload(const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical);
+extern void texCache_pin(Texture_t *aTexture);
+extern void texCache_unpin(Texture_t *aTexture);
+extern void texCache_unpinAll(void);
+extern TextureCacheStats_t texCache_getStats(void);
+extern void texture_setData(Texture_t *aTexture, const unsigned char *aData, int aWidth, int aHeight, bool aHasAlpha, bool aRepeatHorizontal, bool aRepeatVertical);
+extern void texture_setDataWithFormat(Texture_t *aTexture, const unsigned char *aData, int aWidth, int aHeight, bool aHasAlpha, TexturePixelFormat_t aFormat, bool aRepeatHorizontal, bool aRepeatVertical);
+typedef void (*TextureLoadCallback_t)(Texture_t *aTexture, bool aSucceeded, void *aContext);
+typedef struct _TextureLoaderStats { int queuedLoads; int pendingUploads; size_t bytesUploaded; } TextureLoaderStats_t;
+extern Texture_t *texLoader_loadPng(const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical, TextureLoadCallback_t aCallback, void *aContext, int aLuaCallback);
+extern void texLoader_reloadPng(Texture_t *aTexture);
+extern void texLoader_processUploads(void);
+extern void texLoader_setUploadBudget(size_t aBytes);
+extern void texLoader_cancelAll(void);
+extern TextureLoaderStats_t texLoader_getStats(void);
+extern void texture_releaseStagingBuffer(void);
+extern void texture_setSource(Texture_t *aTexture, const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical);
+extern bool texture_reload(Texture_t *aTexture);
+extern void texture_bind(Texture_t *aTexture);
+typedef struct _TextureManagerStats { size_t budget; size_t bytesResident; int residentTextures; int evictedTextures; unsigned long evictions; unsigned long reloads; } TextureManagerStats_t;
+extern void texManager_setBudget(size_t aBytes);
+extern void texManager_setAsyncReload(bool aAsync);
+extern void texManager_update(void);
+extern void texManager_touch(Texture_t *aTexture);
+extern TextureManagerStats_t texManager_getStats(void);
+typedef struct _PackedImage { Texture_t *texture; vec2_t origin; vec2_t size; TextureRect_t rect; } PackedImage_t;
+typedef struct _TexturePackerImage TexturePackerImage_t;
+typedef struct _TexturePacker { _Obj_guts _guts; vec2_t pageSize; int padding; int numberOfImages, imageCapacity; TexturePackerImage_t *images; bool isPacked; int numberOfPages; Texture_t **pages; } TexturePacker_t;
+extern TexturePacker_t *texPacker_create(vec2_t aPageSize, int aPadding);
+extern bool texPacker_addImage(TexturePacker_t *aPacker, const char *aName, const unsigned char *aData, int aWidth, int aHeight, bool aHasAlpha);
+extern bool texPacker_addPng(TexturePacker_t *aPacker, const char *aName, const char *aPath);
+extern bool texPacker_pack(TexturePacker_t *aPacker);
+extern PackedImage_t texPacker_getImage(TexturePacker_t *aPacker, const char *aName);
 extern TextureRect_t textureRectangle_createWithPixelCoordinates(Texture_t *aTexture, vec2_t aOrigin, vec2_t aSize);
 extern TextureRect_t textureRectangle_createWithSizeInPixels(Texture_t *aTexture, vec2_t aSize);
 extern TextureRect_t textureRectangle_create(float aX, float aY, float aWidth, float aHeight);
 extern bool texture_loadPackingInfo(Texture_t *aTexture, const char *aPath);
+extern void texture_setSubTextures(Texture_t *aTexture, const SubTexture_t *aSubTextures, int aCount);
+extern int texture_getSubTextureId(Texture_t *aTexture, const char *aTexName);
+extern const SubTexture_t *texture_getSubTexture(Texture_t *aTexture, int aId);
 extern TextureRect_t texture_getSubTextureRect(Texture_t *aTexture, const char *aTexName);
 extern vec2_t texture_getSubTextureOrigin(Texture_t *aTexture, const char *aTexName);
 extern vec2_t texture_getSubTextureSize(Texture_t *aTexture, const char *aTexName);
@@ -95,18 +143,20 @@ extern void draw_circle(vec2_t aCenter, float radius, int aSubdivisions, vec4_t
 extern void draw_polygon(int aNumberOfVertices, vec2_t *aVertices, vec4_t aColor, bool aShouldFill);
 extern void draw_lineSeg(vec2_t aPointA, vec2_t aPointB, vec4_t aColor);
 typedef struct _SpriteAnimation { int numberOfFrames; int currentFrame; bool loops; } SpriteAnimation_t;
-typedef struct _Sprite { _Obj_guts _guts; RenderableDisplayCallback_t displayCallback; int luaDisplayCallback; TextureAtlas_t *_atlas; vec3_t location; vec2_t size; float scale, angle, opacity; bool flippedHorizontally; bool flippedVertically; int activeAnimation;  SpriteAnimation_t *animations; } Sprite_t;
-typedef struct _SpriteBatch { _Obj_guts _guts; RenderableDisplayCallback_t displayCallback; int luaDisplayCallback; int spriteCount; LinkedList_t *sprites; unsigned vao, vbo, vertCount, vertCapacity; } SpriteBatch_t;
+typedef struct _SpriteState { vec3_t location; float scale, angle; int activeAnimation; int currentFrame; } SpriteState_t;
+typedef struct _Sprite { _Obj_guts _guts; RenderableDisplayCallback_t displayCallback; int luaDisplayCallback; TextureAtlas_t *_atlas; vec3_t location; vec2_t size; float scale, angle, opacity; bool flippedHorizontally; bool flippedVertically; int activeAnimation;  SpriteAnimation_t *animations; volatile bool usesPublishedState; int stateFront, stateBack; volatile int stateMiddle; SpriteState_t states[3]; SpriteState_t previousState; } Sprite_t;
+typedef struct _SpriteBatch { _Obj_guts _guts; RenderableDisplayCallback_t displayCallback; int luaDisplayCallback; int spriteCount; LinkedList_t *sprites; unsigned vbo, ibo, indexCount, vertCapacity; unsigned vao; } SpriteBatch_t;
 extern Class_t Class_SpriteBatch;
 extern Sprite_t *sprite_create(vec3_t aLocation, vec2_t aSize, TextureAtlas_t *aAtlas, int aAnimationCapacity);
 extern SpriteAnimation_t sprite_createAnimation(int aNumberOfFrames);
 extern void sprite_step(Sprite_t *aSprite);
+extern void sprite_publishState(Sprite_t *aSprite);
 extern SpriteBatch_t *spriteBatch_create();
 extern void spriteBatch_addSprite(SpriteBatch_t *aBatch, Sprite_t *aSprite);
 extern bool spriteBatch_insertSprite(SpriteBatch_t *aBatch, Sprite_t *aSprite, Sprite_t *aSpriteToShift);
 extern bool spriteBatch_deleteSprite(SpriteBatch_t *aBatch, Sprite_t *aSprite);
 typedef struct _BackgroundLayer { _Obj_guts _guts; Texture_t *texture; float depth, opacity;} BackgroundLayer_t;
-typedef struct _Background { _Obj_guts _guts; RenderableDisplayCallback_t displayCallback; int luaDisplayCallback; BackgroundLayer_t *layers[4]; vec2_t offset;} Background_t;
+typedef struct _Background { _Obj_guts _guts; RenderableDisplayCallback_t displayCallback; int luaDisplayCallback; BackgroundLayer_t *layers[4]; vec2_t offset; GLuint vbo, vao; vec2_t texCoordScale; } Background_t;
 extern Background_t *background_create();
 extern void background_setLayer(Background_t *aBackground, unsigned int aIndex, BackgroundLayer_t *aLayer);
 extern BackgroundLayer_t *background_createLayer(Texture_t *aTexture, float aDepth);
@@ -127,15 +177,33 @@ extern void input_beginEvent(InputManager_t *aManager, Input_type_t aType, unsig
 extern void input_endEvent(InputManager_t *aManager, Input_type_t aType, unsigned char *aCode);
 typedef enum _TMXMap_orientation { kTMXMap_orthogonal, kTMXMap_isometric } TMXMap_orientation;
 typedef struct _TMXProperty { char *name; char *value;} TMXProperty_t;
-typedef struct _TMXTileset { int firstTileGid; int imageWidth, imageHeight; int tileWidth, tileHeight; int spacing; int margin; char *imagePath;} TMXTileset_t;
-typedef struct _TMXTile { TMXTileset_t *tileset; int id; bool flippedVertically; bool flippedHorizontally;} TMXTile_t;
-typedef struct _TMXLayer { char *name; float opacity; bool isVisible; int numberOfTiles; TMXTile_t *tiles; int numberOfProperties; TMXProperty_t *properties; } TMXLayer_t;
+typedef struct _TMXAnimationFrame { int tileId; int duration; } TMXAnimationFrame_t;
+typedef struct _TMXTileAnimation { int tileId; int numberOfFrames; TMXAnimationFrame_t *frames; int totalDuration; } TMXTileAnimation_t;
+typedef struct _TMXTileset { int firstTileGid; int imageWidth, imageHeight; int tileWidth, tileHeight; int spacing; int margin; char *imagePath; int numberOfAnimations; TMXTileAnimation_t *animations; } TMXTileset_t;
+typedef struct _TMXTile { TMXTileset_t *tileset; int id; bool flippedVertically; bool flippedHorizontally; bool flippedDiagonally; } TMXTile_t;
+typedef struct _TMXLayer { char *name; float opacity; bool isVisible; int numberOfTiles; TMXTile_t *tiles; int numberOfProperties; TMXProperty_t *properties; struct _TMXLayerCollision *collision; } TMXLayer_t;
 typedef struct _TMXObject { char *name; char *type; int x, y;  int width, height;  TMXTile_t tile;  int numberOfProperties; TMXProperty_t *properties; } TMXObject_t;
 typedef struct _TMXObjectGroup { char *name; int numberOfObjects; TMXObject_t *objects; int numberOfProperties; TMXProperty_t *properties; } TMXObjectGroup_t;
-typedef struct _TMXMap { _Obj_guts _guts; TMXMap_orientation orientation; int width, height;  int tileWidth, tileHeight;  int numberOfLayers; TMXLayer_t *layers; int numberOfTilesets; TMXTileset_t *tilesets; int numberOfObjectGroups; TMXObjectGroup_t *objectGroups; int numberOfProperties; TMXProperty_t *properties;} TMXMap_t;
+typedef struct _MappedFile { const void *data; size_t length; void *_mapping; size_t _mappingLength; void *_buffer; void *_archiveBuffer; } MappedFile_t;
+typedef struct _TMXMap { _Obj_guts _guts; TMXMap_orientation orientation; int width, height;  int tileWidth, tileHeight;  int numberOfLayers; TMXLayer_t *layers; int numberOfTilesets; TMXTileset_t *tilesets; int numberOfObjectGroups; TMXObjectGroup_t *objectGroups; int numberOfProperties; TMXProperty_t *properties; int gidTableSize; TMXTileset_t **gidTable; MappedFile_t mappedFile; } TMXMap_t;
 extern TMXMap_t *tmx_readMapFile(const char *aFilename);
-typedef struct _TMXLayerRenderable { _Obj_guts _guts; RenderableDisplayCallback_t displayCallback; int luaDisplayCallback; TMXLayer_t *layer; TMXMap_t *map;  TextureAtlas_t *atlas; GLuint posVBO, texCoordVBO, indexVBO; int indexCount;} TMXLayerRenderable_t;
+extern bool tmx_writeBinaryMapFile(TMXMap_t *aMap, const char *aFilename);
+typedef struct _TMXLayerChunk { GLuint vbo; GLuint ibo; GLuint vao; int cellsWide, cellsHigh; int tileCount; int *pageStarts; } TMXLayerChunk_t;
+typedef struct _TMXAnimatedTile { int x, y; TMXTileAnimation_t *animation; int currentFrame; } TMXAnimatedTile_t;
+typedef struct _TMXLayerRenderable { _Obj_guts _guts; RenderableDisplayCallback_t displayCallback; int luaDisplayCallback; TMXLayer_t *layer; TMXMap_t *map; int numberOfPages; Texture_t **pages; vec2_t *pageSizes; int *tilesetPages; int *tilesetOffsets; struct _TMXLayerUpload *pendingUpload; vec2_t maxTileSize; int chunksWide, chunksHigh; TMXLayerChunk_t *chunks; GLMFloat animationTime; int numberOfAnimatedTiles, animatedTileCapacity; TMXAnimatedTile_t *animatedTiles; } TMXLayerRenderable_t;
 extern TMXLayerRenderable_t *tmx_createRenderableForLayer(TMXMap_t *aMap, unsigned int aLayerIdx);
+extern TMXLayerRenderable_t *tmx_prepareRenderableForLayer(TMXMap_t *aMap, unsigned int aLayerIdx, int aMaxTextureSize);
+extern bool tmx_layerUploadStep(TMXLayerRenderable_t *aLayer);
+extern bool tmx_layerSetTile(TMXLayerRenderable_t *aLayer, int aX, int aY, unsigned int aTileGID);
+typedef enum { kMapRegion_empty, kMapRegion_queued, kMapRegion_loading, kMapRegion_decoded, kMapRegion_ready, kMapRegion_missing } MapRegionState_t;
+typedef struct _MapRegion { int x, y; MapRegionState_t state; char path[512]; TMXMap_t *map; int numberOfLayers, numberOfUploadedLayers; TMXLayerRenderable_t **layers; unsigned long lastUsed; size_t memoryUsed; } MapRegion_t;
+typedef struct _MapStreamerStats { int loadsInFlight; int pendingUploads; int residentRegions; size_t memoryUsed; } MapStreamerStats_t;
+// Only the leading fields are declared (The thread state that follows is platform specific)
+typedef struct _MapStreamer { _Obj_guts _guts; RenderableDisplayCallback_t displayCallback; int luaDisplayCallback; char *pathFormat; vec2_t regionSize; int loadRadius; GLMFloat uploadBudget; int capacity; MapRegion_t *regions; unsigned long frame; int maxTextureSize; int focusX, focusY; } MapStreamer_t;
+extern MapStreamer_t *mapStreamer_create(const char *aPathFormat, vec2_t aRegionSize, int aLoadRadius, int aCapacity);
+extern void mapStreamer_update(MapStreamer_t *aStreamer, vec2_t aFocus);
+extern MapRegion_t *mapStreamer_getRegion(MapStreamer_t *aStreamer, int aX, int aY);
+extern MapStreamerStats_t mapStreamer_getStats(MapStreamer_t *aStreamer);
 extern const char *tmx_mapGetPropertyNamed(TMXMap_t *aMap, const char *aPropertyName);
 extern TMXLayer_t *tmx_mapGetLayerNamed(TMXMap_t *aMap, const char *aLayerName);
 extern TMXObjectGroup_t *tmx_mapGetObjectGroupNamed(TMXMap_t *aMap, const char *aGroupName);
@@ -144,11 +212,12 @@ extern Class_t Class_SoundEffect;
 typedef struct _SoundEffect SoundEffect_t;
 extern Class_t Class_BackgroundMusic;
 typedef struct _BackgroundMusic BackgroundMusic_t;
+typedef uint32_t SoundInstance_t;
 extern Class_t Class_SoundManager;
 typedef struct _SoundManager SoundManager_t;
 extern SoundEffect_t *sfx_load(const char *aFilename);
 extern void sfx_unload(SoundEffect_t *aSound);
-extern void sfx_play(SoundEffect_t *aSound);
+extern SoundInstance_t sfx_play(SoundEffect_t *aSound);
 extern void sfx_stop(SoundEffect_t *aSound);
 extern void sfx_toggle(SoundEffect_t *aSound);
 extern bool sfx_isPlaying(SoundEffect_t *aSound);
@@ -156,6 +225,13 @@ extern void sfx_setVolume(SoundEffect_t *aSound, float aVolume);
 extern void sfx_setLocation(SoundEffect_t *aSound, vec3_t aPos);
 extern void sfx_setLooping(SoundEffect_t *aSound, bool aShouldLoop);
 extern void sfx_setPitch(SoundEffect_t *aSound, float aPitch);
+extern void sfx_setPriority(SoundEffect_t *aSound, int aPriority);
+extern void sfx_setMaxInstances(SoundEffect_t *aSound, int aMaxInstances);
+extern void sfxInstance_stop(SoundInstance_t aInstance);
+extern bool sfxInstance_isPlaying(SoundInstance_t aInstance);
+extern void sfxInstance_setVolume(SoundInstance_t aInstance, float aVolume);
+extern void sfxInstance_setPitch(SoundInstance_t aInstance, float aPitch);
+extern void sfxInstance_setLocation(SoundInstance_t aInstance, vec3_t aPos);
 extern BackgroundMusic_t *bgm_load(const char *aFilename);
 extern void bgm_unload(BackgroundMusic_t *aBGM);
 extern void bgm_play(BackgroundMusic_t *aBGM);
@@ -166,6 +242,21 @@ extern void bgm_setVolume(BackgroundMusic_t *aBGM, float aVolume);
 extern void bgm_setLooping(BackgroundMusic_t *aBGM, bool aLoops);
 extern SoundManager_t *soundManager_create();
 extern bool soundManager_makeCurrent(SoundManager_t *aManager);
+typedef enum { kPreloadAsset_texture, kPreloadAsset_atlas, kPreloadAsset_map, kPreloadAsset_sound, kPreloadAsset_music, kPreloadAsset_data, kPreloadAsset_unknown } PreloadAssetType_t;
+typedef struct _Preloader Preloader_t;
+typedef void (*PreloadProgressCallback_t)(Preloader_t *aPreloader, int aCompleted, int aTotal, void *aContext);
+struct _Preloader { _Obj_guts _guts; int numberOfAssets, capacity; void *assets; int numberOfCompletedAssets; int numberOfFailedAssets; GLMFloat uploadBudget; bool isStarted; };
+extern Preloader_t *preloader_create(void);
+extern bool preloader_addAsset(Preloader_t *aPreloader, PreloadAssetType_t aType, const char *aName, const char *aPath, const char *aPackingInfoPath, bool aRepeats);
+extern bool preloader_addDependency(Preloader_t *aPreloader, const char *aName, const char *aDependencyName);
+extern bool preloader_addManifest(Preloader_t *aPreloader, const char *aPath);
+extern PreloadAssetType_t preloader_typeForPath(const char *aPath);
+extern void preloader_start(Preloader_t *aPreloader, int aNumberOfThreads, PreloadProgressCallback_t aCallback, void *aContext, int aLuaCallback);
+extern bool preloader_update(Preloader_t *aPreloader);
+extern void preloader_finish(Preloader_t *aPreloader);
+extern bool preloader_isFinished(Preloader_t *aPreloader);
+extern Obj_t *preloader_getAsset(Preloader_t *aPreloader, const char *aName);
+extern PreloadAssetType_t preloader_getAssetType(Preloader_t *aPreloader, const char *aName);
 typedef struct _World World_t;
 typedef struct _WorldShape WorldShape_t;
 typedef uintptr_t WorldShapeGroup_t;
@@ -177,12 +268,14 @@ typedef void (*WorldEntity_UpdateHandler)(WorldEntity_t *aEntity);
 extern Class_t Class_WorldEntity;
 struct _WorldEntity { _Obj_guts _guts; World_t *world;  Obj_t *owner;  void *cpBody; LinkedList_t *shapes; WorldEntity_UpdateHandler cUpdateHandler; WorldEntity_CollisionHandler cPreCollisionHandler; WorldEntity_CollisionHandler cCollisionHandler; WorldEntity_CollisionHandler cPostCollisionHandler; int luaUpdateHandler; int luaPreCollisionHandler; int luaCollisionHandler; int luaPostCollisionHandler; };
 struct _WorldShape { _Obj_guts _guts; void *cpShape;};
-struct _World { _Obj_guts _guts; void *cpSpace; LinkedList_t *entities; WorldEntity_t *staticEntity; bool isPaused; };
+struct _World { _Obj_guts _guts; void *cpSpace; LinkedList_t *entities; WorldEntity_t *staticEntity; bool isPaused; bool defersScriptHandlers; void *scriptEvents; int scriptEventCount, scriptEventCapacity; };
 typedef enum { kWorldJointType_Pin,    kWorldJointType_Slide,    kWorldJointType_Pivot,    kWorldJointType_Groove,    kWorldJointType_DampedSpring,    kWorldJointType_DampedRotarySpring,    kWorldJointType_RotaryLimit,    kWorldJointType_Ratchet,    kWorldJointType_Gear,    kWorldJointType_SimpleMotor } WorldJointType_t;
 extern Class_t Class_WorldConstraint;
 typedef struct _WorldConstraint {    World_t *world;     WorldEntity_t *a, *b;    WorldJointType_t type;    void *cpConstraint; } WorldConstraint_t;
 extern World_t *world_create(void);
 extern void world_step(World_t *aWorld, GameTimer_t *aTimer);
+extern void world_timerUpdate(GameTimer_t *aTimer);
+extern void world_dispatchScriptHandlers(World_t *aWorld);
 extern void world_setGravity(World_t *aWorld, vec2_t aGravity);
 extern vec2_t world_gravity(World_t *aWorld);
 extern void world_addEntity(World_t *aWorld, WorldEntity_t *aEntity);
@@ -195,6 +288,7 @@ extern void worldEnt_setLocation(WorldEntity_t *aEntity, vec2_t aLocation);
 extern GLMFloat worldEnt_angle(WorldEntity_t *aEntity);
 extern void worldEnt_setAngle(WorldEntity_t *aEntity, GLMFloat aAngle);
 extern WorldShape_t *worldEnt_addShape(WorldEntity_t *aEntity, WorldShape_t *aShape);
+extern void worldEnt_removeShape(WorldEntity_t *aEntity, WorldShape_t *aShape);
 extern void worldEnt_applyForce(WorldEntity_t *aEntity, vec2_t aForce, vec2_t aOffset);
 extern void worldEnt_applyImpulse(WorldEntity_t *aEntity, vec2_t aImpulse, vec2_t aOffset);
 extern vec2_t worldEnt_velocity(WorldEntity_t *aEntity);
@@ -226,10 +320,14 @@ extern WorldConstraint_t *worldConstr_createRatchetJoint(WorldEntity_t *a, World
 extern WorldConstraint_t *worldConstr_createGearJoint(WorldEntity_t *a, WorldEntity_t *b, GLMFloat aPhase, GLMFloat aRatio);
 extern WorldConstraint_t *worldConstr_createSimpleMotorJoint(WorldEntity_t *a, WorldEntity_t *b, GLMFloat aRate);
 extern void worldConstr_invalidate(WorldConstraint_t *aConstraint);
+extern int tmx_createCollisionShapesForLayer(TMXMap_t *aMap, unsigned int aLayerIdx, World_t *aWorld, const unsigned int *aSolidGids, int aSolidGidCount);
 extern void draw_world(World_t *aWorld, bool aDrawBB);
 extern void draw_worldShape(WorldShape_t *aShape, WorldEntity_t *aEntity, bool aDrawBB);
 extern void draw_worldEntity(WorldEntity_t *aEntity, bool aDrawBB);
 extern bool util_pathForResource(const char *name, const char *ext, const char *dir, char *output, int maxLen);
+extern bool vfs_mount(const char *aPath);
+extern void vfs_unmountAll(void);
+extern bool vfs_contains(const char *aRelativePath);
 typedef enum { kPlatformMac, kPlatformIOS, kPlatformAndroid, kPlatformWindows, kPlatformOther } Platform_t;
 extern Platform_t util_platform(void);
 extern void _dynamo_log(const char *str);
@@ -273,6 +371,13 @@ function dynamo.pathForResource(name, type, directory)
     end
 end
 
+-- Mounts a resource archive built with dpkpack, resources missing from disk are then looked up in it
+-- (Resources that have already been looked up keep their paths)
+function dynamo.mountArchive(path)
+    return lib.vfs_mount(path)
+end
+dynamo.unmountArchives = lib.vfs_unmountAll
+
 function dynamo.log(...)
     local prefix = ""
     if debug ~= nil then
@@ -308,6 +413,13 @@ dynamo.texture = {}
 
 ffi.metatype("Texture_t", {
     __index = {
+        -- Ids stay valid until the packing info is replaced: look them up once, then use getSubTexture(id).rect etc.
+        getSubTextureId = function(self, name)
+            local id = lib.texture_getSubTextureId(self, name)
+            if id == -1 then return nil end
+            return id
+        end,
+        getSubTexture = lib.texture_getSubTexture,
         getSubTextureRect = lib.texture_getSubTextureRect,
         getSubTextureOrigin = lib.texture_getSubTextureOrigin,
         getSubTextureSize = lib.texture_getSubTextureSize,
@@ -322,17 +434,98 @@ ffi.metatype("Texture_t", {
 function dynamo.texture.load(path, packingInfoPath, tile)
     tile = tile or false
 
-    local tex = lib.texture_loadFromPng(path, tile, tile)
+    local tex = lib.texCache_loadPng(path, tile, tile)
     if tex == nil then
         dynamo.log("Couldn't find texture at path", path)
         return nil
     end
-    if packingInfoPath ~= nil then
+    -- Cached textures may already have had their packing info loaded
+    if packingInfoPath ~= nil and tex.subtextures == nil then
         lib.texture_loadPackingInfo(tex, packingInfoPath)
     end
     return _obj_addToGC(tex)
 end
 
+dynamo.texture.pixelFormats = {
+    rgba8    = lib.kTexturePixelFormat_Auto,
+    rgba4444 = lib.kTexturePixelFormat_RGBA4444,
+    rgba5551 = lib.kTexturePixelFormat_RGBA5551,
+    rgb565   = lib.kTexturePixelFormat_RGB565
+}
+-- Loads a png converted to one of dynamo.texture.pixelFormats (Bypassing the texture cache)
+-- premultiply defaults to true, which the renderer's blend function expects
+function dynamo.texture.loadWithFormat(path, format, premultiply, tile)
+    tile = tile or false
+    if premultiply == nil then premultiply = true end
+    local tex = lib.texture_loadFromPngWithFormat(path, format or lib.kTexturePixelFormat_Auto, premultiply, tile, tile)
+    if tex == nil then
+        dynamo.log("Couldn't find texture at path", path)
+        return nil
+    end
+    return _obj_addToGC(tex)
+end
+
+-- Frees the buffer images are decoded into before upload (Kept between loads; call after loading a level if memory is tight)
+dynamo.texture.releaseStagingBuffer = lib.texture_releaseStagingBuffer
+
+-- Loads a texture and keeps it loaded until dynamo.texture.unpin is called
+function dynamo.texture.preload(path, tile)
+    tile = tile or false
+    local tex = lib.texCache_preload(path, tile, tile)
+    if tex == nil then
+        dynamo.log("Couldn't find texture at path", path)
+        return nil
+    end
+    return _obj_addToGC(tex)
+end
+dynamo.texture.pin      = lib.texCache_pin
+dynamo.texture.unpin    = lib.texCache_unpin
+dynamo.texture.unpinAll = lib.texCache_unpinAll
+dynamo.texture.getCacheStats = lib.texCache_getStats
+
+-- Starts loading a texture in the background and returns a placeholder that can be used right away
+-- callback(texture, succeeded) is called once the image has been uploaded
+function dynamo.texture.loadAsync(path, tile, callback)
+    tile = tile or false
+    local tex = nil
+    local callbackId = -1
+    if callback ~= nil then
+        callbackId = dynamo.registerCallback(function(_, succeeded)
+            callback(tex, succeeded)
+        end)
+    end
+    tex = _obj_addToGC(lib.texLoader_loadPng(path, tile, tile, nil, nil, callbackId))
+    return tex
+end
+dynamo.texture.setUploadBudget = lib.texLoader_setUploadBudget
+dynamo.texture.getLoaderStats  = lib.texLoader_getStats
+-- Caps the video memory used by textures loaded from files, evicting the least recently drawn ones (0 for no cap)
+dynamo.texture.setBudget          = lib.texManager_setBudget
+dynamo.texture.setAsyncReload     = lib.texManager_setAsyncReload
+dynamo.texture.getResidencyStats  = lib.texManager_getStats
+
+-- Creates a packer that combines individual images into shared textures at runtime
+-- (Textures returned by getImage & getPage are owned by the packer)
+function dynamo.texture.createPacker(pageSize, padding)
+    pageSize = pageSize or vec2(1024, 1024)
+    return _obj_addToGC(lib.texPacker_create(pageSize, padding or 1))
+end
+
+ffi.metatype("TexturePacker_t", {
+    __index = {
+        addImage = lib.texPacker_addImage,
+        addPng   = lib.texPacker_addPng,
+        pack     = lib.texPacker_pack,
+        getImage = lib.texPacker_getImage,
+        getPage  = function(self, idx)
+            if idx < 0 or idx >= self.numberOfPages then
+                return nil
+            end
+            return self.pages[idx]
+        end
+    }
+})
+
 
 --
 -- Texture atlases
@@ -361,6 +554,7 @@ dynamo.sprite = {}
 ffi.metatype("Sprite_t", {
     __index = {
         step = lib.sprite_step,
+        publishState = lib.sprite_publishState,
         currentFrame = function(self)
             return self.animations[self.activeAnimation].currentFrame
         end
@@ -576,7 +770,11 @@ ffi.metatype("GameTimer_t", {
         end,
         pause  = lib.gameTimer_pause,
         resume = lib.gameTimer_resume,
-        reset  = lib.gameTimer_reset
+        reset  = lib.gameTimer_reset,
+        startSimulationThread = lib.gameTimer_startSimulationThread,
+        stopSimulationThread  = lib.gameTimer_stopSimulationThread,
+        lockSimulation        = lib.gameTimer_lockSimulation,
+        unlockSimulation      = lib.gameTimer_unlockSimulation
     }
 })
 
@@ -614,7 +812,23 @@ ffi.metatype("TMXMap_t", {
         getProperty           = lib.tmx_mapGetPropertyNamed,
         getLayer              = tmx_mapGetLayerNamed,
         getObjectGroup        = tmx_mapGetObjectGroupNamed,
-        createLayerRenderable = function(...) return _obj_addToGC(lib.tmx_createRenderableForLayer(...)) end
+        createLayerRenderable = function(...)
+            local renderable = lib.tmx_createRenderableForLayer(...)
+            if renderable == nil then
+                return nil
+            end
+            return _obj_addToGC(renderable)
+        end,
+        writeBinary           = lib.tmx_writeBinaryMapFile,
+        -- Adds merged static collision shapes for a layer to a world
+        -- solidGids is an optional table of global tile ids, by default every non empty tile is solid
+        createCollisionShapes = function(self, layerIdx, world, solidGids)
+            if solidGids == nil then
+                return lib.tmx_createCollisionShapesForLayer(self, layerIdx, world, nil, 0)
+            end
+            local gidArr = ffi.new("unsigned int[?]", #solidGids, solidGids)
+            return lib.tmx_createCollisionShapesForLayer(self, layerIdx, world, gidArr, #solidGids)
+        end
     }
 })
 
@@ -642,6 +856,12 @@ ffi.metatype("TMXObjectGroup_t", {
     __index = lib.tmx_objGroupGetObjectNamed
 })
 
+ffi.metatype("TMXLayerRenderable_t", {
+    __index = {
+        setTile = lib.tmx_layerSetTile
+    }
+})
+
 function math.round(num)
     return math.floor(num+0.5)
 end
@@ -668,6 +888,19 @@ ffi.metatype("TMXTileset_t", {
 })
 
 dynamo.map.load = function(...) return _obj_addToGC(lib.tmx_readMapFile(...)) end
+-- Streams the regions of a world split into map files named by pathFormat (e.g. "world_%d_%d.tmx") around a focus point
+dynamo.map.createStreamer = function(pathFormat, regionSize, loadRadius, capacity)
+    capacity = capacity or (2*loadRadius+1)*(2*loadRadius+1)
+    return _obj_addToGC(lib.mapStreamer_create(pathFormat, regionSize, loadRadius, capacity))
+end
+
+ffi.metatype("MapStreamer_t", {
+    __index = {
+        update    = lib.mapStreamer_update,
+        getRegion = lib.mapStreamer_getRegion,
+        getStats  = lib.mapStreamer_getStats
+    }
+})
 
 --
 -- Backgrounds
@@ -696,7 +929,7 @@ end
 --
 -- Sound
 
-dynamo.sound = { sfx = {}, bgm = {} }
+dynamo.sound = { sfx = {}, bgm = {}, instance = {} }
 local _createSoundManager = function(...) return _obj_addToGC(lib.soundManager_create(...)) end
 
 ffi.metatype("SoundEffect_t", {
@@ -715,6 +948,10 @@ ffi.metatype("SoundEffect_t", {
             lib.sfx_setPitch(self, val)
         elseif key == "volume" then
             lib.sfx_setVolume(self, val)
+        elseif key == "priority" then
+            lib.sfx_setPriority(self, val)
+        elseif key == "maxInstances" then
+            lib.sfx_setMaxInstances(self, val)
         else
             error("Undefined key "..key)
         end
@@ -743,6 +980,89 @@ ffi.metatype("BackgroundMusic_t", {
 dynamo.sound.sfx.load = function(...) return _obj_addToGC(lib.sfx_load(...)) end
 dynamo.sound.bgm.load = function(...) return _obj_addToGC(lib.bgm_load(...)) end
 
+-- Instances are the handles returned by sfx:play()
+dynamo.sound.instance.stop        = lib.sfxInstance_stop
+dynamo.sound.instance.isPlaying   = lib.sfxInstance_isPlaying
+dynamo.sound.instance.setVolume   = lib.sfxInstance_setVolume
+dynamo.sound.instance.setPitch    = lib.sfxInstance_setPitch
+dynamo.sound.instance.setLocation = lib.sfxInstance_setLocation
+
+--
+-- Preloading
+
+local _preloadAssetTypes = {
+    texture = lib.kPreloadAsset_texture,
+    atlas   = lib.kPreloadAsset_atlas,
+    map     = lib.kPreloadAsset_map,
+    sound   = lib.kPreloadAsset_sound,
+    music   = lib.kPreloadAsset_music,
+    data    = lib.kPreloadAsset_data
+}
+local _preloadAssetCTypes = {
+    [tonumber(lib.kPreloadAsset_texture)] = "Texture_t*",
+    [tonumber(lib.kPreloadAsset_atlas)]   = "Texture_t*",
+    [tonumber(lib.kPreloadAsset_map)]     = "TMXMap_t*",
+    [tonumber(lib.kPreloadAsset_sound)]   = "SoundEffect_t*",
+    [tonumber(lib.kPreloadAsset_music)]   = "BackgroundMusic_t*"
+}
+-- Preloaders that dynamo.cycle creates assets for
+local _activePreloaders = {}
+
+ffi.metatype("Preloader_t", {
+    __index = {
+        -- Blocks until everything has loaded
+        finish     = lib.preloader_finish,
+        isFinished = lib.preloader_isFinished,
+        -- Returns a loaded asset (Held by the preloader), cast to its type
+        get = function(self, name)
+            local asset = lib.preloader_getAsset(self, name)
+            local ctype = _preloadAssetCTypes[tonumber(lib.preloader_getAssetType(self, name))]
+            if asset == nil or ctype == nil then
+                return asset
+            end
+            return ffi.cast(ctype, asset)
+        end
+    }
+})
+
+-- Loads the assets listed in a manifest in parallel & returns the preloader holding them
+-- The manifest is either the resource name of a JSON manifest (See preloader.h) or a table in the same format:
+--   { { name = "hero", path = "hero.png", packingInfo = "hero.json" }, { path = "level1.dtmb", dependsOn = { "hero" } } }
+-- progressCallback(completed, total) is called as assets complete. The assets are created by dynamo.cycle, unless
+-- the preloader's finish method is called to wait for them.
+function dynamo.preload(manifest, progressCallback, numberOfThreads)
+    local preloader = _obj_addToGC(lib.preloader_create())
+    if type(manifest) == "string" then
+        local manifestPath = dynamo.pathForResource(manifest)
+        if manifestPath == nil or not lib.preloader_addManifest(preloader, manifestPath) then
+            dynamo.log("Invalid preload manifest", manifest)
+        end
+    else
+        for _,asset in ipairs(manifest) do
+            local assetType = _preloadAssetTypes[asset.type] or lib.preloader_typeForPath(asset.path)
+            if asset.type == nil and asset.packingInfo ~= nil and assetType == lib.kPreloadAsset_texture then
+                assetType = lib.kPreloadAsset_atlas
+            end
+            lib.preloader_addAsset(preloader, assetType, asset.name, asset.path, asset.packingInfo, asset["repeat"] or false)
+        end
+        for _,asset in ipairs(manifest) do
+            for _,dependency in ipairs(asset.dependsOn or {}) do
+                lib.preloader_addDependency(preloader, asset.name or asset.path, dependency)
+            end
+        end
+    end
+
+    local callbackId = -1
+    if progressCallback ~= nil then
+        callbackId = dynamo.registerCallback(function(_, completed, total)
+            progressCallback(completed, total)
+        end)
+    end
+    lib.preloader_start(preloader, numberOfThreads or 0, nil, nil, callbackId)
+    _activePreloaders[preloader] = true
+    return preloader
+end
+
 
 --
 -- Game world
@@ -753,6 +1073,7 @@ ffi.metatype("World_t", {
         removeEntity        = lib.world_removeEntity,
         gravity          = lib.world_gravity,
         step             = lib.world_step,
+        dispatchScriptHandlers = lib.world_dispatchScriptHandlers,
         momentForCircle  = lib.world_momentForCircle,
         momentForSegment = lib.world_momentForSegment,
         momentForPoly    = lib.world_momentForPoly,
@@ -806,6 +1127,7 @@ ffi.metatype("WorldEntity_t", {
         angle        = lib.worldEnt_angle,
         velocity     = lib.worldEnt_velocity,
         addShape     = lib.worldEnt_addShape,
+        removeShape  = lib.worldEnt_removeShape,
         applyForce   = lib.worldEnt_applyForce,
         applyImpulse = lib.worldEnt_applyImpulse,
 
@@ -928,12 +1250,16 @@ function dynamo.cleanup()
     dynamo.log("Dynamo is cleaning up after itself")
 
     -- Release all resources
+    if dynamo.timer ~= nil and dynamo.timer.isThreaded then
+        dynamo.stopSimulationThread()
+    end
     dynamo.renderer = nil
     dynamo.timer = nil
     dynamo.input.manager = nil
     dynamo.world = nil
     dynamo.soundManager = nil
     lib.soundManager_makeCurrent(nil)
+    lib.texLoader_cancelAll()
     lib.draw_cleanup()
 end
 
@@ -951,6 +1277,26 @@ function dynamo.passMessage(key, value)
     _messages[key] = value
 end
 
+-- Moves the physics world onto a simulation thread, so that stepping it no longer stalls rendering.
+-- The Lua handlers of entities are then called from dynamo.cycle, after the step they were triggered in
+function dynamo.startSimulationThread()
+    dynamo.timer.updateContext  = dynamo.world
+    dynamo.timer.updateCallback = lib.world_timerUpdate
+    if not dynamo.timer:startSimulationThread() then
+        dynamo.timer.updateCallback = nil
+        dynamo.timer.updateContext  = nil
+        return false
+    end
+    return true
+end
+
+function dynamo.stopSimulationThread()
+    dynamo.timer:stopSimulationThread()
+    dynamo.timer.updateCallback = nil
+    dynamo.timer.updateContext  = nil
+    dynamo.world:dispatchScriptHandlers()
+end
+
 function dynamo.pause()
     dynamo.timer:pause()
 end
@@ -965,7 +1311,21 @@ function dynamo.cycle()
     end
     dynamo.input.manager:postActiveEvents()
     dynamo.timer:step(dynamo.time())
-    dynamo.world:step(dynamo.timer)
+    if dynamo.timer.isThreaded then
+        -- The simulation thread steps the world
+        dynamo.timer:lockSimulation()
+        dynamo.world:dispatchScriptHandlers()
+        dynamo.timer:unlockSimulation()
+    else
+        dynamo.world:step(dynamo.timer)
+    end
+    lib.texLoader_processUploads()
+    for preloader,_ in pairs(_activePreloaders) do
+        if lib.preloader_update(preloader) then
+            _activePreloaders[preloader] = nil
+        end
+    end
+    lib.texManager_update()
     dynamo.renderer:display(dynamo.timer.timeSinceLastUpdate, dynamo.timer:interpolation())
     lib.autoReleasePool_drain(lib.autoReleasePool_getGlobal())
 
@@ -22,6 +22,9 @@ public class DynamoApp extends Application {
 		
 		System.loadLibrary("dynamo");
 
+		// Games that ship their resources as an archive read them from the APK directly
+		if(ResourceManager.mountArchive())
+			return;
 		try {
 			ResourceManager.copyResources();
 		} catch (IOException e) {
@@ -131,6 +131,8 @@ public class DynamoView extends GLSurfaceView {
 			GLES20.glBlendFunc(GLES20.GL_SRC_ALPHA, GLES20.GL_ONE_MINUS_SRC_ALPHA);
 
 			// We need to initialize Dynamo after the GL surface is initialized, since it calls GL functions during initialization.
+			// The surface is recreated along with a new GL context (Losing every GL object) when the app returns from the
+			// background, so Dynamo is then booted again from scratch.
 			jni.luaCtx_init();
 			jni.luaCtx_addSearchPath(jni.getGlobalLuaContext(), ResourceManager.resourceDirPath() + "/DynamoScripts");
 			jni.luaCtx_executeFile(jni.getGlobalLuaContext(), bootScriptPath);
@@ -6,10 +6,27 @@ import java.io.IOException;
 import java.io.InputStream;
 
 import android.content.Context;
+import android.content.res.AssetFileDescriptor;
 import android.content.res.AssetManager;
 
 public class ResourceManager {
 	public static String RESOURCE_PATH = "GameResources";
+	public static String ARCHIVE_NAME = "GameResources.dpk";
+	private static boolean archiveMounted = false;
+
+	// Mounts the resource archive (Built with dpkpack) straight out of the APK if the game ships one, so nothing needs copying
+	// The archive must be stored uncompressed within the APK (e.g. by passing "-0 dpk" to aapt)
+	public static boolean mountArchive()
+	{
+		try {
+			AssetFileDescriptor fd = DynamoApp.globalContext().getAssets().openFd(ARCHIVE_NAME);
+			archiveMounted = jni.vfs_mountFd(fd.getParcelFileDescriptor().getFd(), fd.getStartOffset(), fd.getLength());
+			fd.close();
+		} catch (IOException e) {
+			archiveMounted = false;
+		}
+		return archiveMounted;
+	}
 
 	// Copies the game assets to /data/data/<appidentifier>/RESOURCE_PATH/ replacing existing files
 	// You'll generally only want to call this after installation & updates
@@ -46,6 +63,11 @@ public class ResourceManager {
 	public static String pathForResource(String fileName, String extension, String subDir)
 	{
 		assert(fileName != null);
+		// Resources inside the archive are referred to by their virtual path
+		if(archiveMounted) {
+			String path = "vfs:" + (subDir != null ? subDir+"/" : "") + fileName;
+			return extension != null ? path+"."+extension : path;
+		}
 		String dirPath = RESOURCE_PATH;
 		if(subDir != null)
 			dirPath += "/"+subDir;
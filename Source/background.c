@@ -5,6 +5,7 @@
 static void _background_draw(Renderer_t *aRenderer, Background_t *aBackground, GLMFloat aTimeSinceLastFrame, GLMFloat aInterpolation);
 static void background_destroy(Background_t *aBackground);
 static void background_destroyLayer(BackgroundLayer_t *aLayer);
+static void _background_setAttributes(Background_t *aBackground);
 
 Class_t Class_Background = {
     "Background",
@@ -33,6 +34,11 @@ enum {
     kBackground_layer3OpacityUniform
 };
 
+struct _BackgroundVertex {
+    vec2_t loc;
+    vec2_t texCoord;
+};
+
 Background_t *background_create()
 {
     Background_t *out = obj_create_autoreleased(&Class_Background);
@@ -59,12 +65,38 @@ Background_t *background_create()
         _backgroundShader->uniforms[kShader_colormap2Uniform] = shader_getUniformLocation(_backgroundShader, "u_colormap2");
         _backgroundShader->uniforms[kShader_colormap3Uniform] = shader_getUniformLocation(_backgroundShader, "u_colormap3");
     }
+
+    // The quad only changes when the viewport or texture size does so it's kept in a vbo
+    glGenBuffers(1, &out->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, out->vbo);
+    glBufferData(GL_ARRAY_BUFFER, 4*sizeof(struct _BackgroundVertex), NULL, GL_DYNAMIC_DRAW);
+    out->texCoordScale = GLMVec2_zero;
+    out->vao = 0;
+    if(dynamo_glVAOSupported()) {
+        dynamo_glGenVertexArrays(1, &out->vao);
+        dynamo_glBindVertexArray(out->vao);
+        _background_setAttributes(out);
+        dynamo_glBindVertexArray(0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
     
     return out;
 }
 
+static void _background_setAttributes(Background_t *aBackground)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, aBackground->vbo);
+    glVertexAttribPointer(_backgroundShader->attributes[kShader_positionAttribute], 2, GL_FLOAT, GL_FALSE, sizeof(struct _BackgroundVertex), (void*)offsetof(struct _BackgroundVertex, loc));
+    glEnableVertexAttribArray(_backgroundShader->attributes[kShader_positionAttribute]);
+    glVertexAttribPointer(_backgroundShader->attributes[kShader_texCoord0Attribute], 2, GL_FLOAT, GL_FALSE, sizeof(struct _BackgroundVertex), (void*)offsetof(struct _BackgroundVertex, texCoord));
+    glEnableVertexAttribArray(_backgroundShader->attributes[kShader_texCoord0Attribute]);
+}
+
 static void background_destroy(Background_t *aBackground)
 {
+    if(aBackground->vao)
+        dynamo_glDeleteVertexArrays(1, &aBackground->vao);
+    glDeleteBuffers(1, &aBackground->vbo);
     for(int i = 0; i < kBackground_maxLayers; ++i) {
         obj_release(aBackground->layers[i]);
         aBackground->layers[i] = NULL;
@@ -97,21 +129,21 @@ static void _background_draw(Renderer_t *aRenderer, Background_t *aBackground, G
     if(!aBackground->layers[0])
         return;
     
-    GLfloat vertices[4*2] = {
-        1.0f, -1.0f,
-        -1.0f, -1.0f,
-        1.0f, 1.0f,
-        -1.0f, 1.0f
-    };
-    
     vec2_t viewportSize = aRenderer->viewportSize;
     vec2_t textureSize = aBackground->layers[0]->texture->size;
-    GLfloat texCoords[4*2] = {
-        viewportSize.w/textureSize.w, 0.0f,
-        0.0,                          0.0f,
-        viewportSize.w/textureSize.w, viewportSize.h/textureSize.h,
-        0.0,                          viewportSize.h/textureSize.h
-    };
+    vec2_t texCoordScale = vec2_div(viewportSize, textureSize);
+    if(texCoordScale.w != aBackground->texCoordScale.w || texCoordScale.h != aBackground->texCoordScale.h) {
+        struct _BackgroundVertex vertices[4] = {
+            { {  1.0f, -1.0f }, { texCoordScale.w, 0.0f } },
+            { { -1.0f, -1.0f }, { 0.0f,            0.0f } },
+            { {  1.0f,  1.0f }, { texCoordScale.w, texCoordScale.h } },
+            { { -1.0f,  1.0f }, { 0.0f,            texCoordScale.h } }
+        };
+        glBindBuffer(GL_ARRAY_BUFFER, aBackground->vbo);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(vertices), vertices);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        aBackground->texCoordScale = texCoordScale;
+    }
     
     
     shader_makeActive(_backgroundShader);
@@ -123,7 +155,7 @@ static void _background_draw(Renderer_t *aRenderer, Background_t *aBackground, G
     BackgroundLayer_t *layer;
     if((layer = aBackground->layers[0])) {
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, layer->texture->id);
+        texture_bind(layer->texture);
         glUniform1i(_backgroundShader->uniforms[kShader_colormap0Uniform],  0);
         glUniform1f(_backgroundShader->uniforms[kBackground_layer0OpacityUniform], layer->opacity);
         glUniform1f(_backgroundShader->uniforms[kBackground_layer0DepthUniform], layer->depth);
@@ -133,7 +165,7 @@ static void _background_draw(Renderer_t *aRenderer, Background_t *aBackground, G
     }
     if((layer = aBackground->layers[1])) {
         glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, layer->texture->id);
+        texture_bind(layer->texture);
         glUniform1i(_backgroundShader->uniforms[kShader_colormap1Uniform], 1);
         glUniform1f(_backgroundShader->uniforms[kBackground_layer1OpacityUniform], layer->opacity);
         glUniform1f(_backgroundShader->uniforms[kBackground_layer1DepthUniform], layer->depth);
@@ -143,7 +175,7 @@ static void _background_draw(Renderer_t *aRenderer, Background_t *aBackground, G
     }
     if((layer = aBackground->layers[2])) {
         glActiveTexture(GL_TEXTURE2);
-        glBindTexture(GL_TEXTURE_2D, aBackground->layers[2]->texture->id);
+        texture_bind(aBackground->layers[2]->texture);
         glUniform1i(_backgroundShader->uniforms[kShader_colormap2Uniform], 2);
         glUniform1f(_backgroundShader->uniforms[kBackground_layer2OpacityUniform], layer->opacity);
         glUniform1f(_backgroundShader->uniforms[kBackground_layer2DepthUniform], layer->depth);
@@ -153,7 +185,7 @@ static void _background_draw(Renderer_t *aRenderer, Background_t *aBackground, G
     }
     if((layer = aBackground->layers[3])) {
         glActiveTexture(GL_TEXTURE3);
-        glBindTexture(GL_TEXTURE_2D, layer->texture->id);
+        texture_bind(layer->texture);
         glUniform1i(_backgroundShader->uniforms[kShader_colormap3Uniform], 3);
         glUniform1f(_backgroundShader->uniforms[kBackground_layer3OpacityUniform], layer->opacity);
         glUniform1f(_backgroundShader->uniforms[kBackground_layer3DepthUniform], layer->depth);
@@ -162,11 +194,15 @@ static void _background_draw(Renderer_t *aRenderer, Background_t *aBackground, G
         glUniform1f(_backgroundShader->uniforms[kBackground_layer3DepthUniform], -1.0f);
     }
     
-    glVertexAttribPointer(_backgroundShader->attributes[kShader_positionAttribute], 2, GL_FLOAT, GL_FALSE, 0, vertices);
-    glEnableVertexAttribArray(_backgroundShader->attributes[kShader_positionAttribute]);
-    glVertexAttribPointer(_backgroundShader->attributes[kShader_texCoord0Attribute], 2, GL_FLOAT, GL_FALSE, 0, texCoords);
-    glEnableVertexAttribArray(_backgroundShader->attributes[kShader_texCoord0Attribute]);
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    if(aBackground->vao) {
+        dynamo_glBindVertexArray(aBackground->vao);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        dynamo_glBindVertexArray(0);
+    } else {
+        _background_setAttributes(aBackground);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
     
     shader_makeInactive(_backgroundShader);
 }
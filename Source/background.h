@@ -43,6 +43,8 @@ typedef struct _Background {
     RENDERABLE_GUTS;
     BackgroundLayer_t *layers[kBackground_maxLayers];
     vec2_t offset;
+    GLuint vbo, vao; // vao is 0 if vertex array objects are unsupported
+    vec2_t texCoordScale; // The texture coordinate scale currently stored in the vbo
 } Background_t;
 
 /*!
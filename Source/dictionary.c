@@ -57,7 +57,7 @@ static void _node_apply(DictionaryNode_t *aNode, char *aSteps, DictionaryApplier
 
 void dict_apply(Dictionary_t *aDict, DictionaryApplier_t aApplier, void *aCtx)
 {
-    char *steps = calloc(1, DICT_MAXKEYLEN);
+    char *steps = calloc(1, DICT_MAXKEYLEN + 2); // Room for the terminating step & NUL of the longest keys
     _node_apply(&aDict->rootNode, steps, aApplier, aCtx);
     free(steps);
 }
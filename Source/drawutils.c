@@ -6,6 +6,68 @@ Shader_t *gColoredShader = NULL;
 static Renderer_t *_renderer = NULL;
 static const vec4_t kColorWhite = { 1.0f, 1.0f, 1.0f, 1.0f };
 
+// Immediate mode draws are streamed through a shared VBO using one of two fixed vertex layouts
+// so that the attribute setup can be captured once in a VAO per layout
+typedef struct _TexturedVertex {
+    vec3_t loc;
+    vec2_t texCoord;
+} TexturedVertex_t;
+typedef struct _ColoredVertex {
+    vec2_t loc;
+    vec4_t color;
+} ColoredVertex_t;
+
+static GLuint _streamVBO = 0;
+static GLuint _texturedVAO = 0, _coloredVAO = 0;
+
+// Scratch space for the tiles of draw_textureAtlas, reused across draws & grown as needed
+static TexturedVertex_t *_atlasVertices = NULL;
+static GLuint *_atlasIndices = NULL;
+static int _atlasTileCapacity = 0;
+
+static void _draw_setTexturedAttributes()
+{
+    glVertexAttribPointer(gTexturedShader->attributes[kShader_positionAttribute], 3, GL_FLOAT, GL_FALSE, sizeof(TexturedVertex_t), (void*)offsetof(TexturedVertex_t, loc));
+    glEnableVertexAttribArray(gTexturedShader->attributes[kShader_positionAttribute]);
+    glVertexAttribPointer(gTexturedShader->attributes[kShader_texCoord0Attribute], 2, GL_FLOAT, GL_FALSE, sizeof(TexturedVertex_t), (void*)offsetof(TexturedVertex_t, texCoord));
+    glEnableVertexAttribArray(gTexturedShader->attributes[kShader_texCoord0Attribute]);
+}
+static void _draw_setColoredAttributes()
+{
+    glVertexAttribPointer(gColoredShader->attributes[kShader_positionAttribute], 2, GL_FLOAT, GL_FALSE, sizeof(ColoredVertex_t), (void*)offsetof(ColoredVertex_t, loc));
+    glEnableVertexAttribArray(gColoredShader->attributes[kShader_positionAttribute]);
+    glVertexAttribPointer(gColoredShader->attributes[kShader_colorAttribute], 4, GL_FLOAT, GL_FALSE, sizeof(ColoredVertex_t), (void*)offsetof(ColoredVertex_t, color));
+    glEnableVertexAttribArray(gColoredShader->attributes[kShader_colorAttribute]);
+}
+
+// Uploads the vertices to the stream buffer and leaves it ready for drawing
+// (Call _draw_endStream once done)
+static void _draw_beginTexturedStream(TexturedVertex_t *aVertices, int aCount)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, _streamVBO);
+    // Orphan the previous contents so we don't stall on draws still using them
+    glBufferData(GL_ARRAY_BUFFER, aCount*sizeof(TexturedVertex_t), aVertices, GL_STREAM_DRAW);
+    if(_texturedVAO)
+        dynamo_glBindVertexArray(_texturedVAO);
+    else
+        _draw_setTexturedAttributes();
+}
+static void _draw_beginColoredStream(ColoredVertex_t *aVertices, int aCount)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, _streamVBO);
+    glBufferData(GL_ARRAY_BUFFER, aCount*sizeof(ColoredVertex_t), aVertices, GL_STREAM_DRAW);
+    if(_coloredVAO)
+        dynamo_glBindVertexArray(_coloredVAO);
+    else
+        _draw_setColoredAttributes();
+}
+static void _draw_endStream()
+{
+    if(_texturedVAO)
+        dynamo_glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 void draw_init(Renderer_t *aDefaultRenderer)
 {
     _renderer = aDefaultRenderer;
@@ -33,12 +95,32 @@ void draw_init(Renderer_t *aDefaultRenderer)
         glEnableVertexAttribArray(gColoredShader->attributes[kShader_positionAttribute]);
         shader_makeInactive(gColoredShader);
     }
+    if(!_streamVBO) {
+        glGenBuffers(1, &_streamVBO);
+        if(dynamo_glVAOSupported()) {
+            glBindBuffer(GL_ARRAY_BUFFER, _streamVBO);
+            dynamo_glGenVertexArrays(1, &_texturedVAO);
+            dynamo_glBindVertexArray(_texturedVAO);
+            _draw_setTexturedAttributes();
+            dynamo_glGenVertexArrays(1, &_coloredVAO);
+            dynamo_glBindVertexArray(_coloredVAO);
+            _draw_setColoredAttributes();
+            dynamo_glBindVertexArray(0);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+    }
 }
 
 void draw_cleanup()
 {
     if(gTexturedShader) obj_release(gTexturedShader), gTexturedShader = NULL;
     if(gColoredShader) obj_release(gColoredShader),   gColoredShader  = NULL;
+    if(_texturedVAO) dynamo_glDeleteVertexArrays(1, &_texturedVAO), _texturedVAO = 0;
+    if(_coloredVAO) dynamo_glDeleteVertexArrays(1, &_coloredVAO),   _coloredVAO  = 0;
+    if(_streamVBO) glDeleteBuffers(1, &_streamVBO),                 _streamVBO   = 0;
+    free(_atlasVertices), _atlasVertices = NULL;
+    free(_atlasIndices),  _atlasIndices  = NULL;
+    _atlasTileCapacity = 0;
 }
 
 
@@ -46,20 +128,13 @@ void draw_cleanup()
 
 void draw_quad(vec3_t aCenter, vec2_t aSize, Texture_t *aTexture, TextureRect_t aTextureArea, vec4_t aColor, float aAngle, bool aFlipHorizontal, bool aFlipVertical)
 {
-    GLfloat vertices[4*3] = {
-        0.0f,    0.0f,    0.0f,
-        0.0f,    aSize.h, 0.0f,
-        aSize.w, 0.0f,    0.0f,
-        aSize.w, aSize.h, 0.0f
-    };
-
     float maxTexX = aTextureArea.origin.x + aTextureArea.size.w;
     float maxTexY = aTextureArea.origin.y + aTextureArea.size.h;
-    GLfloat texCoords[4*2] = {
-        aFlipHorizontal ? maxTexX : aTextureArea.origin.x, aFlipVertical ? maxTexY : aTextureArea.origin.y,
-        aFlipHorizontal ? maxTexX : aTextureArea.origin.x, aFlipVertical ? aTextureArea.origin.y : maxTexY,
-        aFlipHorizontal ? aTextureArea.origin.x : maxTexX, aFlipVertical ? maxTexY : aTextureArea.origin.y,
-        aFlipHorizontal ? aTextureArea.origin.x : maxTexX, aFlipVertical ? aTextureArea.origin.y : maxTexY
+    TexturedVertex_t vertices[4] = {
+        { { 0.0f,    0.0f,    0.0f }, { aFlipHorizontal ? maxTexX : aTextureArea.origin.x, aFlipVertical ? maxTexY : aTextureArea.origin.y } },
+        { { 0.0f,    aSize.h, 0.0f }, { aFlipHorizontal ? maxTexX : aTextureArea.origin.x, aFlipVertical ? aTextureArea.origin.y : maxTexY } },
+        { { aSize.w, 0.0f,    0.0f }, { aFlipHorizontal ? aTextureArea.origin.x : maxTexX, aFlipVertical ? maxTexY : aTextureArea.origin.y } },
+        { { aSize.w, aSize.h, 0.0f }, { aFlipHorizontal ? aTextureArea.origin.x : maxTexX, aFlipVertical ? aTextureArea.origin.y : maxTexY } }
     };
 
     // Translate&rotate the quad into it's target location
@@ -71,16 +146,15 @@ void draw_quad(vec3_t aCenter, vec2_t aSize, Texture_t *aTexture, TextureRect_t
 
     shader_makeActive(gTexturedShader);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, aTexture->id);
+    texture_bind(aTexture);
 
     shader_updateMatrices(gTexturedShader, _renderer);
     glUniform1i(gTexturedShader->uniforms[kShader_colormap0Uniform], 0);
     glUniform4fv(gTexturedShader->uniforms[kShader_colorUniform], 1, aColor.f);
 
-    glVertexAttribPointer(gTexturedShader->attributes[kShader_positionAttribute], 3, GL_FLOAT, GL_FALSE, 0, vertices);
-    glVertexAttribPointer(gTexturedShader->attributes[kShader_texCoord0Attribute], 2, GL_FLOAT, GL_FALSE, 0, texCoords);
-
+    _draw_beginTexturedStream(vertices, 4);
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    _draw_endStream();
 
     shader_makeInactive(gTexturedShader);
     matrix_stack_pop(_renderer->worldMatrixStack);
@@ -142,38 +216,51 @@ void draw_textureAtlas_getVertices(TextureAtlas_t *aAtlas, int aNumberOfTiles, v
 
 void draw_textureAtlas(TextureAtlas_t *aAtlas, int aNumberOfTiles, vec2_t *aOffsets, vec2_t *aCenterPoints)
 {
-    int numberOfVertices;
-    int numberOfIndices;
-    vec2_t *vertices;
-    vec2_t *texCoords;
-    GLuint *indices;
+    if(aNumberOfTiles <= 0)
+        return;
+    if(aNumberOfTiles > _atlasTileCapacity) {
+        _atlasTileCapacity = MAX(aNumberOfTiles, _atlasTileCapacity*2);
+        _atlasVertices = realloc(_atlasVertices, 4*_atlasTileCapacity*sizeof(TexturedVertex_t));
+        _atlasIndices  = realloc(_atlasIndices,  6*_atlasTileCapacity*sizeof(GLuint));
+    }
 
-    draw_textureAtlas_getVertices(aAtlas, aNumberOfTiles, aOffsets, aCenterPoints, &vertices, &texCoords, &numberOfVertices, &indices, &numberOfIndices);
+    // Same layout as draw_textureAtlas_getVertices
+    vec2_t halfSize = { aAtlas->size.x/2.0f, aAtlas->size.y/2.0f };
+    for(int i = 0; i < aNumberOfTiles; ++i) {
+        TextureRect_t texRect = texAtlas_getTextureRect(aAtlas, (int)aOffsets[i].x, (int)aOffsets[i].y);
+        TexturedVertex_t *vertices = &_atlasVertices[4*i];
+        vertices[0] = (TexturedVertex_t){ { aCenterPoints[i].x - halfSize.x, aCenterPoints[i].y - halfSize.y, 0.0f },
+                                          texRect.origin };
+        vertices[1] = (TexturedVertex_t){ { aCenterPoints[i].x - halfSize.x, aCenterPoints[i].y + halfSize.y, 0.0f },
+                                          { texRect.origin.u, texRect.origin.v + texRect.size.v } };
+        vertices[2] = (TexturedVertex_t){ { aCenterPoints[i].x + halfSize.x, aCenterPoints[i].y + halfSize.y, 0.0f },
+                                          { texRect.origin.u + texRect.size.u, texRect.origin.v + texRect.size.v } };
+        vertices[3] = (TexturedVertex_t){ { aCenterPoints[i].x + halfSize.x, aCenterPoints[i].y - halfSize.y, 0.0f },
+                                          { texRect.origin.u + texRect.size.u, texRect.origin.v } };
+
+        GLuint *indices = &_atlasIndices[6*i];
+        indices[0] = (4*i)+0; indices[1] = (4*i)+1; indices[2] = (4*i)+2;
+        indices[3] = (4*i)+0; indices[4] = (4*i)+2; indices[5] = (4*i)+3;
+    }
 
     matrix_stack_push(_renderer->worldMatrixStack);
 
     shader_makeActive(gTexturedShader);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, aAtlas->texture->id);
+    texture_bind(aAtlas->texture);
 
     shader_updateMatrices(gTexturedShader, _renderer);
     glUniform1i(gTexturedShader->uniforms[kShader_colormap0Uniform], 0);
-    vec4_t white = {1.0, 1.0, 1.0, 1.0};
-    glUniform4fv(gTexturedShader->uniforms[kShader_colorUniform], 1, white.f);
-
-    glVertexAttribPointer(gTexturedShader->attributes[kShader_positionAttribute], 2, GL_FLOAT, GL_FALSE, 0, vertices);
-    glVertexAttribPointer(gTexturedShader->attributes[kShader_texCoord0Attribute], 2, GL_FLOAT, GL_FALSE, 0, texCoords);
+    glUniform4fv(gTexturedShader->uniforms[kShader_colorUniform], 1, kColorWhite.f);
 
-    glDrawElements(GL_TRIANGLES, numberOfIndices, GL_UNSIGNED_INT, indices);
+    _draw_beginTexturedStream(_atlasVertices, 4*aNumberOfTiles);
+    glDrawElements(GL_TRIANGLES, 6*aNumberOfTiles, GL_UNSIGNED_INT, _atlasIndices);
+    _draw_endStream();
 
     shader_makeInactive(gTexturedShader);
     matrix_stack_pop(_renderer->worldMatrixStack);
 
     glBindTexture(GL_TEXTURE_2D, 0);
-
-    free(vertices);
-    free(texCoords);
-    free(indices);
 }
 
 
@@ -183,13 +270,12 @@ void draw_rect(vec2_t aCenter, vec2_t aSize, float aAngle, vec4_t aColor, bool a
 {
     vec2_t size = vec2_floor(aSize);
     size = vec2_floor(size);
-    GLfloat vertices[4*2] = {
-        -size.w/2.0, -aSize.h/2.0,
-        -size.w/2.0,  aSize.h/2.0,
-         size.w/2.0,  size.h/2.0,
-         size.w/2.0, -aSize.h/2.0
+    ColoredVertex_t vertices[4] = {
+        { { -size.w/2.0, -aSize.h/2.0 }, aColor },
+        { { -size.w/2.0,  aSize.h/2.0 }, aColor },
+        { {  size.w/2.0,  size.h/2.0  }, aColor },
+        { {  size.w/2.0, -aSize.h/2.0 }, aColor }
     };
-    vec4_t colors[4] = { aColor, aColor, aColor, aColor };
 
     // Translate&rotate the rectangle into it's target location
     matrix_stack_push(_renderer->worldMatrixStack);
@@ -200,10 +286,9 @@ void draw_rect(vec2_t aCenter, vec2_t aSize, float aAngle, vec4_t aColor, bool a
 
     shader_updateMatrices(gColoredShader, _renderer);
 
-    glVertexAttribPointer(gColoredShader->attributes[kShader_positionAttribute], 2, GL_FLOAT, GL_FALSE, 0, vertices);
-    glVertexAttribPointer(gColoredShader->attributes[kShader_colorAttribute], 4, GL_FLOAT, GL_FALSE, 0, colors);
-
+    _draw_beginColoredStream(vertices, 4);
     glDrawArrays(aShouldFill ? GL_TRIANGLE_FAN : GL_LINE_LOOP, 0, 4);
+    _draw_endStream();
 
     shader_makeInactive(gColoredShader);
     matrix_stack_pop(_renderer->worldMatrixStack);
@@ -213,14 +298,12 @@ void draw_rect(vec2_t aCenter, vec2_t aSize, float aAngle, vec4_t aColor, bool a
 void draw_ellipse(vec2_t aCenter, vec2_t aRadii, int aSubdivisions, float aAngle, vec4_t aColor, bool aShouldFill)
 {
     aSubdivisions = MAX(6, aSubdivisions);
-    float vertices[aSubdivisions*2] ;
-    vec4_t colors[aSubdivisions];
+    ColoredVertex_t vertices[aSubdivisions];
     float twoPi = 2.0f*M_PI;
     int count = 0;
-    for(float theta = twoPi; theta > 0.001; theta -= twoPi/(float)aSubdivisions) {
-        colors[count/2] = aColor;
-        vertices[count++] = cosf(theta) * aRadii.w;
-        vertices[count++] = sinf(theta) * aRadii.h;
+    for(float theta = twoPi; theta > 0.001 && count < aSubdivisions; theta -= twoPi/(float)aSubdivisions) {
+        vertices[count].loc = (vec2_t){ cosf(theta) * aRadii.w, sinf(theta) * aRadii.h };
+        vertices[count++].color = aColor;
     }
 
     // Translate&rotate the ellipse into it's target location
@@ -231,12 +314,9 @@ void draw_ellipse(vec2_t aCenter, vec2_t aRadii, int aSubdivisions, float aAngle
     shader_makeActive(gColoredShader);
     shader_updateMatrices(gColoredShader, _renderer);
 
-    glVertexAttribPointer(gColoredShader->attributes[kShader_positionAttribute], 2, GL_FLOAT, GL_FALSE, 0, vertices);
-    glEnableVertexAttribArray(gColoredShader->attributes[kShader_positionAttribute]);
-    glVertexAttribPointer(gColoredShader->attributes[kShader_colorAttribute], 4, GL_FLOAT, GL_FALSE, 0, colors);
-    glEnableVertexAttribArray(gColoredShader->attributes[kShader_colorAttribute]);
-
-    glDrawArrays(aShouldFill ? GL_TRIANGLE_FAN : GL_LINE_LOOP, 0, aSubdivisions);
+    _draw_beginColoredStream(vertices, count);
+    glDrawArrays(aShouldFill ? GL_TRIANGLE_FAN : GL_LINE_LOOP, 0, count);
+    _draw_endStream();
 
     shader_makeInactive(gColoredShader);
     matrix_stack_pop(_renderer->worldMatrixStack);
@@ -264,32 +344,35 @@ void draw_point(vec2_t aLocation, vec4_t aColor)
 
 void draw_polygon(int aNumberOfVertices, vec2_t *aVertices, vec4_t aColor, bool aShouldFill)
 {
-    vec4_t colors[aNumberOfVertices];
-    for(int i = 0; i < aNumberOfVertices; ++i) colors[i] = aColor;
+    ColoredVertex_t vertices[aNumberOfVertices];
+    for(int i = 0; i < aNumberOfVertices; ++i) {
+        vertices[i].loc = aVertices[i];
+        vertices[i].color = aColor;
+    }
 
     shader_makeActive(gColoredShader);
     shader_updateMatrices(gColoredShader, _renderer);
 
-    glVertexAttribPointer(gColoredShader->attributes[kShader_positionAttribute], 2, GL_FLOAT, GL_FALSE, 0, aVertices);
-    glVertexAttribPointer(gColoredShader->attributes[kShader_colorAttribute], 4, GL_FLOAT, GL_FALSE, 0, colors);
-
+    _draw_beginColoredStream(vertices, aNumberOfVertices);
     glDrawArrays(aShouldFill ? GL_TRIANGLE_FAN : GL_LINE_LOOP, 0, aNumberOfVertices);
+    _draw_endStream();
 
     shader_makeInactive(gColoredShader);
 }
 
 void draw_lineSeg(vec2_t aPointA, vec2_t aPointB, vec4_t aColor)
 {
-    vec2_t vertices[2] = { vec2_floor(aPointA), vec2_floor(aPointB) };
-    vec4_t colors[2] = { aColor, aColor };
+    ColoredVertex_t vertices[2] = {
+        { vec2_floor(aPointA), aColor },
+        { vec2_floor(aPointB), aColor }
+    };
 
     shader_makeActive(gColoredShader);
     shader_updateMatrices(gColoredShader, _renderer);
 
-    glVertexAttribPointer(gColoredShader->attributes[kShader_positionAttribute], 2, GL_FLOAT, GL_FALSE, 0, vertices);
-    glVertexAttribPointer(gColoredShader->attributes[kShader_colorAttribute], 4, GL_FLOAT, GL_FALSE, 0, colors);
-
+    _draw_beginColoredStream(vertices, 2);
     glDrawArrays(GL_LINE_STRIP, 0, 2);
+    _draw_endStream();
 
     shader_makeInactive(gColoredShader);
 }
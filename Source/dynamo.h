@@ -14,9 +14,14 @@
 #include "glutils.h"
 #include "input.h"
 #include "json.h"
+#include "json_document.h"
+#include "json_query.h"
+#include "json_writer.h"
 #include "linkedlist.h"
 #include "luacontext.h"
+#include "map_streamer.h"
 #include "object.h"
+#include "preloader.h"
 #include "primitive_types.h"
 #include "renderer.h"
 #include "scene.h"
@@ -25,7 +30,12 @@
 #include "sprite.h"
 #include "texture.h"
 #include "texture_atlas.h"
+#include "texture_cache.h"
+#include "texture_loader.h"
+#include "texture_manager.h"
+#include "texture_packer.h"
 #include "tmx_map.h"
 #include "util.h"
+#include "vfs.h"
 #include "world.h"
 #endif
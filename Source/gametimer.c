@@ -1,18 +1,22 @@
 #include "gametimer.h"
 #include "util.h"
 #include "luacontext.h"
+#include <time.h>
 
 #ifdef __APPLE__
 #include <mach/mach_time.h>
 #endif
 
 #ifdef ANDROID
-#include <time.h>
 #define NSEC_PER_SEC 1000000000
 #endif
 
+// The maximum number of updates the simulation thread will run back to back to catch up after a stall
+#define kGameTimerMaxCatchUpUpdates 5
+
 static void _callScheduledCallbackIfNeeded(GameTimer_ScheduledCallback_t *aWrapper, GameTimer_t *aTimer);
 static void gameTimer_destroy(GameTimer_t *aGameTimer);
+static void *_gameTimer_simulationThread(GameTimer_t *aTimer);
 
 Class_t Class_GameTimer = {
     "GameTimer",
@@ -29,71 +33,201 @@ GameTimer_t *gameTimer_create(GLMFloat aFps, GameTimer_updateCallback_t aUpdateC
     out->luaUpdateCallback = -1;
     out->resetAt = dynamo_time();
     out->status = kGameTimerStatusNormal;
+    out->isThreaded = false;
+    out->shouldStopThread = false;
+    out->lastThreadedUpdateAt = 0;
+    pthread_mutex_init(&out->stateLock, NULL);
+    pthread_mutex_init(&out->simulationLock, NULL);
 
     return out;
 }
 void gameTimer_destroy(GameTimer_t *aTimer)
 {
+    gameTimer_stopSimulationThread(aTimer);
     if(aTimer->luaUpdateCallback != -1)
         luaCtx_unregisterScriptHandler(GlobalLuaContext, aTimer->luaUpdateCallback);
     obj_release(aTimer->scheduledCallbacks);
+    pthread_mutex_destroy(&aTimer->stateLock);
+    pthread_mutex_destroy(&aTimer->simulationLock);
 }
 
 extern void gameTimer_step(GameTimer_t *aTimer, GLMFloat aElapsed)
 {
-    if(aTimer->status == kGameTimerStatusPaused)
+    pthread_mutex_lock(&aTimer->stateLock);
+    if(aTimer->status == kGameTimerStatusPaused) {
+        pthread_mutex_unlock(&aTimer->stateLock);
         return;
+    }
 
     aElapsed -= aTimer->resetAt;
     if(aTimer->status == kGameTimerStatusAboutToResume) {
         aTimer->status = kGameTimerStatusNormal;
         aTimer->resetAt += aElapsed - aTimer->elapsed;
     }
+    pthread_mutex_unlock(&aTimer->stateLock);
 
     GLMFloat delta = aElapsed - aTimer->elapsed;
     aTimer->timeSinceLastUpdate = MAX(0.0, aTimer->timeSinceLastUpdate+delta);
     aTimer->elapsed = aElapsed;
 
+    // The callbacks below modify the state the simulation thread works on
+    if(aTimer->isThreaded)
+        gameTimer_lockSimulation(aTimer);
+
     // Execute any scheduled callbacks
     llist_apply(aTimer->scheduledCallbacks, (LinkedListApplier_t)&_callScheduledCallbackIfNeeded, aTimer);
 
     for(; aTimer->timeSinceLastUpdate > aTimer->desiredInterval; aTimer->timeSinceLastUpdate -= aTimer->desiredInterval) {
-        if(aTimer->updateCallback)
+        if(aTimer->updateCallback && !aTimer->isThreaded)
             aTimer->updateCallback(aTimer);
         if(aTimer->luaUpdateCallback != -1) {
+            pthread_mutex_lock(&aTimer->stateLock);
+            long ticks = aTimer->ticks;
+            pthread_mutex_unlock(&aTimer->stateLock);
             luaCtx_pushScriptHandler(GlobalLuaContext, aTimer->luaUpdateCallback);
-            luaCtx_pushnumber(GlobalLuaContext, aTimer->ticks);
+            luaCtx_pushnumber(GlobalLuaContext, ticks);
             luaCtx_pushnumber(GlobalLuaContext, aTimer->elapsed);
             luaCtx_pushnumber(GlobalLuaContext, aTimer->timeSinceLastUpdate);
             luaCtx_pushnumber(GlobalLuaContext, aTimer->desiredInterval);
             luaCtx_pcall(GlobalLuaContext, 4, 0, 0);
         }
-        ++aTimer->ticks;
+        // When threaded the simulation thread owns the tick count
+        if(!aTimer->isThreaded)
+            ++aTimer->ticks;
     }
+
+    if(aTimer->isThreaded)
+        gameTimer_unlockSimulation(aTimer);
 }
 
 GLMFloat gameTimer_interpolationSinceLastUpdate(GameTimer_t *aTimer)
 {
+    if(aTimer->isThreaded) {
+        pthread_mutex_lock(&aTimer->stateLock);
+        GLMFloat lastUpdateAt = aTimer->lastThreadedUpdateAt;
+        pthread_mutex_unlock(&aTimer->stateLock);
+        return CLAMP((aTimer->elapsed - lastUpdateAt) / aTimer->desiredInterval, 0.0, 1.0);
+    }
     return aTimer->timeSinceLastUpdate / aTimer->desiredInterval;
 }
 
 void gameTimer_reset(GameTimer_t *aTimer)
 {
+    pthread_mutex_lock(&aTimer->stateLock);
     aTimer->resetAt = dynamo_time();
-    aTimer->elapsed = 0;
     aTimer->ticks = 0;
+    aTimer->lastThreadedUpdateAt = 0;
+    pthread_mutex_unlock(&aTimer->stateLock);
+    aTimer->elapsed = 0;
     aTimer->timeSinceLastUpdate = 0;
 }
 
 void gameTimer_pause(GameTimer_t *aTimer)
 {
+    pthread_mutex_lock(&aTimer->stateLock);
     aTimer->status = kGameTimerStatusPaused;
+    pthread_mutex_unlock(&aTimer->stateLock);
 }
 
 void gameTimer_resume(GameTimer_t *aTimer)
 {
+    pthread_mutex_lock(&aTimer->stateLock);
     if(aTimer->status == kGameTimerStatusPaused)
         aTimer->status = kGameTimerStatusAboutToResume;
+    pthread_mutex_unlock(&aTimer->stateLock);
+}
+
+#pragma mark - Threading
+
+bool gameTimer_startSimulationThread(GameTimer_t *aTimer)
+{
+    if(aTimer->isThreaded)
+        return true;
+    if(!aTimer->updateCallback) {
+        dynamo_log("The timer has no update callback to run on a simulation thread");
+        return false;
+    }
+
+    pthread_mutex_lock(&aTimer->stateLock);
+    aTimer->shouldStopThread = false;
+    aTimer->lastThreadedUpdateAt = aTimer->elapsed;
+    pthread_mutex_unlock(&aTimer->stateLock);
+    aTimer->isThreaded = true;
+    if(pthread_create(&aTimer->simulationThread, NULL, (void *(*)(void *))&_gameTimer_simulationThread, aTimer) != 0) {
+        dynamo_log("Unable to create simulation thread");
+        aTimer->isThreaded = false;
+        return false;
+    }
+    return true;
+}
+
+void gameTimer_stopSimulationThread(GameTimer_t *aTimer)
+{
+    if(!aTimer->isThreaded)
+        return;
+
+    pthread_mutex_lock(&aTimer->stateLock);
+    aTimer->shouldStopThread = true;
+    pthread_mutex_unlock(&aTimer->stateLock);
+    pthread_join(aTimer->simulationThread, NULL);
+    aTimer->isThreaded = false;
+    // Hand the time not yet simulated back to the single threaded loop
+    aTimer->timeSinceLastUpdate = MAX(0.0, aTimer->elapsed - aTimer->lastThreadedUpdateAt);
+}
+
+void gameTimer_lockSimulation(GameTimer_t *aTimer)
+{
+    pthread_mutex_lock(&aTimer->simulationLock);
+}
+
+void gameTimer_unlockSimulation(GameTimer_t *aTimer)
+{
+    pthread_mutex_unlock(&aTimer->simulationLock);
+}
+
+static void _gameTimer_sleep(GLMFloat aDuration)
+{
+    if(aDuration <= 0.0)
+        return;
+    struct timespec duration;
+    duration.tv_sec = (time_t)aDuration;
+    duration.tv_nsec = (long)((aDuration - duration.tv_sec) * NSEC_PER_SEC);
+    nanosleep(&duration, NULL);
+}
+
+static void *_gameTimer_simulationThread(GameTimer_t *aTimer)
+{
+    pthread_mutex_lock(&aTimer->stateLock);
+    while(!aTimer->shouldStopThread) {
+        if(aTimer->status != kGameTimerStatusNormal) {
+            pthread_mutex_unlock(&aTimer->stateLock);
+            _gameTimer_sleep(aTimer->desiredInterval);
+            pthread_mutex_lock(&aTimer->stateLock);
+            continue;
+        }
+        GLMFloat now = dynamo_time() - aTimer->resetAt;
+
+        // Drop time we can't catch up on rather than spiraling
+        if(now - aTimer->lastThreadedUpdateAt > kGameTimerMaxCatchUpUpdates*aTimer->desiredInterval)
+            aTimer->lastThreadedUpdateAt = now - aTimer->desiredInterval;
+
+        while(now - aTimer->lastThreadedUpdateAt >= aTimer->desiredInterval && !aTimer->shouldStopThread) {
+            // The state lock is not held during the update, so the render thread is never blocked on it for long
+            pthread_mutex_unlock(&aTimer->stateLock);
+            pthread_mutex_lock(&aTimer->simulationLock);
+            aTimer->updateCallback(aTimer);
+            pthread_mutex_unlock(&aTimer->simulationLock);
+            pthread_mutex_lock(&aTimer->stateLock);
+            ++aTimer->ticks;
+            aTimer->lastThreadedUpdateAt += aTimer->desiredInterval;
+        }
+        GLMFloat sleepDuration = aTimer->lastThreadedUpdateAt + aTimer->desiredInterval - (dynamo_time() - aTimer->resetAt);
+        pthread_mutex_unlock(&aTimer->stateLock);
+        _gameTimer_sleep(sleepDuration);
+        pthread_mutex_lock(&aTimer->stateLock);
+    }
+    pthread_mutex_unlock(&aTimer->stateLock);
+    return NULL;
 }
 
 #pragma mark - Scheduled callbacks
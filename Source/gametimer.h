@@ -7,6 +7,7 @@
 #include "object.h"
 #include <stdbool.h>
 #include <GLMath/GLMath.h>
+#include <pthread.h>
 
 #ifndef _GAMETIMER_H_
 #define _GAMETIMER_H_
@@ -48,6 +49,8 @@ enum {
     @field desiredInterval The desired interval between game updates
     @field ticks The number of game cycles since startup
     @field updateCallback A function that is called on every iteration of the game loop
+    @field updateContext An arbitrary pointer for use by updateCallback (world_timerUpdate expects the world to step)
+    @field isThreaded Indicates whether or not updateCallback is being run on a separate simulation thread
 */
 struct _GameTimer {
     OBJ_GUTS
@@ -58,8 +61,17 @@ struct _GameTimer {
     short status;
     long ticks;
     GameTimer_updateCallback_t updateCallback;
+    void *updateContext;
     int luaUpdateCallback;
     LinkedList_t *scheduledCallbacks;
+    bool isThreaded;
+    bool shouldStopThread;
+    GLMFloat lastThreadedUpdateAt; // The elapsed time at which the simulation thread last finished an update
+    pthread_t simulationThread;
+    // Guards resetAt, status, ticks, shouldStopThread & lastThreadedUpdateAt, which the simulation thread shares
+    pthread_mutex_t stateLock;
+    // Held by the simulation thread for the duration of each update (See gameTimer_lockSimulation)
+    pthread_mutex_t simulationLock;
 };
 
 /*!
@@ -73,6 +85,7 @@ extern GameTimer_t *gameTimer_create(GLMFloat aFps, GameTimer_updateCallback_t a
 extern void gameTimer_step(GameTimer_t *aTimer, GLMFloat elapsed);
 /*!
     Returns a value from 0-1 indicating the current interpolation between game updates.
+    (In threaded mode this is the progress towards the next update of the simulation thread)
 */
 extern GLMFloat gameTimer_interpolationSinceLastUpdate(GameTimer_t *aTimer);
 /*!
@@ -84,6 +97,29 @@ extern void gameTimer_pause(GameTimer_t *aTimer);
 */
 extern void gameTimer_resume(GameTimer_t *aTimer);
 
+/*!
+    Starts running updateCallback on a dedicated simulation thread at desiredInterval.
+    gameTimer_step must still be called from the render thread, it then only advances the elapsed time,
+    fires scheduled callbacks and the Lua update callback (The Lua state is not thread safe). Those are run with the
+    simulation locked, so that they can safely modify the state updateCallback works on.
+    State shared with the renderer should be handed over using snapshots (See sprite_publishState)
+*/
+extern bool gameTimer_startSimulationThread(GameTimer_t *aTimer);
+/*!
+    Stops the simulation thread and returns the timer to single threaded mode. Blocks until the current update has finished.
+*/
+extern void gameTimer_stopSimulationThread(GameTimer_t *aTimer);
+/*!
+    Blocks until the simulation thread has finished its current update, & keeps it from starting another until
+    gameTimer_unlockSimulation is called. Anything that modifies the state the simulation thread updates (Such as the
+    physics world) from another thread must do so with the simulation locked. (The lock is not recursive)
+*/
+extern void gameTimer_lockSimulation(GameTimer_t *aTimer);
+/*!
+    Lets the simulation thread continue after gameTimer_lockSimulation.
+*/
+extern void gameTimer_unlockSimulation(GameTimer_t *aTimer);
+
 /*!
     Resets the timer to 0.
 */
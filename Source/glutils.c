@@ -1,7 +1,92 @@
 #include "glutils.h"
 #include <string.h>
 
+#if defined(__APPLE__) && (TARGET_OS_IPHONE || TARGET_OS_SIMULATOR)
+    #define kVAOExtension "GL_OES_vertex_array_object"
+    #define _glGenVertexArrays    glGenVertexArraysOES
+    #define _glBindVertexArray    glBindVertexArrayOES
+    #define _glDeleteVertexArrays glDeleteVertexArraysOES
+#elif defined(__APPLE__)
+    #define kVAOExtension "GL_APPLE_vertex_array_object"
+    #define _glGenVertexArrays    glGenVertexArraysAPPLE
+    #define _glBindVertexArray    glBindVertexArrayAPPLE
+    #define _glDeleteVertexArrays glDeleteVertexArraysAPPLE
+#elif defined(ANDROID)
+    // Not every GLESv2 library exports the OES entry points so they have to be looked up at runtime
+    #include <EGL/egl.h>
+    #define kVAOExtension "GL_OES_vertex_array_object"
+    static PFNGLGENVERTEXARRAYSOESPROC    _glGenVertexArrays;
+    static PFNGLBINDVERTEXARRAYOESPROC    _glBindVertexArray;
+    static PFNGLDELETEVERTEXARRAYSOESPROC _glDeleteVertexArrays;
+#else
+    // Core from GL 3.0, where core profiles stop listing extensions in a single string
+    #define kVAOCoreMajorVersion 3
+    #define kVAOExtension "GL_ARB_vertex_array_object"
+    #define _glGenVertexArrays    glGenVertexArrays
+    #define _glBindVertexArray    glBindVertexArray
+    #define _glDeleteVertexArrays glDeleteVertexArrays
+#endif
+
 bool dynamo_glExtSupported(const char *name)
 {
-    return strstr((char *)glGetString(GL_EXTENSIONS), name) != NULL;
-}
\ No newline at end of file
+    const char *extensions = (const char *)glGetString(GL_EXTENSIONS);
+    if(extensions)
+        return strstr(extensions, name) != NULL;
+#ifdef kVAOCoreMajorVersion
+    glGetError(); // GL_EXTENSIONS is an invalid enum for glGetString in core profiles
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for(GLint i = 0; i < count; ++i) {
+        const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+        if(extension && strcmp(extension, name) == 0)
+            return true;
+    }
+#endif
+    return false;
+}
+
+bool dynamo_glVAOSupported()
+{
+    static int supported = -1;
+    if(supported != -1)
+        return supported;
+#ifdef DYNAMO_NO_VAO
+    supported = false;
+#elif defined(kVAOCoreMajorVersion)
+    GLint majorVersion = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &majorVersion);
+    glGetError(); // GL_MAJOR_VERSION is unknown to GL 2.x, which leaves majorVersion at 0
+    supported = majorVersion >= kVAOCoreMajorVersion || dynamo_glExtSupported(kVAOExtension);
+#else
+    supported = dynamo_glExtSupported(kVAOExtension);
+    #ifdef ANDROID
+    if(supported) {
+        _glGenVertexArrays    = (PFNGLGENVERTEXARRAYSOESPROC)eglGetProcAddress("glGenVertexArraysOES");
+        _glBindVertexArray    = (PFNGLBINDVERTEXARRAYOESPROC)eglGetProcAddress("glBindVertexArrayOES");
+        _glDeleteVertexArrays = (PFNGLDELETEVERTEXARRAYSOESPROC)eglGetProcAddress("glDeleteVertexArraysOES");
+        supported = _glGenVertexArrays && _glBindVertexArray && _glDeleteVertexArrays;
+    }
+    #endif
+#endif
+    return supported;
+}
+
+void dynamo_glGenVertexArrays(GLsizei aCount, GLuint *aoArrays)
+{
+    if(dynamo_glVAOSupported())
+        _glGenVertexArrays(aCount, aoArrays);
+    else
+        memset(aoArrays, 0, sizeof(GLuint)*aCount);
+}
+
+void dynamo_glBindVertexArray(GLuint aArray)
+{
+    if(dynamo_glVAOSupported())
+        _glBindVertexArray(aArray);
+}
+
+void dynamo_glDeleteVertexArrays(GLsizei aCount, const GLuint *aArrays)
+{
+    if(dynamo_glVAOSupported())
+        _glDeleteVertexArrays(aCount, aArrays);
+}
@@ -42,4 +42,12 @@
 #define glError()
 #endif
 
-bool dynamo_glExtSupported(const char *name);
\ No newline at end of file
+bool dynamo_glExtSupported(const char *name);
+
+// Vertex array objects (OES_vertex_array_object on ES2, APPLE_vertex_array_object on OS X & core on desktop GL)
+// dynamo_glVAOSupported() must be called with a current context, if it returns false the attribute
+// pointers have to be specified for every draw.
+bool dynamo_glVAOSupported();
+void dynamo_glGenVertexArrays(GLsizei aCount, GLuint *aoArrays);
+void dynamo_glBindVertexArray(GLuint aArray);
+void dynamo_glDeleteVertexArrays(GLsizei aCount, const GLuint *aArrays);
\ No newline at end of file
@@ -1,7 +1,7 @@
 #include "json.h"
+#include "json_writer.h"
 #include "util.h"
 #include <yajl/yajl_parse.h>
-#include <yajl/yajl_gen.h>
 #include <string.h>
 #include <stdlib.h>
 
@@ -134,12 +134,29 @@ static void _freeParseContext(struct _ParseContext *ctx)
 }
 
 Obj_t *parseJSON(const char *aJsonStr)
+{
+    return parseJSONData(aJsonStr, strlen(aJsonStr));
+}
+
+Obj_t *parseJSONFile(const char *aPath)
+{
+    MappedFile_t file;
+    if(!util_mapFile(aPath, kMappedFileAccess_sequential, &file)) {
+        dynamo_log("Couldn't read JSON from %s", aPath);
+        return NULL;
+    }
+    Obj_t *root = parseJSONData(file.data, file.length);
+    util_unmapFile(&file);
+    return root;
+}
+
+Obj_t *parseJSONData(const char *aData, size_t aLength)
 {
     Array_t *ctxStack = array_create(8, NULL, (RemovalCallback_t)&_freeParseContext);
     yajl_handle parser = yajl_alloc(&parserCallbacks, NULL, (void *)ctxStack);
-    yajl_status status = yajl_parse(parser, (const unsigned char*)aJsonStr, strlen(aJsonStr));
+    yajl_status status = yajl_parse(parser, (const unsigned char*)aData, aLength);
     if(status != yajl_status_ok) {
-        unsigned char *err = yajl_get_error(parser, 1, (unsigned char*)aJsonStr, strlen(aJsonStr));
+        unsigned char *err = yajl_get_error(parser, 1, (unsigned char*)aData, aLength);
         dynamo_log("Couldn't parse JSON: %s", err);
         yajl_free_error(parser, err);
         return NULL;
@@ -160,57 +177,16 @@ Obj_t *parseJSON(const char *aJsonStr)
 
 #pragma mark - Generation
 
-static bool _objToJSON(Obj_t *aObj, yajl_gen g);
-
-static void _addDict(char *key, void *value, void *ctx)
-{
-    yajl_gen_string(ctx, (unsigned char*)key, strlen(key));
-    _objToJSON(value, ctx);
-}
-
-bool _objToJSON(Obj_t *aObj, yajl_gen g)
-{
-    if(!aObj) {
-        yajl_gen_null(g);
-    } else if(obj_isClass(aObj, &Class_Dictionary)) {
-        yajl_gen_map_open(g);
-        dict_apply(aObj, (DictionaryApplier_t)&_addDict, g);
-        yajl_gen_map_close(g);
-    } else if(obj_isClass(aObj, &Class_Array)) {
-        Array_t *arr = aObj;
-        yajl_gen_array_open(g);
-        for(int i = 0; i < arr->count; ++i) {
-            _objToJSON(arr->items[i], g);
-        }
-        yajl_gen_array_close(g);
-    } else if(obj_isClass(aObj, &Class_String)) {
-        String_t *str = aObj;
-        yajl_gen_string(g, (unsigned char*)str->cString, str->length);
-    } else if(obj_isClass(aObj, &Class_Number)) {
-        Number_t *num = aObj;
-        yajl_gen_double(g, (double)num->floatValue);
-    } else
-        return false;
-    return true;
-}
-
 bool objToJSON(Obj_t *aObj, char *aoBuf, size_t aBufLen)
 {
-    yajl_gen g = yajl_gen_alloc(NULL);
-//    yajl_gen_config(g, yajl_gen_beautify, 1);
-    yajl_gen_config(g, yajl_gen_validate_utf8, 1);
-
-    bool succeeded = _objToJSON(aObj, g);
-    if(!succeeded)
-        return false;
-
-    const unsigned char *internalBuf;
-    size_t internalBufLen;
-    yajl_gen_status status = yajl_gen_get_buf(g, &internalBuf, &internalBufLen);
-    if(status != yajl_gen_status_ok || aBufLen < internalBufLen+1)
-        return false;
-    strncpy(aoBuf, (char*)internalBuf, internalBufLen);
-    aoBuf[internalBufLen] = '\0';
-
-    return true;
+    JSONWriter_t *writer = jsonWriter_create(kJSONWriterFormat_json);
+    bool succeeded = jsonWriter_obj(writer, aObj) && jsonWriter_close(writer);
+
+    size_t length;
+    const char *json = jsonWriter_getBuffer(writer, &length);
+    succeeded = succeeded && aBufLen >= length+1;
+    if(succeeded)
+        memcpy(aoBuf, json, length+1);
+    obj_release(writer);
+    return succeeded;
 }
@@ -17,9 +17,18 @@
     Parses a json string and returns the root object
 */
 Obj_t *parseJSON(const char *aJsonStr);
+/*!
+    Parses aLength bytes of json (The data does not need to be NUL terminated)
+*/
+Obj_t *parseJSONData(const char *aData, size_t aLength);
+/*!
+    Parses a json file (Either a filesystem or a virtual path) straight out of memory mapped storage
+*/
+Obj_t *parseJSONFile(const char *aPath);
 
 /*!
-    Creates a JSON string from an object
+    Creates a JSON string from an object. Fails if the string does not fit in aoBuf.
+    (See json_writer.h to write JSON of any size)
 */
 bool objToJSON(Obj_t *aObj, char *aoBuf, size_t aBufLen);
 #endif
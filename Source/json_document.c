@@ -0,0 +1,373 @@
+#include "json_document.h"
+#include "json.h"
+#include <yajl/yajl_parse.h>
+#include <stdlib.h>
+
+#define kJSONArenaMinChunkSize (4096)
+
+typedef struct _JSONArenaChunk {
+    struct _JSONArenaChunk *next;
+    size_t size, used;
+    unsigned char bytes[];
+} JSONArenaChunk_t;
+
+// A container being parsed
+typedef struct _JSONFrame {
+    int firstSlot; // Where its values start on the slot stack
+    bool isObject;
+    const char *key; // The key of the next member of objects
+    uint32_t keyLength;
+} JSONFrame_t;
+
+typedef struct _JSONParser {
+    JSONDocument_t *document;
+    uintptr_t dataStart, dataEnd; // The parsed text, which strings without escapes are sliced out of
+    // The values of the open containers, copied into the arena once they are closed & their size is known
+    JSONMember_t *slots;
+    int numberOfSlots, slotCapacity;
+    JSONFrame_t *frames;
+    int numberOfFrames, frameCapacity;
+    JSONValue_t root;
+    bool hasRoot;
+} JSONParser_t;
+
+static void jsonDoc_destroy(JSONDocument_t *aDocument);
+
+Class_t Class_JSONDocument = {
+    "JSONDocument",
+    sizeof(JSONDocument_t),
+    (Obj_destructor_t)&jsonDoc_destroy
+};
+
+static void jsonDoc_destroy(JSONDocument_t *aDocument)
+{
+    JSONArenaChunk_t *chunk = aDocument->chunks;
+    while(chunk) {
+        JSONArenaChunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    util_unmapFile(&aDocument->file);
+}
+
+#pragma mark - Arena
+
+static JSONArenaChunk_t *_jsonDoc_addChunk(JSONDocument_t *aDocument, size_t aSize)
+{
+    JSONArenaChunk_t *chunk = malloc(sizeof(JSONArenaChunk_t) + aSize);
+    if(!chunk)
+        return NULL;
+    chunk->next = aDocument->chunks;
+    chunk->size = aSize;
+    chunk->used = 0;
+    aDocument->chunks = chunk;
+    return chunk;
+}
+
+static void *_jsonDoc_alloc(JSONDocument_t *aDocument, size_t aSize)
+{
+    aSize = (aSize + 7) & ~(size_t)7;
+    JSONArenaChunk_t *chunk = aDocument->chunks;
+    if(!chunk || chunk->size - chunk->used < aSize) {
+        // Chunks double in size so a document takes a handful of them regardless of its size
+        size_t size = MAX(kJSONArenaMinChunkSize, aSize);
+        if(chunk)
+            size = MAX(size, chunk->size*2);
+        if(!(chunk = _jsonDoc_addChunk(aDocument, size)))
+            return NULL;
+    }
+    void *out = chunk->bytes + chunk->used;
+    chunk->used += aSize;
+    aDocument->memoryUsed += aSize;
+    return out;
+}
+
+// Returns a slice of the parsed text when possible, or a copy in the arena if yajl unescaped the string into its own buffer
+static const char *_jsonDoc_keepString(JSONParser_t *aParser, const unsigned char *aString, size_t aLength)
+{
+    uintptr_t start = (uintptr_t)aString;
+    if(start >= aParser->dataStart && start + aLength <= aParser->dataEnd)
+        return (const char *)aString;
+    char *copy = _jsonDoc_alloc(aParser->document, aLength ? aLength : 1);
+    if(copy)
+        memcpy(copy, aString, aLength);
+    return copy;
+}
+
+#pragma mark - Parsing
+
+static int _jsonDoc_addValue(JSONParser_t *aParser, JSONValue_t aValue)
+{
+    if(aParser->numberOfFrames == 0) {
+        aParser->root = aValue;
+        aParser->hasRoot = true;
+        return true;
+    }
+    if(aParser->numberOfSlots == aParser->slotCapacity) {
+        int capacity = MAX(64, aParser->slotCapacity*2);
+        JSONMember_t *slots = realloc(aParser->slots, capacity*sizeof(JSONMember_t));
+        if(!slots)
+            return false;
+        aParser->slots = slots;
+        aParser->slotCapacity = capacity;
+    }
+    JSONFrame_t *frame = &aParser->frames[aParser->numberOfFrames - 1];
+    JSONMember_t *slot = &aParser->slots[aParser->numberOfSlots++];
+    slot->value = aValue;
+    slot->key = frame->key;
+    slot->keyLength = frame->keyLength;
+    return true;
+}
+
+static int _jsonDoc_handleNull(void *aParser)
+{
+    JSONValue_t value = { .type = kJSONType_null };
+    return _jsonDoc_addValue(aParser, value);
+}
+
+static int _jsonDoc_handleBoolean(void *aParser, int aBoolean)
+{
+    JSONValue_t value = { .type = kJSONType_bool, .boolean = aBoolean };
+    return _jsonDoc_addValue(aParser, value);
+}
+
+static int _jsonDoc_handleInteger(void *aParser, long long aInteger)
+{
+    JSONValue_t value = { .type = kJSONType_number, .number = (double)aInteger };
+    return _jsonDoc_addValue(aParser, value);
+}
+
+static int _jsonDoc_handleDouble(void *aParser, double aDouble)
+{
+    JSONValue_t value = { .type = kJSONType_number, .number = aDouble };
+    return _jsonDoc_addValue(aParser, value);
+}
+
+static int _jsonDoc_handleString(void *aParser_, const unsigned char *aString, size_t aLength)
+{
+    JSONParser_t *aParser = aParser_;
+    JSONValue_t value = { .type = kJSONType_string, .length = aLength };
+    value.string = _jsonDoc_keepString(aParser, aString, aLength);
+    return value.string && _jsonDoc_addValue(aParser, value);
+}
+
+static int _jsonDoc_handleMapKey(void *aParser_, const unsigned char *aKey, size_t aLength)
+{
+    JSONParser_t *aParser = aParser_;
+    JSONFrame_t *frame = &aParser->frames[aParser->numberOfFrames - 1];
+    frame->key = _jsonDoc_keepString(aParser, aKey, aLength);
+    frame->keyLength = aLength;
+    return frame->key != NULL;
+}
+
+static int _jsonDoc_openContainer(JSONParser_t *aParser, bool aIsObject)
+{
+    if(aParser->numberOfFrames == aParser->frameCapacity) {
+        int capacity = MAX(16, aParser->frameCapacity*2);
+        JSONFrame_t *frames = realloc(aParser->frames, capacity*sizeof(JSONFrame_t));
+        if(!frames)
+            return false;
+        aParser->frames = frames;
+        aParser->frameCapacity = capacity;
+    }
+    JSONFrame_t *frame = &aParser->frames[aParser->numberOfFrames++];
+    frame->firstSlot = aParser->numberOfSlots;
+    frame->isObject = aIsObject;
+    frame->key = NULL;
+    frame->keyLength = 0;
+    return true;
+}
+
+static int _jsonDoc_handleStartMap(void *aParser)
+{
+    return _jsonDoc_openContainer(aParser, true);
+}
+
+static int _jsonDoc_handleStartArray(void *aParser)
+{
+    return _jsonDoc_openContainer(aParser, false);
+}
+
+static int _jsonDoc_handleEnd(void *aParser_)
+{
+    JSONParser_t *aParser = aParser_;
+    JSONFrame_t *frame = &aParser->frames[--aParser->numberOfFrames];
+    int count = aParser->numberOfSlots - frame->firstSlot;
+    JSONMember_t *slots = &aParser->slots[frame->firstSlot];
+    JSONValue_t value = { .type = frame->isObject ? kJSONType_object : kJSONType_array, .length = count };
+    if(count > 0) {
+        if(frame->isObject) {
+            value.members = _jsonDoc_alloc(aParser->document, count*sizeof(JSONMember_t));
+            if(!value.members)
+                return false;
+            memcpy(value.members, slots, count*sizeof(JSONMember_t));
+        } else {
+            value.elements = _jsonDoc_alloc(aParser->document, count*sizeof(JSONValue_t));
+            if(!value.elements)
+                return false;
+            for(int i = 0; i < count; ++i)
+                value.elements[i] = slots[i].value;
+        }
+    }
+    aParser->numberOfSlots = frame->firstSlot;
+    return _jsonDoc_addValue(aParser, value);
+}
+
+static yajl_callbacks _JSONDocCallbacks = {
+    _jsonDoc_handleNull,
+    _jsonDoc_handleBoolean,
+    _jsonDoc_handleInteger,
+    _jsonDoc_handleDouble,
+    NULL,
+    _jsonDoc_handleString,
+    _jsonDoc_handleStartMap,
+    _jsonDoc_handleMapKey,
+    _jsonDoc_handleEnd,
+    _jsonDoc_handleStartArray,
+    _jsonDoc_handleEnd
+};
+
+JSONDocument_t *jsonDoc_parseData(const char *aData, size_t aLength)
+{
+    JSONDocument_t *document = obj_create(&Class_JSONDocument);
+    JSONParser_t parser = {
+        .document = document,
+        .dataStart = (uintptr_t)aData,
+        .dataEnd = (uintptr_t)aData + aLength
+    };
+    // Size the first chunk after the text, the nodes usually take a few times as much
+    _jsonDoc_addChunk(document, MAX(kJSONArenaMinChunkSize, aLength));
+
+    yajl_handle yajl = yajl_alloc(&_JSONDocCallbacks, NULL, &parser);
+    yajl_status status = yajl_parse(yajl, (const unsigned char *)aData, aLength);
+    if(status == yajl_status_ok)
+        status = yajl_complete_parse(yajl);
+    if(status != yajl_status_ok || !parser.hasRoot) {
+        unsigned char *err = yajl_get_error(yajl, 1, (const unsigned char *)aData, aLength);
+        dynamo_log("Couldn't parse JSON: %s", err);
+        yajl_free_error(yajl, err);
+        obj_release(document);
+        document = NULL;
+    }
+    yajl_free(yajl);
+    free(parser.slots);
+    free(parser.frames);
+    if(!document)
+        return NULL;
+
+    document->root = _jsonDoc_alloc(document, sizeof(JSONValue_t));
+    if(!document->root) {
+        obj_release(document);
+        return NULL;
+    }
+    *document->root = parser.root;
+    return document;
+}
+
+JSONDocument_t *jsonDoc_parseFile(const char *aPath)
+{
+    MappedFile_t file;
+    if(!util_mapFile(aPath, kMappedFileAccess_sequential, &file)) {
+        dynamo_log("Couldn't read JSON from %s", aPath);
+        return NULL;
+    }
+    JSONDocument_t *document = jsonDoc_parseData(file.data, file.length);
+    if(document)
+        document->file = file;
+    else
+        util_unmapFile(&file);
+    return document;
+}
+
+#pragma mark - Accessing values
+
+static const JSONValue_t *_jsonValue_getMember(const JSONValue_t *aValue, const char *aKey, size_t aKeyLength)
+{
+    if(!aValue || aValue->type != kJSONType_object)
+        return NULL;
+    for(uint32_t i = 0; i < aValue->length; ++i) {
+        const JSONMember_t *member = &aValue->members[i];
+        if(member->keyLength == aKeyLength && memcmp(member->key, aKey, aKeyLength) == 0)
+            return &member->value;
+    }
+    return NULL;
+}
+
+const JSONValue_t *jsonValue_get(const JSONValue_t *aValue, const char *aKey)
+{
+    return _jsonValue_getMember(aValue, aKey, strlen(aKey));
+}
+
+const JSONValue_t *jsonValue_getPath(const JSONValue_t *aValue, const char *aPath)
+{
+    const char *component = aPath;
+    while(aValue && *component) {
+        const char *end = strchr(component, '.');
+        size_t length = end ? (size_t)(end - component) : strlen(component);
+        if(aValue->type == kJSONType_array) {
+            char *indexEnd;
+            unsigned long idx = strtoul(component, &indexEnd, 10);
+            aValue = indexEnd == component + length ? jsonValue_at(aValue, idx) : NULL;
+        } else
+            aValue = _jsonValue_getMember(aValue, component, length);
+        if(!end)
+            break;
+        component = end + 1;
+    }
+    return aValue;
+}
+
+bool jsonValue_copyString(const JSONValue_t *aValue, char *aoBuf, size_t aBufLen)
+{
+    if(!aValue || aValue->type != kJSONType_string || aBufLen == 0)
+        return false;
+    size_t length = MIN(aValue->length, aBufLen - 1);
+    memcpy(aoBuf, aValue->string, length);
+    aoBuf[length] = '\0';
+    return length == aValue->length;
+}
+
+#pragma mark - Adapter
+
+Obj_t *jsonValue_toObj(const JSONValue_t *aValue)
+{
+    if(!aValue)
+        return NULL;
+    switch(aValue->type) {
+        case kJSONType_bool:
+            return number_create(aValue->boolean ? 1.0 : 0.0);
+        case kJSONType_number:
+            return number_create((GLMFloat)aValue->number);
+        case kJSONType_string:
+            return string_create(aValue->string, aValue->length);
+        case kJSONType_array: {
+            Array_t *array = array_create(MAX(1, aValue->length), (InsertionCallback_t)&obj_retain, (RemovalCallback_t)&obj_release);
+            for(uint32_t i = 0; i < aValue->length; ++i) {
+                Obj_t *element = jsonValue_toObj(&aValue->elements[i]);
+                if(element)
+                    array_push(array, element);
+            }
+            return array;
+        }
+        case kJSONType_object: {
+            Dictionary_t *dict = dict_create((InsertionCallback_t)&obj_retain, (RemovalCallback_t)&obj_release);
+            char keyBuf[256];
+            for(uint32_t i = 0; i < aValue->length; ++i) {
+                const JSONMember_t *member = &aValue->members[i];
+                Obj_t *memberObj = jsonValue_toObj(&member->value);
+                if(!memberObj)
+                    continue;
+                // Dictionary keys have to be NUL terminated
+                char *key = member->keyLength < sizeof(keyBuf) ? keyBuf : malloc(member->keyLength + 1);
+                memcpy(key, member->key, member->keyLength);
+                key[member->keyLength] = '\0';
+                dict_set(dict, key, memberObj);
+                if(key != keyBuf)
+                    free(key);
+            }
+            return dict;
+        }
+        default:
+            return NULL;
+    }
+}
@@ -0,0 +1,160 @@
+/*!
+    @header JSON Document
+    @abstract
+    @discussion A compact, read only JSON DOM.
+
+    Unlike parseJSON, which creates an object for every value, a document stores all of its nodes in a single arena:
+    numbers, booleans & nulls are held inline in tagged values, & strings that contain no escape sequences are slices
+    of the parsed text rather than copies. Releasing the document frees everything at once.
+
+    Strings are therefore not NUL terminated (Use their length), & the text a document was parsed from must outlive it.
+    Documents created with jsonDoc_parseFile keep the file mapped for as long as they live.
+
+    Documents are created retained (Not autoreleased) so they can be parsed on any thread.
+*/
+
+#ifndef _JSONDOCUMENT_H_
+#define _JSONDOCUMENT_H_
+
+#include "object.h"
+#include "util.h"
+#include <stdint.h>
+#include <string.h>
+
+typedef enum _JSONType {
+    kJSONType_null,
+    kJSONType_bool,
+    kJSONType_number,
+    kJSONType_string,
+    kJSONType_array,
+    kJSONType_object
+} JSONType_t;
+
+typedef struct _JSONMember JSONMember_t;
+
+/*!
+    A JSON value
+
+    @field type The type of the value
+    @field length The length of strings in bytes, or the number of elements (Or members) of arrays (Or objects)
+*/
+typedef struct _JSONValue {
+    JSONType_t type;
+    uint32_t length;
+    union {
+        bool boolean;
+        double number;
+        const char *string;
+        struct _JSONValue *elements;
+        JSONMember_t *members;
+    };
+} JSONValue_t;
+
+/*!
+    A member of an object. (Members are stored in the order they appear in)
+*/
+struct _JSONMember {
+    JSONValue_t value;
+    const char *key;
+    uint32_t keyLength;
+};
+
+/*!
+    A parsed document
+
+    @field root The top level value
+    @field memoryUsed The number of bytes allocated for the nodes & copied strings
+*/
+typedef struct _JSONDocument {
+    OBJ_GUTS
+    JSONValue_t *root;
+    size_t memoryUsed;
+    struct _JSONArenaChunk *chunks;
+    MappedFile_t file; // The file the document was parsed from (If any)
+} JSONDocument_t;
+extern Class_t Class_JSONDocument;
+
+/*!
+    Parses aLength bytes of JSON. The document refers to the data, so it must not be freed until the document has been.
+    Returns a retained document, or NULL if the data is not valid JSON.
+*/
+extern JSONDocument_t *jsonDoc_parseData(const char *aData, size_t aLength);
+/*!
+    Parses a JSON file (Either a filesystem or a virtual path) straight out of memory mapped storage.
+    Returns a retained document, or NULL if the file could not be read or is not valid JSON.
+*/
+extern JSONDocument_t *jsonDoc_parseFile(const char *aPath);
+
+#pragma mark - Accessing values
+
+static inline bool jsonValue_isNull(const JSONValue_t *aValue)
+{
+    return !aValue || aValue->type == kJSONType_null;
+}
+
+/*!
+    Returns the value of a number (Or boolean), or aDefault if aValue is missing or of another type.
+*/
+static inline double jsonValue_number(const JSONValue_t *aValue, double aDefault)
+{
+    if(!aValue)
+        return aDefault;
+    if(aValue->type == kJSONType_number)
+        return aValue->number;
+    if(aValue->type == kJSONType_bool)
+        return aValue->boolean;
+    return aDefault;
+}
+
+/*!
+    Returns the value of a boolean (Or whether a number is non zero), or aDefault if aValue is missing or of another type.
+*/
+static inline bool jsonValue_bool(const JSONValue_t *aValue, bool aDefault)
+{
+    return jsonValue_number(aValue, aDefault) != 0.0;
+}
+
+/*!
+    Returns true if aValue is a string equal to aString.
+*/
+static inline bool jsonValue_stringEquals(const JSONValue_t *aValue, const char *aString)
+{
+    return aValue && aValue->type == kJSONType_string && strlen(aString) == aValue->length
+        && memcmp(aValue->string, aString, aValue->length) == 0;
+}
+
+/*!
+    Returns the element at aIdx of an array, or NULL if out of bounds or aValue is not an array.
+*/
+static inline const JSONValue_t *jsonValue_at(const JSONValue_t *aValue, unsigned int aIdx)
+{
+    if(!aValue || aValue->type != kJSONType_array || aIdx >= aValue->length)
+        return NULL;
+    return &aValue->elements[aIdx];
+}
+
+/*!
+    Returns the value of the member named aKey of an object, or NULL if it has none or aValue is not an object.
+    (Objects are searched linearly, in the order their members appeared in)
+*/
+extern const JSONValue_t *jsonValue_get(const JSONValue_t *aValue, const char *aKey);
+/*!
+    Follows a path of '.' separated member names & array indices from aValue. (e.g. "frames.hero.frame.w" or "layers.0.name")
+    Returns NULL if any component is missing.
+*/
+extern const JSONValue_t *jsonValue_getPath(const JSONValue_t *aValue, const char *aPath);
+/*!
+    Copies a string into aoBuf, truncating it to aBufLen-1 bytes & NUL terminating it.
+    Returns false if aValue is not a string or had to be truncated.
+*/
+extern bool jsonValue_copyString(const JSONValue_t *aValue, char *aoBuf, size_t aBufLen);
+
+#pragma mark - Adapter
+
+/*!
+    Converts a value to the objects parseJSON would have returned for it (Autoreleased dictionaries, arrays, strings & numbers),
+    for code written against those. Like parseJSON, booleans become numbers & nulls are left out.
+    Must be called on the main thread.
+*/
+extern Obj_t *jsonValue_toObj(const JSONValue_t *aValue);
+#endif
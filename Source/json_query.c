@@ -0,0 +1,491 @@
+#include "json_query.h"
+#include <yajl/yajl_parse.h>
+#include <stdlib.h>
+
+#define kJSONQueryMaxCopiedKeyLength 128
+
+typedef enum _JSONQueryPathKind {
+    kJSONQueryPath_value,
+    kJSONQueryPath_bind,
+    kJSONQueryPath_record,
+    kJSONQueryPath_field
+} JSONQueryPathKind_t;
+
+typedef struct _JSONQueryComponent {
+    const char *name;
+    size_t length;
+    int index; // -1 unless the component is a number
+    bool isWildcard;
+} JSONQueryComponent_t;
+
+typedef struct _JSONQueryPath {
+    JSONQueryPathKind_t kind;
+    char *text; // The components point into it
+    int numberOfComponents;
+    JSONQueryComponent_t components[kJSONQueryMaxComponents];
+
+    JSONQueryValueCallback_t callback;
+    void *context;
+    // Bindings & fields
+    JSONFieldType_t type;
+    void *target; // The bound variable, or the offset of fields within their record
+    size_t size;
+    int record, field;
+} JSONQueryPath_t;
+
+typedef struct _JSONQueryRecord {
+    size_t size;
+    unsigned char *record; // Reused for every container matched
+    uint64_t fieldsFound;
+    bool isOpen;
+    JSONQueryMatch_t match;
+    JSONQueryRecordCallback_t callback;
+    void *context;
+} JSONQueryRecord_t;
+
+// An open container
+typedef struct _JSONQueryLevel {
+    uint64_t active; // The paths that continue below this container
+    uint64_t openedRecords;
+    bool isArray;
+    int index; // The index of the current element of arrays
+    uint64_t memberActive; // The paths matching the current member of objects
+    const char *key; // The key of the current member of objects
+    size_t keyLength;
+    char keyCopy[kJSONQueryMaxCopiedKeyLength]; // Keys that yajl unescaped into its own buffer are copied here
+} JSONQueryLevel_t;
+
+typedef struct _JSONQueryRun {
+    JSONQuery_t *query;
+    uintptr_t dataStart, dataEnd;
+    uint64_t allPaths;
+    int depth;
+    int skipDepth; // The depth within a subtree that no path goes through
+    JSONQueryLevel_t levels[kJSONQueryMaxDepth];
+} JSONQueryRun_t;
+
+static void jsonQuery_destroy(JSONQuery_t *aQuery);
+
+Class_t Class_JSONQuery = {
+    "JSONQuery",
+    sizeof(JSONQuery_t),
+    (Obj_destructor_t)&jsonQuery_destroy
+};
+
+JSONQuery_t *jsonQuery_create(void)
+{
+    JSONQuery_t *out = obj_create(&Class_JSONQuery);
+    out->paths = calloc(kJSONQueryMaxPaths, sizeof(JSONQueryPath_t));
+    out->records = calloc(kJSONQueryMaxPaths, sizeof(JSONQueryRecord_t));
+    return out;
+}
+
+static void jsonQuery_destroy(JSONQuery_t *aQuery)
+{
+    for(int i = 0; i < aQuery->numberOfPaths; ++i)
+        free(aQuery->paths[i].text);
+    for(int i = 0; i < aQuery->numberOfRecords; ++i)
+        free(aQuery->records[i].record);
+    free(aQuery->paths);
+    free(aQuery->records);
+}
+
+#pragma mark - Building queries
+
+// Adds a path made of the components of aPrefix (If any) followed by those of aPath
+static JSONQueryPath_t *_jsonQuery_addPath(JSONQuery_t *aQuery, JSONQueryPathKind_t aKind, const JSONQueryPath_t *aPrefix,
+                                           const char *aPath)
+{
+    if(aQuery->numberOfPaths == kJSONQueryMaxPaths) {
+        dynamo_log("Too many paths in JSON query");
+        return NULL;
+    }
+    JSONQueryPath_t *path = &aQuery->paths[aQuery->numberOfPaths];
+    memset(path, 0, sizeof(JSONQueryPath_t));
+    path->kind = aKind;
+    path->text = strdup(aPath);
+    if(aPrefix) {
+        path->numberOfComponents = aPrefix->numberOfComponents;
+        memcpy(path->components, aPrefix->components, aPrefix->numberOfComponents*sizeof(JSONQueryComponent_t));
+    }
+    for(char *component = path->text; *component; ) {
+        char *end = strchr(component, '.');
+        size_t length = end ? (size_t)(end - component) : strlen(component);
+        if(length == 0 || path->numberOfComponents == kJSONQueryMaxComponents) {
+            dynamo_log("Invalid JSON query path %s", aPath);
+            free(path->text);
+            return NULL;
+        }
+        JSONQueryComponent_t *out = &path->components[path->numberOfComponents++];
+        out->name = component;
+        out->length = length;
+        out->isWildcard = length == 1 && *component == '*';
+        char *indexEnd;
+        long index = strtol(component, &indexEnd, 10);
+        out->index = (indexEnd == component + length && index >= 0) ? (int)index : -1;
+        if(!end)
+            break;
+        component = end + 1;
+    }
+    ++aQuery->numberOfPaths;
+    return path;
+}
+
+bool jsonQuery_addValue(JSONQuery_t *aQuery, const char *aPath, JSONQueryValueCallback_t aCallback, void *aContext)
+{
+    JSONQueryPath_t *path = _jsonQuery_addPath(aQuery, kJSONQueryPath_value, NULL, aPath);
+    if(!path)
+        return false;
+    path->callback = aCallback;
+    path->context = aContext;
+    return true;
+}
+
+bool jsonQuery_bind(JSONQuery_t *aQuery, const char *aPath, JSONFieldType_t aType, void *aoTarget, size_t aSize)
+{
+    JSONQueryPath_t *path = _jsonQuery_addPath(aQuery, kJSONQueryPath_bind, NULL, aPath);
+    if(!path)
+        return false;
+    path->type = aType;
+    path->target = aoTarget;
+    path->size = aSize;
+    return true;
+}
+
+bool jsonQuery_addRecord(JSONQuery_t *aQuery, const char *aPath, const JSONQueryField_t *aFields, int aNumberOfFields,
+                         size_t aRecordSize, JSONQueryRecordCallback_t aCallback, void *aContext)
+{
+    if(aNumberOfFields > 64 || aQuery->numberOfPaths + 1 + aNumberOfFields > kJSONQueryMaxPaths) {
+        dynamo_log("Too many paths in JSON query");
+        return false;
+    }
+    int firstPath = aQuery->numberOfPaths;
+    JSONQueryPath_t *recordPath = _jsonQuery_addPath(aQuery, kJSONQueryPath_record, NULL, aPath);
+    if(!recordPath)
+        return false;
+    recordPath->record = aQuery->numberOfRecords;
+    for(int i = 0; i < aNumberOfFields; ++i) {
+        JSONQueryPath_t *fieldPath = _jsonQuery_addPath(aQuery, kJSONQueryPath_field, &aQuery->paths[firstPath], aFields[i].path);
+        if(!fieldPath) {
+            // Drops the paths added so far
+            while(aQuery->numberOfPaths > firstPath)
+                free(aQuery->paths[--aQuery->numberOfPaths].text);
+            return false;
+        }
+        fieldPath->type = aFields[i].type;
+        fieldPath->target = (void *)aFields[i].offset;
+        fieldPath->size = aFields[i].size;
+        fieldPath->record = aQuery->numberOfRecords;
+        fieldPath->field = i;
+    }
+    JSONQueryRecord_t *record = &aQuery->records[aQuery->numberOfRecords++];
+    record->size = aRecordSize;
+    record->record = malloc(MAX(1, aRecordSize));
+    record->callback = aCallback;
+    record->context = aContext;
+    return true;
+}
+
+void jsonQuery_stop(JSONQuery_t *aQuery)
+{
+    aQuery->shouldStop = true;
+}
+
+#pragma mark - Matching
+
+// Returns the paths in aActive whose component at aDepth matches a member key (Or array index if aKey is NULL)
+static uint64_t _jsonQuery_filter(JSONQuery_t *aQuery, uint64_t aActive, int aDepth, const char *aKey, size_t aKeyLength,
+                                  int aIndex)
+{
+    uint64_t out = 0;
+    for(int i = 0; aActive; ++i, aActive >>= 1) {
+        if(!(aActive & 1))
+            continue;
+        const JSONQueryComponent_t *component = &aQuery->paths[i].components[aDepth];
+        if(component->isWildcard
+           || (aKey ? (component->length == aKeyLength && memcmp(component->name, aKey, aKeyLength) == 0)
+                    : component->index == aIndex))
+            out |= 1ULL << i;
+    }
+    return out;
+}
+
+// Returns the paths that have at least aDepth+1 components
+static uint64_t _jsonQuery_longerThan(JSONQuery_t *aQuery, uint64_t aPaths, int aDepth)
+{
+    uint64_t out = 0;
+    for(int i = 0; i < aQuery->numberOfPaths; ++i) {
+        if((aPaths & (1ULL << i)) && aQuery->paths[i].numberOfComponents > aDepth)
+            out |= 1ULL << i;
+    }
+    return out;
+}
+
+// Returns the paths matching the value that is starting
+static uint64_t _jsonQuery_beginValue(JSONQueryRun_t *aRun)
+{
+    if(aRun->depth == 0)
+        return aRun->allPaths;
+    JSONQueryLevel_t *level = &aRun->levels[aRun->depth - 1];
+    if(!level->isArray)
+        return level->memberActive;
+    int index = level->index++;
+    return _jsonQuery_filter(aRun->query, level->active, aRun->depth - 1, NULL, 0, index);
+}
+
+static void _jsonQuery_getMatch(JSONQueryRun_t *aRun, const JSONQueryPath_t *aPath, JSONQueryMatch_t *aoMatch)
+{
+    aoMatch->value = NULL;
+    aoMatch->numberOfWildcards = 0;
+    for(int i = 0; i < aPath->numberOfComponents && aoMatch->numberOfWildcards < kJSONQueryMaxWildcards; ++i) {
+        if(!aPath->components[i].isWildcard)
+            continue;
+        const JSONQueryLevel_t *level = &aRun->levels[i];
+        JSONQueryWildcard_t *wildcard = &aoMatch->wildcards[aoMatch->numberOfWildcards++];
+        wildcard->key = level->isArray ? NULL : level->key;
+        wildcard->keyLength = level->isArray ? 0 : level->keyLength;
+        wildcard->index = level->isArray ? level->index - 1 : -1;
+    }
+}
+
+static bool _jsonQuery_store(const JSONValue_t *aValue, JSONFieldType_t aType, void *aoTarget, size_t aSize)
+{
+    if(aType == kJSONField_string) {
+        if(aValue->type != kJSONType_string || aSize == 0)
+            return false;
+        size_t length = MIN(aValue->length, aSize - 1);
+        memcpy(aoTarget, aValue->string, length);
+        ((char *)aoTarget)[length] = '\0';
+        return true;
+    }
+    if(aValue->type != kJSONType_number && aValue->type != kJSONType_bool)
+        return false;
+    double number = jsonValue_number(aValue, 0.0);
+    switch(aType) {
+        case kJSONField_float:  *(float *)aoTarget = number;       break;
+        case kJSONField_double: *(double *)aoTarget = number;      break;
+        case kJSONField_int:    *(int *)aoTarget = (int)number;    break;
+        case kJSONField_bool:   *(bool *)aoTarget = number != 0.0; break;
+        default:
+            return false;
+    }
+    return true;
+}
+
+static int _jsonQuery_scalar(JSONQueryRun_t *aRun, const JSONValue_t *aValue)
+{
+    JSONQuery_t *query = aRun->query;
+    uint64_t active = _jsonQuery_beginValue(aRun);
+    for(int i = 0; active; ++i, active >>= 1) {
+        JSONQueryPath_t *path = &query->paths[i];
+        if(!(active & 1) || path->numberOfComponents != aRun->depth)
+            continue;
+        switch(path->kind) {
+            case kJSONQueryPath_value: {
+                JSONQueryMatch_t match;
+                _jsonQuery_getMatch(aRun, path, &match);
+                match.value = aValue;
+                path->callback(query, &match, path->context);
+                break;
+            }
+            case kJSONQueryPath_bind:
+                _jsonQuery_store(aValue, path->type, path->target, path->size);
+                break;
+            case kJSONQueryPath_field: {
+                JSONQueryRecord_t *record = &query->records[path->record];
+                if(record->isOpen && _jsonQuery_store(aValue, path->type, record->record + (size_t)path->target, path->size))
+                    record->fieldsFound |= 1ULL << path->field;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    return !query->shouldStop;
+}
+
+#pragma mark - Parsing
+
+static int _jsonQuery_handleNull(void *aRun)
+{
+    if(((JSONQueryRun_t *)aRun)->skipDepth > 0)
+        return true;
+    JSONValue_t value = { .type = kJSONType_null };
+    return _jsonQuery_scalar(aRun, &value);
+}
+
+static int _jsonQuery_handleBoolean(void *aRun, int aBoolean)
+{
+    if(((JSONQueryRun_t *)aRun)->skipDepth > 0)
+        return true;
+    JSONValue_t value = { .type = kJSONType_bool, .boolean = aBoolean };
+    return _jsonQuery_scalar(aRun, &value);
+}
+
+// Numbers are received as text so that skipped ones are not converted
+static int _jsonQuery_handleNumber(void *aRun, const char *aNumber, size_t aLength)
+{
+    if(((JSONQueryRun_t *)aRun)->skipDepth > 0)
+        return true;
+    // The text is not NUL terminated
+    char buf[64];
+    char *text = aLength < sizeof(buf) ? buf : malloc(aLength + 1);
+    memcpy(text, aNumber, aLength);
+    text[aLength] = '\0';
+    JSONValue_t value = { .type = kJSONType_number, .number = strtod(text, NULL) };
+    if(text != buf)
+        free(text);
+    return _jsonQuery_scalar(aRun, &value);
+}
+
+static int _jsonQuery_handleString(void *aRun, const unsigned char *aString, size_t aLength)
+{
+    if(((JSONQueryRun_t *)aRun)->skipDepth > 0)
+        return true;
+    JSONValue_t value = { .type = kJSONType_string, .length = aLength, .string = (const char *)aString };
+    return _jsonQuery_scalar(aRun, &value);
+}
+
+static int _jsonQuery_handleMapKey(void *aRun_, const unsigned char *aKey, size_t aLength)
+{
+    JSONQueryRun_t *aRun = aRun_;
+    if(aRun->skipDepth > 0)
+        return true;
+    JSONQueryLevel_t *level = &aRun->levels[aRun->depth - 1];
+    // Matched now, as yajl reuses its buffer for the next string
+    level->memberActive = _jsonQuery_filter(aRun->query, level->active, aRun->depth - 1, (const char *)aKey, aLength, -1);
+    if(!level->memberActive)
+        return true;
+    uintptr_t start = (uintptr_t)aKey;
+    if(start >= aRun->dataStart && start + aLength <= aRun->dataEnd) {
+        level->key = (const char *)aKey;
+        level->keyLength = aLength;
+    } else {
+        level->keyLength = MIN(aLength, sizeof(level->keyCopy));
+        memcpy(level->keyCopy, aKey, level->keyLength);
+        level->key = level->keyCopy;
+    }
+    return true;
+}
+
+static int _jsonQuery_openContainer(JSONQueryRun_t *aRun, bool aIsArray)
+{
+    if(aRun->skipDepth > 0) {
+        ++aRun->skipDepth;
+        return true;
+    }
+    JSONQuery_t *query = aRun->query;
+    uint64_t active = _jsonQuery_beginValue(aRun);
+    uint64_t continuing = _jsonQuery_longerThan(query, active, aRun->depth);
+    uint64_t records = 0;
+    for(int i = 0; i < query->numberOfPaths; ++i) {
+        if((active & (1ULL << i)) && query->paths[i].kind == kJSONQueryPath_record
+           && query->paths[i].numberOfComponents == aRun->depth)
+            records |= 1ULL << query->paths[i].record;
+    }
+    if((!continuing && !records) || aRun->depth == kJSONQueryMaxDepth) {
+        aRun->skipDepth = 1;
+        return true;
+    }
+    for(int i = 0; i < query->numberOfPaths; ++i) {
+        JSONQueryPath_t *path = &query->paths[i];
+        if(path->kind != kJSONQueryPath_record || !(records & (1ULL << path->record)))
+            continue;
+        JSONQueryRecord_t *record = &query->records[path->record];
+        memset(record->record, 0, record->size);
+        record->fieldsFound = 0;
+        record->isOpen = true;
+        _jsonQuery_getMatch(aRun, path, &record->match);
+    }
+    JSONQueryLevel_t *level = &aRun->levels[aRun->depth++];
+    level->active = continuing;
+    level->openedRecords = records;
+    level->isArray = aIsArray;
+    level->index = 0;
+    level->memberActive = 0;
+    return true;
+}
+
+static int _jsonQuery_handleStartMap(void *aRun)
+{
+    return _jsonQuery_openContainer(aRun, false);
+}
+
+static int _jsonQuery_handleStartArray(void *aRun)
+{
+    return _jsonQuery_openContainer(aRun, true);
+}
+
+static int _jsonQuery_handleEnd(void *aRun_)
+{
+    JSONQueryRun_t *aRun = aRun_;
+    if(aRun->skipDepth > 0) {
+        --aRun->skipDepth;
+        return true;
+    }
+    JSONQuery_t *query = aRun->query;
+    JSONQueryLevel_t *level = &aRun->levels[--aRun->depth];
+    for(int i = 0; level->openedRecords; ++i, level->openedRecords >>= 1) {
+        if(!(level->openedRecords & 1))
+            continue;
+        JSONQueryRecord_t *record = &query->records[i];
+        record->isOpen = false;
+        record->callback(query, &record->match, record->record, record->fieldsFound, record->context);
+    }
+    return !query->shouldStop;
+}
+
+static yajl_callbacks _JSONQueryCallbacks = {
+    _jsonQuery_handleNull,
+    _jsonQuery_handleBoolean,
+    NULL,
+    NULL,
+    _jsonQuery_handleNumber,
+    _jsonQuery_handleString,
+    _jsonQuery_handleStartMap,
+    _jsonQuery_handleMapKey,
+    _jsonQuery_handleEnd,
+    _jsonQuery_handleStartArray,
+    _jsonQuery_handleEnd
+};
+
+bool jsonQuery_runData(JSONQuery_t *aQuery, const char *aData, size_t aLength)
+{
+    // The run state is about 10KB, too much for the stack of some threads
+    JSONQueryRun_t *run = malloc(sizeof(JSONQueryRun_t));
+    run->query = aQuery;
+    run->dataStart = (uintptr_t)aData;
+    run->dataEnd = (uintptr_t)aData + aLength;
+    run->allPaths = aQuery->numberOfPaths == 64 ? ~0ULL : (1ULL << aQuery->numberOfPaths) - 1;
+    run->depth = 0;
+    run->skipDepth = 0;
+    aQuery->shouldStop = false;
+    for(int i = 0; i < aQuery->numberOfRecords; ++i)
+        aQuery->records[i].isOpen = false;
+
+    yajl_handle yajl = yajl_alloc(&_JSONQueryCallbacks, NULL, run);
+    yajl_status status = yajl_parse(yajl, (const unsigned char *)aData, aLength);
+    if(status == yajl_status_ok)
+        status = yajl_complete_parse(yajl);
+    bool succeeded = status == yajl_status_ok || (status == yajl_status_client_canceled && aQuery->shouldStop);
+    if(!succeeded) {
+        unsigned char *err = yajl_get_error(yajl, 1, (const unsigned char *)aData, aLength);
+        dynamo_log("Couldn't parse JSON: %s", err);
+        yajl_free_error(yajl, err);
+    }
+    yajl_free(yajl);
+    free(run);
+    return succeeded;
+}
+
+bool jsonQuery_runFile(JSONQuery_t *aQuery, const char *aPath)
+{
+    MappedFile_t file;
+    if(!util_mapFile(aPath, kMappedFileAccess_sequential, &file)) {
+        dynamo_log("Couldn't read JSON from %s", aPath);
+        return false;
+    }
+    bool succeeded = jsonQuery_runData(aQuery, file.data, file.length);
+    util_unmapFile(&file);
+    return succeeded;
+}
@@ -0,0 +1,138 @@
+/*!
+    @header JSON Query
+    @abstract
+    @discussion Extracts a handful of values out of JSON without building a DOM.
+
+    A query is a set of paths, each either calling a function for the values it matches, filling in a variable, or
+    filling in a struct for every container it matches (A record). Running the query streams the text through the
+    parser once; everything outside of the paths is skipped without being stored, so the memory used does not depend on
+    the size of the input.
+
+    Paths are '.' separated member names or array indices, where '*' matches any member or element:
+        "meta.size.w"         The "w" member of "size" in "meta"
+        "frames.*"            Every member (or element) of "frames"
+        "layers.0.name"       The name of the first layer
+    Record fields are paths relative to their record's container.
+
+    Queries are created retained (Not autoreleased) so they can be built & run on any thread.
+*/
+
+#ifndef _JSONQUERY_H_
+#define _JSONQUERY_H_
+
+#include "object.h"
+#include "json_document.h"
+#include <stddef.h>
+
+#define kJSONQueryMaxPaths 64
+#define kJSONQueryMaxDepth 64
+#define kJSONQueryMaxComponents 8
+#define kJSONQueryMaxWildcards 4
+
+/*!
+    The types that values are stored as in variables & record fields
+*/
+typedef enum _JSONFieldType {
+    kJSONField_float,  // float (From a number or boolean)
+    kJSONField_double, // double (From a number or boolean)
+    kJSONField_int,    // int (From a number or boolean, truncated)
+    kJSONField_bool,   // bool (From a boolean or number)
+    kJSONField_string  // char[size] (From a string, truncated to fit & NUL terminated)
+} JSONFieldType_t;
+
+/*!
+    A field of a record
+
+    @field path The path of the value relative to the record's container
+    @field offset The offset of the field within the record (Use offsetof)
+    @field size The size of the field (Only used by strings)
+*/
+typedef struct _JSONQueryField {
+    const char *path;
+    JSONFieldType_t type;
+    size_t offset;
+    size_t size;
+} JSONQueryField_t;
+
+/*!
+    What a '*' in a path matched: a member key, or an array index (Where key is NULL)
+*/
+typedef struct _JSONQueryWildcard {
+    const char *key;
+    size_t keyLength;
+    int index;
+} JSONQueryWildcard_t;
+
+/*!
+    A match of a query path
+
+    @field value The matched value (Strings are only valid during the callback). NULL for records
+    @field wildcards What each '*' in the path matched, in order
+*/
+typedef struct _JSONQueryMatch {
+    const JSONValue_t *value;
+    int numberOfWildcards;
+    JSONQueryWildcard_t wildcards[kJSONQueryMaxWildcards];
+} JSONQueryMatch_t;
+
+typedef struct _JSONQuery JSONQuery_t;
+
+/*!
+    Called for a value matched by a path.
+*/
+typedef void (*JSONQueryValueCallback_t)(JSONQuery_t *aQuery, const JSONQueryMatch_t *aMatch, void *aContext);
+/*!
+    Called once a record's container has ended.
+
+    @param aRecord The record, zeroed before being filled in
+    @param aFieldsFound A bit set for each field that was found (1 << the index of the field)
+*/
+typedef void (*JSONQueryRecordCallback_t)(JSONQuery_t *aQuery, const JSONQueryMatch_t *aMatch, void *aRecord,
+                                          uint64_t aFieldsFound, void *aContext);
+
+/*!
+    A query
+*/
+struct _JSONQuery {
+    OBJ_GUTS
+    int numberOfPaths;
+    struct _JSONQueryPath *paths;
+    int numberOfRecords;
+    struct _JSONQueryRecord *records;
+    bool shouldStop;
+};
+extern Class_t Class_JSONQuery;
+
+/*!
+    Creates an empty query.
+*/
+extern JSONQuery_t *jsonQuery_create(void);
+/*!
+    Calls aCallback for every scalar value (String, number, boolean or null) matching aPath.
+    Returns false if the path is invalid or the query is full.
+*/
+extern bool jsonQuery_addValue(JSONQuery_t *aQuery, const char *aPath, JSONQueryValueCallback_t aCallback, void *aContext);
+/*!
+    Stores the value at aPath in aoTarget (Of aSize bytes for strings). Targets of values that are missing or of an
+    incompatible type are left untouched, so they can be set to defaults beforehand.
+*/
+extern bool jsonQuery_bind(JSONQuery_t *aQuery, const char *aPath, JSONFieldType_t aType, void *aoTarget, size_t aSize);
+/*!
+    Fills in a record of aRecordSize bytes for every object or array matching aPath, & passes it to aCallback once the
+    container ends. Every field takes up a path in the query.
+*/
+extern bool jsonQuery_addRecord(JSONQuery_t *aQuery, const char *aPath, const JSONQueryField_t *aFields, int aNumberOfFields,
+                                size_t aRecordSize, JSONQueryRecordCallback_t aCallback, void *aContext);
+/*!
+    Stops a running query once the current callback returns. (e.g. once everything needed has been found)
+*/
+extern void jsonQuery_stop(JSONQuery_t *aQuery);
+/*!
+    Runs a query over aLength bytes of JSON. Returns false if the JSON is invalid (Up to where the query stopped).
+*/
+extern bool jsonQuery_runData(JSONQuery_t *aQuery, const char *aData, size_t aLength);
+/*!
+    Runs a query over a file (Either a filesystem or a virtual path), straight out of memory mapped storage.
+*/
+extern bool jsonQuery_runFile(JSONQuery_t *aQuery, const char *aPath);
+#endif
@@ -0,0 +1,794 @@
+#include "json_writer.h"
+#include "json.h"
+#include "vfs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdint.h>
+#include <unistd.h>
+
+// Container states
+#define kContainer_object       (1 << 0)
+#define kContainer_hasItems     (1 << 1)
+#define kContainer_expectsValue (1 << 2) // A key has been written
+
+// CBOR major types
+#define kCBOR_unsigned (0 << 5)
+#define kCBOR_negative (1 << 5)
+#define kCBOR_text     (3 << 5)
+#define kCBOR_array    (4 << 5)
+#define kCBOR_map      (5 << 5)
+#define kCBOR_indefinite 31
+#define kCBOR_false    0xf4
+#define kCBOR_true     0xf5
+#define kCBOR_null     0xf6
+#define kCBOR_float32  0xfa
+#define kCBOR_float64  0xfb
+#define kCBOR_break    0xff
+
+static void jsonWriter_destroy(JSONWriter_t *aWriter);
+
+Class_t Class_JSONWriter = {
+    "JSONWriter",
+    sizeof(JSONWriter_t),
+    (Obj_destructor_t)&jsonWriter_destroy
+};
+
+static JSONWriter_t *_jsonWriter_create(JSONWriterFormat_t aFormat, int aFd, size_t aCapacity)
+{
+    JSONWriter_t *out = obj_create(&Class_JSONWriter);
+    out->format = aFormat;
+    out->fd = aFd;
+    out->capacity = aCapacity;
+    out->buffer = malloc(aCapacity);
+    return out;
+}
+
+JSONWriter_t *jsonWriter_create(JSONWriterFormat_t aFormat)
+{
+    return _jsonWriter_create(aFormat, -1, 256);
+}
+
+JSONWriter_t *jsonWriter_createWithFd(int aFd, JSONWriterFormat_t aFormat)
+{
+    return _jsonWriter_create(aFormat, aFd, kJSONWriterChunkSize);
+}
+
+JSONWriter_t *jsonWriter_createWithFile(const char *aPath, JSONWriterFormat_t aFormat)
+{
+    if(vfs_isVirtualPath(aPath)) {
+        dynamo_log("Can't write to %s, archives are read only", aPath);
+        return NULL;
+    }
+    size_t temporaryPathLength = strlen(aPath) + 5;
+    char *temporaryPath = malloc(temporaryPathLength);
+    snprintf(temporaryPath, temporaryPathLength, "%s.tmp", aPath);
+    int fd = open(temporaryPath, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if(fd < 0) {
+        dynamo_log("Couldn't create %s", temporaryPath);
+        free(temporaryPath);
+        return NULL;
+    }
+    JSONWriter_t *out = _jsonWriter_create(aFormat, fd, kJSONWriterChunkSize);
+    out->ownsFd = true;
+    out->path = strdup(aPath);
+    out->temporaryPath = temporaryPath;
+    return out;
+}
+
+static void jsonWriter_destroy(JSONWriter_t *aWriter)
+{
+    if(aWriter->ownsFd && !aWriter->isClosed) {
+        close(aWriter->fd);
+        unlink(aWriter->temporaryPath);
+    }
+    free(aWriter->buffer);
+    free(aWriter->path);
+    free(aWriter->temporaryPath);
+}
+
+#pragma mark - Output
+
+static bool _jsonWriter_flush(JSONWriter_t *aWriter, const unsigned char *aBytes, size_t aLength)
+{
+    while(aLength > 0) {
+        ssize_t written = write(aWriter->fd, aBytes, aLength);
+        if(written < 0 && errno == EINTR)
+            continue;
+        if(written <= 0) {
+            dynamo_log("Couldn't write JSON: %s", strerror(errno));
+            aWriter->failed = true;
+            return false;
+        }
+        aBytes += written;
+        aLength -= written;
+    }
+    return true;
+}
+
+static void _jsonWriter_write(JSONWriter_t *aWriter, const void *aBytes, size_t aLength)
+{
+    if(aWriter->failed)
+        return;
+    if(aWriter->fd >= 0) {
+        if(aWriter->length + aLength > aWriter->capacity) {
+            if(!_jsonWriter_flush(aWriter, aWriter->buffer, aWriter->length))
+                return;
+            aWriter->length = 0;
+            // Large strings are written straight out rather than through the buffer
+            if(aLength >= aWriter->capacity) {
+                if(_jsonWriter_flush(aWriter, aBytes, aLength))
+                    aWriter->bytesWritten += aLength;
+                return;
+            }
+        }
+    } else if(aWriter->length + aLength + 1 > aWriter->capacity) {
+        // Keeps room for a NUL byte
+        size_t capacity = MAX(aWriter->capacity*2, aWriter->length + aLength + 1);
+        unsigned char *buffer = realloc(aWriter->buffer, capacity);
+        if(!buffer) {
+            aWriter->failed = true;
+            return;
+        }
+        aWriter->buffer = buffer;
+        aWriter->capacity = capacity;
+    }
+    memcpy(aWriter->buffer + aWriter->length, aBytes, aLength);
+    aWriter->length += aLength;
+    aWriter->bytesWritten += aLength;
+}
+
+static inline void _jsonWriter_putc(JSONWriter_t *aWriter, unsigned char aByte)
+{
+    _jsonWriter_write(aWriter, &aByte, 1);
+}
+
+bool jsonWriter_close(JSONWriter_t *aWriter)
+{
+    if(aWriter->isClosed)
+        return !aWriter->failed;
+    aWriter->isClosed = true;
+    if(aWriter->depth > 0 || !aWriter->hasRoot) {
+        dynamo_log("Unfinished JSON");
+        aWriter->failed = true;
+    }
+    if(aWriter->fd >= 0 && !aWriter->failed && _jsonWriter_flush(aWriter, aWriter->buffer, aWriter->length))
+        aWriter->length = 0;
+    else if(aWriter->fd < 0 && aWriter->buffer)
+        aWriter->buffer[aWriter->length] = '\0';
+
+    if(aWriter->ownsFd) {
+        // Makes sure the data is on disk before it replaces the previous file
+        if(!aWriter->failed && fsync(aWriter->fd) != 0)
+            aWriter->failed = true;
+        if(close(aWriter->fd) != 0)
+            aWriter->failed = true;
+        if(!aWriter->failed && rename(aWriter->temporaryPath, aWriter->path) != 0) {
+            dynamo_log("Couldn't replace %s", aWriter->path);
+            aWriter->failed = true;
+        }
+        if(aWriter->failed)
+            unlink(aWriter->temporaryPath);
+    }
+    return !aWriter->failed;
+}
+
+const void *jsonWriter_getBuffer(JSONWriter_t *aWriter, size_t *aoLength)
+{
+    if(aWriter->fd >= 0) {
+        *aoLength = 0;
+        return NULL;
+    }
+    aWriter->buffer[aWriter->length] = '\0';
+    *aoLength = aWriter->length;
+    return aWriter->buffer;
+}
+
+#pragma mark - Structure
+
+// Writes the separators that precede a value, & checks that a value is expected
+static bool _jsonWriter_beginValue(JSONWriter_t *aWriter)
+{
+    if(aWriter->failed || aWriter->isClosed) {
+        aWriter->failed = true;
+        return false;
+    }
+    if(aWriter->depth == 0) {
+        if(aWriter->hasRoot) {
+            dynamo_log("JSON can only have a single root value");
+            aWriter->failed = true;
+            return false;
+        }
+        aWriter->hasRoot = true;
+        return true;
+    }
+    unsigned char *container = &aWriter->containers[aWriter->depth - 1];
+    if(*container & kContainer_object) {
+        if(!(*container & kContainer_expectsValue)) {
+            dynamo_log("Object members need keys");
+            aWriter->failed = true;
+            return false;
+        }
+        *container &= ~kContainer_expectsValue;
+    } else {
+        if((*container & kContainer_hasItems) && aWriter->format == kJSONWriterFormat_json)
+            _jsonWriter_putc(aWriter, ',');
+        *container |= kContainer_hasItems;
+    }
+    return true;
+}
+
+static void _jsonWriter_cborHead(JSONWriter_t *aWriter, unsigned char aMajorType, uint64_t aValue)
+{
+    unsigned char head[9];
+    int length;
+    if(aValue < 24) {
+        head[0] = aMajorType | aValue;
+        length = 1;
+    } else {
+        int bytes = aValue <= 0xff ? 1 : aValue <= 0xffff ? 2 : aValue <= 0xffffffff ? 4 : 8;
+        head[0] = aMajorType | (bytes == 1 ? 24 : bytes == 2 ? 25 : bytes == 4 ? 26 : 27);
+        for(int i = 0; i < bytes; ++i)
+            head[bytes - i] = (aValue >> (8*i)) & 0xff;
+        length = bytes + 1;
+    }
+    _jsonWriter_write(aWriter, head, length);
+}
+
+static void _jsonWriter_beginContainer(JSONWriter_t *aWriter, bool aIsObject)
+{
+    if(!_jsonWriter_beginValue(aWriter))
+        return;
+    if(aWriter->depth == kJSONWriterMaxDepth) {
+        dynamo_log("JSON nested too deeply");
+        aWriter->failed = true;
+        return;
+    }
+    aWriter->containers[aWriter->depth++] = aIsObject ? kContainer_object : 0;
+    if(aWriter->format == kJSONWriterFormat_json)
+        _jsonWriter_putc(aWriter, aIsObject ? '{' : '[');
+    else
+        _jsonWriter_putc(aWriter, (aIsObject ? kCBOR_map : kCBOR_array) | kCBOR_indefinite);
+}
+
+static void _jsonWriter_endContainer(JSONWriter_t *aWriter, bool aIsObject)
+{
+    if(aWriter->failed)
+        return;
+    unsigned char container = aWriter->depth > 0 ? aWriter->containers[aWriter->depth - 1] : 0;
+    if(aWriter->depth == 0 || (bool)(container & kContainer_object) != aIsObject || (container & kContainer_expectsValue)) {
+        dynamo_log("Mismatched end of JSON container");
+        aWriter->failed = true;
+        return;
+    }
+    --aWriter->depth;
+    if(aWriter->format == kJSONWriterFormat_json)
+        _jsonWriter_putc(aWriter, aIsObject ? '}' : ']');
+    else
+        _jsonWriter_putc(aWriter, kCBOR_break);
+}
+
+void jsonWriter_beginObject(JSONWriter_t *aWriter)
+{
+    _jsonWriter_beginContainer(aWriter, true);
+}
+
+void jsonWriter_endObject(JSONWriter_t *aWriter)
+{
+    _jsonWriter_endContainer(aWriter, true);
+}
+
+void jsonWriter_beginArray(JSONWriter_t *aWriter)
+{
+    _jsonWriter_beginContainer(aWriter, false);
+}
+
+void jsonWriter_endArray(JSONWriter_t *aWriter)
+{
+    _jsonWriter_endContainer(aWriter, false);
+}
+
+#pragma mark - Values
+
+static void _jsonWriter_writeString(JSONWriter_t *aWriter, const char *aString, size_t aLength)
+{
+    if(aWriter->format == kJSONWriterFormat_cbor) {
+        _jsonWriter_cborHead(aWriter, kCBOR_text, aLength);
+        _jsonWriter_write(aWriter, aString, aLength);
+        return;
+    }
+    static const char hexDigits[] = "0123456789abcdef";
+    _jsonWriter_putc(aWriter, '"');
+    // Characters that need no escaping are written in runs
+    size_t runStart = 0;
+    for(size_t i = 0; i < aLength; ++i) {
+        unsigned char c = aString[i];
+        if(c >= 0x20 && c != '"' && c != '\\')
+            continue;
+        _jsonWriter_write(aWriter, aString + runStart, i - runStart);
+        runStart = i + 1;
+        char escape[6] = { '\\', 0 };
+        int escapeLength = 2;
+        switch(c) {
+            case '"':  escape[1] = '"';  break;
+            case '\\': escape[1] = '\\'; break;
+            case '\b': escape[1] = 'b';  break;
+            case '\f': escape[1] = 'f';  break;
+            case '\n': escape[1] = 'n';  break;
+            case '\r': escape[1] = 'r';  break;
+            case '\t': escape[1] = 't';  break;
+            default:
+                memcpy(escape + 1, "u00", 3);
+                escape[4] = hexDigits[c >> 4];
+                escape[5] = hexDigits[c & 0xf];
+                escapeLength = 6;
+        }
+        _jsonWriter_write(aWriter, escape, escapeLength);
+    }
+    _jsonWriter_write(aWriter, aString + runStart, aLength - runStart);
+    _jsonWriter_putc(aWriter, '"');
+}
+
+void jsonWriter_keyWithLength(JSONWriter_t *aWriter, const char *aKey, size_t aLength)
+{
+    if(aWriter->failed)
+        return;
+    unsigned char *container = aWriter->depth > 0 ? &aWriter->containers[aWriter->depth - 1] : NULL;
+    if(!container || !(*container & kContainer_object) || (*container & kContainer_expectsValue)) {
+        dynamo_log("JSON key written outside of an object");
+        aWriter->failed = true;
+        return;
+    }
+    if((*container & kContainer_hasItems) && aWriter->format == kJSONWriterFormat_json)
+        _jsonWriter_putc(aWriter, ',');
+    *container |= kContainer_hasItems | kContainer_expectsValue;
+    _jsonWriter_writeString(aWriter, aKey, aLength);
+    if(aWriter->format == kJSONWriterFormat_json)
+        _jsonWriter_putc(aWriter, ':');
+}
+
+void jsonWriter_key(JSONWriter_t *aWriter, const char *aKey)
+{
+    jsonWriter_keyWithLength(aWriter, aKey, strlen(aKey));
+}
+
+void jsonWriter_stringWithLength(JSONWriter_t *aWriter, const char *aString, size_t aLength)
+{
+    if(_jsonWriter_beginValue(aWriter))
+        _jsonWriter_writeString(aWriter, aString, aLength);
+}
+
+void jsonWriter_string(JSONWriter_t *aWriter, const char *aString)
+{
+    jsonWriter_stringWithLength(aWriter, aString, strlen(aString));
+}
+
+// Writes digits into the end of a buffer, returns the first one
+static char *_jsonWriter_formatInteger(long long aInteger, char *aoBufEnd)
+{
+    unsigned long long magnitude = aInteger < 0 ? -(unsigned long long)aInteger : (unsigned long long)aInteger;
+    char *cursor = aoBufEnd;
+    do {
+        *--cursor = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while(magnitude > 0);
+    if(aInteger < 0)
+        *--cursor = '-';
+    return cursor;
+}
+
+static void _jsonWriter_cborInteger(JSONWriter_t *aWriter, long long aInteger)
+{
+    if(aInteger >= 0)
+        _jsonWriter_cborHead(aWriter, kCBOR_unsigned, aInteger);
+    else
+        _jsonWriter_cborHead(aWriter, kCBOR_negative, -1 - aInteger);
+}
+
+void jsonWriter_integer(JSONWriter_t *aWriter, long long aInteger)
+{
+    if(!_jsonWriter_beginValue(aWriter))
+        return;
+    if(aWriter->format == kJSONWriterFormat_cbor) {
+        _jsonWriter_cborInteger(aWriter, aInteger);
+        return;
+    }
+    char buf[24];
+    char *digits = _jsonWriter_formatInteger(aInteger, buf + sizeof(buf));
+    _jsonWriter_write(aWriter, digits, buf + sizeof(buf) - digits);
+}
+
+// Integral values small enough to be exact are written as integers
+static inline bool _jsonWriter_isIntegral(double aNumber)
+{
+    return aNumber >= -9007199254740992.0 && aNumber <= 9007199254740992.0 && aNumber == (double)(long long)aNumber;
+}
+
+// Shortest round trip formatting using Grisu2 (Florian Loitsch, "Printing Floating-Point Numbers Quickly and Accurately
+// with Integers"). The digits are generated with integer arithmetic only, from the number scaled by a cached power of ten
+// into a 64 bit window, and are as few as the interval between the number's neighbours allows. In rare cases one more
+// digit than the shortest is printed, the output still reads back as the same number.
+
+typedef struct _JSONDiyFp {
+    uint64_t f;
+    int e;
+} JSONDiyFp_t;
+
+// Normalized powers of ten from 10^-348 to 10^340, in steps of 8
+static const uint64_t _JSONCachedPowersF[] = {
+    0xfa8fd5a0081c0288, 0xbaaee17fa23ebf76, 0x8b16fb203055ac76, 0xcf42894a5dce35ea,
+    0x9a6bb0aa55653b2d, 0xe61acf033d1a45df, 0xab70fe17c79ac6ca, 0xff77b1fcbebcdc4f,
+    0xbe5691ef416bd60c, 0x8dd01fad907ffc3c, 0xd3515c2831559a83, 0x9d71ac8fada6c9b5,
+    0xea9c227723ee8bcb, 0xaecc49914078536d, 0x823c12795db6ce57, 0xc21094364dfb5637,
+    0x9096ea6f3848984f, 0xd77485cb25823ac7, 0xa086cfcd97bf97f4, 0xef340a98172aace5,
+    0xb23867fb2a35b28e, 0x84c8d4dfd2c63f3b, 0xc5dd44271ad3cdba, 0x936b9fcebb25c996,
+    0xdbac6c247d62a584, 0xa3ab66580d5fdaf6, 0xf3e2f893dec3f126, 0xb5b5ada8aaff80b8,
+    0x87625f056c7c4a8b, 0xc9bcff6034c13053, 0x964e858c91ba2655, 0xdff9772470297ebd,
+    0xa6dfbd9fb8e5b88f, 0xf8a95fcf88747d94, 0xb94470938fa89bcf, 0x8a08f0f8bf0f156b,
+    0xcdb02555653131b6, 0x993fe2c6d07b7fac, 0xe45c10c42a2b3b06, 0xaa242499697392d3,
+    0xfd87b5f28300ca0e, 0xbce5086492111aeb, 0x8cbccc096f5088cc, 0xd1b71758e219652c,
+    0x9c40000000000000, 0xe8d4a51000000000, 0xad78ebc5ac620000, 0x813f3978f8940984,
+    0xc097ce7bc90715b3, 0x8f7e32ce7bea5c70, 0xd5d238a4abe98068, 0x9f4f2726179a2245,
+    0xed63a231d4c4fb27, 0xb0de65388cc8ada8, 0x83c7088e1aab65db, 0xc45d1df942711d9a,
+    0x924d692ca61be758, 0xda01ee641a708dea, 0xa26da3999aef774a, 0xf209787bb47d6b85,
+    0xb454e4a179dd1877, 0x865b86925b9bc5c2, 0xc83553c5c8965d3d, 0x952ab45cfa97a0b3,
+    0xde469fbd99a05fe3, 0xa59bc234db398c25, 0xf6c69a72a3989f5c, 0xb7dcbf5354e9bece,
+    0x88fcf317f22241e2, 0xcc20ce9bd35c78a5, 0x98165af37b2153df, 0xe2a0b5dc971f303a,
+    0xa8d9d1535ce3b396, 0xfb9b7cd9a4a7443c, 0xbb764c4ca7a44410, 0x8bab8eefb6409c1a,
+    0xd01fef10a657842c, 0x9b10a4e5e9913129, 0xe7109bfba19c0c9d, 0xac2820d9623bf429,
+    0x80444b5e7aa7cf85, 0xbf21e44003acdd2d, 0x8e679c2f5e44ff8f, 0xd433179d9c8cb841,
+    0x9e19db92b4e31ba9, 0xeb96bf6ebadf77d9, 0xaf87023b9bf0ee6b
+};
+static const int16_t _JSONCachedPowersE[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+    -901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+    -582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+    -263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+    56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+    694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+    1013, 1039, 1066
+};
+
+static const uint64_t _JSONPow10[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL,
+    10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL, 100000000000000ULL, 1000000000000000ULL,
+    10000000000000000ULL, 100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static inline JSONDiyFp_t _jsonDiyFp_normalize(JSONDiyFp_t aFp)
+{
+    while(!(aFp.f & (1ULL << 63))) {
+        aFp.f <<= 1;
+        --aFp.e;
+    }
+    return aFp;
+}
+
+// The upper 64 bits of the product, rounded
+static inline JSONDiyFp_t _jsonDiyFp_multiply(JSONDiyFp_t aLhs, JSONDiyFp_t aRhs)
+{
+    const uint64_t M32 = 0xFFFFFFFFULL;
+    uint64_t a = aLhs.f >> 32, b = aLhs.f & M32, c = aRhs.f >> 32, d = aRhs.f & M32;
+    uint64_t ac = a*c, bc = b*c, ad = a*d, bd = b*d;
+    uint64_t tmp = (bd >> 32) + (ad & M32) + (bc & M32) + (1ULL << 31);
+    JSONDiyFp_t out = { ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), aLhs.e + aRhs.e + 64 };
+    return out;
+}
+
+// Gets the cached power that brings a number with the binary exponent aE into [2^-60, 2^-32) once multiplied,
+// along with its decimal exponent (negated)
+static JSONDiyFp_t _jsonDiyFp_cachedPower(int aE, int *aoK)
+{
+    double dk = (-61 - aE)*0.30102999566398114 + 347;
+    int k = (int)dk;
+    if(dk - k > 0.0)
+        ++k;
+    unsigned index = (unsigned)((k >> 3) + 1);
+    *aoK = -(-348 + (int)index*8);
+    JSONDiyFp_t out = { _JSONCachedPowersF[index], _JSONCachedPowersE[index] };
+    return out;
+}
+
+static inline void _jsonWriter_grisuRound(char *aBuf, int aLength, uint64_t aDelta, uint64_t aRest, uint64_t aTenKappa, uint64_t aDistance)
+{
+    while(aRest < aDistance && aDelta - aRest >= aTenKappa
+          && (aRest + aTenKappa < aDistance || aDistance - aRest > aRest + aTenKappa - aDistance)) {
+        --aBuf[aLength - 1];
+        aRest += aTenKappa;
+    }
+}
+
+// Generates the digits of aW (Scaled) with the upper boundary aMp, as long as they are needed to tell it apart from
+// anything outside of [aMp - aDelta, aMp]
+static int _jsonWriter_grisuDigits(JSONDiyFp_t aW, JSONDiyFp_t aMp, uint64_t aDelta, char *aoBuf, int *aoK)
+{
+    JSONDiyFp_t one = { 1ULL << -aMp.e, aMp.e };
+    uint64_t distance = aMp.f - aW.f;
+    uint32_t p1 = (uint32_t)(aMp.f >> -one.e);
+    uint64_t p2 = aMp.f & (one.f - 1);
+    int kappa = 1;
+    while(kappa < 10 && p1 >= _JSONPow10[kappa])
+        ++kappa;
+    int length = 0;
+    // The integral part
+    while(kappa > 0) {
+        uint32_t digit = p1 / (uint32_t)_JSONPow10[kappa - 1];
+        p1 %= (uint32_t)_JSONPow10[kappa - 1];
+        if(digit || length)
+            aoBuf[length++] = '0' + digit;
+        --kappa;
+        uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+        if(rest <= aDelta) {
+            *aoK += kappa;
+            _jsonWriter_grisuRound(aoBuf, length, aDelta, rest, _JSONPow10[kappa] << -one.e, distance);
+            return length;
+        }
+    }
+    // The fractional part
+    for(;;) {
+        p2 *= 10;
+        aDelta *= 10;
+        char digit = (char)(p2 >> -one.e);
+        if(digit || length)
+            aoBuf[length++] = '0' + digit;
+        p2 &= one.f - 1;
+        --kappa;
+        if(p2 < aDelta) {
+            *aoK += kappa;
+            _jsonWriter_grisuRound(aoBuf, length, aDelta, p2, one.f, -kappa < 20 ? distance*_JSONPow10[-kappa] : 0);
+            return length;
+        }
+    }
+}
+
+// Writes the shortest digits of a positive finite number, returns their count. The number is aoBuf*10^aoK
+static int _jsonWriter_grisu2(double aNumber, bool aSinglePrecision, char *aoBuf, int *aoK)
+{
+    // Split into significand & exponent, the boundaries being halfway to the neighbouring numbers of the type
+    uint64_t hiddenBit;
+    JSONDiyFp_t v;
+    if(aSinglePrecision) {
+        float single = (float)aNumber;
+        uint32_t bits;
+        memcpy(&bits, &single, sizeof(bits));
+        int biasedExponent = (bits >> 23) & 0xFF;
+        hiddenBit = 1ULL << 23;
+        v.f = bits & (hiddenBit - 1);
+        if(biasedExponent) {
+            v.f += hiddenBit;
+            v.e = biasedExponent - 150;
+        } else
+            v.e = -149;
+    } else {
+        uint64_t bits;
+        memcpy(&bits, &aNumber, sizeof(bits));
+        int biasedExponent = (int)((bits >> 52) & 0x7FF);
+        hiddenBit = 1ULL << 52;
+        v.f = bits & (hiddenBit - 1);
+        if(biasedExponent) {
+            v.f += hiddenBit;
+            v.e = biasedExponent - 1075;
+        } else
+            v.e = -1074;
+    }
+    JSONDiyFp_t plus = { (v.f << 1) + 1, v.e - 1 };
+    plus = _jsonDiyFp_normalize(plus);
+    // The gap below a power of two is half as wide
+    JSONDiyFp_t minus = v.f == hiddenBit ? (JSONDiyFp_t){ (v.f << 2) - 1, v.e - 2 } : (JSONDiyFp_t){ (v.f << 1) - 1, v.e - 1 };
+    minus.f <<= minus.e - plus.e;
+    minus.e = plus.e;
+
+    JSONDiyFp_t power = _jsonDiyFp_cachedPower(plus.e, aoK);
+    JSONDiyFp_t w = _jsonDiyFp_multiply(_jsonDiyFp_normalize(v), power);
+    JSONDiyFp_t wPlus = _jsonDiyFp_multiply(plus, power);
+    JSONDiyFp_t wMinus = _jsonDiyFp_multiply(minus, power);
+    // Narrowed by the multiplications' rounding error
+    ++wMinus.f;
+    --wPlus.f;
+    return _jsonWriter_grisuDigits(w, wPlus, wPlus.f - wMinus.f, aoBuf, aoK);
+}
+
+int jsonWriter_formatNumber(double aNumber, bool aSinglePrecision, char *aoBuf)
+{
+    if(!isfinite(aNumber)) {
+        memcpy(aoBuf, "null", 5);
+        return 4;
+    }
+    if(_jsonWriter_isIntegral(aNumber)) {
+        char buf[24];
+        char *digits = _jsonWriter_formatInteger((long long)aNumber, buf + sizeof(buf));
+        int length = buf + sizeof(buf) - digits;
+        memcpy(aoBuf, digits, length);
+        aoBuf[length] = '\0';
+        return length;
+    }
+    char *cursor = aoBuf;
+    if(aNumber < 0.0) {
+        *cursor++ = '-';
+        aNumber = -aNumber;
+    }
+    char digits[20];
+    int k;
+    int length = _jsonWriter_grisu2(aNumber, aSinglePrecision, digits, &k);
+    int pointPosition = length + k; // 10^(pointPosition - 1) <= number < 10^pointPosition
+
+    if(k >= 0 && pointPosition <= 21) {
+        // 1234e7 -> 12340000000
+        memcpy(cursor, digits, length);
+        memset(cursor + length, '0', k);
+        cursor += pointPosition;
+    } else if(pointPosition > 0 && pointPosition <= 21) {
+        // 1234e-2 -> 12.34
+        memcpy(cursor, digits, pointPosition);
+        cursor[pointPosition] = '.';
+        memcpy(cursor + pointPosition + 1, digits + pointPosition, length - pointPosition);
+        cursor += length + 1;
+    } else if(pointPosition > -6 && pointPosition <= 0) {
+        // 1234e-6 -> 0.001234
+        *cursor++ = '0';
+        *cursor++ = '.';
+        memset(cursor, '0', -pointPosition);
+        memcpy(cursor - pointPosition, digits, length);
+        cursor += length - pointPosition;
+    } else {
+        // 1234e30 -> 1.234e33
+        *cursor++ = digits[0];
+        if(length > 1) {
+            *cursor++ = '.';
+            memcpy(cursor, digits + 1, length - 1);
+            cursor += length - 1;
+        }
+        *cursor++ = 'e';
+        char buf[24];
+        char *exponent = _jsonWriter_formatInteger(pointPosition - 1, buf + sizeof(buf));
+        memcpy(cursor, exponent, buf + sizeof(buf) - exponent);
+        cursor += buf + sizeof(buf) - exponent;
+    }
+    *cursor = '\0';
+    return (int)(cursor - aoBuf);
+}
+
+static void _jsonWriter_number(JSONWriter_t *aWriter, double aNumber, bool aSinglePrecision)
+{
+    if(!_jsonWriter_beginValue(aWriter))
+        return;
+    if(aWriter->format == kJSONWriterFormat_json) {
+        char buf[32];
+        _jsonWriter_write(aWriter, buf, jsonWriter_formatNumber(aNumber, aSinglePrecision, buf));
+        return;
+    }
+    if(_jsonWriter_isIntegral(aNumber)) {
+        _jsonWriter_cborInteger(aWriter, (long long)aNumber);
+        return;
+    }
+    unsigned char bytes[9];
+    int size;
+    float single = (float)aNumber;
+    // Doubles that are exactly representable as floats are stored in half the space (Which includes inf & nan)
+    if(aSinglePrecision || (double)single == aNumber || isnan(aNumber)) {
+        uint32_t bits;
+        memcpy(&bits, &single, sizeof(bits));
+        bytes[0] = kCBOR_float32;
+        for(int i = 0; i < 4; ++i)
+            bytes[4 - i] = (bits >> (8*i)) & 0xff;
+        size = 5;
+    } else {
+        uint64_t bits;
+        memcpy(&bits, &aNumber, sizeof(bits));
+        bytes[0] = kCBOR_float64;
+        for(int i = 0; i < 8; ++i)
+            bytes[8 - i] = (bits >> (8*i)) & 0xff;
+        size = 9;
+    }
+    _jsonWriter_write(aWriter, bytes, size);
+}
+
+void jsonWriter_number(JSONWriter_t *aWriter, double aNumber)
+{
+    _jsonWriter_number(aWriter, aNumber, false);
+}
+
+void jsonWriter_float(JSONWriter_t *aWriter, float aNumber)
+{
+    _jsonWriter_number(aWriter, aNumber, true);
+}
+
+void jsonWriter_bool(JSONWriter_t *aWriter, bool aValue)
+{
+    if(!_jsonWriter_beginValue(aWriter))
+        return;
+    if(aWriter->format == kJSONWriterFormat_json)
+        _jsonWriter_write(aWriter, aValue ? "true" : "false", aValue ? 4 : 5);
+    else
+        _jsonWriter_putc(aWriter, aValue ? kCBOR_true : kCBOR_false);
+}
+
+void jsonWriter_null(JSONWriter_t *aWriter)
+{
+    if(!_jsonWriter_beginValue(aWriter))
+        return;
+    if(aWriter->format == kJSONWriterFormat_json)
+        _jsonWriter_write(aWriter, "null", 4);
+    else
+        _jsonWriter_putc(aWriter, kCBOR_null);
+}
+
+#pragma mark - Object graphs & documents
+
+typedef struct _JSONWriterApplyContext {
+    JSONWriter_t *writer;
+    bool succeeded;
+} JSONWriterApplyContext_t;
+
+static void _jsonWriter_writeMember(const char *aKey, void *aValue, void *aCtx)
+{
+    JSONWriterApplyContext_t *ctx = aCtx;
+    jsonWriter_key(ctx->writer, aKey);
+    ctx->succeeded &= jsonWriter_obj(ctx->writer, aValue);
+}
+
+bool jsonWriter_obj(JSONWriter_t *aWriter, Obj_t *aObj)
+{
+    if(!aObj)
+        jsonWriter_null(aWriter);
+    else if(obj_isClass(aObj, &Class_Dictionary)) {
+        JSONWriterApplyContext_t ctx = { aWriter, true };
+        jsonWriter_beginObject(aWriter);
+        dict_apply(aObj, &_jsonWriter_writeMember, &ctx);
+        jsonWriter_endObject(aWriter);
+        return ctx.succeeded;
+    } else if(obj_isClass(aObj, &Class_Array)) {
+        Array_t *array = aObj;
+        bool succeeded = true;
+        jsonWriter_beginArray(aWriter);
+        for(int i = 0; i < array->count; ++i)
+            succeeded &= jsonWriter_obj(aWriter, array->items[i]);
+        jsonWriter_endArray(aWriter);
+        return succeeded;
+    } else if(obj_isClass(aObj, &Class_String)) {
+        String_t *str = aObj;
+        jsonWriter_stringWithLength(aWriter, str->cString, str->length);
+    } else if(obj_isClass(aObj, &Class_Number)) {
+        Number_t *num = aObj;
+        _jsonWriter_number(aWriter, num->floatValue, sizeof(GLMFloat) == sizeof(float));
+    } else
+        return false;
+    return true;
+}
+
+void jsonWriter_value(JSONWriter_t *aWriter, const JSONValue_t *aValue)
+{
+    if(!aValue) {
+        jsonWriter_null(aWriter);
+        return;
+    }
+    switch(aValue->type) {
+        case kJSONType_null:
+            jsonWriter_null(aWriter);
+            break;
+        case kJSONType_bool:
+            jsonWriter_bool(aWriter, aValue->boolean);
+            break;
+        case kJSONType_number:
+            jsonWriter_number(aWriter, aValue->number);
+            break;
+        case kJSONType_string:
+            jsonWriter_stringWithLength(aWriter, aValue->string, aValue->length);
+            break;
+        case kJSONType_array:
+            jsonWriter_beginArray(aWriter);
+            for(uint32_t i = 0; i < aValue->length; ++i)
+                jsonWriter_value(aWriter, &aValue->elements[i]);
+            jsonWriter_endArray(aWriter);
+            break;
+        case kJSONType_object:
+            jsonWriter_beginObject(aWriter);
+            for(uint32_t i = 0; i < aValue->length; ++i) {
+                jsonWriter_keyWithLength(aWriter, aValue->members[i].key, aValue->members[i].keyLength);
+                jsonWriter_value(aWriter, &aValue->members[i].value);
+            }
+            jsonWriter_endObject(aWriter);
+            break;
+    }
+}
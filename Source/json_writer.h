@@ -0,0 +1,128 @@
+/*!
+    @header JSON Writer
+    @abstract
+    @discussion Streams JSON (Or its binary equivalent, CBOR) out as it is generated.
+
+    A writer either collects its output in a buffer that grows as needed, or writes it to a file descriptor in fixed size
+    chunks, so arbitrarily large documents can be written without sizing a buffer up front or holding them in memory.
+    Values are written one at a time (jsonWriter_beginObject, jsonWriter_key, jsonWriter_number, ...), or whole object
+    graphs & documents at once.
+
+    Numbers are written in the shortest form that reads back as the same value, & integral values as integers.
+
+    CBOR (RFC 7049) output is smaller & faster to both write & read than text, which suits save games & network
+    payloads. Containers are written with indefinite lengths so that they can be streamed. Non finite numbers,
+    which JSON can not represent (They are written as null), are preserved in CBOR.
+*/
+
+#ifndef _JSONWRITER_H_
+#define _JSONWRITER_H_
+
+#include "object.h"
+#include "json_document.h"
+
+#define kJSONWriterMaxDepth 128
+#define kJSONWriterChunkSize (16*1024)
+
+typedef enum _JSONWriterFormat {
+    kJSONWriterFormat_json,
+    kJSONWriterFormat_cbor
+} JSONWriterFormat_t;
+
+/*!
+    A writer
+
+    @field format The format written
+    @field failed Set if the output could not be written, or if values were written out of place (e.g. a value with no key
+                  inside an object). Subsequent writes are ignored.
+    @field bytesWritten The number of bytes output so far
+*/
+typedef struct _JSONWriter {
+    OBJ_GUTS
+    JSONWriterFormat_t format;
+    bool failed;
+    size_t bytesWritten;
+
+    unsigned char *buffer;
+    size_t length, capacity;
+    int fd; // -1 when writing to the buffer
+    bool ownsFd;
+    char *path, *temporaryPath; // Set when writing to a file
+
+    bool isClosed;
+    bool hasRoot;
+    int depth;
+    unsigned char containers[kJSONWriterMaxDepth]; // The state of each open container
+} JSONWriter_t;
+extern Class_t Class_JSONWriter;
+
+/*!
+    Creates a writer that collects its output in memory. (Retrieved using jsonWriter_getBuffer)
+*/
+extern JSONWriter_t *jsonWriter_create(JSONWriterFormat_t aFormat);
+/*!
+    Creates a writer that writes to an open file descriptor, which is left open.
+*/
+extern JSONWriter_t *jsonWriter_createWithFd(int aFd, JSONWriterFormat_t aFormat);
+/*!
+    Creates a writer that writes to a file. The output goes to a temporary file that only replaces aPath once the writer
+    is closed successfully, so the previous contents survive a failed or interrupted save.
+    Returns NULL if the file can not be created. (Archives are read only, so virtual paths can not be written to)
+*/
+extern JSONWriter_t *jsonWriter_createWithFile(const char *aPath, JSONWriterFormat_t aFormat);
+/*!
+    Flushes the output, & replaces the destination file of writers created with jsonWriter_createWithFile.
+    Returns false if anything failed, or if containers were left open. Nothing can be written once a writer is closed.
+    (Releasing an unclosed file writer discards its output)
+*/
+extern bool jsonWriter_close(JSONWriter_t *aWriter);
+/*!
+    Returns the output of writers created with jsonWriter_create. JSON output is NUL terminated.
+    The buffer belongs to the writer.
+*/
+extern const void *jsonWriter_getBuffer(JSONWriter_t *aWriter, size_t *aoLength);
+
+#pragma mark - Values
+
+extern void jsonWriter_beginObject(JSONWriter_t *aWriter);
+extern void jsonWriter_endObject(JSONWriter_t *aWriter);
+extern void jsonWriter_beginArray(JSONWriter_t *aWriter);
+extern void jsonWriter_endArray(JSONWriter_t *aWriter);
+/*!
+    Writes the key of the next member of the current object.
+*/
+extern void jsonWriter_key(JSONWriter_t *aWriter, const char *aKey);
+extern void jsonWriter_keyWithLength(JSONWriter_t *aWriter, const char *aKey, size_t aLength);
+/*!
+    Writes a UTF-8 string.
+*/
+extern void jsonWriter_string(JSONWriter_t *aWriter, const char *aString);
+extern void jsonWriter_stringWithLength(JSONWriter_t *aWriter, const char *aString, size_t aLength);
+extern void jsonWriter_number(JSONWriter_t *aWriter, double aNumber);
+/*!
+    Writes a single precision number, in the shortest form that reads back as the same float.
+    (e.g. 0.1f is written as 0.1 rather than 0.100000001490116)
+*/
+extern void jsonWriter_float(JSONWriter_t *aWriter, float aNumber);
+extern void jsonWriter_integer(JSONWriter_t *aWriter, long long aInteger);
+extern void jsonWriter_bool(JSONWriter_t *aWriter, bool aValue);
+extern void jsonWriter_null(JSONWriter_t *aWriter);
+/*!
+    Writes an object graph made of dictionaries, arrays, strings & numbers (As returned by parseJSON).
+    Returns false if it contains objects of other classes.
+*/
+extern bool jsonWriter_obj(JSONWriter_t *aWriter, Obj_t *aObj);
+/*!
+    Writes a document value along with its children.
+*/
+extern void jsonWriter_value(JSONWriter_t *aWriter, const JSONValue_t *aValue);
+
+#pragma mark - Number formatting
+
+/*!
+    Formats a number as JSON, in the shortest form that reads back as the same double (Or float if aSinglePrecision is set).
+    Uses Grisu2, which in rare cases gives one digit more than the shortest form.
+    aoBuf must hold at least 32 bytes. Returns the length of the output.
+*/
+extern int jsonWriter_formatNumber(double aNumber, bool aSinglePrecision, char *aoBuf);
+#endif
@@ -0,0 +1,473 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include "ktx_loader.h"
+#include "util.h"
+
+static void ktx_destroy(Ktx_t *self);
+static Class_t Class_Ktx = {
+    "Ktx",
+    sizeof(Ktx_t),
+    (Obj_destructor_t)&ktx_destroy
+};
+
+static const unsigned char kKTX1Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+static const unsigned char kKTX2Identifier[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// ASTC block footprints, in the order of their GL & Vulkan enums
+static const int kASTCBlockSizes[14][2] = {
+    { 4, 4 }, { 5, 4 }, { 5, 5 }, { 6, 5 }, { 6, 6 }, { 8, 5 }, { 8, 6 },
+    { 8, 8 }, { 10, 5 }, { 10, 6 }, { 10, 8 }, { 10, 10 }, { 12, 10 }, { 12, 12 }
+};
+
+#pragma mark - Formats
+
+static bool _ktx_isASTC(unsigned aFormat)
+{
+    return (aFormat >= kKTXFormat_ASTC_RGBA_FIRST && aFormat <= kKTXFormat_ASTC_RGBA_LAST)
+        || (aFormat >= kKTXFormat_ASTC_SRGB8_ALPHA8_FIRST && aFormat <= kKTXFormat_ASTC_SRGB8_ALPHA8_LAST);
+}
+
+// Gets the block footprint & size in bytes of a format, returns false if the format is not supported
+static bool _ktx_getBlockInfo(unsigned aFormat, int *aoBlockWidth, int *aoBlockHeight, int *aoBlockBytes)
+{
+    switch(aFormat) {
+        case kKTXFormat_ETC1_RGB8:
+        case kKTXFormat_ETC2_RGB8:
+        case kKTXFormat_ETC2_SRGB8:
+        case kKTXFormat_ETC2_RGB8_PUNCHTHROUGH_A1:
+        case kKTXFormat_ETC2_SRGB8_PUNCHTHROUGH_A1:
+            *aoBlockWidth = *aoBlockHeight = 4;
+            *aoBlockBytes = 8;
+            return true;
+        case kKTXFormat_ETC2_RGBA8_EAC:
+        case kKTXFormat_ETC2_SRGB8_ALPHA8_EAC:
+            *aoBlockWidth = *aoBlockHeight = 4;
+            *aoBlockBytes = 16;
+            return true;
+        default:
+            if(!_ktx_isASTC(aFormat))
+                return false;
+            int idx = aFormat >= kKTXFormat_ASTC_SRGB8_ALPHA8_FIRST ? aFormat - kKTXFormat_ASTC_SRGB8_ALPHA8_FIRST
+                                                                    : aFormat - kKTXFormat_ASTC_RGBA_FIRST;
+            *aoBlockWidth  = kASTCBlockSizes[idx][0];
+            *aoBlockHeight = kASTCBlockSizes[idx][1];
+            *aoBlockBytes  = 16;
+            return true;
+    }
+}
+
+// Maps a KTX2 VkFormat to the matching GL enum (0 if unsupported)
+static unsigned _ktx_formatForVkFormat(uint32_t aVkFormat)
+{
+    switch(aVkFormat) {
+        case 147: return kKTXFormat_ETC2_RGB8;  // VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK
+        case 148: return kKTXFormat_ETC2_SRGB8;
+        case 149: return kKTXFormat_ETC2_RGB8_PUNCHTHROUGH_A1;
+        case 150: return kKTXFormat_ETC2_SRGB8_PUNCHTHROUGH_A1;
+        case 151: return kKTXFormat_ETC2_RGBA8_EAC;
+        case 152: return kKTXFormat_ETC2_SRGB8_ALPHA8_EAC;
+        default:
+            // VK_FORMAT_ASTC_4x4_UNORM_BLOCK ... VK_FORMAT_ASTC_12x12_SRGB_BLOCK alternate between UNORM & SRGB
+            if(aVkFormat >= 157 && aVkFormat <= 184) {
+                unsigned idx = (aVkFormat - 157) / 2;
+                return ((aVkFormat - 157) % 2) ? kKTXFormat_ASTC_SRGB8_ALPHA8_FIRST + idx : kKTXFormat_ASTC_RGBA_FIRST + idx;
+            }
+            return 0;
+    }
+}
+
+bool ktx_canDecompress(unsigned aFormat)
+{
+    switch(aFormat) {
+        case kKTXFormat_ETC1_RGB8:
+        case kKTXFormat_ETC2_RGB8:
+        case kKTXFormat_ETC2_SRGB8:
+        case kKTXFormat_ETC2_RGBA8_EAC:
+        case kKTXFormat_ETC2_SRGB8_ALPHA8_EAC:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool ktx_formatHasAlpha(unsigned aFormat)
+{
+    return aFormat != kKTXFormat_ETC1_RGB8 && aFormat != kKTXFormat_ETC2_RGB8 && aFormat != kKTXFormat_ETC2_SRGB8;
+}
+
+#pragma mark - Loading
+
+static uint32_t _ktx_read32(const unsigned char *aPtr, bool aSwap)
+{
+    uint32_t value;
+    memcpy(&value, aPtr, 4);
+    if(aSwap)
+        value = ((value & 0xff) << 24) | ((value & 0xff00) << 8) | ((value >> 8) & 0xff00) | (value >> 24);
+    return value;
+}
+
+static uint64_t _ktx_read64(const unsigned char *aPtr)
+{
+    uint64_t value;
+    memcpy(&value, aPtr, 8);
+    return value;
+}
+
+// Fills in the size of every level & validates it against the amount of data present
+static bool _ktx_setLevel(Ktx_t *self, int aLevel, const unsigned char *aData, size_t aSize)
+{
+    int blockWidth, blockHeight, blockBytes;
+    _ktx_getBlockInfo(self->glInternalFormat, &blockWidth, &blockHeight, &blockBytes);
+
+    KTXLevel_t *level = &self->levels[aLevel];
+    level->width  = MAX(1, self->width >> aLevel);
+    level->height = MAX(1, self->height >> aLevel);
+    size_t expected = (size_t)((level->width + blockWidth - 1)/blockWidth) * ((level->height + blockHeight - 1)/blockHeight) * blockBytes;
+    if(aSize < expected)
+        return false;
+    level->data = aData;
+    level->size = expected;
+    return true;
+}
+
+// Reads the vertical component of the KTXorientation metadata ("S=r,T=d" in KTX1 files, "rd" in KTX2 files) out of the
+// key/value pairs, each stored as its size followed by a null terminated key & the value, padded to 4 bytes
+static void _ktx_readOrientation(Ktx_t *self, const unsigned char *aData, size_t aLength, bool aSwap, bool aIsKTX2)
+{
+    const char kKey[] = "KTXorientation";
+    size_t offset = 0;
+    while(offset + 4 <= aLength) {
+        size_t size = _ktx_read32(aData + offset, aSwap);
+        offset += 4;
+        if(size > aLength - offset)
+            return;
+        const char *pair = (const char *)aData + offset;
+        offset += (size + 3) & ~(size_t)3;
+        if(size <= sizeof(kKey) || memcmp(pair, kKey, sizeof(kKey)) != 0)
+            continue;
+        const char *value = pair + sizeof(kKey);
+        size_t valueLength = strnlen(value, size - sizeof(kKey));
+        // KTX2 gives the vertical direction second, KTX1 after "T="
+        for(size_t i = 0; i < valueLength; ++i) {
+            bool isVertical = aIsKTX2 ? i == 1 : (i >= 2 && value[i - 2] == 'T' && value[i - 1] == '=');
+            if(isVertical) {
+                self->isTopDown = value[i] == 'd';
+                break;
+            }
+        }
+        return;
+    }
+}
+
+static bool _ktx_parseKTX1(Ktx_t *self, const unsigned char *aData, size_t aLength)
+{
+    if(aLength < 64)
+        return false;
+    uint32_t endianness = _ktx_read32(aData + 12, false);
+    bool swap = endianness == 0x01020304;
+    if(!swap && endianness != 0x04030201)
+        return false;
+
+    uint32_t header[12];
+    for(int i = 0; i < 12; ++i)
+        header[i] = _ktx_read32(aData + 16 + i*4, swap);
+    uint32_t glType = header[0], glInternalFormat = header[3];
+    uint32_t depth = header[7], arrayElements = header[8], faces = header[9], levels = header[10], keyValueBytes = header[11];
+    if(glType != 0 || depth > 1 || arrayElements > 0 || faces != 1) {
+        dynamo_log("Only compressed 2D KTX textures are supported");
+        return false;
+    }
+
+    int blockWidth, blockHeight, blockBytes;
+    if(!_ktx_getBlockInfo(glInternalFormat, &blockWidth, &blockHeight, &blockBytes)) {
+        dynamo_log("Unsupported KTX format 0x%x", glInternalFormat);
+        return false;
+    }
+    self->glInternalFormat = glInternalFormat;
+    self->width  = header[5];
+    self->height = MAX(1, header[6]);
+    self->numberOfLevels = MAX(1, levels);
+    self->levels = calloc(self->numberOfLevels, sizeof(KTXLevel_t));
+
+    if(keyValueBytes > aLength - 64)
+        return false;
+    _ktx_readOrientation(self, aData + 64, keyValueBytes, swap, false);
+
+    size_t offset = 64 + (size_t)keyValueBytes;
+    for(int i = 0; i < self->numberOfLevels; ++i) {
+        if(offset + 4 > aLength)
+            return false;
+        size_t imageSize = _ktx_read32(aData + offset, swap);
+        offset += 4;
+        if(offset + imageSize > aLength || !_ktx_setLevel(self, i, aData + offset, imageSize))
+            return false;
+        offset += (imageSize + 3) & ~(size_t)3; // Mip padding
+    }
+    return true;
+}
+
+static bool _ktx_parseKTX2(Ktx_t *self, const unsigned char *aData, size_t aLength)
+{
+    if(aLength < 80)
+        return false;
+    uint32_t header[9];
+    for(int i = 0; i < 9; ++i)
+        header[i] = _ktx_read32(aData + 12 + i*4, false);
+    uint32_t vkFormat = header[0], depth = header[4], layers = header[5], faces = header[6], levels = header[7];
+    if(header[8] != 0) {
+        dynamo_log("Supercompressed KTX2 textures are not supported");
+        return false;
+    }
+    if(depth > 1 || layers > 1 || faces != 1) {
+        dynamo_log("Only 2D KTX textures are supported");
+        return false;
+    }
+    self->glInternalFormat = _ktx_formatForVkFormat(vkFormat);
+    if(!self->glInternalFormat) {
+        dynamo_log("Unsupported KTX2 format %u", vkFormat);
+        return false;
+    }
+    self->width  = header[2];
+    self->height = MAX(1, header[3]);
+    self->numberOfLevels = MAX(1, levels);
+    self->levels = calloc(self->numberOfLevels, sizeof(KTXLevel_t));
+
+    if(80 + (size_t)self->numberOfLevels*24 > aLength)
+        return false;
+    uint32_t keyValueOffset = _ktx_read32(aData + 56, false), keyValueBytes = _ktx_read32(aData + 60, false);
+    if((uint64_t)keyValueOffset + keyValueBytes > aLength)
+        return false;
+    _ktx_readOrientation(self, aData + keyValueOffset, keyValueBytes, false, true);
+    for(int i = 0; i < self->numberOfLevels; ++i) {
+        uint64_t offset = _ktx_read64(aData + 80 + i*24);
+        uint64_t size   = _ktx_read64(aData + 80 + i*24 + 8);
+        if(offset + size > aLength || !_ktx_setLevel(self, i, aData + offset, size))
+            return false;
+    }
+    return true;
+}
+
+Ktx_t *ktx_load(const char *aPath)
+{
+    // The levels are uploaded straight out of the mapping
+    MappedFile_t file;
+    if(!util_mapFile(aPath, kMappedFileAccess_prefetch, &file))
+        return NULL;
+
+    Ktx_t *self = obj_create_autoreleased(&Class_Ktx);
+    self->file = file;
+    const unsigned char *bytes = file.data;
+    size_t length = file.length;
+    bool success = false;
+    if(length >= 12 && memcmp(bytes, kKTX1Identifier, 12) == 0)
+        success = _ktx_parseKTX1(self, bytes, length);
+    else if(length >= 12 && memcmp(bytes, kKTX2Identifier, 12) == 0)
+        success = _ktx_parseKTX2(self, bytes, length);
+    if(!success || self->width <= 0) {
+        dynamo_log("Invalid KTX file %s", aPath);
+        return NULL;
+    }
+    return self;
+}
+
+void ktx_destroy(Ktx_t *self)
+{
+    free(self->levels);
+    util_unmapFile(&self->file);
+}
+
+#pragma mark - Software decompression
+// Reference ETC1/ETC2/EAC decoder used when the GPU lacks support for a format (Also handy for validating files offline)
+
+static const int kETCModifierTables[8][4] = {
+    {  2,   8,  -2,   -8 }, {  5,  17,  -5,  -17 }, {  9,  29,  -9,  -29 }, { 13,  42, -13,  -42 },
+    { 18,  60, -18,  -60 }, { 24,  80, -24,  -80 }, { 33, 106, -33, -106 }, { 47, 183, -47, -183 }
+};
+static const int kETC2Distances[8] = { 3, 6, 11, 16, 23, 32, 41, 64 };
+static const int kEACModifierTables[16][8] = {
+    { -3, -6,  -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 },
+    { -2, -5,  -8, -13, 1, 4, 7, 12 }, { -2, -4,  -6, -13, 1, 3, 5, 12 },
+    { -3, -6,  -8, -12, 2, 5, 7, 11 }, { -3, -7,  -9, -11, 2, 6, 8, 10 },
+    { -4, -7,  -8, -11, 3, 6, 7, 10 }, { -3, -5,  -8, -11, 2, 4, 7, 10 },
+    { -2, -6,  -8, -10, 1, 5, 7,  9 }, { -2, -5,  -8, -10, 1, 4, 7,  9 },
+    { -2, -4,  -8, -10, 1, 3, 7,  9 }, { -2, -5,  -7, -10, 1, 4, 6,  9 },
+    { -3, -4,  -7, -10, 2, 3, 6,  9 }, { -1, -2,  -3, -10, 0, 1, 2,  9 },
+    { -4, -6,  -8,  -9, 3, 5, 7,  8 }, { -3, -5,  -7,  -9, 2, 4, 6,  8 }
+};
+
+static inline int _ktx_clampByte(int aValue)
+{
+    return aValue < 0 ? 0 : (aValue > 255 ? 255 : aValue);
+}
+
+// Expands a color component of aBits bits to 8 bits
+static inline int _ktx_extend(int aValue, int aBits)
+{
+    return (aValue << (8 - aBits)) | (aValue >> (2*aBits - 8));
+}
+
+// Sign extends the low 3 bits of a byte
+static inline int _ktx_signExtend3(int aValue)
+{
+    aValue &= 0x7;
+    return aValue >= 4 ? aValue - 8 : aValue;
+}
+
+// Decodes the RGB channels of an ETC1 or ETC2 color block into a 4x4 RGBA block (Indexed [y*4 + x])
+static void _ktx_decodeColorBlock(const unsigned char *aSrc, bool aIsETC2, unsigned char aoPixels[16][4])
+{
+    uint32_t indices = ((uint32_t)aSrc[4] << 24) | ((uint32_t)aSrc[5] << 16) | ((uint32_t)aSrc[6] << 8) | aSrc[7];
+    int base[2][3];
+    int paint[4][3];
+    bool usePaintColors = false;
+
+    if(aSrc[3] & 0x2) {
+        // Differential mode, whose overflows select the ETC2 modes
+        int r = aSrc[0] >> 3, g = aSrc[1] >> 3, b = aSrc[2] >> 3;
+        int r2 = r + _ktx_signExtend3(aSrc[0]), g2 = g + _ktx_signExtend3(aSrc[1]), b2 = b + _ktx_signExtend3(aSrc[2]);
+
+        if(aIsETC2 && (r2 < 0 || r2 > 31)) {
+            // T mode
+            int c0[3] = { _ktx_extend(((aSrc[0] >> 1) & 0xc) | (aSrc[0] & 0x3), 4), _ktx_extend(aSrc[1] >> 4, 4), _ktx_extend(aSrc[1] & 0xf, 4) };
+            int c1[3] = { _ktx_extend(aSrc[2] >> 4, 4), _ktx_extend(aSrc[2] & 0xf, 4), _ktx_extend(aSrc[3] >> 4, 4) };
+            int distance = kETC2Distances[(((aSrc[3] >> 2) & 0x3) << 1) | (aSrc[3] & 0x1)];
+            for(int c = 0; c < 3; ++c) {
+                paint[0][c] = c0[c];
+                paint[1][c] = _ktx_clampByte(c1[c] + distance);
+                paint[2][c] = c1[c];
+                paint[3][c] = _ktx_clampByte(c1[c] - distance);
+            }
+            usePaintColors = true;
+        } else if(aIsETC2 && (g2 < 0 || g2 > 31)) {
+            // H mode
+            int c0[3] = {
+                _ktx_extend((aSrc[0] >> 3) & 0xf, 4),
+                _ktx_extend(((aSrc[0] & 0x7) << 1) | ((aSrc[1] >> 4) & 0x1), 4),
+                _ktx_extend((aSrc[1] & 0x8) | ((aSrc[1] & 0x3) << 1) | ((aSrc[2] >> 7) & 0x1), 4)
+            };
+            int c1[3] = {
+                _ktx_extend((aSrc[2] >> 3) & 0xf, 4),
+                _ktx_extend(((aSrc[2] & 0x7) << 1) | ((aSrc[3] >> 7) & 0x1), 4),
+                _ktx_extend((aSrc[3] >> 3) & 0xf, 4)
+            };
+            int value0 = (c0[0] << 16) | (c0[1] << 8) | c0[2];
+            int value1 = (c1[0] << 16) | (c1[1] << 8) | c1[2];
+            int distance = kETC2Distances[(aSrc[3] & 0x4) | ((aSrc[3] & 0x1) << 1) | (value0 >= value1)];
+            for(int c = 0; c < 3; ++c) {
+                paint[0][c] = _ktx_clampByte(c0[c] + distance);
+                paint[1][c] = _ktx_clampByte(c0[c] - distance);
+                paint[2][c] = _ktx_clampByte(c1[c] + distance);
+                paint[3][c] = _ktx_clampByte(c1[c] - distance);
+            }
+            usePaintColors = true;
+        } else if(aIsETC2 && (b2 < 0 || b2 > 31)) {
+            // Planar mode: the colors are interpolated between an origin, horizontal & vertical color
+            int o[3] = {
+                _ktx_extend((aSrc[0] >> 1) & 0x3f, 6),
+                _ktx_extend(((aSrc[0] & 0x1) << 6) | ((aSrc[1] >> 1) & 0x3f), 7),
+                _ktx_extend(((aSrc[1] & 0x1) << 5) | (aSrc[2] & 0x18) | ((aSrc[2] << 1) & 0x6) | ((aSrc[3] >> 7) & 0x1), 6)
+            };
+            int h[3] = {
+                _ktx_extend(((aSrc[3] >> 1) & 0x3e) | (aSrc[3] & 0x1), 6),
+                _ktx_extend((aSrc[4] >> 1) & 0x7f, 7),
+                _ktx_extend(((aSrc[4] & 0x1) << 5) | ((aSrc[5] >> 3) & 0x1f), 6)
+            };
+            int v[3] = {
+                _ktx_extend(((aSrc[5] & 0x7) << 3) | ((aSrc[6] >> 5) & 0x7), 6),
+                _ktx_extend(((aSrc[6] & 0x1f) << 2) | ((aSrc[7] >> 6) & 0x3), 7),
+                _ktx_extend(aSrc[7] & 0x3f, 6)
+            };
+            for(int y = 0; y < 4; ++y) {
+                for(int x = 0; x < 4; ++x) {
+                    for(int c = 0; c < 3; ++c)
+                        aoPixels[y*4 + x][c] = _ktx_clampByte((x*(h[c] - o[c]) + y*(v[c] - o[c]) + 4*o[c] + 2) >> 2);
+                }
+            }
+            return;
+        } else {
+            base[0][0] = _ktx_extend(r, 5);  base[0][1] = _ktx_extend(g, 5);  base[0][2] = _ktx_extend(b, 5);
+            base[1][0] = _ktx_extend(r2 & 0x1f, 5); base[1][1] = _ktx_extend(g2 & 0x1f, 5); base[1][2] = _ktx_extend(b2 & 0x1f, 5);
+        }
+    } else {
+        // Individual mode
+        for(int c = 0; c < 3; ++c) {
+            base[0][c] = _ktx_extend(aSrc[c] >> 4, 4);
+            base[1][c] = _ktx_extend(aSrc[c] & 0xf, 4);
+        }
+    }
+
+    const int *tables[2] = { kETCModifierTables[(aSrc[3] >> 5) & 0x7], kETCModifierTables[(aSrc[3] >> 2) & 0x7] };
+    bool flipped = aSrc[3] & 0x1;
+    for(int y = 0; y < 4; ++y) {
+        for(int x = 0; x < 4; ++x) {
+            // Pixel indices are stored column by column
+            int bit = y + x*4;
+            int idx = ((indices >> (15 + bit)) & 0x2) | ((indices >> bit) & 0x1);
+            for(int c = 0; c < 3; ++c) {
+                if(usePaintColors)
+                    aoPixels[y*4 + x][c] = paint[idx][c];
+                else {
+                    int subblock = flipped ? (y >= 2) : (x >= 2);
+                    aoPixels[y*4 + x][c] = _ktx_clampByte(base[subblock][c] + tables[subblock][idx]);
+                }
+            }
+        }
+    }
+}
+
+// Decodes an EAC alpha block into the alpha channel of a 4x4 RGBA block
+static void _ktx_decodeAlphaBlock(const unsigned char *aSrc, unsigned char aoPixels[16][4])
+{
+    int base = aSrc[0];
+    int multiplier = aSrc[1] >> 4;
+    const int *table = kEACModifierTables[aSrc[1] & 0xf];
+    uint64_t indices = 0;
+    for(int i = 2; i < 8; ++i)
+        indices = (indices << 8) | aSrc[i];
+
+    for(int y = 0; y < 4; ++y) {
+        for(int x = 0; x < 4; ++x) {
+            int idx = (indices >> (((3 - y) + (3 - x)*4) * 3)) & 0x7;
+            aoPixels[y*4 + x][3] = _ktx_clampByte(base + table[idx]*multiplier);
+        }
+    }
+}
+
+unsigned char *ktx_decompressLevel(Ktx_t *aKtx, int aLevel)
+{
+    dynamo_assert(aLevel >= 0 && aLevel < aKtx->numberOfLevels, "Invalid mipmap level");
+    unsigned format = aKtx->glInternalFormat;
+    if(!ktx_canDecompress(format))
+        return NULL;
+
+    KTXLevel_t *level = &aKtx->levels[aLevel];
+    bool hasAlpha = ktx_formatHasAlpha(format);
+    int channels = hasAlpha ? 4 : 3;
+    int blockBytes = hasAlpha ? 16 : 8;
+    int blocksWide = (level->width + 3)/4, blocksHigh = (level->height + 3)/4;
+    unsigned char *out = malloc((size_t)level->width * level->height * channels);
+
+    const unsigned char *src = level->data;
+    unsigned char block[16][4];
+    for(int by = 0; by < blocksHigh; ++by) {
+        for(int bx = 0; bx < blocksWide; ++bx, src += blockBytes) {
+            memset(block, 0xff, sizeof(block));
+            if(hasAlpha) {
+                _ktx_decodeAlphaBlock(src, block);
+                _ktx_decodeColorBlock(src + 8, true, block);
+            } else
+                _ktx_decodeColorBlock(src, format != kKTXFormat_ETC1_RGB8, block);
+
+            // Copy the block, clipping it at the image edges
+            for(int y = 0; y < 4 && by*4 + y < level->height; ++y) {
+                for(int x = 0; x < 4 && bx*4 + x < level->width; ++x) {
+                    unsigned char *dst = out + ((size_t)(by*4 + y)*level->width + bx*4 + x)*channels;
+                    memcpy(dst, block[y*4 + x], channels);
+                }
+            }
+        }
+    }
+    return out;
+}
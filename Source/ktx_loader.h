@@ -0,0 +1,79 @@
+/*!
+    @header KTX Loader
+    @abstract
+    @discussion Provides loading of GPU compressed images stored in KTX (Version 1 & 2) containers.
+
+    ETC1, ETC2 & ASTC (LDR) images are supported, along with their prebuilt mipmap levels. Supercompressed KTX2 files
+    (BasisLZ/zstd) are not. Like PNGs, images are expected with their first row at the bottom, so they should be
+    created with a lower left origin (e.g. toktx --lower_left_maps_to_s0t0). The KTXorientation metadata is read, &
+    images stored top row first are flipped when they are decompressed in software, but compressed blocks can not be
+    flipped, so those are uploaded as they are (upside down) with a warning. Files without the metadata are taken to
+    have a lower left origin.
+*/
+
+#ifndef _KTXLOADER_H_
+#define _KTXLOADER_H_
+#include "object.h"
+#include "util.h"
+#include <stddef.h>
+
+// OpenGL enums of the compressed formats (Not all GL headers define them)
+#define kKTXFormat_ETC1_RGB8                    0x8D64 // GL_ETC1_RGB8_OES
+#define kKTXFormat_ETC2_RGB8                    0x9274 // GL_COMPRESSED_RGB8_ETC2
+#define kKTXFormat_ETC2_SRGB8                   0x9275
+#define kKTXFormat_ETC2_RGB8_PUNCHTHROUGH_A1    0x9276
+#define kKTXFormat_ETC2_SRGB8_PUNCHTHROUGH_A1   0x9277
+#define kKTXFormat_ETC2_RGBA8_EAC               0x9278 // GL_COMPRESSED_RGBA8_ETC2_EAC
+#define kKTXFormat_ETC2_SRGB8_ALPHA8_EAC        0x9279
+#define kKTXFormat_ASTC_RGBA_FIRST              0x93B0 // GL_COMPRESSED_RGBA_ASTC_4x4_KHR
+#define kKTXFormat_ASTC_RGBA_LAST               0x93BD // GL_COMPRESSED_RGBA_ASTC_12x12_KHR
+#define kKTXFormat_ASTC_SRGB8_ALPHA8_FIRST      0x93D0
+#define kKTXFormat_ASTC_SRGB8_ALPHA8_LAST       0x93DD
+
+/*!
+    A mipmap level of a KTX image
+
+    @field data The compressed blocks (Points into the file data)
+*/
+typedef struct _KTXLevel {
+    int width, height;
+    const unsigned char *data;
+    size_t size;
+} KTXLevel_t;
+
+/*!
+    Representation of a KTX image.
+
+    @field glInternalFormat The OpenGL enum of the compressed format (One of kKTXFormat_*)
+    @field levels The mipmap levels, largest first
+    @field isTopDown True if the KTXorientation metadata says the first row is the top one
+*/
+typedef struct {
+    OBJ_GUTS
+    unsigned glInternalFormat;
+    int width;
+    int height;
+    int numberOfLevels;
+    KTXLevel_t *levels;
+    bool isTopDown;
+    MappedFile_t file; // The levels point into the file
+} Ktx_t;
+
+/*!
+    Loads a KTX image from the given path
+*/
+extern Ktx_t *ktx_load(const char *aPath);
+/*!
+    Returns true if aFormat is an ETC format, that can be decompressed in software when the GPU does not support it.
+*/
+extern bool ktx_canDecompress(unsigned aFormat);
+/*!
+    Returns true if aFormat has an alpha channel.
+*/
+extern bool ktx_formatHasAlpha(unsigned aFormat);
+/*!
+    Decompresses a mipmap level into 8 bit per channel RGB(A) pixels. (RGBA if the format has alpha, RGB otherwise)
+    You are responsible for freeing the output. Returns NULL if the format can not be decompressed.
+*/
+extern unsigned char *ktx_decompressLevel(Ktx_t *aKtx, int aLevel);
+#endif
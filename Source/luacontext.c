@@ -1,5 +1,7 @@
 #include "luacontext.h"
 #include "util.h"
+#include "texture_cache.h"
+#include "texture_loader.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -9,6 +11,7 @@ LuaContext_t *GlobalLuaContext = NULL;
 
 int luaApi_dynamo_registerCallback(lua_State *aState);
 int luaApi_dynamo_unregisterCallback(lua_State *aState);
+static int _luaCtx_moduleLoader(lua_State *aState);
 
 
 Class_t Class_LuaContext = {
@@ -26,6 +29,10 @@ void luaCtx_init()
 void luaCtx_teardown()
 {
     if(GlobalLuaContext) {
+        // Drop the loads & pins the scripts left behind, so that their textures do not outlive the context
+        // (It is rebooted on Android once the GL context, along with the textures' names, has been lost)
+        texLoader_cancelAll();
+        texCache_unpinAll();
         obj_release(GlobalLuaContext);
         GlobalLuaContext = NULL;
     }
@@ -45,6 +52,13 @@ LuaContext_t *luaCtx_createContext()
     lua_setglobal(out->luaState, "dynamo_registerCallback");
     lua_pushcfunction(out->luaState, &luaApi_dynamo_unregisterCallback);
     lua_setglobal(out->luaState, "dynamo_unregisterCallback");
+
+    // Replace Lua's package.path searcher, so that modules are parsed straight out of mapped files & can be found in mounted archives
+    lua_getglobal(out->luaState, "package");
+        lua_getfield(out->luaState, -1, "loaders");
+        lua_pushcfunction(out->luaState, &_luaCtx_moduleLoader);
+        lua_rawseti(out->luaState, -2, 2);
+    lua_pop(out->luaState, 2);
     
     char buf[1024];
     dynamo_assert(util_pathForResource(NULL, NULL, "DynamoScripts", buf, 1024), "Couldn't find dynamo scripts");
@@ -99,10 +113,74 @@ bool luaCtx_pcall(LuaContext_t *aCtx, int nargs, int nresults, int errfunc)
     return true;
 }   
 
+// Loads a script into a function at the top of the stack, parsing it straight out of the mapped file
+// Returns LUA_ERRFILE if the file could not be read
+static int _luaCtx_loadFile(lua_State *aState, const char *aPath)
+{
+    MappedFile_t script;
+    if(!util_mapFile(aPath, kMappedFileAccess_sequential, &script)) {
+        lua_pushfstring(aState, "cannot open %s", aPath);
+        return LUA_ERRFILE;
+    }
+    // Skip a leading #! line like luaL_loadfile does (Keeping the newline so line numbers stay the same)
+    const char *source = script.data;
+    size_t length = script.length;
+    if(length > 0 && source[0] == '#') {
+        const char *lineEnd = memchr(source, '\n', length);
+        size_t skipped = lineEnd ? (size_t)(lineEnd - source) : length;
+        source += skipped;
+        length -= skipped;
+    }
+    lua_pushfstring(aState, "@%s", aPath);
+    int err = luaL_loadbuffer(aState, source, length, lua_tostring(aState, -1));
+    lua_remove(aState, -2); // The chunk name
+    util_unmapFile(&script);
+    return err;
+}
+
+// A package.loaders function that searches package.path, like Lua's own but loading through _luaCtx_loadFile
+static int _luaCtx_moduleLoader(lua_State *aState)
+{
+    const char *moduleName = luaL_checkstring(aState, 1);
+    moduleName = luaL_gsub(aState, moduleName, ".", "/");
+    lua_getglobal(aState, "package");
+    lua_getfield(aState, -1, "path");
+    const char *templates = lua_tostring(aState, -1);
+    if(!templates)
+        return luaL_error(aState, "'package.path' must be a string");
+
+    luaL_Buffer errors;
+    luaL_buffinit(aState, &errors);
+    while(*templates) {
+        size_t length = strcspn(templates, ";");
+        if(length > 0) {
+            lua_pushlstring(aState, templates, length);
+            const char *path = luaL_gsub(aState, lua_tostring(aState, -1), "?", moduleName);
+            int err = _luaCtx_loadFile(aState, path);
+            if(err == 0)
+                return 1;
+            if(err != LUA_ERRFILE)
+                return luaL_error(aState, "error loading module '%s' from file '%s':\n\t%s",
+                                  lua_tostring(aState, 1), path, lua_tostring(aState, -1));
+            lua_pop(aState, 1); // The error message
+            lua_pushfstring(aState, "\n\tno file '%s'", path);
+            lua_remove(aState, -2); // The path
+            lua_remove(aState, -2); // The template
+            // The buffer expects its own values at the top of the stack
+            luaL_addvalue(&errors);
+        }
+        templates += length;
+        if(*templates == ';')
+            ++templates;
+    }
+    luaL_pushresult(&errors);
+    return 1;
+}
+
 bool luaCtx_executeFile(LuaContext_t *aCtx, const char *aPath)
 {
     int err = 0;
-    err = luaL_loadfile(aCtx->luaState, aPath);
+    err = _luaCtx_loadFile(aCtx->luaState, aPath);
     
     if(err) {
         dynamo_log("Lua error: %s", (char*)lua_tostring(aCtx->luaState, -1));
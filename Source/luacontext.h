@@ -63,7 +63,7 @@ extern void luaCtx_setfield(LuaContext_t *aCtx, int idx, const char *k);
 */
 extern bool luaCtx_pcall(LuaContext_t *aCtx, int nargs, int nrseults, int errfunc);
 /*!
-    Loads and executes the file at the given path.
+    Loads and executes the file at the given path. (Either a filesystem or a virtual path)
 */
 extern bool luaCtx_executeFile(LuaContext_t *aCtx, const char *aPath);
 /*!
@@ -71,7 +71,7 @@ extern bool luaCtx_executeFile(LuaContext_t *aCtx, const char *aPath);
 */
 extern bool luaCtx_executeString(LuaContext_t *aCtx, const char *aScript);
 /*!
-    Adds a path to the global lua search path (Used by require()).
+    Adds a path to the global lua search path (Used by require()). Virtual paths are searched in the mounted archives.
 */
 extern bool luaCtx_addSearchPath(LuaContext_t *aCtx, const char *aPath);
 /*!
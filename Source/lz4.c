@@ -0,0 +1,164 @@
+#include "lz4.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Every match is at least 4 bytes long
+#define kLZ4MinMatch 4
+// The format requires the last 5 bytes to be literals, and the last match to start 12 bytes before the end at the latest
+#define kLZ4LastLiterals 5
+#define kLZ4MatchLimit 12
+#define kLZ4MaxOffset 65535
+#define kLZ4HashBits 16
+
+#pragma mark - Compression
+
+size_t lz4_compressBound(size_t aLength)
+{
+    return aLength + aLength/255 + 16;
+}
+
+static inline uint32_t _lz4_read32(const unsigned char *aPtr)
+{
+    uint32_t value;
+    memcpy(&value, aPtr, 4);
+    return value;
+}
+
+static inline uint32_t _lz4_hash(uint32_t aSequence)
+{
+    return (aSequence * 2654435761U) >> (32 - kLZ4HashBits);
+}
+
+// Lengths of 15 & up are stored as 15 in the token, followed by the remainder
+static inline unsigned char _lz4_nibble(size_t aLength)
+{
+    return aLength < 15 ? (unsigned char)aLength : 15;
+}
+
+// Writes a length that did not fit in a token nibble as a run of 255s & a remainder
+static inline unsigned char *_lz4_writeLength(unsigned char *aoDst, size_t aLength)
+{
+    for(; aLength >= 255; aLength -= 255)
+        *aoDst++ = 255;
+    *aoDst++ = (unsigned char)aLength;
+    return aoDst;
+}
+
+static unsigned char *_lz4_writeSequence(unsigned char *aoDst, const unsigned char *aLiterals, size_t aLiteralLength,
+                                         size_t aOffset, size_t aMatchLength)
+{
+    unsigned char *token = aoDst++;
+    *token = (unsigned char)(_lz4_nibble(aLiteralLength) << 4);
+    if(aLiteralLength >= 15)
+        aoDst = _lz4_writeLength(aoDst, aLiteralLength - 15);
+    memcpy(aoDst, aLiterals, aLiteralLength);
+    aoDst += aLiteralLength;
+    if(aMatchLength == 0) // The last sequence has no match
+        return aoDst;
+
+    *aoDst++ = aOffset & 0xff;
+    *aoDst++ = aOffset >> 8;
+    size_t matchCode = aMatchLength - kLZ4MinMatch;
+    *token |= _lz4_nibble(matchCode);
+    if(matchCode >= 15)
+        aoDst = _lz4_writeLength(aoDst, matchCode - 15);
+    return aoDst;
+}
+
+size_t lz4_compress(const void *aSrc, size_t aLength, void *aoDst)
+{
+    const unsigned char *src = aSrc;
+    unsigned char *dst = aoDst;
+    const unsigned char *anchor = src; // Start of the pending literals
+    if(aLength <= kLZ4MatchLimit)
+        return _lz4_writeSequence(dst, anchor, aLength, 0, 0) - (unsigned char *)aoDst;
+
+    // Positions (+1, so 0 means empty) of the last occurrence of each hashed 4 byte sequence
+    uint32_t *table = calloc(1 << kLZ4HashBits, sizeof(uint32_t));
+    if(!table)
+        return 0;
+    const unsigned char *matchLimit = src + aLength - kLZ4MatchLimit;
+    const unsigned char *end = src + aLength;
+    const unsigned char *cursor = src;
+    while(cursor < matchLimit) {
+        uint32_t sequence = _lz4_read32(cursor);
+        uint32_t hash = _lz4_hash(sequence);
+        size_t candidatePos = table[hash];
+        table[hash] = (uint32_t)(cursor - src) + 1;
+
+        const unsigned char *candidate = candidatePos ? src + candidatePos - 1 : NULL;
+        if(!candidate || cursor - candidate > kLZ4MaxOffset || _lz4_read32(candidate) != sequence) {
+            ++cursor;
+            continue;
+        }
+        // Extend the match as far as the format allows
+        const unsigned char *matchEnd = cursor + kLZ4MinMatch;
+        const unsigned char *candidateEnd = candidate + kLZ4MinMatch;
+        while(matchEnd < end - kLZ4LastLiterals && *matchEnd == *candidateEnd) {
+            ++matchEnd;
+            ++candidateEnd;
+        }
+        dst = _lz4_writeSequence(dst, anchor, cursor - anchor, cursor - candidate, matchEnd - cursor);
+        cursor = anchor = matchEnd;
+    }
+    dst = _lz4_writeSequence(dst, anchor, end - anchor, 0, 0);
+    free(table);
+    return dst - (unsigned char *)aoDst;
+}
+
+#pragma mark - Decompression
+
+// Reads the remainder of a length whose token nibble was 15
+static inline bool _lz4_readLength(const unsigned char **aioSrc, const unsigned char *aSrcEnd, size_t *aioLength)
+{
+    unsigned char byte;
+    do {
+        if(*aioSrc >= aSrcEnd)
+            return false;
+        byte = *(*aioSrc)++;
+        *aioLength += byte;
+    } while(byte == 255);
+    return true;
+}
+
+bool lz4_decompress(const void *aSrc, size_t aSrcLength, void *aoDst, size_t aDstLength)
+{
+    const unsigned char *src = aSrc, *srcEnd = src + aSrcLength;
+    unsigned char *dst = aoDst, *dstEnd = dst + aDstLength;
+
+    while(src < srcEnd) {
+        unsigned char token = *src++;
+        size_t literalLength = token >> 4;
+        if(literalLength == 15 && !_lz4_readLength(&src, srcEnd, &literalLength))
+            return false;
+        if(literalLength > (size_t)(srcEnd - src) || literalLength > (size_t)(dstEnd - dst))
+            return false;
+        memcpy(dst, src, literalLength);
+        src += literalLength;
+        dst += literalLength;
+        if(src == srcEnd) // The last sequence ends after its literals
+            break;
+
+        if(srcEnd - src < 2)
+            return false;
+        size_t offset = src[0] | (src[1] << 8);
+        src += 2;
+        size_t matchLength = token & 0xf;
+        if(matchLength == 15 && !_lz4_readLength(&src, srcEnd, &matchLength))
+            return false;
+        matchLength += kLZ4MinMatch;
+        if(offset == 0 || offset > (size_t)(dst - (unsigned char *)aoDst) || matchLength > (size_t)(dstEnd - dst))
+            return false;
+        const unsigned char *match = dst - offset;
+        if(offset >= matchLength) {
+            memcpy(dst, match, matchLength);
+            dst += matchLength;
+        } else {
+            // The match overlaps the bytes it produces (A repeating pattern), so copy forward one byte at a time
+            for(size_t i = 0; i < matchLength; ++i)
+                *dst++ = *match++;
+        }
+    }
+    return dst == dstEnd;
+}
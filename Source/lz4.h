@@ -0,0 +1,31 @@
+/*!
+    @header LZ4
+    @abstract
+    @discussion Compression & decompression of raw LZ4 blocks. (The block format only, without the frame format's headers & checksums)
+
+    Decompression is fast enough to be done at load time, for data such as scripts & maps that compress well.
+    The compressor is a simple greedy one, intended for offline tools.
+    Has no dependencies on the rest of the engine so that tools can be built from it alone.
+*/
+
+#ifndef _LZ4_H_
+#define _LZ4_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*!
+    Returns the largest size that compressing aLength bytes can produce.
+*/
+extern size_t lz4_compressBound(size_t aLength);
+/*!
+    Compresses aLength bytes into aoDst, which must hold at least lz4_compressBound(aLength) bytes.
+    Returns the compressed size, or 0 on failure.
+*/
+extern size_t lz4_compress(const void *aSrc, size_t aLength, void *aoDst);
+/*!
+    Decompresses a block into aoDst, which must hold the original size of the data.
+    Returns false if the block is corrupt or does not decompress to exactly aDstLength bytes.
+*/
+extern bool lz4_decompress(const void *aSrc, size_t aSrcLength, void *aoDst, size_t aDstLength);
+#endif
@@ -0,0 +1,344 @@
+#include "map_streamer.h"
+#include "gametimer.h"
+#include "util.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+static void mapStreamer_destroy(MapStreamer_t *aStreamer);
+static void _mapStreamer_draw(Renderer_t *aRenderer, MapStreamer_t *aStreamer, GLMFloat aTimeSinceLastFrame, GLMFloat aInterpolation);
+static void *_mapStreamer_worker(MapStreamer_t *aStreamer);
+
+Class_t Class_MapStreamer = {
+    "MapStreamer",
+    sizeof(MapStreamer_t),
+    (Obj_destructor_t)&mapStreamer_destroy
+};
+
+MapStreamer_t *mapStreamer_create(const char *aPathFormat, vec2_t aRegionSize, int aLoadRadius, int aCapacity)
+{
+    dynamo_assert(aPathFormat != NULL, "Invalid path format");
+    dynamo_assert(aRegionSize.w > 0.0 && aRegionSize.h > 0.0, "Invalid region size");
+    dynamo_assert((2*aLoadRadius + 1)*(2*aLoadRadius + 1) <= aCapacity, "Capacity too small for the load radius");
+
+    MapStreamer_t *out = obj_create_autoreleased(&Class_MapStreamer);
+    out->displayCallback = (RenderableDisplayCallback_t)&_mapStreamer_draw;
+    out->luaDisplayCallback = -1;
+    out->pathFormat = strdup(aPathFormat);
+    out->regionSize = aRegionSize;
+    out->loadRadius = aLoadRadius;
+    out->uploadBudget = 0.004;
+    out->capacity = aCapacity;
+    out->regions = calloc(aCapacity, sizeof(MapRegion_t));
+    out->frame = 0;
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+    out->maxTextureSize = maxTextureSize;
+    out->focusX = out->focusY = 0;
+
+    pthread_mutex_init(&out->lock, NULL);
+    pthread_cond_init(&out->workAvailable, NULL);
+    out->shouldStopWorker = false;
+    out->hasWorker = pthread_create(&out->workerThread, NULL, (void *(*)(void *))&_mapStreamer_worker, out) == 0;
+    if(!out->hasWorker)
+        dynamo_log("Unable to create map streaming thread");
+
+    return out;
+}
+
+// Releases everything held by a region & marks its slot as free (Must not be called on a loading region)
+static void _mapStreamer_clearRegion(MapRegion_t *aRegion)
+{
+    for(int i = 0; i < aRegion->numberOfLayers; ++i) {
+        if(aRegion->layers[i])
+            obj_release(aRegion->layers[i]);
+    }
+    free(aRegion->layers);
+    if(aRegion->map)
+        obj_release(aRegion->map);
+    memset(aRegion, 0, sizeof(MapRegion_t));
+    aRegion->state = kMapRegion_empty;
+}
+
+void mapStreamer_destroy(MapStreamer_t *aStreamer)
+{
+    if(aStreamer->hasWorker) {
+        pthread_mutex_lock(&aStreamer->lock);
+        aStreamer->shouldStopWorker = true;
+        pthread_cond_broadcast(&aStreamer->workAvailable);
+        pthread_mutex_unlock(&aStreamer->lock);
+        pthread_join(aStreamer->workerThread, NULL);
+    }
+    for(int i = 0; i < aStreamer->capacity; ++i)
+        _mapStreamer_clearRegion(&aStreamer->regions[i]);
+    free(aStreamer->regions);
+    free(aStreamer->pathFormat);
+    pthread_mutex_destroy(&aStreamer->lock);
+    pthread_cond_destroy(&aStreamer->workAvailable);
+}
+
+#pragma mark - Region management
+
+// The worker changes the state of queued & loading regions, so states are only read & written with the lock held
+static MapRegionState_t _mapStreamer_regionState(MapStreamer_t *aStreamer, MapRegion_t *aRegion)
+{
+    pthread_mutex_lock(&aStreamer->lock);
+    MapRegionState_t state = aRegion->state;
+    pthread_mutex_unlock(&aStreamer->lock);
+    return state;
+}
+
+static MapRegion_t *_mapStreamer_findRegion(MapStreamer_t *aStreamer, int aX, int aY)
+{
+    for(int i = 0; i < aStreamer->capacity; ++i) {
+        MapRegion_t *region = &aStreamer->regions[i];
+        if(region->state != kMapRegion_empty && region->x == aX && region->y == aY)
+            return region;
+    }
+    return NULL;
+}
+
+// Returns a free slot, or evicts the least recently used region that is neither needed this frame nor being loaded
+static MapRegion_t *_mapStreamer_acquireSlot(MapStreamer_t *aStreamer)
+{
+    MapRegion_t *lru = NULL;
+    for(int i = 0; i < aStreamer->capacity; ++i) {
+        MapRegion_t *region = &aStreamer->regions[i];
+        if(region->state == kMapRegion_empty)
+            return region;
+        if(region->state == kMapRegion_loading || region->lastUsed == aStreamer->frame)
+            continue;
+        if(!lru || region->lastUsed < lru->lastUsed)
+            lru = region;
+    }
+    if(lru)
+        _mapStreamer_clearRegion(lru);
+    return lru;
+}
+
+static void _mapStreamer_requestRegion(MapStreamer_t *aStreamer, int aX, int aY)
+{
+    MapRegion_t *region = _mapStreamer_findRegion(aStreamer, aX, aY);
+    if(region) {
+        region->lastUsed = aStreamer->frame;
+        return;
+    }
+    region = _mapStreamer_acquireSlot(aStreamer);
+    if(!region)
+        return;
+
+    region->x = aX;
+    region->y = aY;
+    region->lastUsed = aStreamer->frame;
+    char name[512];
+    snprintf(name, 512, aStreamer->pathFormat, aX, aY);
+    if(util_pathForResource(name, NULL, NULL, region->path, 512) && aStreamer->hasWorker) {
+        region->state = kMapRegion_queued;
+        pthread_cond_signal(&aStreamer->workAvailable);
+    } else
+        region->state = kMapRegion_missing;
+}
+
+// Rough size of the CPU side of a map
+static size_t _mapStreamer_mapSize(TMXMap_t *aMap)
+{
+    size_t size = aMap->mappedFile.length + aMap->gidTableSize*sizeof(TMXTileset_t *);
+    for(int i = 0; i < aMap->numberOfLayers; ++i)
+        size += aMap->layers[i].numberOfTiles*sizeof(TMXTile_t);
+    return size;
+}
+
+// Rough size of the GPU resources of a layer
+static size_t _mapStreamer_layerSize(TMXLayerRenderable_t *aLayer)
+{
+    size_t size = 0;
+    for(int i = 0; i < aLayer->numberOfPages; ++i)
+        size += (size_t)(aLayer->pages[i]->size.w * aLayer->pages[i]->size.h) * 4;
+    for(int i = 0; i < aLayer->chunksWide*aLayer->chunksHigh; ++i) {
+        if(aLayer->chunks[i].vbo)
+            size += aLayer->chunks[i].cellsWide*aLayer->chunks[i].cellsHigh*4*2*sizeof(vec2_t) + aLayer->chunks[i].tileCount*6*sizeof(GLushort);
+    }
+    return size;
+}
+
+static bool _mapStreamer_layerHasTiles(TMXLayer_t *aLayer)
+{
+    for(int i = 0; i < aLayer->numberOfTiles; ++i) {
+        if(aLayer->tiles[i].tileset)
+            return true;
+    }
+    return false;
+}
+
+void mapStreamer_update(MapStreamer_t *aStreamer, vec2_t aFocus)
+{
+    ++aStreamer->frame;
+    int focusX = (int)floorf(aFocus.x / aStreamer->regionSize.w);
+    int focusY = (int)floorf(aFocus.y / aStreamer->regionSize.h);
+
+    // Request the regions ring by ring, the worker loads the ones nearest to the focus region first
+    pthread_mutex_lock(&aStreamer->lock);
+    aStreamer->focusX = focusX;
+    aStreamer->focusY = focusY;
+    _mapStreamer_requestRegion(aStreamer, focusX, focusY);
+    for(int r = 1; r <= aStreamer->loadRadius; ++r) {
+        for(int i = -r; i <= r; ++i) {
+            _mapStreamer_requestRegion(aStreamer, focusX + i, focusY - r);
+            _mapStreamer_requestRegion(aStreamer, focusX + i, focusY + r);
+        }
+        for(int i = -r + 1; i <= r - 1; ++i) {
+            _mapStreamer_requestRegion(aStreamer, focusX - r, focusY + i);
+            _mapStreamer_requestRegion(aStreamer, focusX + r, focusY + i);
+        }
+    }
+    pthread_mutex_unlock(&aStreamer->lock);
+
+    // Create the GPU resources of decoded regions, a page or chunk at a time, until the budget runs out
+    // (Apart from their state, decoded regions are only touched by this thread)
+    GLMFloat start = dynamo_globalTime();
+    for(int i = 0; i < aStreamer->capacity; ++i) {
+        MapRegion_t *region = &aStreamer->regions[i];
+        if(_mapStreamer_regionState(aStreamer, region) != kMapRegion_decoded)
+            continue;
+        while(region->numberOfUploadedLayers < region->numberOfLayers) {
+            TMXLayerRenderable_t *layer = region->layers[region->numberOfUploadedLayers];
+            bool uploaded = layer == NULL;
+            while(!uploaded) {
+                if(dynamo_globalTime() - start >= aStreamer->uploadBudget)
+                    return;
+                uploaded = tmx_layerUploadStep(layer);
+            }
+            if(layer)
+                region->memoryUsed += _mapStreamer_layerSize(layer);
+            ++region->numberOfUploadedLayers;
+        }
+        pthread_mutex_lock(&aStreamer->lock);
+        region->state = kMapRegion_ready;
+        pthread_mutex_unlock(&aStreamer->lock);
+    }
+}
+
+MapRegion_t *mapStreamer_getRegion(MapStreamer_t *aStreamer, int aX, int aY)
+{
+    pthread_mutex_lock(&aStreamer->lock);
+    MapRegion_t *region = _mapStreamer_findRegion(aStreamer, aX, aY);
+    if(region && region->state != kMapRegion_ready)
+        region = NULL;
+    pthread_mutex_unlock(&aStreamer->lock);
+    return region;
+}
+
+MapStreamerStats_t mapStreamer_getStats(MapStreamer_t *aStreamer)
+{
+    MapStreamerStats_t stats = { 0, 0, 0, 0 };
+    pthread_mutex_lock(&aStreamer->lock);
+    for(int i = 0; i < aStreamer->capacity; ++i) {
+        MapRegion_t *region = &aStreamer->regions[i];
+        switch(region->state) {
+            case kMapRegion_queued:
+            case kMapRegion_loading:
+                ++stats.loadsInFlight;
+                break;
+            case kMapRegion_decoded:
+                ++stats.pendingUploads;
+                break;
+            case kMapRegion_ready:
+                ++stats.residentRegions;
+                break;
+            default:
+                break;
+        }
+        stats.memoryUsed += region->memoryUsed;
+    }
+    pthread_mutex_unlock(&aStreamer->lock);
+    return stats;
+}
+
+#pragma mark - Worker
+
+static void *_mapStreamer_worker(MapStreamer_t *aStreamer)
+{
+    char path[512];
+    pthread_mutex_lock(&aStreamer->lock);
+    while(!aStreamer->shouldStopWorker) {
+        // Take the queued region nearest to the focus region
+        MapRegion_t *region = NULL;
+        int regionDistance = 0;
+        for(int i = 0; i < aStreamer->capacity; ++i) {
+            MapRegion_t *candidate = &aStreamer->regions[i];
+            if(candidate->state != kMapRegion_queued)
+                continue;
+            int dx = candidate->x - aStreamer->focusX, dy = candidate->y - aStreamer->focusY;
+            if(!region || dx*dx + dy*dy < regionDistance) {
+                region = candidate;
+                regionDistance = dx*dx + dy*dy;
+            }
+        }
+        if(!region) {
+            pthread_cond_wait(&aStreamer->workAvailable, &aStreamer->lock);
+            continue;
+        }
+        region->state = kMapRegion_loading;
+        strncpy(path, region->path, 512);
+        pthread_mutex_unlock(&aStreamer->lock);
+
+        // Loading regions are never evicted, so the slot stays ours while the lock is released
+        TMXMap_t *map = tmx_loadMapFile(path);
+        // Decode the tileset images & build the meshes here as well, leaving only the GL calls to the GL thread
+        TMXLayerRenderable_t **layers = NULL;
+        if(map) {
+            layers = calloc(MAX(1, map->numberOfLayers), sizeof(TMXLayerRenderable_t *));
+            for(int i = 0; i < map->numberOfLayers; ++i) {
+                if(!_mapStreamer_layerHasTiles(&map->layers[i]))
+                    continue;
+                layers[i] = tmx_prepareRenderableForLayer(map, i, aStreamer->maxTextureSize);
+                if(!layers[i]) {
+                    // A region missing a layer would be drawn with holes in it, so none of it is kept
+                    for(int j = 0; j < i; ++j) {
+                        if(layers[j])
+                            obj_release(layers[j]);
+                    }
+                    free(layers);
+                    layers = NULL;
+                    obj_release(map);
+                    map = NULL;
+                    break;
+                }
+            }
+        }
+
+        pthread_mutex_lock(&aStreamer->lock);
+        if(map) {
+            region->map = map;
+            region->numberOfLayers = map->numberOfLayers;
+            region->numberOfUploadedLayers = 0;
+            region->layers = layers;
+            region->memoryUsed = _mapStreamer_mapSize(map);
+            region->state = kMapRegion_decoded;
+        } else {
+            dynamo_log("Unable to load map region %s", path);
+            region->state = kMapRegion_missing;
+        }
+    }
+    pthread_mutex_unlock(&aStreamer->lock);
+    return NULL;
+}
+
+#pragma mark - Rendering
+
+static void _mapStreamer_draw(Renderer_t *aRenderer, MapStreamer_t *aStreamer, GLMFloat aTimeSinceLastFrame, GLMFloat aInterpolation)
+{
+    for(int i = 0; i < aStreamer->capacity; ++i) {
+        MapRegion_t *region = &aStreamer->regions[i];
+        if(_mapStreamer_regionState(aStreamer, region) != kMapRegion_ready)
+            continue;
+        matrix_stack_push(aRenderer->worldMatrixStack);
+        matrix_stack_translate(aRenderer->worldMatrixStack, region->x*aStreamer->regionSize.w, region->y*aStreamer->regionSize.h, 0.0f);
+        for(int j = 0; j < region->numberOfLayers; ++j) {
+            TMXLayerRenderable_t *layer = region->layers[j];
+            if(layer && layer->layer->isVisible)
+                layer->displayCallback(aRenderer, (Renderable_t *)layer, aTimeSinceLastFrame, aInterpolation);
+        }
+        matrix_stack_pop(aRenderer->worldMatrixStack);
+    }
+}
@@ -0,0 +1,117 @@
+/*!
+    @header Map Streamer
+    @abstract
+    @discussion Streams the regions of a large world in and out of memory around a focus point (Usually the camera).
+
+    The world is split into a grid of equally sized regions, each stored as its own map file (.tmx or baked binary map).
+    Regions near the focus are read on a background thread, nearest first, which also decodes their tileset images & builds
+    their meshes. Only the textures & buffers are then created on the GL thread, a page or chunk at a time within a per frame
+    time budget. When more regions are needed than fit, the least recently used ones are evicted.
+*/
+
+#ifndef _MAPSTREAMER_H_
+#define _MAPSTREAMER_H_
+
+#include "object.h"
+#include "renderer.h"
+#include "tmx_map.h"
+#include <pthread.h>
+
+typedef enum _MapRegionState {
+    kMapRegion_empty,      // The slot holds no region
+    kMapRegion_queued,     // Waiting for the worker thread
+    kMapRegion_loading,    // Being read by the worker thread
+    kMapRegion_decoded,    // Map read, GPU resources not (fully) created yet
+    kMapRegion_ready,      // Drawable
+    kMapRegion_missing     // No map exists for the region (Or it failed to load)
+} MapRegionState_t;
+
+/*!
+    A region slot
+
+    @field x Horizontal region coordinate
+    @field y Vertical region coordinate (Growing upwards)
+    @field state Changed by both threads, so only accessed with the streamer's lock held
+    @field map The region's map (Retained once decoded)
+    @field layers A renderable for each layer of the map (NULL for empty layers), prepared by the worker thread & uploaded
+    incrementally on the GL thread
+    @field lastUsed The streamer's frame counter when the region was last needed
+    @field memoryUsed Estimated number of bytes held by the region (CPU & GPU)
+*/
+typedef struct _MapRegion {
+    int x, y;
+    MapRegionState_t state;
+    char path[512];
+    TMXMap_t *map;
+    int numberOfLayers, numberOfUploadedLayers;
+    TMXLayerRenderable_t **layers;
+    unsigned long lastUsed;
+    size_t memoryUsed;
+} MapRegion_t;
+
+/*!
+    Streaming statistics
+
+    @field loadsInFlight Regions queued for or being read by the worker thread
+    @field pendingUploads Regions decoded but not yet fully uploaded
+    @field residentRegions Regions that are drawable
+    @field memoryUsed Estimated number of bytes held by all regions
+*/
+typedef struct _MapStreamerStats {
+    int loadsInFlight;
+    int pendingUploads;
+    int residentRegions;
+    size_t memoryUsed;
+} MapStreamerStats_t;
+
+/*!
+    A map streamer, drawn as a renderable
+
+    @field pathFormat printf style format used to get the resource name of a region from its coordinates. (e.g. "world_%d_%d.tmx")
+    @field regionSize The size of a region in pixels
+    @field loadRadius The number of regions around the focus region that are kept loaded
+    @field uploadBudget The maximum time in seconds spent creating GPU resources per call to mapStreamer_update
+    @field maxTextureSize GL_MAX_TEXTURE_SIZE, queried on creation for the worker thread
+    @field focusX The region the worker loads the nearest queued regions to
+*/
+typedef struct _MapStreamer {
+    OBJ_GUTS
+    RENDERABLE_GUTS
+    char *pathFormat;
+    vec2_t regionSize;
+    int loadRadius;
+    GLMFloat uploadBudget;
+    int capacity;
+    MapRegion_t *regions; // Fixed set of slots reused in LRU order
+    unsigned long frame;
+    int maxTextureSize;
+    int focusX, focusY; // Guarded by the lock
+
+    bool hasWorker;
+    pthread_t workerThread;
+    pthread_mutex_t lock; // Guards the state of the regions shared with the worker
+    pthread_cond_t workAvailable;
+    volatile bool shouldStopWorker;
+} MapStreamer_t;
+extern Class_t Class_MapStreamer;
+
+/*!
+    Creates a map streamer and starts its worker thread. Must be called on the GL thread.
+
+    @param aCapacity The maximum number of regions to hold. Must fit the (2*aLoadRadius+1)^2 regions around the focus.
+*/
+extern MapStreamer_t *mapStreamer_create(const char *aPathFormat, vec2_t aRegionSize, int aLoadRadius, int aCapacity);
+/*!
+    Requests the regions around a location in world space (Usually the camera's), evicts regions that are no longer needed
+    and creates GPU resources for decoded regions within the upload budget. Must be called on the GL thread.
+*/
+extern void mapStreamer_update(MapStreamer_t *aStreamer, vec2_t aFocus);
+/*!
+    Returns the region at the given region coordinates if it is drawable, NULL otherwise.
+*/
+extern MapRegion_t *mapStreamer_getRegion(MapStreamer_t *aStreamer, int aX, int aY);
+/*!
+    Gets the current streaming statistics.
+*/
+extern MapStreamerStats_t mapStreamer_getStats(MapStreamer_t *aStreamer);
+#endif
@@ -2,9 +2,11 @@
 #include <ogg/ogg.h>
 #include <vorbis/vorbisfile.h>
 #include <stdlib.h>
+#include <string.h>
 #include "util.h"
 
 static void ogg_destroy(oggFile_t *aFile);
+static void ogg_destroyStream(oggStream_t *aStream);
 static char *_oggErrorString(int aCode);
 
 static Class_t Class_OggFile = {
@@ -13,19 +15,91 @@ static Class_t Class_OggFile = {
 	(Obj_destructor_t)&ogg_destroy
 };
 
+static Class_t Class_OggStream = {
+	"oggStream",
+	sizeof(oggStream_t),
+	(Obj_destructor_t)&ogg_destroyStream
+};
+
+#pragma mark - Mapped streams
+// Sounds are decoded straight out of the mapped file
+
+typedef struct {
+	MappedFile_t file;
+	size_t position;
+} OggMappedStream_t;
+
+static size_t _ogg_mappedRead(void *aoBuffer, size_t aSize, size_t aCount, void *aStream)
+{
+	OggMappedStream_t *stream = aStream;
+	if(aSize == 0)
+		return 0;
+	size_t count = MIN(aCount, (stream->file.length - stream->position) / aSize);
+	memcpy(aoBuffer, (const char *)stream->file.data + stream->position, count*aSize);
+	stream->position += count*aSize;
+	return count;
+}
+
+static int _ogg_mappedSeek(void *aStream, ogg_int64_t aOffset, int aWhence)
+{
+	OggMappedStream_t *stream = aStream;
+	ogg_int64_t base = aWhence == SEEK_CUR ? stream->position : (aWhence == SEEK_END ? stream->file.length : 0);
+	if(base + aOffset < 0 || base + aOffset > (ogg_int64_t)stream->file.length)
+		return -1;
+	stream->position = base + aOffset;
+	return 0;
+}
+
+static int _ogg_mappedClose(void *aStream)
+{
+	OggMappedStream_t *stream = aStream;
+	util_unmapFile(&stream->file);
+	free(stream);
+	return 0;
+}
+
+static long _ogg_mappedTell(void *aStream)
+{
+	return ((OggMappedStream_t *)aStream)->position;
+}
+
+static const ov_callbacks _OggMappedCallbacks = {
+	&_ogg_mappedRead, &_ogg_mappedSeek, &_ogg_mappedClose, &_ogg_mappedTell
+};
+
+// Opens a file or virtual path, returns false on failure
+static bool _ogg_open(const char *aFilename, OggVorbis_File *aoStream)
+{
+	OggMappedStream_t *stream = calloc(1, sizeof(OggMappedStream_t));
+	if(!util_mapFile(aFilename, kMappedFileAccess_sequential, &stream->file)) {
+		free(stream);
+		return false;
+	}
+	if(ov_open_callbacks(stream, aoStream, NULL, 0, _OggMappedCallbacks) < 0) {
+		_ogg_mappedClose(stream);
+		return false;
+	}
+	return true;
+}
+
+#pragma mark - Loading
+
 oggFile_t *ogg_load(const char *aFilename)
 {
-	FILE *handle = fopen(aFilename, "rb");
-	if(!handle) return NULL;
+	oggFile_t *out = ogg_decode(aFilename);
+	return out ? obj_autorelease(out) : NULL;
+}
+
+oggFile_t *ogg_decode(const char *aFilename)
+{
 	OggVorbis_File *oggStream = malloc(sizeof(OggVorbis_File));
-	int result = ov_open(handle, oggStream, NULL, 0);
-	if(result > 0) {
-		fclose(handle);
+	if(!_ogg_open(aFilename, oggStream)) {
+		free(oggStream);
 		return NULL;
 	}
 	vorbis_info *vorbisInfo = ov_info(oggStream, -1);
 	if(!vorbisInfo)
-		debug_log("Couldn't get info about vorbis file");
+		dynamo_log("Couldn't get info about vorbis file");
 	int samples = ov_pcm_total(oggStream, -1);
 
 	int bytes = 2*samples* vorbisInfo->channels;
@@ -38,14 +112,14 @@ oggFile_t *ogg_load(const char *aFilename)
 
 		long value = ov_read(oggStream, cursor, remain, 0, 2, 1, NULL);
 		if(value < 0) {
-			debug_log("Unable to load sound from %s", aFilename);
+			dynamo_log("Unable to load sound from %s", aFilename);
 			free(data);
 			return NULL;
 		}
 		bytes_read += value;
 	}
 
-	oggFile_t *out = obj_create_autoreleased(&Class_OggFile);
+	oggFile_t *out = obj_create(&Class_OggFile);
 	out->fileHandle = oggStream;
 	out->samples = samples;
 	out->rate = vorbisInfo->rate;
@@ -61,6 +135,61 @@ void ogg_destroy(oggFile_t *aFile)
 	free(aFile->data);
 }
 
+#pragma mark - Streaming
+
+oggStream_t *ogg_openStream(const char *aFilename)
+{
+	OggVorbis_File *oggStream = malloc(sizeof(OggVorbis_File));
+	if(!_ogg_open(aFilename, oggStream)) {
+		free(oggStream);
+		return NULL;
+	}
+	vorbis_info *vorbisInfo = ov_info(oggStream, -1);
+	if(!vorbisInfo) {
+		dynamo_log("Couldn't get info about vorbis file");
+		ov_clear(oggStream);
+		free(oggStream);
+		return NULL;
+	}
+	oggStream_t *out = obj_create(&Class_OggStream);
+	out->fileHandle = oggStream;
+	out->channels = vorbisInfo->channels;
+	out->rate = vorbisInfo->rate;
+	out->samples = ov_pcm_total(oggStream, -1);
+	return out;
+}
+
+int ogg_readStream(oggStream_t *aStream, void *aoBuffer, int aLength)
+{
+	// ov_read decodes at most a packet at a time
+	int bytesRead = 0;
+	while(bytesRead < aLength) {
+		long value = ov_read(aStream->fileHandle, (char *)aoBuffer + bytesRead, aLength - bytesRead, 0, 2, 1, NULL);
+		if(value == OV_HOLE)
+			continue; // Data was skipped over, but decoding can carry on
+		if(value < 0) {
+			dynamo_log("Unable to decode ogg stream: %s", _oggErrorString(value));
+			return bytesRead > 0 ? bytesRead : -1;
+		}
+		if(value == 0)
+			break;
+		bytesRead += value;
+	}
+	return bytesRead;
+}
+
+bool ogg_seekStream(oggStream_t *aStream, double aSeconds)
+{
+	long long sample = MAX(0, MIN(aStream->samples, (long long)(aSeconds*aStream->rate)));
+	return ov_pcm_seek(aStream->fileHandle, sample) == 0;
+}
+
+void ogg_destroyStream(oggStream_t *aStream)
+{
+	ov_clear(aStream->fileHandle);
+	free(aStream->fileHandle);
+}
+
 static char *_oggErrorString(int aCode)
 {
 	switch(aCode) {
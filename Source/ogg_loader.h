@@ -12,6 +12,26 @@ typedef struct _oggFile {
 	int size;
 } oggFile_t;
 
+// Loads & decodes an ogg vorbis file (Either a filesystem or a virtual path)
 extern oggFile_t *ogg_load(const char *aFilename);
+// Same as ogg_load, but returns a retained file instead of an autoreleased one so that it can be called from any thread
+extern oggFile_t *ogg_decode(const char *aFilename);
+
+// A file that is decoded a piece at a time as it is read, so that only the compressed data is held in memory
+typedef struct _oggStream {
+	OBJ_GUTS
+	void *fileHandle;
+	int channels;
+	int rate;
+	long long samples;
+} oggStream_t;
+
+// Opens an ogg vorbis file for streaming. Returns a retained stream so that it can be read from any thread
+extern oggStream_t *ogg_openStream(const char *aFilename);
+// Decodes up to aLength bytes of 16 bit PCM. Returns the number of bytes decoded, which is 0 at the end of the stream,
+// or -1 on error
+extern int ogg_readStream(oggStream_t *aStream, void *aoBuffer, int aLength);
+// Moves to a position in the stream, in seconds. Positions are sample accurate, so looping by seeking to 0 is gapless
+extern bool ogg_seekStream(oggStream_t *aStream, double aSeconds);
 
 #endif
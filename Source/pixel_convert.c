@@ -0,0 +1,230 @@
+#include "pixel_convert.h"
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+    #define PIXEL_USE_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define PIXEL_USE_NEON
+#endif
+
+// c*a/255 rounded to nearest, exact for every 8 bit input
+static inline unsigned char _pixel_mulDiv255(unsigned c, unsigned a)
+{
+    unsigned t = c*a + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+#pragma mark - Scalar
+
+void pixel_premultiplyRGBA8_scalar(unsigned char *aPixels, size_t aCount)
+{
+    for(size_t i = 0; i < aCount; ++i, aPixels += 4) {
+        unsigned a = aPixels[3];
+        aPixels[0] = _pixel_mulDiv255(aPixels[0], a);
+        aPixels[1] = _pixel_mulDiv255(aPixels[1], a);
+        aPixels[2] = _pixel_mulDiv255(aPixels[2], a);
+    }
+}
+
+void pixel_convertToRGBA4444_scalar(const unsigned char *aSrc, int aChannels, uint16_t *aoDst, size_t aCount)
+{
+    for(size_t i = 0; i < aCount; ++i, aSrc += aChannels) {
+        unsigned a = aChannels == 4 ? aSrc[3] : 255;
+        aoDst[i] = ((aSrc[0] >> 4) << 12) | ((aSrc[1] >> 4) << 8) | ((aSrc[2] >> 4) << 4) | (a >> 4);
+    }
+}
+
+void pixel_convertToRGBA5551_scalar(const unsigned char *aSrc, int aChannels, uint16_t *aoDst, size_t aCount)
+{
+    for(size_t i = 0; i < aCount; ++i, aSrc += aChannels) {
+        unsigned a = aChannels == 4 ? aSrc[3] : 255;
+        aoDst[i] = ((aSrc[0] >> 3) << 11) | ((aSrc[1] >> 3) << 6) | ((aSrc[2] >> 3) << 1) | (a >> 7);
+    }
+}
+
+void pixel_convertToRGB565_scalar(const unsigned char *aSrc, int aChannels, uint16_t *aoDst, size_t aCount)
+{
+    for(size_t i = 0; i < aCount; ++i, aSrc += aChannels)
+        aoDst[i] = ((aSrc[0] >> 3) << 11) | ((aSrc[1] >> 2) << 5) | (aSrc[2] >> 3);
+}
+
+#pragma mark - SSE2
+
+#if defined(PIXEL_USE_SSE2)
+
+void pixel_premultiplyRGBA8(unsigned char *aPixels, size_t aCount)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alphaLanes = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    const __m128i alphaFactor = _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0);
+    const __m128i half = _mm_set1_epi16(128);
+
+    size_t i = 0;
+    for(; i + 4 <= aCount; i += 4) {
+        __m128i px = _mm_loadu_si128((const __m128i *)(aPixels + i*4));
+        __m128i halves[2] = { _mm_unpacklo_epi8(px, zero), _mm_unpackhi_epi8(px, zero) };
+        for(int h = 0; h < 2; ++h) {
+            // Broadcast each pixel's alpha over its channels; alpha itself is multiplied by 255 so it comes out unchanged
+            __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(halves[h], 0xFF), 0xFF);
+            alpha = _mm_or_si128(_mm_andnot_si128(alphaLanes, alpha), alphaFactor);
+            __m128i t = _mm_add_epi16(_mm_mullo_epi16(halves[h], alpha), half);
+            halves[h] = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+        }
+        _mm_storeu_si128((__m128i *)(aPixels + i*4), _mm_packus_epi16(halves[0], halves[1]));
+    }
+    pixel_premultiplyRGBA8_scalar(aPixels + i*4, aCount - i);
+}
+
+// Narrows 2x4 32 bit lanes holding 16 bit values into 8 16 bit lanes (SSE2 only has a signed saturating pack)
+static inline __m128i _pixel_pack32To16(__m128i aLow, __m128i aHigh)
+{
+    aLow  = _mm_srai_epi32(_mm_slli_epi32(aLow, 16), 16);
+    aHigh = _mm_srai_epi32(_mm_slli_epi32(aHigh, 16), 16);
+    return _mm_packs_epi32(aLow, aHigh);
+}
+
+// Each 32 bit lane holds one RGBA8 pixel, with red in the low byte
+static inline __m128i _pixel_packLanes4444(__m128i p)
+{
+    __m128i r = _mm_and_si128(_mm_slli_epi32(p, 8),  _mm_set1_epi32(0xF000));
+    __m128i g = _mm_and_si128(_mm_srli_epi32(p, 4),  _mm_set1_epi32(0x0F00));
+    __m128i b = _mm_and_si128(_mm_srli_epi32(p, 16), _mm_set1_epi32(0x00F0));
+    __m128i a = _mm_srli_epi32(p, 28);
+    return _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, a));
+}
+
+static inline __m128i _pixel_packLanes5551(__m128i p)
+{
+    __m128i r = _mm_and_si128(_mm_slli_epi32(p, 8),  _mm_set1_epi32(0xF800));
+    __m128i g = _mm_and_si128(_mm_srli_epi32(p, 5),  _mm_set1_epi32(0x07C0));
+    __m128i b = _mm_and_si128(_mm_srli_epi32(p, 18), _mm_set1_epi32(0x003E));
+    __m128i a = _mm_srli_epi32(p, 31);
+    return _mm_or_si128(_mm_or_si128(r, g), _mm_or_si128(b, a));
+}
+
+static inline __m128i _pixel_packLanes565(__m128i p)
+{
+    __m128i r = _mm_and_si128(_mm_slli_epi32(p, 8),  _mm_set1_epi32(0xF800));
+    __m128i g = _mm_and_si128(_mm_srli_epi32(p, 5),  _mm_set1_epi32(0x07E0));
+    __m128i b = _mm_and_si128(_mm_srli_epi32(p, 19), _mm_set1_epi32(0x001F));
+    return _mm_or_si128(_mm_or_si128(r, g), b);
+}
+
+#define PIXEL_SSE2_CONVERTER(name, packLanes) \
+void pixel_convertTo##name(const unsigned char *aSrc, int aChannels, uint16_t *aoDst, size_t aCount) \
+{ \
+    size_t i = 0; \
+    if(aChannels == 4) { \
+        for(; i + 8 <= aCount; i += 8) { \
+            __m128i low  = packLanes(_mm_loadu_si128((const __m128i *)(aSrc + i*4))); \
+            __m128i high = packLanes(_mm_loadu_si128((const __m128i *)(aSrc + i*4 + 16))); \
+            _mm_storeu_si128((__m128i *)(aoDst + i), _pixel_pack32To16(low, high)); \
+        } \
+    } \
+    pixel_convertTo##name##_scalar(aSrc + i*aChannels, aChannels, aoDst + i, aCount - i); \
+}
+
+PIXEL_SSE2_CONVERTER(RGBA4444, _pixel_packLanes4444)
+PIXEL_SSE2_CONVERTER(RGBA5551, _pixel_packLanes5551)
+PIXEL_SSE2_CONVERTER(RGB565,   _pixel_packLanes565)
+
+#pragma mark - NEON
+
+#elif defined(PIXEL_USE_NEON)
+
+static inline uint8x8_t _pixel_mulDiv255x8(uint8x8_t aC, uint8x8_t aA)
+{
+    uint16x8_t x = vmull_u8(aC, aA);
+    // (x + ((x + 128) >> 8) + 128) >> 8, the same rounding as the scalar version
+    return vrshrn_n_u16(vrsraq_n_u16(x, x, 8), 8);
+}
+
+static inline uint8x16_t _pixel_mulDiv255x16(uint8x16_t aC, uint8x16_t aA)
+{
+    return vcombine_u8(_pixel_mulDiv255x8(vget_low_u8(aC), vget_low_u8(aA)),
+                       _pixel_mulDiv255x8(vget_high_u8(aC), vget_high_u8(aA)));
+}
+
+void pixel_premultiplyRGBA8(unsigned char *aPixels, size_t aCount)
+{
+    size_t i = 0;
+    for(; i + 16 <= aCount; i += 16) {
+        uint8x16x4_t px = vld4q_u8(aPixels + i*4);
+        px.val[0] = _pixel_mulDiv255x16(px.val[0], px.val[3]);
+        px.val[1] = _pixel_mulDiv255x16(px.val[1], px.val[3]);
+        px.val[2] = _pixel_mulDiv255x16(px.val[2], px.val[3]);
+        vst4q_u8(aPixels + i*4, px);
+    }
+    pixel_premultiplyRGBA8_scalar(aPixels + i*4, aCount - i);
+}
+
+// The channels are shifted into the top byte, then inserted from the top down so each one keeps only its high bits
+static inline uint16x8_t _pixel_pack4444(uint8x8_t r, uint8x8_t g, uint8x8_t b, uint8x8_t a)
+{
+    uint16x8_t out = vshll_n_u8(r, 8);
+    out = vsriq_n_u16(out, vshll_n_u8(g, 8), 4);
+    out = vsriq_n_u16(out, vshll_n_u8(b, 8), 8);
+    return vsriq_n_u16(out, vshll_n_u8(a, 8), 12);
+}
+
+static inline uint16x8_t _pixel_pack5551(uint8x8_t r, uint8x8_t g, uint8x8_t b, uint8x8_t a)
+{
+    uint16x8_t out = vshll_n_u8(r, 8);
+    out = vsriq_n_u16(out, vshll_n_u8(g, 8), 5);
+    out = vsriq_n_u16(out, vshll_n_u8(b, 8), 10);
+    return vsriq_n_u16(out, vshll_n_u8(a, 8), 15);
+}
+
+static inline uint16x8_t _pixel_pack565(uint8x8_t r, uint8x8_t g, uint8x8_t b, uint8x8_t a)
+{
+    uint16x8_t out = vshll_n_u8(r, 8);
+    out = vsriq_n_u16(out, vshll_n_u8(g, 8), 5);
+    return vsriq_n_u16(out, vshll_n_u8(b, 8), 11);
+}
+
+#define PIXEL_NEON_CONVERTER(name, pack) \
+void pixel_convertTo##name(const unsigned char *aSrc, int aChannels, uint16_t *aoDst, size_t aCount) \
+{ \
+    size_t i = 0; \
+    for(; i + 16 <= aCount; i += 16) { \
+        uint8x16_t r, g, b, a; \
+        if(aChannels == 4) { \
+            uint8x16x4_t px = vld4q_u8(aSrc + i*4); \
+            r = px.val[0]; g = px.val[1]; b = px.val[2]; a = px.val[3]; \
+        } else { \
+            uint8x16x3_t px = vld3q_u8(aSrc + i*3); \
+            r = px.val[0]; g = px.val[1]; b = px.val[2]; a = vdupq_n_u8(255); \
+        } \
+        vst1q_u16(aoDst + i,     pack(vget_low_u8(r),  vget_low_u8(g),  vget_low_u8(b),  vget_low_u8(a))); \
+        vst1q_u16(aoDst + i + 8, pack(vget_high_u8(r), vget_high_u8(g), vget_high_u8(b), vget_high_u8(a))); \
+    } \
+    pixel_convertTo##name##_scalar(aSrc + i*aChannels, aChannels, aoDst + i, aCount - i); \
+}
+
+PIXEL_NEON_CONVERTER(RGBA4444, _pixel_pack4444)
+PIXEL_NEON_CONVERTER(RGBA5551, _pixel_pack5551)
+PIXEL_NEON_CONVERTER(RGB565,   _pixel_pack565)
+
+#pragma mark - Fallback
+
+#else
+
+void pixel_premultiplyRGBA8(unsigned char *aPixels, size_t aCount)
+{
+    pixel_premultiplyRGBA8_scalar(aPixels, aCount);
+}
+void pixel_convertToRGBA4444(const unsigned char *aSrc, int aChannels, uint16_t *aoDst, size_t aCount)
+{
+    pixel_convertToRGBA4444_scalar(aSrc, aChannels, aoDst, aCount);
+}
+void pixel_convertToRGBA5551(const unsigned char *aSrc, int aChannels, uint16_t *aoDst, size_t aCount)
+{
+    pixel_convertToRGBA5551_scalar(aSrc, aChannels, aoDst, aCount);
+}
+void pixel_convertToRGB565(const unsigned char *aSrc, int aChannels, uint16_t *aoDst, size_t aCount)
+{
+    pixel_convertToRGB565_scalar(aSrc, aChannels, aoDst, aCount);
+}
+
+#endif
@@ -0,0 +1,40 @@
+/*!
+    @header Pixel Conversion
+    @abstract
+    @discussion Converts 8 bit per channel pixel data at load time: alpha premultiplication & packing into 16 bit formats.
+
+    The kernels use SSE2 or NEON when the compiler targets them, falling back on scalar code otherwise.
+    Both paths produce identical output; the scalar versions are exposed for reference & benchmarking.
+    The 16 bit conversions may be done in place (aoDst pointing to aSrc) since they never write past what they have read.
+*/
+
+#ifndef _PIXELCONVERT_H_
+#define _PIXELCONVERT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*!
+    Multiplies the color channels of RGBA8 pixels by their alpha, in place. (Rounded to nearest)
+*/
+extern void pixel_premultiplyRGBA8(unsigned char *aPixels, size_t aCount);
+/*!
+    Packs RGB8 (aChannels = 3) or RGBA8 (aChannels = 4) pixels into GL_UNSIGNED_SHORT_4_4_4_4 values.
+    RGB8 pixels are treated as opaque.
+*/
+extern void pixel_convertToRGBA4444(const unsigned char *aSrc, int aChannels, uint16_t *aoDst, size_t aCount);
+/*!
+    Packs RGB8 or RGBA8 pixels into GL_UNSIGNED_SHORT_5_5_5_1 values. (Alpha is set if it is at least 128)
+*/
+extern void pixel_convertToRGBA5551(const unsigned char *aSrc, int aChannels, uint16_t *aoDst, size_t aCount);
+/*!
+    Packs RGB8 or RGBA8 pixels into GL_UNSIGNED_SHORT_5_6_5 values, dropping alpha.
+*/
+extern void pixel_convertToRGB565(const unsigned char *aSrc, int aChannels, uint16_t *aoDst, size_t aCount);
+
+// Scalar reference implementations
+extern void pixel_premultiplyRGBA8_scalar(unsigned char *aPixels, size_t aCount);
+extern void pixel_convertToRGBA4444_scalar(const unsigned char *aSrc, int aChannels, uint16_t *aoDst, size_t aCount);
+extern void pixel_convertToRGBA5551_scalar(const unsigned char *aSrc, int aChannels, uint16_t *aoDst, size_t aCount);
+extern void pixel_convertToRGB565_scalar(const unsigned char *aSrc, int aChannels, uint16_t *aoDst, size_t aCount);
+#endif
@@ -1,7 +1,9 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include <stdbool.h>
 #include "png_loader.h"
+#include "pixel_convert.h"
 #include "util.h"
 
 #ifndef __APPLE__
@@ -19,163 +21,236 @@ static Class_t Class_Png = {
 };
 
 
-Png_t *png_load(const char *aPath) {
-    Png_t *self = obj_create_autoreleased(&Class_Png);
+#pragma mark - Decoder
+
+// Images are decoded straight out of the mapped file
+typedef struct {
+    MappedFile_t file;
+    size_t position;
+} PngReader_t;
+
+static PngReader_t *_png_openReader(const char *aPath)
+{
+    PngReader_t *reader = calloc(1, sizeof(PngReader_t));
+    if(!util_mapFile(aPath, kMappedFileAccess_sequential, &reader->file)) {
+        free(reader);
+        return NULL;
+    }
+    return reader;
+}
+
+static void _png_closeReader(PngReader_t *aReader)
+{
+    util_unmapFile(&aReader->file);
+    free(aReader);
+}
+
 #ifndef __APPLE__ // Disabled CG loading for now, I don't think it's providing any speed gain => better to use same code path everywhere
-    png_structp png_ptr;
-    png_infop info_ptr;
-    unsigned int sig_read = 0;
-    int color_type;
-    FILE *fp;
 
-    if ((fp = fopen(aPath, "rb")) == NULL)
-        return false;
+static void _png_read(png_structp aPng, png_bytep aoData, png_size_t aLength)
+{
+    PngReader_t *reader = png_get_io_ptr(aPng);
+    if(aLength > reader->file.length - reader->position)
+        png_error(aPng, "Read past the end of the image");
+    memcpy(aoData, (const unsigned char *)reader->file.data + reader->position, aLength);
+    reader->position += aLength;
+}
 
-    /* Create and initialize the png_struct
-     * with the desired error handler
-     * functions.  If you want to use the
-     * default stderr and longjump method,
-     * you can supply NULL for the last
-     * three parameters.  We also supply the
-     * the compiler header file version, so
-     * that we know if the application
-     * was compiled with a compatible version
-     * of the library.  REQUIRED
-     */
-    png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-
-    if (png_ptr == NULL) {
-        fclose(fp);
+bool png_openDecoder(PngDecoder_t *aoDecoder, const char *aPath, bool aForceAlpha)
+{
+    memset(aoDecoder, 0, sizeof(PngDecoder_t));
+    PngReader_t *fileReader = _png_openReader(aPath);
+    if(!fileReader)
         return false;
-    }
 
-    /* Allocate/initialize the memory
-     * for image information.  REQUIRED. */
-    info_ptr = png_create_info_struct(png_ptr);
-    if (info_ptr == NULL) {
-        fclose(fp);
+    /* Create and initialize the png_struct with the default stderr & longjmp error handling.
+     * We also supply the compiler header file version, so that we know if the application
+     * was compiled with a compatible version of the library. */
+    png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info_ptr = png_ptr ? png_create_info_struct(png_ptr) : NULL;
+    if(!info_ptr) {
         png_destroy_read_struct(&png_ptr, (png_infopp)NULL, (png_infopp)NULL);
+        _png_closeReader(fileReader);
         return false;
     }
+    aoDecoder->reader = png_ptr;
+    aoDecoder->info = info_ptr;
+    aoDecoder->fileReader = fileReader;
 
-    /* Set error handling if you are
-     * using the setjmp/longjmp method
-     * (this is the normal method of
-     * doing things with libpng).
-     * REQUIRED unless you  set up
-     * your own error handlers in
-     * the png_create_read_struct()
-     * earlier.
-     */
-    if (setjmp(png_jmpbuf(png_ptr))) {
-        /* Free all of the memory associated
-         * with the png_ptr and info_ptr */
-        png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
-        fclose(fp);
-        /* If we get here, we had a
-         * problem reading the file */
+    // libpng jumps back here if it runs into a problem reading the file
+    if(setjmp(png_jmpbuf(png_ptr))) {
+        png_closeDecoder(aoDecoder);
         return false;
     }
+    png_set_read_fn(png_ptr, fileReader, &_png_read);
+    png_read_info(png_ptr, info_ptr);
 
-    /* Set up the output control if
-     * you are using standard C streams */
-    png_init_io(png_ptr, fp);
-
-    /* If we have already
-     * read some of the signature */
-    png_set_sig_bytes(png_ptr, sig_read);
-
-    /*
-     * If you have enough memory to read
-     * in the entire image at once, and
-     * you need to specify only
-     * transforms that can be controlled
-     * with one of the PNG_TRANSFORM_*
-     * bits (this presently excludes
-     * dithering, filling, setting
-     * background, and doing gamma
-     * adjustment), then you can read the
-     * entire image (including pixels)
-     * into the info structure with this
-     * call
-     *
-     * PNG_TRANSFORM_STRIP_16 |
-     * PNG_TRANSFORM_PACKING  forces 8 bit
-     * PNG_TRANSFORM_EXPAND forces to
-     *  expand a palette into RGB
-     */
-    png_read_png(png_ptr, info_ptr, PNG_TRANSFORM_STRIP_16 | PNG_TRANSFORM_PACKING | PNG_TRANSFORM_EXPAND, (png_voidp)NULL);
-    self->width = png_get_image_width(png_ptr, info_ptr);
-    self->height = png_get_image_height(png_ptr, info_ptr);
-    color_type = png_get_color_type(png_ptr, info_ptr);
-    switch (color_type) {
-        case PNG_COLOR_TYPE_RGBA:
-            self->hasAlpha = true;
-            break;
-        case PNG_COLOR_TYPE_RGB:
-            self->hasAlpha = false;
-            break;
-        default:
-            dynamo_log("Color type: %d not supported", color_type);
-            png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
-            fclose(fp);
-            return false;
+    /* The transforms are applied to each row as it is read:
+     * palettes, low bit depths & tRNS chunks expand to 8 bit RGB(A), 16 bit channels are stripped to 8 & gray becomes RGB */
+    png_set_expand(png_ptr);
+    png_set_strip_16(png_ptr);
+    png_set_packing(png_ptr);
+    png_set_gray_to_rgb(png_ptr);
+    if(aForceAlpha)
+        png_set_filler(png_ptr, 0xff, PNG_FILLER_AFTER);
+    aoDecoder->numberOfPasses = png_set_interlace_handling(png_ptr);
+    png_read_update_info(png_ptr, info_ptr);
+
+    aoDecoder->width = png_get_image_width(png_ptr, info_ptr);
+    aoDecoder->height = png_get_image_height(png_ptr, info_ptr);
+    aoDecoder->hasAlpha = (png_get_color_type(png_ptr, info_ptr) & PNG_COLOR_MASK_ALPHA) != 0;
+    aoDecoder->channels = png_get_channels(png_ptr, info_ptr);
+    if(aoDecoder->channels != 3 && aoDecoder->channels != 4) {
+        dynamo_log("Unsupported png layout: %d channels", aoDecoder->channels);
+        png_closeDecoder(aoDecoder);
+        return false;
     }
-    unsigned int row_bytes = png_get_rowbytes(png_ptr, info_ptr);
-    self->data = (unsigned char*) malloc(row_bytes * (self->height));
+    return true;
+}
 
-    png_bytepp row_pointers = png_get_rows(png_ptr, info_ptr);
+bool png_decodeInto(PngDecoder_t *aDecoder, unsigned char *aoPixels, size_t aRowStride, bool aPremultiply)
+{
+    png_structp png_ptr = aDecoder->reader;
+    if(setjmp(png_jmpbuf(png_ptr)))
+        return false;
 
-    // Read the image flipped vertically
-    for(int i = 0; i < self->height; i++) {
-        memcpy((void*)self->data + (row_bytes *  i), row_pointers[self->height - i - 1], row_bytes);
+    // Interlaced images are only complete once the last pass is read
+    bool premultiply = aPremultiply && aDecoder->hasAlpha;
+    for(int pass = 0; pass < aDecoder->numberOfPasses; ++pass) {
+        bool isLastPass = pass == aDecoder->numberOfPasses - 1;
+        // Read the image flipped vertically
+        for(int y = 0; y < aDecoder->height; ++y) {
+            unsigned char *row = aoPixels + (size_t)(aDecoder->height - y - 1)*aRowStride;
+            png_read_row(png_ptr, row, NULL);
+            if(premultiply && isLastPass)
+                pixel_premultiplyRGBA8(row, aDecoder->width);
+        }
     }
+    png_read_end(png_ptr, (png_infop)NULL);
+    return true;
+}
 
-    /* Clean up after the read,
-     * and free any memory allocated */
-    png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+void png_closeDecoder(PngDecoder_t *aDecoder)
+{
+    png_structp png_ptr = aDecoder->reader;
+    png_infop info_ptr = aDecoder->info;
+    if(png_ptr)
+        png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+    if(aDecoder->fileReader)
+        _png_closeReader(aDecoder->fileReader);
+    memset(aDecoder, 0, sizeof(PngDecoder_t));
+}
 
-    /* Close the file */
-    fclose(fp);
 #else
-    // We're on iOS, so let's use CG
-    CGDataProviderRef provider = CGDataProviderCreateWithFilename(aPath);
-    if(!provider)
+// We're on iOS, so let's use CG
+
+bool png_openDecoder(PngDecoder_t *aoDecoder, const char *aPath, bool aForceAlpha)
+{
+    memset(aoDecoder, 0, sizeof(PngDecoder_t));
+    // CG reads the data lazily, so the file stays mapped until the decoder is closed
+    PngReader_t *fileReader = _png_openReader(aPath);
+    if(!fileReader)
         return false;
+    aoDecoder->fileReader = fileReader;
+    CGDataProviderRef provider = CGDataProviderCreateWithData(NULL, fileReader->file.data, fileReader->file.length, NULL);
+    if(!provider) {
+        png_closeDecoder(aoDecoder);
+        return false;
+    }
     CGImageRef cgImg = CGImageCreateWithPNGDataProvider(provider,
                                                         NULL,
                                                         false,
                                                         kCGRenderingIntentDefault);
     CGDataProviderRelease(provider);
-    if(!cgImg)
+    if(!cgImg) {
+        png_closeDecoder(aoDecoder);
         return false;
-    self->width    = CGImageGetWidth(cgImg);
-    self->height   = CGImageGetHeight(cgImg);
-    self->hasAlpha = CGImageGetAlphaInfo(cgImg) != kCGImageAlphaNone;
+    }
+    aoDecoder->reader   = (void *)cgImg;
+    aoDecoder->width    = CGImageGetWidth(cgImg);
+    aoDecoder->height   = CGImageGetHeight(cgImg);
+    aoDecoder->hasAlpha = CGImageGetAlphaInfo(cgImg) != kCGImageAlphaNone;
+    // CG only draws into RGBA contexts
+    aoDecoder->channels = 4;
+    aoDecoder->outputsPremultiplied = true;
+    aoDecoder->numberOfPasses = 1;
+    return true;
+}
 
-    self->data = malloc(self->width * self->height * 4);
+bool png_decodeInto(PngDecoder_t *aDecoder, unsigned char *aoPixels, size_t aRowStride, bool aPremultiply)
+{
+    CGImageRef cgImg = (CGImageRef)aDecoder->reader;
     CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
-    CGContextRef ctx = CGBitmapContextCreate((void*)self->data, self->width, self->height,
-                                             8, 4*self->width, colorSpace,
+    CGContextRef ctx = CGBitmapContextCreate((void*)aoPixels, aDecoder->width, aDecoder->height,
+                                             8, aRowStride, colorSpace,
                                              kCGImageAlphaPremultipliedLast | kCGBitmapByteOrder32Big);
     CGColorSpaceRelease(colorSpace);
-    if(!ctx) {
-        CGImageRelease(cgImg);
+    if(!ctx)
         return false;
-    }
 
     // Draw a flipped representation into the data pointer
-    CGContextClearRect(ctx, CGRectMake( 0, 0, self->width, self->height ) );
+    CGContextClearRect(ctx, CGRectMake( 0, 0, aDecoder->width, aDecoder->height ) );
     CGContextScaleCTM(ctx, 1, -1);
-    CGContextTranslateCTM(ctx, 0, -self->height);
-    CGContextDrawImage(ctx, CGRectMake(0, 0, self->width, self->height), cgImg);
-
+    CGContextTranslateCTM(ctx, 0, -aDecoder->height);
+    CGContextDrawImage(ctx, CGRectMake(0, 0, aDecoder->width, aDecoder->height), cgImg);
     CGContextRelease(ctx);
-    CGImageRelease(cgImg);
+    return true;
+}
+
+void png_closeDecoder(PngDecoder_t *aDecoder)
+{
+    if(aDecoder->reader)
+        CGImageRelease((CGImageRef)aDecoder->reader);
+    if(aDecoder->fileReader)
+        _png_closeReader(aDecoder->fileReader);
+    memset(aDecoder, 0, sizeof(PngDecoder_t));
+}
 #endif
+
+#pragma mark - Images
+
+// Decodes the file at aPath into self, returns false on failure
+static bool _png_decode(Png_t *self, const char *aPath)
+{
+    PngDecoder_t decoder;
+    if(!png_openDecoder(&decoder, aPath, false))
+        return false;
+    self->width = decoder.width;
+    self->height = decoder.height;
+    self->hasAlpha = decoder.channels == 4;
+    self->isPremultiplied = decoder.outputsPremultiplied;
+
+    size_t rowBytes = (size_t)decoder.width*decoder.channels;
+    self->data = malloc(rowBytes*decoder.height);
+    bool succeeded = png_decodeInto(&decoder, (unsigned char *)self->data, rowBytes, false);
+    png_closeDecoder(&decoder);
+    return succeeded;
+}
+
+Png_t *png_load(const char *aPath)
+{
+    Png_t *self = obj_create_autoreleased(&Class_Png);
+    return _png_decode(self, aPath) ? self : NULL;
+}
+
+Png_t *png_loadRetained(const char *aPath)
+{
+    Png_t *self = obj_create(&Class_Png);
+    if(!_png_decode(self, aPath)) {
+        obj_release(self);
+        return NULL;
+    }
     return self;
 }
 
+void png_premultiply(Png_t *aImage)
+{
+    if(!aImage->hasAlpha || aImage->isPremultiplied)
+        return;
+    pixel_premultiplyRGBA8((unsigned char *)aImage->data, (size_t)aImage->width*aImage->height);
+    aImage->isPremultiplied = true;
+}
+
 void png_destroy(Png_t *self)
 {
     free((void*)self->data);
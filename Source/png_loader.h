@@ -2,20 +2,29 @@
     @header PNG Loader
     @abstract
     @discussion Provides loading of PNGs.
+
+    Images can either be loaded into a Png_t, or decoded row by row straight into a buffer provided by the caller
+    (A reusable staging buffer, or the final location of the image within a larger one) through a PngDecoder_t,
+    avoiding any intermediate copy of the image.
 */
 
 #ifndef _PNGLOADER_H_
 #define _PNGLOADER_H_
 #include "object.h"
+#include <stdio.h>
 
 /*!
     Representation of a png image.
+
+    @field hasAlpha True if the data has 4 channels (RGBA) rather than 3 (RGB)
+    @field isPremultiplied True if the color channels have been multiplied by alpha
 */
 typedef struct {
     OBJ_GUTS
     int height;
     int width;
     bool hasAlpha;
+    bool isPremultiplied;
     const unsigned char *data;
 } Png_t;
 
@@ -23,4 +32,50 @@ typedef struct {
     Loads a png from the given path
 */
 extern Png_t *png_load(const char *aPath);
+/*!
+    Loads a png from the given path, returning it retained rather than autoreleased.
+    Does not touch the autorelease pool, so it can be used from threads other than the main one.
+*/
+extern Png_t *png_loadRetained(const char *aPath);
+/*!
+    Multiplies the color channels of an image by its alpha, in place. Does nothing if the image has no alpha or
+    already is premultiplied.
+*/
+extern void png_premultiply(Png_t *aImage);
+
+/*!
+    Streams the pixels of a png file into a caller provided buffer, one row at a time.
+
+    @field width The image width in pixels
+    @field height The image height in pixels
+    @field channels The number of 8 bit channels written per pixel: 4 (RGBA) or 3 (RGB)
+    @field hasAlpha True if the image has transparency (False for opaque images decoded with a forced alpha channel)
+    @field outputsPremultiplied True if the decoded colors are always premultiplied. (CoreGraphics can only output those)
+*/
+typedef struct {
+    int width, height;
+    int channels;
+    bool hasAlpha;
+    bool outputsPremultiplied;
+    int numberOfPasses;
+    void *reader, *info; // libpng's read & info structures (The CGImage on Apple platforms)
+    void *fileReader; // The mapped file being decoded
+} PngDecoder_t;
+
+/*!
+    Opens a png file (Either a filesystem or a virtual path) and reads its header. Palette, gray, low & 16 bit depth images are converted to 8 bit RGB(A) as
+    they are decoded. If aForceAlpha is true, opaque images are decoded to RGBA too.
+    Returns false if the file could not be read, in which case the decoder does not need to be closed.
+    Can be used from any thread.
+*/
+extern bool png_openDecoder(PngDecoder_t *aoDecoder, const char *aPath, bool aForceAlpha);
+/*!
+    Decodes the image into aoPixels, rows ordered bottom to top & aRowStride bytes apart, premultiplying each row
+    as it is decoded if requested. The buffer must hold at least (height - 1)*aRowStride + width*channels bytes.
+*/
+extern bool png_decodeInto(PngDecoder_t *aDecoder, unsigned char *aoPixels, size_t aRowStride, bool aPremultiply);
+/*!
+    Closes the file & releases the decoder's resources.
+*/
+extern void png_closeDecoder(PngDecoder_t *aDecoder);
 #endif
@@ -0,0 +1,607 @@
+#include "preloader.h"
+#include "gametimer.h"
+#include "json.h"
+#include "luacontext.h"
+#include "png_loader.h"
+#include "sound.h"
+#include "texture.h"
+#include "texture_cache.h"
+#include "tmx_map.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#define kPreloaderMaxPathLength 1024
+
+typedef struct _PreloadAsset {
+    char *name;
+    PreloadAssetType_t type;
+    char *resourceName, *packingInfoName;
+    bool repeats;
+    int *dependencies; // Indices of the assets that have to be created first
+    int numberOfDependencies;
+    PreloadAssetState_t state;
+
+    // Resolved when the preloader is started (Empty if the resource is missing)
+    char path[kPreloaderMaxPathLength];
+    char packingInfoPath[kPreloaderMaxPathLength];
+
+    // Written by the worker decoding the asset, then owned by the main thread once decoded
+    bool decodeFailed;
+    unsigned char *pixels; // Premultiplied image of PNG textures
+    int width, height;
+    bool hasAlpha;
+    MappedFile_t prefetchedFile; // The file of assets whose data is read by the creating API (KTX textures & music)
+    MappedFile_t dataFile; // Packing info of atlases & data files, parsed on the main thread
+    TMXMap_t *map;
+    SoundEffectData_t *sound;
+
+    Obj_t *object; // Retained once created
+} PreloadAsset_t;
+
+static void preloader_destroy(Preloader_t *aPreloader);
+static void *_preloader_worker(Preloader_t *aPreloader);
+
+Class_t Class_Preloader = {
+    "Preloader",
+    sizeof(Preloader_t),
+    (Obj_destructor_t)&preloader_destroy
+};
+
+Preloader_t *preloader_create(void)
+{
+    Preloader_t *out = obj_create_autoreleased(&Class_Preloader);
+    out->uploadBudget = 0.008;
+    out->luaProgressCallback = -1;
+    pthread_mutex_init(&out->lock, NULL);
+    pthread_cond_init(&out->assetDecoded, NULL);
+    return out;
+}
+
+// Frees whatever a worker decoded that was not handed over to a created asset
+static void _preloader_releaseDecoded(PreloadAsset_t *aAsset)
+{
+    free(aAsset->pixels);
+    aAsset->pixels = NULL;
+    util_unmapFile(&aAsset->prefetchedFile);
+    util_unmapFile(&aAsset->dataFile);
+    if(aAsset->map)
+        obj_release(aAsset->map);
+    aAsset->map = NULL;
+    if(aAsset->sound)
+        sfx_discardDecoded(aAsset->sound);
+    aAsset->sound = NULL;
+}
+
+static void _preloader_joinWorkers(Preloader_t *aPreloader)
+{
+    pthread_mutex_lock(&aPreloader->lock);
+    aPreloader->shouldStopWorkers = true;
+    pthread_mutex_unlock(&aPreloader->lock);
+    for(int i = 0; i < aPreloader->numberOfThreads; ++i)
+        pthread_join(aPreloader->threads[i], NULL);
+    aPreloader->numberOfThreads = 0;
+}
+
+void preloader_destroy(Preloader_t *aPreloader)
+{
+    // Workers finish the asset they are decoding before stopping
+    _preloader_joinWorkers(aPreloader);
+    for(int i = 0; i < aPreloader->numberOfAssets; ++i) {
+        PreloadAsset_t *asset = &aPreloader->assets[i];
+        _preloader_releaseDecoded(asset);
+        if(asset->object)
+            obj_release(asset->object);
+        free(asset->name);
+        free(asset->resourceName);
+        free(asset->packingInfoName);
+        free(asset->dependencies);
+    }
+    free(aPreloader->assets);
+    free(aPreloader->order);
+    if(aPreloader->luaProgressCallback != -1)
+        luaCtx_unregisterScriptHandler(GlobalLuaContext, aPreloader->luaProgressCallback);
+    pthread_mutex_destroy(&aPreloader->lock);
+    pthread_cond_destroy(&aPreloader->assetDecoded);
+}
+
+#pragma mark - Manifest
+
+static int _preloader_findAsset(Preloader_t *aPreloader, const char *aName)
+{
+    for(int i = 0; i < aPreloader->numberOfAssets; ++i) {
+        if(strcmp(aPreloader->assets[i].name, aName) == 0)
+            return i;
+    }
+    return -1;
+}
+
+PreloadAssetType_t preloader_typeForPath(const char *aPath)
+{
+    static const struct { const char *extension; PreloadAssetType_t type; } types[] = {
+        { ".png", kPreloadAsset_texture }, { ".ktx", kPreloadAsset_texture }, { ".ktx2", kPreloadAsset_texture },
+        { ".tmx", kPreloadAsset_map },     { ".dtmb", kPreloadAsset_map },
+        { ".ogg", kPreloadAsset_sound },   { ".wav", kPreloadAsset_sound },   { ".caf", kPreloadAsset_sound },
+        { ".aif", kPreloadAsset_sound },   { ".aiff", kPreloadAsset_sound },  { ".mp3", kPreloadAsset_music },
+        { ".m4a", kPreloadAsset_music },   { ".json", kPreloadAsset_data }
+    };
+    const char *extension = aPath ? strrchr(aPath, '.') : NULL;
+    if(!extension)
+        return kPreloadAsset_unknown;
+    for(int i = 0; i < sizeof(types)/sizeof(types[0]); ++i) {
+        if(strcasecmp(extension, types[i].extension) == 0)
+            return types[i].type;
+    }
+    return kPreloadAsset_unknown;
+}
+
+bool preloader_addAsset(Preloader_t *aPreloader, PreloadAssetType_t aType, const char *aName, const char *aPath,
+                        const char *aPackingInfoPath, bool aRepeats)
+{
+    dynamo_assert(aPath != NULL, "Invalid path");
+    if(aPreloader->isStarted) {
+        dynamo_log("Assets can not be added to a preloader once it has started");
+        return false;
+    }
+    aName = aName ? aName : aPath;
+    if(aType == kPreloadAsset_unknown) {
+        dynamo_log("Unknown type of asset %s", aName);
+        return false;
+    }
+    if(_preloader_findAsset(aPreloader, aName) != -1) {
+        dynamo_log("Duplicate asset %s", aName);
+        return false;
+    }
+    if(aType == kPreloadAsset_atlas && !aPackingInfoPath) {
+        dynamo_log("Atlas %s has no packing info", aName);
+        return false;
+    }
+
+    if(aPreloader->numberOfAssets == aPreloader->capacity) {
+        aPreloader->capacity = aPreloader->capacity ? aPreloader->capacity*2 : 16;
+        aPreloader->assets = realloc(aPreloader->assets, aPreloader->capacity*sizeof(PreloadAsset_t));
+    }
+    PreloadAsset_t *asset = &aPreloader->assets[aPreloader->numberOfAssets++];
+    memset(asset, 0, sizeof(PreloadAsset_t));
+    asset->name = strdup(aName);
+    asset->type = aType;
+    asset->resourceName = strdup(aPath);
+    asset->packingInfoName = aPackingInfoPath ? strdup(aPackingInfoPath) : NULL;
+    asset->repeats = aRepeats;
+    asset->state = kPreloadAsset_queued;
+    return true;
+}
+
+bool preloader_addDependency(Preloader_t *aPreloader, const char *aName, const char *aDependencyName)
+{
+    int assetIdx = _preloader_findAsset(aPreloader, aName);
+    int dependencyIdx = _preloader_findAsset(aPreloader, aDependencyName);
+    if(assetIdx == -1 || dependencyIdx == -1 || aPreloader->isStarted) {
+        dynamo_log("Could not make %s depend on %s", aName, aDependencyName);
+        return false;
+    }
+    PreloadAsset_t *asset = &aPreloader->assets[assetIdx];
+    asset->dependencies = realloc(asset->dependencies, (asset->numberOfDependencies + 1)*sizeof(int));
+    asset->dependencies[asset->numberOfDependencies++] = dependencyIdx;
+    return true;
+}
+
+static const char *_preloader_getString(Dictionary_t *aDict, const char *aKey)
+{
+    String_t *string = dict_get(aDict, aKey);
+    return (string && obj_isClass(string, &Class_String)) ? string->cString : NULL;
+}
+
+static PreloadAssetType_t _preloader_typeNamed(const char *aTypeName)
+{
+    static const char *names[] = { "texture", "atlas", "map", "sound", "music", "data" };
+    for(int i = 0; i < sizeof(names)/sizeof(names[0]); ++i) {
+        if(strcmp(aTypeName, names[i]) == 0)
+            return (PreloadAssetType_t)i;
+    }
+    return kPreloadAsset_unknown;
+}
+
+bool preloader_addManifest(Preloader_t *aPreloader, const char *aPath)
+{
+    Obj_t *manifest = parseJSONFile(aPath);
+    if(manifest && obj_isClass(manifest, &Class_Dictionary))
+        manifest = dict_get(manifest, "assets");
+    if(!manifest || !obj_isClass(manifest, &Class_Array)) {
+        dynamo_log("Invalid preload manifest %s", aPath);
+        return false;
+    }
+    Array_t *entries = manifest;
+    bool succeeded = true;
+    for(int i = 0; i < entries->count; ++i) {
+        Dictionary_t *entry = entries->items[i];
+        const char *path = obj_isClass(entry, &Class_Dictionary) ? _preloader_getString(entry, "path") : NULL;
+        if(!path) {
+            dynamo_log("Asset %d of %s has no path", i, aPath);
+            succeeded = false;
+            continue;
+        }
+        const char *packingInfo = _preloader_getString(entry, "packingInfo");
+        const char *typeName = _preloader_getString(entry, "type");
+        PreloadAssetType_t type = typeName ? _preloader_typeNamed(typeName) : preloader_typeForPath(path);
+        if(!typeName && type == kPreloadAsset_texture && packingInfo)
+            type = kPreloadAsset_atlas;
+        Number_t *repeats = dict_get(entry, "repeat");
+        succeeded &= preloader_addAsset(aPreloader, type, _preloader_getString(entry, "name"), path, packingInfo,
+                                        repeats && obj_isClass(repeats, &Class_Number) && repeats->floatValue != 0.0f);
+    }
+    // Dependencies may refer to assets listed further down
+    for(int i = 0; i < entries->count; ++i) {
+        Dictionary_t *entry = entries->items[i];
+        Array_t *dependencies = obj_isClass(entry, &Class_Dictionary) ? dict_get(entry, "dependsOn") : NULL;
+        if(!dependencies || !obj_isClass(dependencies, &Class_Array))
+            continue;
+        const char *name = _preloader_getString(entry, "name");
+        if(!name)
+            name = _preloader_getString(entry, "path");
+        for(int j = 0; name && j < dependencies->count; ++j) {
+            String_t *dependency = dependencies->items[j];
+            if(obj_isClass(dependency, &Class_String))
+                succeeded &= preloader_addDependency(aPreloader, name, dependency->cString);
+        }
+    }
+    return succeeded;
+}
+
+#pragma mark - Loading
+
+// Orders the assets so that every asset comes after its dependencies. Cycles are broken by dropping a dependency.
+static void _preloader_sortAssets(Preloader_t *aPreloader)
+{
+    int count = aPreloader->numberOfAssets;
+    aPreloader->order = malloc(MAX(1, count)*sizeof(int));
+    int *unplacedDependencies = malloc(MAX(1, count)*sizeof(int));
+    bool *isPlaced = calloc(MAX(1, count), sizeof(bool));
+    for(int i = 0; i < count; ++i)
+        unplacedDependencies[i] = aPreloader->assets[i].numberOfDependencies;
+
+    int numberPlaced = 0;
+    while(numberPlaced < count) {
+        bool placedAny = false;
+        for(int i = 0; i < count; ++i) {
+            if(isPlaced[i] || unplacedDependencies[i] > 0)
+                continue;
+            aPreloader->order[numberPlaced++] = i;
+            isPlaced[i] = true;
+            placedAny = true;
+            for(int j = 0; j < count; ++j) {
+                for(int k = 0; k < aPreloader->assets[j].numberOfDependencies; ++k)
+                    unplacedDependencies[j] -= aPreloader->assets[j].dependencies[k] == i;
+            }
+        }
+        if(placedAny)
+            continue;
+        // Every remaining asset waits on another, drop the unplaced dependencies of the first one
+        for(int i = 0; i < count; ++i) {
+            if(isPlaced[i])
+                continue;
+            PreloadAsset_t *asset = &aPreloader->assets[i];
+            dynamo_log("Dependency cycle involving %s", asset->name);
+            int kept = 0;
+            for(int k = 0; k < asset->numberOfDependencies; ++k) {
+                if(isPlaced[asset->dependencies[k]])
+                    asset->dependencies[kept++] = asset->dependencies[k];
+            }
+            asset->numberOfDependencies = kept;
+            unplacedDependencies[i] = 0;
+            break;
+        }
+    }
+    free(unplacedDependencies);
+    free(isPlaced);
+}
+
+static bool _preloader_isKtx(PreloadAsset_t *aAsset)
+{
+    const char *extension = strrchr(aAsset->path, '.');
+    return extension && (strcasecmp(extension, ".ktx") == 0 || strcasecmp(extension, ".ktx2") == 0);
+}
+
+void preloader_start(Preloader_t *aPreloader, int aNumberOfThreads, PreloadProgressCallback_t aCallback, void *aContext,
+                     int aLuaCallback)
+{
+    dynamo_assert(!aPreloader->isStarted, "Preloader already started");
+    aPreloader->isStarted = true;
+    aPreloader->progressCallback = aCallback;
+    aPreloader->progressContext = aContext;
+    aPreloader->luaProgressCallback = aLuaCallback;
+    _preloader_sortAssets(aPreloader);
+
+    for(int i = 0; i < aPreloader->numberOfAssets; ++i) {
+        PreloadAsset_t *asset = &aPreloader->assets[i];
+        if(!util_pathForResource(asset->resourceName, NULL, NULL, asset->path, kPreloaderMaxPathLength)
+           || (asset->packingInfoName
+               && !util_pathForResource(asset->packingInfoName, NULL, NULL, asset->packingInfoPath, kPreloaderMaxPathLength))) {
+            dynamo_log("Could not find %s", asset->name);
+            asset->path[0] = '\0';
+            continue;
+        }
+        // Textures that are already loaded are shared rather than decoded again
+        if(asset->type == kPreloadAsset_texture || asset->type == kPreloadAsset_atlas) {
+            Texture_t *cached = texCache_find(asset->path, asset->repeats, asset->repeats);
+            if(cached)
+                asset->object = obj_retain(cached);
+        }
+    }
+
+    int numberOfThreads = aNumberOfThreads;
+    if(numberOfThreads <= 0)
+        numberOfThreads = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    numberOfThreads = MIN(MIN(MAX(1, numberOfThreads), kPreloaderMaxThreads), aPreloader->numberOfAssets);
+    for(int i = 0; i < numberOfThreads; ++i) {
+        if(pthread_create(&aPreloader->threads[aPreloader->numberOfThreads], NULL, (void *(*)(void *))&_preloader_worker, aPreloader) != 0) {
+            // Without any worker the assets are decoded by preloader_update instead
+            dynamo_log("Unable to create preloading thread");
+            break;
+        }
+        ++aPreloader->numberOfThreads;
+    }
+}
+
+// Decodes a PNG straight into the buffer it is uploaded from, premultiplied (As texLoader_loadPng does)
+static bool _preloader_decodePng(PreloadAsset_t *aAsset)
+{
+    PngDecoder_t decoder;
+    if(!png_openDecoder(&decoder, aAsset->path, false))
+        return false;
+    size_t rowBytes = (size_t)decoder.width*decoder.channels;
+    aAsset->pixels = malloc(rowBytes*decoder.height);
+    bool succeeded = png_decodeInto(&decoder, aAsset->pixels, rowBytes, true);
+    aAsset->width = decoder.width;
+    aAsset->height = decoder.height;
+    aAsset->hasAlpha = decoder.channels == 4;
+    png_closeDecoder(&decoder);
+    return succeeded;
+}
+
+// Reads & decodes everything that does not require the GL or AL contexts. Called on a worker thread.
+static void _preloader_decode(PreloadAsset_t *aAsset)
+{
+    if(aAsset->path[0] == '\0') {
+        aAsset->decodeFailed = true;
+        return;
+    }
+    bool succeeded = true;
+    switch(aAsset->type) {
+        case kPreloadAsset_atlas:
+            succeeded = util_mapFile(aAsset->packingInfoPath, kMappedFileAccess_sequential, &aAsset->dataFile);
+            // Fall through
+        case kPreloadAsset_texture:
+            if(aAsset->object)
+                break;
+            // Compressed textures are uploaded as they are stored, so they only need to be read in
+            if(_preloader_isKtx(aAsset))
+                succeeded &= util_mapFile(aAsset->path, kMappedFileAccess_prefetch, &aAsset->prefetchedFile);
+            else
+                succeeded &= _preloader_decodePng(aAsset);
+            break;
+        case kPreloadAsset_map:
+            aAsset->map = tmx_loadMapFile(aAsset->path);
+            succeeded = aAsset->map != NULL;
+            break;
+        case kPreloadAsset_sound:
+            aAsset->sound = sfx_decode(aAsset->path);
+            succeeded = aAsset->sound != NULL;
+            break;
+        case kPreloadAsset_music:
+            succeeded = util_mapFile(aAsset->path, kMappedFileAccess_prefetch, &aAsset->prefetchedFile);
+            break;
+        case kPreloadAsset_data:
+            succeeded = util_mapFile(aAsset->path, kMappedFileAccess_sequential, &aAsset->dataFile);
+            break;
+        default:
+            succeeded = false;
+    }
+    aAsset->decodeFailed = !succeeded;
+}
+
+static Texture_t *_preloader_createTexture(PreloadAsset_t *aAsset)
+{
+    // The same file may have been loaded since the preloader was started
+    Texture_t *texture = texCache_find(aAsset->path, aAsset->repeats, aAsset->repeats);
+    if(texture)
+        return texture;
+    if(_preloader_isKtx(aAsset))
+        return texCache_loadPng(aAsset->path, aAsset->repeats, aAsset->repeats);
+
+    texture = texture_createFromData(aAsset->pixels, aAsset->width, aAsset->height, aAsset->hasAlpha,
+                                     aAsset->repeats, aAsset->repeats);
+    texture->premultipliesAlpha = true;
+    texture_setSource(texture, aAsset->path, aAsset->repeats, aAsset->repeats);
+    texCache_insert(texture, aAsset->path, aAsset->repeats, aAsset->repeats);
+    return texture;
+}
+
+// Creates the objects of a decoded asset. Called on the main thread.
+static bool _preloader_create(PreloadAsset_t *aAsset)
+{
+    if(aAsset->decodeFailed)
+        return false;
+    switch(aAsset->type) {
+        case kPreloadAsset_texture:
+        case kPreloadAsset_atlas: {
+            if(!aAsset->object) {
+                Texture_t *created = _preloader_createTexture(aAsset);
+                if(!created)
+                    return false;
+                aAsset->object = obj_retain(created);
+            }
+            Texture_t *texture = aAsset->object;
+            // Cached textures may already have had their packing info loaded
+            if(aAsset->type == kPreloadAsset_atlas && !texture->subtextures) {
+                if(!texture_setPackingInfoData(texture, aAsset->dataFile.data, aAsset->dataFile.length)) {
+                    dynamo_log("Invalid texture packing data in %s", aAsset->packingInfoPath);
+                    return false;
+                }
+            }
+            return true;
+        }
+        case kPreloadAsset_map:
+            aAsset->object = aAsset->map; // Already retained
+            aAsset->map = NULL;
+            return true;
+        case kPreloadAsset_sound: {
+            SoundEffect_t *sound = sfx_createFromDecoded(aAsset->sound);
+            aAsset->sound = NULL;
+            if(sound)
+                aAsset->object = obj_retain(sound);
+            return sound != NULL;
+        }
+        case kPreloadAsset_music: {
+            BackgroundMusic_t *music = bgm_load(aAsset->path);
+            if(music)
+                aAsset->object = obj_retain(music);
+            return music != NULL;
+        }
+        case kPreloadAsset_data: {
+            Obj_t *root = parseJSONData(aAsset->dataFile.data, aAsset->dataFile.length);
+            if(root)
+                aAsset->object = obj_retain(root);
+            return root != NULL;
+        }
+        default:
+            return false;
+    }
+}
+
+// Returns the next decoded asset whose dependencies have all completed (Must be called with the lock held)
+static PreloadAsset_t *_preloader_findCreatable(Preloader_t *aPreloader)
+{
+    for(int i = 0; i < aPreloader->numberOfAssets; ++i) {
+        PreloadAsset_t *asset = &aPreloader->assets[aPreloader->order[i]];
+        if(asset->state != kPreloadAsset_decoded)
+            continue;
+        bool isReady = true;
+        for(int j = 0; isReady && j < asset->numberOfDependencies; ++j) {
+            PreloadAssetState_t dependencyState = aPreloader->assets[asset->dependencies[j]].state;
+            isReady = dependencyState == kPreloadAsset_loaded || dependencyState == kPreloadAsset_failed;
+        }
+        if(isReady)
+            return asset;
+    }
+    return NULL;
+}
+
+// Takes the next asset to decode & decodes it. Returns false if there is nothing left to decode. (Called with the lock held)
+static bool _preloader_decodeNext(Preloader_t *aPreloader)
+{
+    if(aPreloader->nextQueued >= aPreloader->numberOfAssets || aPreloader->shouldStopWorkers)
+        return false;
+    PreloadAsset_t *asset = &aPreloader->assets[aPreloader->order[aPreloader->nextQueued++]];
+    asset->state = kPreloadAsset_decoding;
+    pthread_mutex_unlock(&aPreloader->lock);
+
+    // The asset is owned by this thread until it is marked as decoded
+    _preloader_decode(asset);
+
+    pthread_mutex_lock(&aPreloader->lock);
+    asset->state = kPreloadAsset_decoded;
+    pthread_cond_signal(&aPreloader->assetDecoded);
+    return true;
+}
+
+static void _preloader_reportProgress(Preloader_t *aPreloader)
+{
+    if(aPreloader->progressCallback)
+        aPreloader->progressCallback(aPreloader, aPreloader->numberOfCompletedAssets, aPreloader->numberOfAssets,
+                                     aPreloader->progressContext);
+    if(aPreloader->luaProgressCallback != -1) {
+        luaCtx_pushScriptHandler(GlobalLuaContext, aPreloader->luaProgressCallback);
+        luaCtx_pushlightuserdata(GlobalLuaContext, aPreloader);
+        luaCtx_pushinteger(GlobalLuaContext, aPreloader->numberOfCompletedAssets);
+        luaCtx_pushinteger(GlobalLuaContext, aPreloader->numberOfAssets);
+        luaCtx_pcall(GlobalLuaContext, 3, 0, 0);
+    }
+}
+
+bool preloader_update(Preloader_t *aPreloader)
+{
+    dynamo_assert(aPreloader->isStarted, "Preloader not started");
+    if(aPreloader->isFinished)
+        return true;
+
+    GLMFloat start = dynamo_globalTime();
+    bool createdAny = false;
+    while(aPreloader->numberOfCompletedAssets < aPreloader->numberOfAssets) {
+        if(createdAny && dynamo_globalTime() - start >= aPreloader->uploadBudget)
+            break;
+        pthread_mutex_lock(&aPreloader->lock);
+        PreloadAsset_t *asset = _preloader_findCreatable(aPreloader);
+        // Without workers, decode one asset at a time here
+        if(!asset && aPreloader->numberOfThreads == 0 && _preloader_decodeNext(aPreloader))
+            asset = _preloader_findCreatable(aPreloader);
+        pthread_mutex_unlock(&aPreloader->lock);
+        if(!asset)
+            break;
+
+        bool succeeded = _preloader_create(asset);
+        _preloader_releaseDecoded(asset);
+        if(!succeeded) {
+            dynamo_log("Unable to preload %s", asset->name);
+            ++aPreloader->numberOfFailedAssets;
+        }
+        pthread_mutex_lock(&aPreloader->lock);
+        asset->state = succeeded ? kPreloadAsset_loaded : kPreloadAsset_failed;
+        pthread_mutex_unlock(&aPreloader->lock);
+        ++aPreloader->numberOfCompletedAssets;
+        createdAny = true;
+        _preloader_reportProgress(aPreloader);
+    }
+
+    if(aPreloader->numberOfCompletedAssets < aPreloader->numberOfAssets)
+        return false;
+    _preloader_joinWorkers(aPreloader);
+    if(aPreloader->numberOfAssets == 0)
+        _preloader_reportProgress(aPreloader);
+    if(aPreloader->luaProgressCallback != -1)
+        luaCtx_unregisterScriptHandler(GlobalLuaContext, aPreloader->luaProgressCallback);
+    aPreloader->luaProgressCallback = -1;
+    aPreloader->isFinished = true;
+    return true;
+}
+
+void preloader_finish(Preloader_t *aPreloader)
+{
+    while(!preloader_update(aPreloader)) {
+        // Sleep until a worker has decoded something that can be created
+        pthread_mutex_lock(&aPreloader->lock);
+        while(aPreloader->numberOfThreads > 0 && !_preloader_findCreatable(aPreloader))
+            pthread_cond_wait(&aPreloader->assetDecoded, &aPreloader->lock);
+        pthread_mutex_unlock(&aPreloader->lock);
+    }
+}
+
+bool preloader_isFinished(Preloader_t *aPreloader)
+{
+    return aPreloader->isFinished;
+}
+
+Obj_t *preloader_getAsset(Preloader_t *aPreloader, const char *aName)
+{
+    int idx = _preloader_findAsset(aPreloader, aName);
+    return idx != -1 ? aPreloader->assets[idx].object : NULL;
+}
+
+PreloadAssetType_t preloader_getAssetType(Preloader_t *aPreloader, const char *aName)
+{
+    int idx = _preloader_findAsset(aPreloader, aName);
+    return idx != -1 ? aPreloader->assets[idx].type : kPreloadAsset_unknown;
+}
+
+#pragma mark - Worker
+
+static void *_preloader_worker(Preloader_t *aPreloader)
+{
+    // Every asset is queued up front, so workers exit once the queue has been drained
+    pthread_mutex_lock(&aPreloader->lock);
+    while(_preloader_decodeNext(aPreloader));
+    pthread_mutex_unlock(&aPreloader->lock);
+    return NULL;
+}
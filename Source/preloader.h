@@ -0,0 +1,145 @@
+/*!
+    @header Preloader
+    @abstract
+    @discussion Loads the assets of a level in parallel ahead of time.
+
+    The assets are described by a manifest: a JSON file, or a list of assets added one by one (e.g. from a lua table),
+    each optionally naming the assets it depends on. Once started, the files are read & decoded by a pool of worker
+    threads while the OpenGL & OpenAL objects are created on the main thread by preloader_update, within a per call time
+    budget. An asset is only created once all of its dependencies have been, and a progress callback is called every time
+    an asset completes. Loading a level therefore takes about as long as its slowest asset rather than the sum of them all.
+
+    A JSON manifest is either an array of asset descriptions or a dictionary holding one under "assets":
+        [ { "name": "hero", "path": "hero.png", "packingInfo": "hero.json" },
+          { "name": "level", "path": "level1.dtmb", "dependsOn": ["hero"] },
+          { "path": "jump.ogg", "type": "sound" } ]
+    "path" is a resource name (Located using util_pathForResource), "name" defaults to it & "type" (One of
+    texture/atlas/map/sound/music/data) defaults to a guess based on the file extension. Textures may also set "repeat".
+
+    Preloaded textures are added to the texture cache, so later loads of the same files share them.
+*/
+
+#ifndef _PRELOADER_H_
+#define _PRELOADER_H_
+
+#include "object.h"
+#include "GLMath/GLMath.h"
+#include <pthread.h>
+
+#define kPreloaderMaxThreads 8
+
+typedef enum _PreloadAssetType {
+    kPreloadAsset_texture, // A PNG or KTX image
+    kPreloadAsset_atlas,   // A texture along with its packing info
+    kPreloadAsset_map,     // A TMX or binary map
+    kPreloadAsset_sound,   // A sound effect
+    kPreloadAsset_music,   // Background music (Streamed while playing, so only the file is read ahead)
+    kPreloadAsset_data,    // A JSON file
+    kPreloadAsset_unknown
+} PreloadAssetType_t;
+
+typedef enum _PreloadAssetState {
+    kPreloadAsset_queued,   // Waiting for a worker thread
+    kPreloadAsset_decoding, // Being read by a worker thread
+    kPreloadAsset_decoded,  // Waiting to be created on the main thread
+    kPreloadAsset_loaded,   // Created
+    kPreloadAsset_failed    // Missing or could not be decoded (Counts as completed)
+} PreloadAssetState_t;
+
+typedef struct _Preloader Preloader_t;
+
+/*!
+    Called on the main thread every time an asset completes (Whether it loaded or failed), and once everything has
+    completed if the preloader holds no assets.
+*/
+typedef void (*PreloadProgressCallback_t)(Preloader_t *aPreloader, int aCompleted, int aTotal, void *aContext);
+
+/*!
+    A preloader
+
+    @field numberOfAssets The number of assets in the manifest
+    @field numberOfCompletedAssets Assets that have been created or have failed
+    @field numberOfFailedAssets Assets that could not be loaded
+    @field uploadBudget The maximum time in seconds spent creating assets per call to preloader_update
+*/
+struct _Preloader {
+    OBJ_GUTS
+    int numberOfAssets, capacity;
+    struct _PreloadAsset *assets;
+    int numberOfCompletedAssets;
+    int numberOfFailedAssets;
+    GLMFloat uploadBudget;
+    bool isStarted;
+
+    PreloadProgressCallback_t progressCallback;
+    void *progressContext;
+    int luaProgressCallback;
+
+    int numberOfThreads;
+    pthread_t threads[kPreloaderMaxThreads];
+    pthread_mutex_t lock; // Guards the state of the assets shared with the workers
+    pthread_cond_t assetDecoded;
+    int nextQueued; // Index in the decoding order of the next asset for the workers
+    int *order; // The assets sorted so that dependencies come first
+    volatile bool shouldStopWorkers;
+    bool isFinished; // Set once the final progress has been reported
+};
+extern Class_t Class_Preloader;
+
+/*!
+    Creates an empty preloader.
+*/
+extern Preloader_t *preloader_create(void);
+/*!
+    Adds an asset. Returns false if an asset with the same name exists, or if the preloader has been started.
+
+    @param aName The name the asset is retrieved & depended on by (NULL to use aPath)
+    @param aPackingInfoPath The packing info resource of atlases (NULL otherwise)
+*/
+extern bool preloader_addAsset(Preloader_t *aPreloader, PreloadAssetType_t aType, const char *aName, const char *aPath,
+                               const char *aPackingInfoPath, bool aRepeats);
+/*!
+    Makes an asset wait for another one to be created before it is. Both must have been added.
+*/
+extern bool preloader_addDependency(Preloader_t *aPreloader, const char *aName, const char *aDependencyName);
+/*!
+    Adds the assets listed in a JSON manifest.
+*/
+extern bool preloader_addManifest(Preloader_t *aPreloader, const char *aPath);
+/*!
+    Guesses the type of an asset from the extension of its file.
+*/
+extern PreloadAssetType_t preloader_typeForPath(const char *aPath);
+/*!
+    Starts decoding the assets on the worker threads.
+
+    @param aNumberOfThreads The number of worker threads (0 for one less than the number of cores)
+    @param aCallback Optional C function to call as assets complete
+    @param aLuaCallback Optional registered lua callback (-1 for none), called with the preloader, the number of
+                        completed assets & the total. The callback is unregistered once every asset has completed.
+*/
+extern void preloader_start(Preloader_t *aPreloader, int aNumberOfThreads, PreloadProgressCallback_t aCallback, void *aContext,
+                            int aLuaCallback);
+/*!
+    Creates the decoded assets whose dependencies have been created, within the upload budget.
+    Returns true once every asset has completed. Must be called on the main thread.
+*/
+extern bool preloader_update(Preloader_t *aPreloader);
+/*!
+    Blocks until every asset has completed, creating them as they are decoded. Must be called on the main thread.
+*/
+extern void preloader_finish(Preloader_t *aPreloader);
+/*!
+    Returns true once every asset has completed.
+*/
+extern bool preloader_isFinished(Preloader_t *aPreloader);
+/*!
+    Returns a loaded asset (Texture_t, TMXMap_t, SoundEffect_t, BackgroundMusic_t or the root object of the JSON data),
+    or NULL if it does not exist or has not been loaded (yet). The asset is held by the preloader until it is destroyed.
+*/
+extern Obj_t *preloader_getAsset(Preloader_t *aPreloader, const char *aName);
+/*!
+    Returns the type of an asset, or kPreloadAsset_unknown if it does not exist.
+*/
+extern PreloadAssetType_t preloader_getAssetType(Preloader_t *aPreloader, const char *aName);
+#endif
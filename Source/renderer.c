@@ -2,6 +2,7 @@
 #include "glutils.h"
 #include "util.h"
 #include "luacontext.h"
+#include "gametimer.h"
 
 static void renderer_destroy(Renderer_t *aRenderer);
 Class_t Class_Renderer = {
@@ -27,6 +28,7 @@ Renderer_t *renderer_create(vec2_t aViewPortSize, vec3_t aCameraOffset)
     out->cameraOffset = aCameraOffset;
     out->worldMatrixStack = matrix_stack_create(10);
     out->projectionMatrixStack = matrix_stack_create(10);
+    out->lastDisplayDuration = 0;
 
     // Initialize the transform matrices
     matrix_stack_push(out->worldMatrixStack);
@@ -47,6 +49,7 @@ void renderer_destroy(Renderer_t *aRenderer)
 
 void renderer_display(Renderer_t *aRenderer, GLMFloat aTimeSinceLastFrame, GLMFloat aInterpolation)
 {
+    GLMFloat startTime = dynamo_globalTime();
     glClear(GL_COLOR_BUFFER_BIT);
     
     matrix_stack_push(aRenderer->worldMatrixStack);
@@ -73,6 +76,7 @@ void renderer_display(Renderer_t *aRenderer, GLMFloat aTimeSinceLastFrame, GLMFl
     }
     
     matrix_stack_pop(aRenderer->worldMatrixStack);
+    aRenderer->lastDisplayDuration = dynamo_globalTime() - startTime;
 }
 
 
@@ -42,6 +42,7 @@ extern Class_t Class_Renderable;
     @field cameraOffset The viewing offset of the renderer
     @field worldMatrixStack The world matrix stack
     @field projectionMatrixStack The projection matrix stack
+    @field lastDisplayDuration The CPU time in seconds spent submitting the last frame (Excludes the driver's deferred work)
 */
 struct _Renderer {
     OBJ_GUTS
@@ -51,6 +52,7 @@ struct _Renderer {
     matrix_stack_t *worldMatrixStack;
     matrix_stack_t *projectionMatrixStack;
     LinkedList_t *renderables; // For internal use only
+    GLMFloat lastDisplayDuration;
 };
 extern Class_t Class_Renderer;
 
@@ -73,18 +73,17 @@ Shader_t *shader_load(const char *aVertSrc, const char *aFragSrc)
 
 Shader_t *shader_loadFromFiles(const char *aVertShaderPath, const char *aFragShaderPath)
 {
-    char *vertShaderSource = NULL, *fragShaderSource = NULL;
-    size_t vertShaderLength, fragShaderLength;
-    
-    util_readFile(aVertShaderPath, &vertShaderLength, &vertShaderSource);
-    dynamo_assert(vertShaderLength > 0 && vertShaderSource != NULL, "Could not read vertex shader source");
+    // The sources are compiled straight out of the mappings (Which are NUL terminated)
+    MappedFile_t vertShaderFile, fragShaderFile;
+    bool vertShaderRead = util_mapFile(aVertShaderPath, kMappedFileAccess_sequential, &vertShaderFile);
+    dynamo_assert(vertShaderRead && vertShaderFile.length > 0, "Could not read vertex shader source");
 
-    util_readFile(aFragShaderPath, &fragShaderLength, &fragShaderSource);
-    dynamo_assert(fragShaderLength > 0 && fragShaderSource != NULL, "Could not read fragment shader source");
-    Shader_t *out = shader_load(vertShaderSource, fragShaderSource);
+    bool fragShaderRead = util_mapFile(aFragShaderPath, kMappedFileAccess_sequential, &fragShaderFile);
+    dynamo_assert(fragShaderRead && fragShaderFile.length > 0, "Could not read fragment shader source");
+    Shader_t *out = shader_load(vertShaderFile.data, fragShaderFile.data);
 
-    free(vertShaderSource);
-    free(fragShaderSource);
+    util_unmapFile(&vertShaderFile);
+    util_unmapFile(&fragShaderFile);
 
     return out;
 }
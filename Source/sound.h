@@ -6,6 +6,7 @@
 
 #include "GLMath/GLMath.h"
 #include "object.h"
+#include <stdint.h>
 
 // Because the different platforms supported are so very different when it comes to audio,
 // all audio related types are opaque
@@ -23,6 +24,13 @@ typedef struct _SoundEffect SoundEffect_t;
 */
 typedef struct _BackgroundMusic BackgroundMusic_t;
 extern Class_t Class_BackgroundMusic;
+/*!
+    Identifies one playback (Instance) of a sound effect, as returned by sfx_play. An effect can have several instances
+    playing at once. Instances that have finished, been stopped or had their voice taken over by another sound are ignored
+    by the functions that take them, so handles can be kept around without being released.
+*/
+typedef uint32_t SoundInstance_t;
+#define kSoundInstance_none 0
 /*!
     Manages the audio state. Sounds can not be created or played if there is no current sound manager.<br>
     Currently you should only create one manager at a time. Creating multiple instances will result in undefined behaviour.
@@ -34,24 +42,56 @@ extern Class_t Class_SoundManager;
     Loads a sound effect
 */
 extern SoundEffect_t *sfx_load(const char *aFilename);
+/*!
+    A sound effect read & decoded ahead of the creation of its audio objects. (Opaque)
+    Splits loading so that the decoding can happen on a worker thread.
+*/
+typedef struct _SoundEffectData SoundEffectData_t;
+/*!
+    Reads & decodes a sound effect file. Does not touch the audio API, so it may be called from any thread.
+    Returns NULL on failure.
+*/
+extern SoundEffectData_t *sfx_decode(const char *aFilename);
+/*!
+    Creates a sound effect from decoded data, which is freed. Must be called on the main thread with a current sound manager.
+*/
+extern SoundEffect_t *sfx_createFromDecoded(SoundEffectData_t *aData);
+/*!
+    Frees decoded data that will not be used.
+*/
+extern void sfx_discardDecoded(SoundEffectData_t *aData);
 /*!
     Unloads a sound effect
 */
 extern void sfx_unload(SoundEffect_t *aSound);
 
 /*!
-    Plays a sound effect.
+    Starts a new instance of a sound effect, without interrupting the ones already playing.
+    Instances are played on a fixed number of voices. When they are all in use the voice of the least important instance
+    (Lowest priority, then farthest away, then oldest) is taken over, unless every playing instance has a higher priority
+    than aSound. An effect at its instance limit takes over its own oldest instance instead.
+    Returns the new instance, or kSoundInstance_none if it could not be played.
 */
-extern void sfx_play(SoundEffect_t *aSound);
+extern SoundInstance_t sfx_play(SoundEffect_t *aSound);
 /*!
-    Stops playback of a sound effect.
+    Stops every instance of a sound effect.
 */
 extern void sfx_stop(SoundEffect_t *aSound);
 /*!
-    Checks whether a sound effect is playing or not.
+    Checks whether any instance of a sound effect is playing.
 */
 extern bool sfx_isPlaying(SoundEffect_t *aSound);
 
+/*!
+    Sets the priority of a sound effect's instances when voices run out. (Defaults to 0)
+*/
+extern void sfx_setPriority(SoundEffect_t *aSound, int aPriority);
+/*!
+    Sets the maximum number of instances of a sound effect that play at once, or 0 for no limit. (The default)
+*/
+extern void sfx_setMaxInstances(SoundEffect_t *aSound, int aMaxInstances);
+
+// The setters below apply to the instances that are playing as well as to the ones started afterwards
 /*!
     Sets the volume of a sound effect.
 */
@@ -69,6 +109,27 @@ extern void sfx_setLooping(SoundEffect_t *aSound, bool aShouldLoop);
 */
 extern void sfx_setPitch(SoundEffect_t *aSound, float aPitch);
 
+/*!
+    Stops a single instance of a sound effect.
+*/
+extern void sfxInstance_stop(SoundInstance_t aInstance);
+/*!
+    Checks whether an instance of a sound effect is still playing.
+*/
+extern bool sfxInstance_isPlaying(SoundInstance_t aInstance);
+/*!
+    Sets the volume of a single instance.
+*/
+extern void sfxInstance_setVolume(SoundInstance_t aInstance, float aVolume);
+/*!
+    Sets the pitch of a single instance.
+*/
+extern void sfxInstance_setPitch(SoundInstance_t aInstance, float aPitch);
+/*!
+    Sets the 3D location of a single instance.
+*/
+extern void sfxInstance_setLocation(SoundInstance_t aInstance, vec3_t aPos);
+
 /*!
     Loads BGM.
 */
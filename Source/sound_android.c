@@ -7,6 +7,7 @@
 
 #include "sound.h"
 #include "util.h"
+#include "vfs.h"
 #include <SLES/OpenSLES.h>
 #include <SLES/OpenSLES_Android.h>
 #include <dlfcn.h>
@@ -20,6 +21,9 @@ struct _SoundEffect {
     SoundManager_t *soundManager; // Weak reference
     char *path;
     int channel;
+    uint32_t generation; // Incremented every time the effect is played, so that handles to earlier instances are ignored
+    int priority;
+    int maxInstances;
     SLboolean       loaded;
     SLObjectItf     oslPlayerObject;
     SLPlayItf       oslPlayerPlayInterface;
@@ -39,6 +43,7 @@ extern Class_t Class_SoundManager;
 struct _SoundManager {
     OBJ_GUTS
     bool oslLoadedChannels[ANDROID_MAX_SIMUL_SOUNDS]; // true => Busy, false => Available
+    SoundEffect_t *oslChannelEffects[ANDROID_MAX_SIMUL_SOUNDS]; // Weak references, for looking up instances
     SLObjectItf oslEngineObject;
     SLEngineItf oslEngineInterface;
     SLObjectItf oslOutputMixObject;
@@ -126,6 +131,19 @@ SoundEffect_t *sfx_load(const char *aFilename)
     SLDataLocator_URI dataLocator = { SL_DATALOCATOR_URI, (char*)aFilename };
     SLDataFormat_MIME dataFormat = { SL_DATAFORMAT_MIME, NULL, SL_CONTAINERTYPE_UNSPECIFIED };
     SLDataSource dataSource = { &dataLocator, &dataFormat };
+    // Sounds inside archives are played from their range of the archive file (They must be stored uncompressed)
+    SLDataLocator_AndroidFD fdLocator = { SL_DATALOCATOR_ANDROIDFD, -1, 0, 0 };
+    if(vfs_isVirtualPath(aFilename)) {
+        size_t length;
+        off_t offset;
+        if(!vfs_getFileRange(aFilename, &fdLocator.fd, &offset, &length)) {
+            dynamo_log("%s is missing or compressed", aFilename);
+            return NULL;
+        }
+        fdLocator.offset = offset;
+        fdLocator.length = length;
+        dataSource.pLocator = &fdLocator;
+    }
 
     SLDataLocator_OutputMix outputMixLocator = { SL_DATALOCATOR_OUTPUTMIX, _CurrentSoundManager->oslOutputMixObject };
     SLDataSink audioSink = { &outputMixLocator, NULL };
@@ -162,6 +180,38 @@ SoundEffect_t *sfx_load(const char *aFilename)
 
     out->loaded = true;
     _CurrentSoundManager->oslLoadedChannels[channel] = true;
+    _CurrentSoundManager->oslChannelEffects[channel] = out;
+    return out;
+}
+
+// OpenSL decodes while playing, so decoding ahead of time only warms the file up so that creating the player does not block on IO
+struct _SoundEffectData {
+    char *path;
+};
+
+SoundEffectData_t *sfx_decode(const char *aFilename)
+{
+    MappedFile_t file;
+    if(!util_mapFile(aFilename, kMappedFileAccess_prefetch, &file)) {
+        dynamo_log("Could not load %s", aFilename);
+        return NULL;
+    }
+    util_unmapFile(&file); // The pages stay in the page cache
+    SoundEffectData_t *out = malloc(sizeof(SoundEffectData_t));
+    out->path = strdup(aFilename);
+    return out;
+}
+
+void sfx_discardDecoded(SoundEffectData_t *aData)
+{
+    free(aData->path);
+    free(aData);
+}
+
+SoundEffect_t *sfx_createFromDecoded(SoundEffectData_t *aData)
+{
+    SoundEffect_t *out = sfx_load(aData->path);
+    sfx_discardDecoded(aData);
     return out;
 }
 
@@ -172,6 +222,7 @@ void sfx_unload(SoundEffect_t *aSound)
     aSound->loaded = false;
     (*aSound->oslPlayerObject)->Destroy(aSound->oslPlayerObject);
     aSound->soundManager->oslLoadedChannels[aSound->channel] = false;
+    aSound->soundManager->oslChannelEffects[aSound->channel] = NULL;
     aSound->oslPlayerObject = NULL;
     aSound->oslPlayerPlayInterface = NULL;
     aSound->oslPlayerSeekInterface = NULL;
@@ -186,7 +237,7 @@ void sfx_destroy(SoundEffect_t *aSound)
     sfx_unload(aSound);
 }
 
-void sfx_setPosition(SoundEffect_t *aSound, vec3_t aPos)
+void sfx_setLocation(SoundEffect_t *aSound, vec3_t aPos)
 {
     if(!aSound->oslPlayer3DLocationInterface)
         return;
@@ -239,10 +290,17 @@ void _sfx_pause(SoundEffect_t *aSound)
     _osl_setPlayState(aSound->oslPlayerPlayInterface, SL_PLAYSTATE_PAUSED);
 }
 
-void sfx_play(SoundEffect_t *aSound)
+// Each effect has a single OpenSL player, so it plays one instance at a time & the priority & instance limit have
+// nothing to choose between
+SoundInstance_t sfx_play(SoundEffect_t *aSound)
 {
-    if(!aSound->loaded) return;
-    _osl_setPlayState(aSound->oslPlayerPlayInterface, SL_PLAYSTATE_PLAYING);
+    if(!aSound->loaded) return kSoundInstance_none;
+    if(!_osl_setPlayState(aSound->oslPlayerPlayInterface, SL_PLAYSTATE_PLAYING))
+        return kSoundInstance_none;
+    aSound->generation = (aSound->generation + 1) & 0xffffff;
+    if(aSound->generation == 0)
+        aSound->generation = 1;
+    return (aSound->generation << 8) | aSound->channel;
 }
 void sfx_stop(SoundEffect_t *aSound)
 {
@@ -257,6 +315,63 @@ bool sfx_isPlaying(SoundEffect_t *aSound)
     return _osl_getPlayState(aSound->oslPlayerPlayInterface) == SL_PLAYSTATE_PLAYING;
 }
 
+void sfx_setPriority(SoundEffect_t *aSound, int aPriority)
+{
+    aSound->priority = aPriority;
+}
+
+void sfx_setMaxInstances(SoundEffect_t *aSound, int aMaxInstances)
+{
+    aSound->maxInstances = MAX(0, aMaxInstances);
+}
+
+#pragma mark - Sound effect instances
+
+// Returns the effect playing an instance, or NULL if the instance is no longer playing
+static SoundEffect_t *_sfx_effectForInstance(SoundInstance_t aInstance)
+{
+    int channel = aInstance & 0xff;
+    if(!_CurrentSoundManager || aInstance == kSoundInstance_none || channel >= ANDROID_MAX_SIMUL_SOUNDS)
+        return NULL;
+    SoundEffect_t *effect = _CurrentSoundManager->oslChannelEffects[channel];
+    if(!effect || effect->generation != aInstance >> 8 || !sfx_isPlaying(effect))
+        return NULL;
+    return effect;
+}
+
+void sfxInstance_stop(SoundInstance_t aInstance)
+{
+    SoundEffect_t *effect = _sfx_effectForInstance(aInstance);
+    if(effect)
+        sfx_stop(effect);
+}
+
+bool sfxInstance_isPlaying(SoundInstance_t aInstance)
+{
+    return _sfx_effectForInstance(aInstance) != NULL;
+}
+
+void sfxInstance_setVolume(SoundInstance_t aInstance, float aVolume)
+{
+    SoundEffect_t *effect = _sfx_effectForInstance(aInstance);
+    if(effect)
+        sfx_setVolume(effect, aVolume);
+}
+
+void sfxInstance_setPitch(SoundInstance_t aInstance, float aPitch)
+{
+    SoundEffect_t *effect = _sfx_effectForInstance(aInstance);
+    if(effect)
+        sfx_setPitch(effect, aPitch);
+}
+
+void sfxInstance_setLocation(SoundInstance_t aInstance, vec3_t aPos)
+{
+    SoundEffect_t *effect = _sfx_effectForInstance(aInstance);
+    if(effect)
+        sfx_setLocation(effect, aPos);
+}
+
 #pragma mark - BGM
 
 BackgroundMusic_t *bgm_load(const char *aFilename)
@@ -1,10 +1,9 @@
-#include "sound.h"
+#include "sound_openal.h"
 #include "util.h"
+#include "vfs.h"
 
 #include <AudioToolbox/AudioToolbox.h>
 #include <CoreFoundation/CFURL.h>
-#include <OpenAL/AL.h>
-#include <OpenAL/alc.h>
 
 // TODO: Soften error handling
 
@@ -16,23 +15,6 @@
     #import <AVFoundation/AVFoundation.h>
 #endif
 
-struct _SoundEffect {
-    OBJ_GUTS
-    // These properties should only be modified using their setter functions to ensure that
-    // the internal state stays up to date with their values.
-    vec3_t position;
-    bool isLooping;
-    float pitch;
-
-    // Platform specific and not guaranteed to exist
-    void *handle;
-    int samples;
-    int rate;
-    int channels;
-    unsigned int buffer;
-    unsigned int source;
-    unsigned int format;
-};
 struct _BackgroundMusic {
     OBJ_GUTS
     void *player;
@@ -43,22 +25,9 @@ struct _SoundManager {
     ALCdevice *device;
 };
 
-static void sfx_destroy(SoundEffect_t *aSound);
-static const char *_openAlErrorString(int aCode);
-static bool _checkForOpenAlError();
-static bool _sound_buf_stream(SoundEffect_t *aSound, ALuint aBuffer);
-static bool _sound_beginPlayback(SoundEffect_t *aSound);
-static bool _sound_update(SoundEffect_t *aSound);
-
 static void bgm_destroy(BackgroundMusic_t *aBGM);
 static void soundManager_destroy(SoundManager_t *aManager);
 
-Class_t Class_SoundEffect = {
-    "SoundEffect",
-    sizeof(SoundEffect_t),
-    (Obj_destructor_t)&sfx_destroy
-};
-
 Class_t Class_BackgroundMusic = {
     "BackgroundMusic",
     sizeof(BackgroundMusic_t),
@@ -73,20 +42,50 @@ Class_t Class_SoundManager = {
 
 #pragma mark - Sound effects
 
-SoundEffect_t *sfx_load(const char *aFilename)
+// Effects are played by sound_openal.c
+
+// Sounds inside archives are decoded straight out of the archive
+static OSStatus _sfx_archiveRead(void *aData, SInt64 aPosition, UInt32 aCount, void *aoBuffer, UInt32 *aoActualCount)
 {
-#define _CHECK_ERR(msg...) if(status != noErr) { \
-    dynamo_log(msg); \
-    return NULL; \
+    VFSData_t *data = aData;
+    if(aPosition < 0 || aPosition > data->size)
+        return kAudioFilePositionError;
+    *aoActualCount = MIN(aCount, data->size - aPosition);
+    memcpy(aoBuffer, (const char *)data->data + aPosition, *aoActualCount);
+    return noErr;
 }
 
-    SoundEffect_t *out = obj_create_autoreleased(&Class_SoundEffect);
+static SInt64 _sfx_archiveSize(void *aData)
+{
+    return ((VFSData_t *)aData)->size;
+}
 
-    CFURLRef url = CFURLCreateFromFileSystemRepresentation(kCFAllocatorDefault, (UInt8*)aFilename, strlen(aFilename), false);
+SoundEffectData_t *sfx_decode(const char *aFilename)
+{
+#define _CHECK_ERR(msg...) if(status != noErr) { \
+    dynamo_log(msg); \
+    goto fail; \
+}
 
-    ExtAudioFileRef AFID;
-    OSStatus status = ExtAudioFileOpenURL(url, &AFID);
-    CFRelease(url);
+    ExtAudioFileRef AFID = NULL;
+    OSStatus status;
+    AudioFileID archiveFile = NULL;
+    VFSData_t archiveData = {0};
+    SoundEffectData_t *out = calloc(1, sizeof(SoundEffectData_t));
+    if(vfs_isVirtualPath(aFilename)) {
+        if(!vfs_read(aFilename, &archiveData)) {
+            dynamo_log("Could not load %s", aFilename);
+            free(out);
+            return NULL;
+        }
+        status = AudioFileOpenWithCallbacks(&archiveData, &_sfx_archiveRead, NULL, &_sfx_archiveSize, NULL, 0, &archiveFile);
+        if(status == noErr)
+            status = ExtAudioFileWrapAudioFileID(archiveFile, false, &AFID);
+    } else {
+        CFURLRef url = CFURLCreateFromFileSystemRepresentation(kCFAllocatorDefault, (UInt8*)aFilename, strlen(aFilename), false);
+        status = ExtAudioFileOpenURL(url, &AFID);
+        CFRelease(url);
+    }
     _CHECK_ERR("Could not load %s", aFilename)
 
     AudioStreamBasicDescription inputFormat;
@@ -118,94 +117,35 @@ SoundEffect_t *sfx_load(const char *aFilename)
     _CHECK_ERR("Error getting audio data length");
 
 
-    UInt32 dataSize = dataLengthInFrames*outputFormat.mBytesPerFrame;
-    void *data = malloc(dataSize);
-    dynamo_assert(data, "Insufficient memory to load audio");
-    memset(data, 0, dataSize);
+    out->size = dataLengthInFrames*outputFormat.mBytesPerFrame;
+    out->samples = malloc(out->size);
+    dynamo_assert(out->samples, "Insufficient memory to load audio");
+    memset(out->samples, 0, out->size);
 
     AudioBufferList dataBuffer;
     dataBuffer.mNumberBuffers = 1;
-    dataBuffer.mBuffers[0].mDataByteSize = dataSize;
+    dataBuffer.mBuffers[0].mDataByteSize = out->size;
     dataBuffer.mBuffers[0].mNumberChannels = outputFormat.mChannelsPerFrame;
-    dataBuffer.mBuffers[0].mData = data;
+    dataBuffer.mBuffers[0].mData = out->samples;
     status = ExtAudioFileRead(AFID, (UInt32*)&dataLengthInFrames, &dataBuffer);
     _CHECK_ERR("Error decoding audio file data");
 
-    out->format = out->channels == 1 ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
-    alGenBuffers(1, &out->buffer);
-    alGenSources(1, &out->source);
-    _checkForOpenAlError();
-    alBufferData(out->buffer, out->format, data, dataSize, out->rate);
-    _checkForOpenAlError();
-
-    alSourcei(out->source, AL_BUFFER,  out->buffer);
-    sfx_setLocation(out, GLMVec3_zero);
-    sfx_setLooping(out, false);
-    sfx_setPitch(out, 1.0f);
-    alSource3f(out->source, AL_VELOCITY,        0.0, 0.0, 0.0);
-    alSource3f(out->source, AL_DIRECTION,       0.0, 0.0, 0.0);
-    alSourcef (out->source, AL_ROLLOFF_FACTOR,  0.0          );
-    alSourcei (out->source, AL_SOURCE_RELATIVE, AL_TRUE      );
-
-    return out;
-}
-
-void sfx_unload(SoundEffect_t *aSound)
-{
-    if(aSound->buffer != UINT_MAX && alIsBuffer(aSound->buffer)) {
-        alSourceUnqueueBuffers(aSound->source, 1, &aSound->buffer), aSound->buffer = UINT_MAX;
-        alDeleteBuffers(1, &aSound->buffer), aSound->buffer = UINT_MAX;
+    ExtAudioFileDispose(AFID);
+    if(archiveFile) {
+        AudioFileClose(archiveFile);
+        vfs_release(&archiveData);
     }
-    if(aSound->source != UINT_MAX && alIsSource(aSound->source))
-        alDeleteSources(1, &aSound->source), aSound->source = UINT_MAX;
-}
-
-void sfx_destroy(SoundEffect_t *aSound)
-{
-    sfx_unload(aSound);
-}
-
-void sfx_setVolume(SoundEffect_t *aSound, float aVolume)
-{
-    alSourcef(aSound->source, AL_GAIN, aVolume);
-}
-
-void sfx_setLocation(SoundEffect_t *aSound, vec3_t aPos)
-{
-    aSound->position = aPos;
-    alSource3f(aSound->source, AL_POSITION, aPos.x, aPos.y, aPos.z);
-}
-
-void sfx_setLooping(SoundEffect_t *aSound, bool aShouldLoop)
-{
-    aSound->isLooping = aShouldLoop;
-    alSourcei(aSound->source, AL_LOOPING, aShouldLoop);
-}
-
-void sfx_setPitch(SoundEffect_t *aSound, float aPitch)
-{
-    aSound->pitch = aPitch;
-    alSourcef(aSound->source, AL_PITCH, 1.0f);
-}
-
-void sfx_play(SoundEffect_t *aSound)
-{
-    if(sfx_isPlaying(aSound))
-        sfx_stop(aSound);
-    alSourcePlay(aSound->source);
-    _checkForOpenAlError();
-}
-void sfx_stop(SoundEffect_t *aSound)
-{
-    alSourceStop(aSound->source);
-    _checkForOpenAlError();
-}
+    return out;
 
-bool sfx_isPlaying(SoundEffect_t *aSound)
-{
-    ALenum state;
-    alGetSourcei(aSound->source, AL_SOURCE_STATE, &state);
-    return (state == AL_PLAYING);
+fail:
+    if(AFID)
+        ExtAudioFileDispose(AFID);
+    if(archiveFile)
+        AudioFileClose(archiveFile);
+    vfs_release(&archiveData);
+    sfx_discardDecoded(out);
+    return NULL;
+#undef _CHECK_ERR
 }
 
 #pragma mark - BGM
@@ -213,11 +153,21 @@ bool sfx_isPlaying(SoundEffect_t *aSound)
 BackgroundMusic_t *bgm_load(const char *aFilename)
 {
     dynamo_assert(aFilename, "Invalid filename");
-    NSString *path = [NSString stringWithUTF8String:aFilename];
-    NSURL *fileURL = [NSURL fileURLWithPath:path isDirectory:NO];
-
     NSError *err = nil;
-    AVAudioPlayer *player = [[AVAudioPlayer alloc] initWithContentsOfURL:fileURL error:&err];
+    AVAudioPlayer *player = nil;
+    if(vfs_isVirtualPath(aFilename)) {
+        VFSData_t archiveData;
+        if(!vfs_read(aFilename, &archiveData))
+            return NULL;
+        // Views into the archive stay valid until it is unmounted, decompressed copies are handed over to the NSData
+        NSData *data = [NSData dataWithBytesNoCopy:(void *)archiveData.data length:archiveData.size
+                                      freeWhenDone:archiveData._buffer != NULL];
+        player = [[AVAudioPlayer alloc] initWithData:data error:&err];
+    } else {
+        NSString *path = [NSString stringWithUTF8String:aFilename];
+        NSURL *fileURL = [NSURL fileURLWithPath:path isDirectory:NO];
+        player = [[AVAudioPlayer alloc] initWithContentsOfURL:fileURL error:&err];
+    }
     if(err) NSLog(@"%@", err);
 
     if(!player) return NULL;
@@ -293,42 +243,20 @@ SoundManager_t *soundManager_create()
 
 void soundManager_destroy(SoundManager_t *aManager)
 {
+    if(alcGetCurrentContext() == aManager->context) {
+        _sfx_destroyVoices();
+        alcMakeContextCurrent(NULL);
+    }
     alcDestroyContext(aManager->context);
     alcCloseDevice(aManager->device);
 }
 
 bool soundManager_makeCurrent(SoundManager_t *aManager)
 {
+    // The voices belong to the context that was current when they were created
+    if(aManager && alcGetCurrentContext() != aManager->context)
+        _sfx_destroyVoices();
     if(aManager)
         return alcMakeContextCurrent(aManager->context);
     return false;
 }
-
-#pragma mark - Utilities
-
-static const char *_openAlErrorString(int aCode)
-{
-        switch(aCode) {
-        case AL_INVALID_NAME:
-            return "Read from media.";
-        case AL_INVALID_ENUM:
-            return "Invalid parameter passed to AL call.";
-        case AL_INVALID_VALUE:
-            return "Invalid enum parameter value.";
-        case AL_INVALID_OPERATION:
-            return "Illegal OpenAL call.";
-        default:
-            return "Unknown OpenAL error.";
-    }
-}
-
-static bool _checkForOpenAlError()
-{
-    int error = alGetError();
-    if(error != AL_NO_ERROR) {
-        dynamo_log("OpenAL error occurred(%d): %s", error, _openAlErrorString(error));
-        return true;
-    }
-    return false;
-}
-
@@ -0,0 +1,423 @@
+#include "sound_openal.h"
+#include "util.h"
+#include <stdlib.h>
+#include <pthread.h>
+
+struct _SoundEffect {
+    OBJ_GUTS
+    ALuint buffer; // Played by every instance, 0 once unloaded
+    ALenum format;
+
+    // Applied to new instances, as well as to the playing ones when set
+    vec3_t position;
+    bool isLooping;
+    float pitch;
+    float volume;
+    int priority;
+    int maxInstances; // 0 for no limit
+};
+
+// A source that plays one instance at a time
+typedef struct _SFXVoice {
+    ALuint source;
+    SoundEffect_t *effect; // Weak reference, NULL while the voice is free
+    uint32_t generation; // Incremented for every instance played, so that handles to earlier ones are ignored
+    unsigned long startedAt; // Orders voices by age
+    int priority;
+    vec3_t position;
+} SFXVoice_t;
+
+static SFXVoice_t _Voices[kSFXMaxVoices];
+static int _NumberOfVoices = 0;
+static unsigned long _PlayCount = 0;
+static pthread_mutex_t _OpenAlLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void sfx_destroy(SoundEffect_t *aSound);
+static const char *_openAlErrorString(int aCode);
+
+Class_t Class_SoundEffect = {
+    "SoundEffect",
+    sizeof(SoundEffect_t),
+    (Obj_destructor_t)&sfx_destroy
+};
+
+#pragma mark - Loading
+
+void sfx_discardDecoded(SoundEffectData_t *aData)
+{
+    free(aData->samples);
+    free(aData);
+}
+
+SoundEffect_t *sfx_createFromDecoded(SoundEffectData_t *aData)
+{
+    SoundEffect_t *out = obj_create_autoreleased(&Class_SoundEffect);
+    out->format = aData->channels == 1 ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+    out->position = GLMVec3_zero;
+    out->isLooping = false;
+    out->pitch = 1.0f;
+    out->volume = 1.0f;
+
+    _sound_lockOpenAl();
+    alGenBuffers(1, &out->buffer);
+    if(_sound_checkForOpenAlError()) {
+        _sound_unlockOpenAl();
+        out->buffer = 0;
+        sfx_discardDecoded(aData);
+        return NULL;
+    }
+    alBufferData(out->buffer, out->format, aData->samples, aData->size, aData->rate);
+    _sound_checkForOpenAlError();
+    _sound_unlockOpenAl();
+    sfx_discardDecoded(aData);
+    return out;
+}
+
+SoundEffect_t *sfx_load(const char *aFilename)
+{
+    SoundEffectData_t *data = sfx_decode(aFilename);
+    return data ? sfx_createFromDecoded(data) : NULL;
+}
+
+void sfx_unload(SoundEffect_t *aSound)
+{
+    if(!aSound->buffer)
+        return;
+    // The buffer can only be deleted once no source uses it
+    sfx_stop(aSound);
+    _sound_lockOpenAl();
+    alDeleteBuffers(1, &aSound->buffer);
+    _sound_checkForOpenAlError();
+    _sound_unlockOpenAl();
+    aSound->buffer = 0;
+}
+
+static void sfx_destroy(SoundEffect_t *aSound)
+{
+    sfx_unload(aSound);
+}
+
+#pragma mark - Voices
+// Other than _sfx_destroyVoices, these are called with the OpenAL lock held
+
+static bool _sfx_createVoices(void)
+{
+    if(_NumberOfVoices > 0)
+        return true;
+    // Platforms support a limited number of sources, so take as many as are available up to the maximum
+    alGetError(); // The first failure ends the loop, so it must not be an earlier one
+    for(int i = 0; i < kSFXMaxVoices; ++i) {
+        SFXVoice_t *voice = &_Voices[i];
+        alGenSources(1, &voice->source);
+        if(alGetError() != AL_NO_ERROR)
+            break;
+        alSource3f(voice->source, AL_VELOCITY,        0.0, 0.0, 0.0);
+        alSource3f(voice->source, AL_DIRECTION,       0.0, 0.0, 0.0);
+        alSourcef (voice->source, AL_ROLLOFF_FACTOR,  0.0          );
+        alSourcei (voice->source, AL_SOURCE_RELATIVE, AL_TRUE      );
+        voice->effect = NULL;
+        ++_NumberOfVoices;
+    }
+    if(_NumberOfVoices == 0)
+        dynamo_log("Unable to create any sound sources");
+    return _NumberOfVoices > 0;
+}
+
+void _sfx_destroyVoices(void)
+{
+    _sound_lockOpenAl();
+    for(int i = 0; i < _NumberOfVoices; ++i) {
+        alSourceStop(_Voices[i].source);
+        alSourcei(_Voices[i].source, AL_BUFFER, 0);
+        alDeleteSources(1, &_Voices[i].source);
+        _Voices[i].effect = NULL;
+    }
+    _NumberOfVoices = 0;
+    _sound_unlockOpenAl();
+}
+
+static void _sfx_freeVoice(SFXVoice_t *aVoice)
+{
+    alSourceStop(aVoice->source);
+    alSourcei(aVoice->source, AL_BUFFER, 0);
+    aVoice->effect = NULL;
+}
+
+// Returns true if a voice is playing an instance, & frees it if its instance has finished
+static bool _sfx_voiceIsActive(SFXVoice_t *aVoice)
+{
+    if(!aVoice->effect)
+        return false;
+    ALint state;
+    alGetSourcei(aVoice->source, AL_SOURCE_STATE, &state);
+    if(state == AL_PLAYING || state == AL_PAUSED)
+        return true;
+    _sfx_freeVoice(aVoice);
+    return false;
+}
+
+static SoundInstance_t _sfx_instanceForVoice(SFXVoice_t *aVoice)
+{
+    return (aVoice->generation << 8) | (uint32_t)(aVoice - _Voices);
+}
+
+// Returns the voice playing an instance, or NULL if the instance is no longer playing
+static SFXVoice_t *_sfx_voiceForInstance(SoundInstance_t aInstance)
+{
+    int index = aInstance & 0xff;
+    if(aInstance == kSoundInstance_none || index >= _NumberOfVoices)
+        return NULL;
+    SFXVoice_t *voice = &_Voices[index];
+    if(voice->generation != aInstance >> 8 || !_sfx_voiceIsActive(voice))
+        return NULL;
+    return voice;
+}
+
+// Finds the voice for a new instance of aSound
+static SFXVoice_t *_sfx_acquireVoice(SoundEffect_t *aSound)
+{
+    // An effect at its limit restarts its own oldest instance
+    if(aSound->maxInstances > 0) {
+        SFXVoice_t *oldest = NULL;
+        int numberOfInstances = 0;
+        for(int i = 0; i < _NumberOfVoices; ++i) {
+            SFXVoice_t *voice = &_Voices[i];
+            if(voice->effect != aSound || !_sfx_voiceIsActive(voice))
+                continue;
+            ++numberOfInstances;
+            if(!oldest || voice->startedAt < oldest->startedAt)
+                oldest = voice;
+        }
+        if(numberOfInstances >= aSound->maxInstances)
+            return oldest;
+    }
+
+    // Otherwise take a free voice, or the one playing the least important instance: the lowest priority, then the
+    // farthest from the listener, then the oldest. Instances of a higher priority than the new one are never interrupted
+    SFXVoice_t *victim = NULL;
+    float victimDistance = 0.0f;
+    for(int i = 0; i < _NumberOfVoices; ++i) {
+        SFXVoice_t *voice = &_Voices[i];
+        if(!_sfx_voiceIsActive(voice))
+            return voice;
+        if(voice->priority > aSound->priority)
+            continue;
+        float distance = vec3_dot(voice->position, voice->position);
+        if(!victim || voice->priority < victim->priority
+           || (voice->priority == victim->priority && (distance > victimDistance
+               || (distance == victimDistance && voice->startedAt < victim->startedAt)))) {
+            victim = voice;
+            victimDistance = distance;
+        }
+    }
+    return victim;
+}
+
+static void _sfx_setVoiceLocation(SFXVoice_t *aVoice, vec3_t aPos)
+{
+    aVoice->position = aPos;
+    alSource3f(aVoice->source, AL_POSITION, aPos.x, aPos.y, aPos.z);
+}
+
+#pragma mark - Playback
+
+SoundInstance_t sfx_play(SoundEffect_t *aSound)
+{
+    if(!aSound->buffer)
+        return kSoundInstance_none;
+    _sound_lockOpenAl();
+    SFXVoice_t *voice = _sfx_createVoices() ? _sfx_acquireVoice(aSound) : NULL;
+    if(!voice) {
+        _sound_unlockOpenAl();
+        return kSoundInstance_none;
+    }
+
+    alSourceStop(voice->source);
+    alSourcei(voice->source, AL_BUFFER,  aSound->buffer);
+    alSourcei(voice->source, AL_LOOPING, aSound->isLooping);
+    alSourcef(voice->source, AL_PITCH,   aSound->pitch);
+    alSourcef(voice->source, AL_GAIN,    aSound->volume);
+    alSource3f(voice->source, AL_POSITION, aSound->position.x, aSound->position.y, aSound->position.z);
+    alSourcePlay(voice->source);
+    if(_sound_checkForOpenAlError()) {
+        _sfx_freeVoice(voice);
+        _sound_unlockOpenAl();
+        return kSoundInstance_none;
+    }
+
+    voice->effect = aSound;
+    voice->priority = aSound->priority;
+    voice->position = aSound->position;
+    voice->startedAt = ++_PlayCount;
+    // Generations take up the top 24 bits of a handle, & skip 0 so that no handle is kSoundInstance_none
+    voice->generation = (voice->generation + 1) & 0xffffff;
+    if(voice->generation == 0)
+        voice->generation = 1;
+    _sound_unlockOpenAl();
+    return _sfx_instanceForVoice(voice);
+}
+
+void sfx_stop(SoundEffect_t *aSound)
+{
+    _sound_lockOpenAl();
+    for(int i = 0; i < _NumberOfVoices; ++i) {
+        if(_Voices[i].effect == aSound)
+            _sfx_freeVoice(&_Voices[i]);
+    }
+    _sound_unlockOpenAl();
+}
+
+bool sfx_isPlaying(SoundEffect_t *aSound)
+{
+    bool isPlaying = false;
+    _sound_lockOpenAl();
+    for(int i = 0; i < _NumberOfVoices && !isPlaying; ++i)
+        isPlaying = _Voices[i].effect == aSound && _sfx_voiceIsActive(&_Voices[i]);
+    _sound_unlockOpenAl();
+    return isPlaying;
+}
+
+void sfx_setPriority(SoundEffect_t *aSound, int aPriority)
+{
+    aSound->priority = aPriority;
+    for(int i = 0; i < _NumberOfVoices; ++i) {
+        if(_Voices[i].effect == aSound)
+            _Voices[i].priority = aPriority;
+    }
+}
+
+void sfx_setMaxInstances(SoundEffect_t *aSound, int aMaxInstances)
+{
+    aSound->maxInstances = MAX(0, aMaxInstances);
+}
+
+void sfx_setVolume(SoundEffect_t *aSound, float aVolume)
+{
+    aSound->volume = aVolume;
+    _sound_lockOpenAl();
+    for(int i = 0; i < _NumberOfVoices; ++i) {
+        if(_Voices[i].effect == aSound)
+            alSourcef(_Voices[i].source, AL_GAIN, aVolume);
+    }
+    _sound_unlockOpenAl();
+}
+
+void sfx_setLocation(SoundEffect_t *aSound, vec3_t aPos)
+{
+    aSound->position = aPos;
+    _sound_lockOpenAl();
+    for(int i = 0; i < _NumberOfVoices; ++i) {
+        if(_Voices[i].effect == aSound)
+            _sfx_setVoiceLocation(&_Voices[i], aPos);
+    }
+    _sound_unlockOpenAl();
+}
+
+void sfx_setLooping(SoundEffect_t *aSound, bool aShouldLoop)
+{
+    aSound->isLooping = aShouldLoop;
+    _sound_lockOpenAl();
+    for(int i = 0; i < _NumberOfVoices; ++i) {
+        if(_Voices[i].effect == aSound)
+            alSourcei(_Voices[i].source, AL_LOOPING, aShouldLoop);
+    }
+    _sound_unlockOpenAl();
+}
+
+void sfx_setPitch(SoundEffect_t *aSound, float aPitch)
+{
+    aSound->pitch = aPitch;
+    _sound_lockOpenAl();
+    for(int i = 0; i < _NumberOfVoices; ++i) {
+        if(_Voices[i].effect == aSound)
+            alSourcef(_Voices[i].source, AL_PITCH, aPitch);
+    }
+    _sound_unlockOpenAl();
+}
+
+#pragma mark - Instances
+
+void sfxInstance_stop(SoundInstance_t aInstance)
+{
+    _sound_lockOpenAl();
+    SFXVoice_t *voice = _sfx_voiceForInstance(aInstance);
+    if(voice)
+        _sfx_freeVoice(voice);
+    _sound_unlockOpenAl();
+}
+
+bool sfxInstance_isPlaying(SoundInstance_t aInstance)
+{
+    _sound_lockOpenAl();
+    bool isPlaying = _sfx_voiceForInstance(aInstance) != NULL;
+    _sound_unlockOpenAl();
+    return isPlaying;
+}
+
+void sfxInstance_setVolume(SoundInstance_t aInstance, float aVolume)
+{
+    _sound_lockOpenAl();
+    SFXVoice_t *voice = _sfx_voiceForInstance(aInstance);
+    if(voice)
+        alSourcef(voice->source, AL_GAIN, aVolume);
+    _sound_unlockOpenAl();
+}
+
+void sfxInstance_setPitch(SoundInstance_t aInstance, float aPitch)
+{
+    _sound_lockOpenAl();
+    SFXVoice_t *voice = _sfx_voiceForInstance(aInstance);
+    if(voice)
+        alSourcef(voice->source, AL_PITCH, aPitch);
+    _sound_unlockOpenAl();
+}
+
+void sfxInstance_setLocation(SoundInstance_t aInstance, vec3_t aPos)
+{
+    _sound_lockOpenAl();
+    SFXVoice_t *voice = _sfx_voiceForInstance(aInstance);
+    if(voice)
+        _sfx_setVoiceLocation(voice, aPos);
+    _sound_unlockOpenAl();
+}
+
+#pragma mark - Utilities
+
+static const char *_openAlErrorString(int aCode)
+{
+    switch(aCode) {
+        case AL_INVALID_NAME:
+            return "Invalid name.";
+        case AL_INVALID_ENUM:
+            return "Invalid enum parameter value.";
+        case AL_INVALID_VALUE:
+            return "Invalid parameter passed to AL call.";
+        case AL_INVALID_OPERATION:
+            return "Illegal OpenAL call.";
+        case AL_OUT_OF_MEMORY:
+            return "Out of memory.";
+        default:
+            return "Unknown OpenAL error.";
+    }
+}
+
+bool _sound_checkForOpenAlError(void)
+{
+    int error = alGetError();
+    if(error != AL_NO_ERROR) {
+        dynamo_log("OpenAL error occurred(%d): %s", error, _openAlErrorString(error));
+        return true;
+    }
+    return false;
+}
+
+void _sound_lockOpenAl(void)
+{
+    pthread_mutex_lock(&_OpenAlLock);
+    alGetError();
+}
+
+void _sound_unlockOpenAl(void)
+{
+    pthread_mutex_unlock(&_OpenAlLock);
+}
@@ -0,0 +1,58 @@
+/*!
+    @header OpenAL sound effects
+    @abstract
+    @discussion Sound effects for the backends that play through OpenAL. (sound_apple.m, & sound_other.c elsewhere)
+
+    Each effect holds a single buffer of decoded audio that all of its instances play from. Instances are played on a
+    fixed pool of sources (Voices) shared by every effect, so the number of effects loaded is not limited by the number of
+    sources the platform supports. Voices are returned to the pool once their instance finishes.
+
+    The backends decode effects into SoundEffectData_t, & release the voices before destroying their OpenAL context.
+*/
+
+#ifndef _SOUND_OPENAL_H_
+#define _SOUND_OPENAL_H_
+
+#include "sound.h"
+#include <stddef.h>
+
+#ifdef __APPLE__
+    #include <OpenAL/al.h>
+    #include <OpenAL/alc.h>
+#else
+    #include <AL/al.h>
+    #include <AL/alc.h>
+#endif
+
+#define kSFXMaxVoices 32
+
+/*!
+    The decoded audio of a sound effect
+
+    @field samples 16 bit linear PCM (Freed using free())
+*/
+struct _SoundEffectData {
+    void *samples;
+    size_t size;
+    int channels;
+    int rate;
+};
+
+/*!
+    Stops & deletes the voices. (They are created again as needed)
+*/
+extern void _sfx_destroyVoices(void);
+
+/*!
+    Logs & clears the pending OpenAL error, if any. Returns true if there was one.
+*/
+extern bool _sound_checkForOpenAlError(void);
+
+/*!
+    OpenAL keeps a single error state for the context rather than one per thread, so calls made by the BGM streaming
+    thread & by the main thread are made with this lock held, & their errors checked before it is released.
+    Locking discards any error left by calls that were not checked.
+*/
+extern void _sound_lockOpenAl(void);
+extern void _sound_unlockOpenAl(void);
+#endif
@@ -1,47 +1,54 @@
 // Fallback sound API, cross platform but only supports Oggvorbis
-#include "sound.h"
+#include "sound_openal.h"
 #include "ogg_loader.h"
 #include "util.h"
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
 
-struct _SoundEffect {
+// BGM is streamed through a small queue of buffers that a thread refills as they finish playing, so the memory used does
+// not depend on the length of the track
+#define kBGMNumberOfBuffers 4
+#define kBGMBufferSize (32*1024) // Bytes of PCM per buffer (~0.19 seconds of 44.1kHz stereo)
+#define kBGMUpdateInterval 0.05 // Seconds between refills
+
+struct _BackgroundMusic {
 	OBJ_GUTS
-	// These properties should only be modified using their setter functions to ensure that
-	// the internal state stays up to date with their values.
-	vec3_t position;
+	SoundManager_t *manager; // Retained, its stream lock is used until the BGM is destroyed
+	oggStream_t *stream;
+	ALuint source;
+	ALuint buffers[kBGMNumberOfBuffers];
+	ALenum format;
+
+	// Shared with the streaming thread, guarded by the manager's stream lock
+	bool isPlaying; // Cleared by the streaming thread once a track that does not loop has played out
 	bool isLooping;
-	float pitch;
-
-	// Platform specific and not guaranteed to exist
-	void *handle;
-	int samples;
-	int rate;
-	int channels;
-	unsigned int buffer;
-	unsigned int source;
-	unsigned int format;
-};
-struct _BackgroundMusic {
-    void *player;
+	bool needsRestart; // Set to requeue the buffers from the current position of the stream
+	bool hasPendingSeek;
+	float seekPosition;
+	bool reachedEnd; // Set once the end of the stream has been queued
+	ALuint freeBuffers[kBGMNumberOfBuffers]; // The buffers that are not queued
+	int numberOfFreeBuffers;
+	BackgroundMusic_t *nextStream; // The next BGM being streamed
 };
 struct _SoundManager {
-    OBJ_GUTS
-    ALCcontext *context;
+	OBJ_GUTS
+	ALCcontext *context;
 	ALCdevice *device;
-};
 
+	pthread_t streamThread;
+	pthread_mutex_t streamLock;
+	pthread_cond_t streamCondition;
+	bool hasStreamThread;
+	bool shouldStopStreaming;
+	BackgroundMusic_t *streams; // The BGM being played
+};
 
-static void sound_destroy(SoundEffect_t *aSound);
-static char *_openAlErrorString(int aCode);
-static bool _checkForOpenAlError();
-static bool _sound_buf_stream(SoundEffect_t *aSound, ALuint aBuffer);
-static bool _sound_beginPlayback(SoundEffect_t *aSound);
-static bool _sound_update(SoundEffect_t *aSound);
+static SoundManager_t *_CurrentSoundManager = NULL;
 
-Class_t Class_SoundEffect = {
-	"SoundEffect",
-	sizeof(SoundEffect_t),
-	(Obj_destructor_t)&sfx_destroy
-};
+static void bgm_destroy(BackgroundMusic_t *aBGM);
+static void soundManager_destroy(SoundManager_t *aManager);
+static void *_soundManager_stream(SoundManager_t *aManager);
 
 Class_t Class_BackgroundMusic = {
 	"BackgroundMusic",
@@ -57,204 +64,407 @@ Class_t Class_SoundManager = {
 
 #pragma mark - Sound loading
 
-SoundEffect_t *sound_load(const char *aFilename)
+// Effects are played by sound_openal.c
+SoundEffectData_t *sfx_decode(const char *aFilename)
 {
-#ifndef TARGET_OS_EMBEDDED
-	SoundEffect_t *out = obj_create_autoreleased(&Class_Sound);
-
-	oggFile_t *oggFile = ogg_load(aFilename);
+	oggFile_t *oggFile = ogg_decode(aFilename);
 	if(!oggFile) {
-		debug_log("Failed to load audio file");
+		dynamo_log("Failed to load audio file");
 		return NULL;
 	}
-	out->format = out->channels == 1 ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
-	alGenBuffers(1, &out->buffer);
-	alGenSources(1, &out->source);
-	_checkForOpenAlError();
-	alBufferData(out->buffer, out->format, oggFile->data, oggFile->size, oggFile->rate);
-	_checkForOpenAlError();
-
-	alSourcei(out->source, AL_BUFFER,  out->buffer);
-	sound_setPosition(out, GLMVec3_zero);
-	sound_setLooping(out, false);
-	sound_setPitch(out, 1.0f);
-	sound_setGain(out, 1.0f);
-	alSource3f(out->source, AL_VELOCITY,        0.0, 0.0, 0.0);
-	alSource3f(out->source, AL_DIRECTION,       0.0, 0.0, 0.0);
-	alSourcef (out->source, AL_ROLLOFF_FACTOR,  0.0          );
-	alSourcei (out->source, AL_SOURCE_RELATIVE, AL_TRUE      );
-
+	SoundEffectData_t *out = malloc(sizeof(SoundEffectData_t));
+	out->samples = oggFile->data;
+	out->size = oggFile->size;
 	out->channels = oggFile->channels;
 	out->rate = oggFile->rate;
-	out->samples = oggFile->samples;
-
+	oggFile->data = NULL; // Now owned by the decoded data
+	obj_release(oggFile);
 	return out;
-#endif
-    return NULL;
 }
 
-void sfx_unload(SoundEffect_t *aSound)
+#pragma mark - BGM
+
+BackgroundMusic_t *bgm_load(const char *aFilename)
 {
-	if(alIsBuffer(aSound->buffer)) {
-		alSourceUnqueueBuffers(aSound->source, 1, &aSound->buffer);
-		alDeleteBuffers(1, &aSound->buffer);
+	if(!_CurrentSoundManager) {
+		dynamo_log("No current sound manager to play %s", aFilename);
+		return NULL;
+	}
+	oggStream_t *stream = ogg_openStream(aFilename);
+	if(!stream) {
+		dynamo_log("Failed to load audio file %s", aFilename);
+		return NULL;
+	}
+	if(stream->channels > 2) {
+		dynamo_log("%s has %d channels, only mono & stereo are supported", aFilename, stream->channels);
+		obj_release(stream);
+		return NULL;
+	}
+
+	BackgroundMusic_t *out = obj_create_autoreleased(&Class_BackgroundMusic);
+	out->manager = obj_retain(_CurrentSoundManager);
+	out->stream = stream;
+	out->format = stream->channels == 1 ? AL_FORMAT_MONO16 : AL_FORMAT_STEREO16;
+	_sound_lockOpenAl();
+	alGenBuffers(kBGMNumberOfBuffers, out->buffers);
+	alGenSources(1, &out->source);
+	if(_sound_checkForOpenAlError()) {
+		_sound_unlockOpenAl();
+		return NULL;
 	}
-	if(alIsSource(aSound->source))
-		alDeleteSources(1, &aSound->source);
+	memcpy(out->freeBuffers, out->buffers, sizeof(out->buffers));
+	out->numberOfFreeBuffers = kBGMNumberOfBuffers;
+
+	// Looping is done by the decoder, a looping source would replay the queue instead of taking new buffers
+	alSourcei (out->source, AL_LOOPING,         AL_FALSE);
+	alSourcef (out->source, AL_ROLLOFF_FACTOR,  0.0     );
+	alSourcei (out->source, AL_SOURCE_RELATIVE, AL_TRUE );
+	alSourcef (out->source, AL_GAIN,            1.0f    );
+	_sound_unlockOpenAl();
+	return out;
 }
 
-void sfx_destroy(SoundEffect_t *aSound)
+static void _soundManager_addStream(SoundManager_t *aManager, BackgroundMusic_t *aBGM)
 {
-	sfx_unload(aSound);
+	for(BackgroundMusic_t *bgm = aManager->streams; bgm; bgm = bgm->nextStream) {
+		if(bgm == aBGM)
+			return;
+	}
+	aBGM->nextStream = aManager->streams;
+	aManager->streams = aBGM;
 }
 
-void sfx_setVolume(SoundEffect_t *aSound, float aVolume)
+static void _soundManager_removeStream(SoundManager_t *aManager, BackgroundMusic_t *aBGM)
 {
-    alSourcef(aSound->source, AL_GAIN, aVolume);
+	for(BackgroundMusic_t **link = &aManager->streams; *link; link = &(*link)->nextStream) {
+		if(*link == aBGM) {
+			*link = aBGM->nextStream;
+			break;
+		}
+	}
+	aBGM->nextStream = NULL;
 }
 
-void sfx_setLocation(SoundEffect_t *aSound, vec3_t aPos)
+// Stops the source & detaches all of its buffers. (Called with the stream & OpenAL locks held)
+static void _bgm_clearQueue(BackgroundMusic_t *aBGM)
 {
-	aSound->position = aPos;
-	alSource3f(aSound->source, AL_POSITION, aPos.x, aPos.y, aPos.z);
+	// Rewinding rather than stopping leaves the source in its initial state, where buffers queued to it count as unplayed
+	alSourceRewind(aBGM->source);
+	alSourcei(aBGM->source, AL_BUFFER, 0);
+	memcpy(aBGM->freeBuffers, aBGM->buffers, sizeof(aBGM->buffers));
+	aBGM->numberOfFreeBuffers = kBGMNumberOfBuffers;
 }
 
-void sfx_setLooping(SoundEffect_t *aSound, bool aShouldLoop)
+void bgm_unload(BackgroundMusic_t *aBGM)
 {
-	aSound->isLooping = aShouldLoop;
-	alSourcei(aSound->source, AL_LOOPING, aShouldLoop);
+	if(!aBGM->stream)
+		return;
+	pthread_mutex_lock(&aBGM->manager->streamLock);
+	_soundManager_removeStream(aBGM->manager, aBGM);
+	aBGM->isPlaying = false;
+	_sound_lockOpenAl();
+	if(alIsSource(aBGM->source)) {
+		_bgm_clearQueue(aBGM);
+		alDeleteSources(1, &aBGM->source);
+	}
+	if(alIsBuffer(aBGM->buffers[0]))
+		alDeleteBuffers(kBGMNumberOfBuffers, aBGM->buffers);
+	_sound_unlockOpenAl();
+	obj_release(aBGM->stream);
+	aBGM->stream = NULL;
+	pthread_mutex_unlock(&aBGM->manager->streamLock);
 }
 
-void sfx_setPitch(SoundEffect_t *aSound, float aPitch)
+static void bgm_destroy(BackgroundMusic_t *aBGM)
 {
-	aSound->pitch = aPitch;
-	alSourcef(aSound->source, AL_PITCH, 1.0f);
+	bgm_unload(aBGM);
+	obj_release(aBGM->manager);
 }
 
-void sfx_play(SoundEffect_t *aSound)
+// Plays from the beginning, or from where bgm_seek was last called to while the BGM was stopped
+void bgm_play(BackgroundMusic_t *aBGM)
 {
-	if(sfx_isPlaying(aSound))
-		sfx_stop(aSound);
-	alSourcePlay(aSound->source);
-	_checkForOpenAlError();
+	if(!aBGM->stream)
+		return;
+	SoundManager_t *manager = aBGM->manager;
+	pthread_mutex_lock(&manager->streamLock);
+	if(aBGM->isPlaying) {
+		aBGM->hasPendingSeek = true;
+		aBGM->seekPosition = 0.0f;
+	}
+	aBGM->isPlaying = true;
+	aBGM->needsRestart = true;
+	_soundManager_addStream(manager, aBGM);
+	pthread_cond_signal(&manager->streamCondition);
+	pthread_mutex_unlock(&manager->streamLock);
 }
-void sfx_stop(SoundEffect_t *aSound)
+
+void bgm_stop(BackgroundMusic_t *aBGM)
 {
-	alSourceStop(aSound->source);
-	_checkForOpenAlError();
+	if(!aBGM->stream)
+		return;
+	SoundManager_t *manager = aBGM->manager;
+	pthread_mutex_lock(&manager->streamLock);
+	_soundManager_removeStream(manager, aBGM);
+	_sound_lockOpenAl();
+	_bgm_clearQueue(aBGM);
+	_sound_unlockOpenAl();
+	aBGM->isPlaying = false;
+	aBGM->needsRestart = false;
+	aBGM->hasPendingSeek = true;
+	aBGM->seekPosition = 0.0f;
+	pthread_mutex_unlock(&manager->streamLock);
 }
 
-bool sfx_isPlaying(SoundEffect_t *aSound)
+bool bgm_isPlaying(BackgroundMusic_t *aBGM)
 {
-	ALenum state;
-	alGetSourcei(aSound->source, AL_SOURCE_STATE, &state);
-	return (state == AL_PLAYING);
+	if(!aBGM->stream)
+		return false;
+	pthread_mutex_lock(&aBGM->manager->streamLock);
+	bool isPlaying = aBGM->isPlaying;
+	pthread_mutex_unlock(&aBGM->manager->streamLock);
+	return isPlaying;
 }
 
-#pragma mark - BGM
-
-BackgroundMusic_t *bgm_load(const char *aFilename)
+void bgm_seek(BackgroundMusic_t *aBGM, float aSeconds)
 {
-	BackgroundMusic_t *out = obj_create_autoreleased(&Class_BackgroundMusic);
-	out->soundEffect = sfx_load(aFilename);
-	if(!out->soundEffect)
-		return NULL;
-	obj_retain(out->soundEffect);
-	return out;
+	if(!aBGM->stream)
+		return;
+	SoundManager_t *manager = aBGM->manager;
+	pthread_mutex_lock(&manager->streamLock);
+	aBGM->hasPendingSeek = true;
+	aBGM->seekPosition = aSeconds;
+	// The queued buffers are dropped & refilled from the new position
+	if(aBGM->isPlaying) {
+		aBGM->needsRestart = true;
+		pthread_cond_signal(&manager->streamCondition);
+	}
+	pthread_mutex_unlock(&manager->streamLock);
 }
 
-void bgm_unload(BackgroundMusic_t *aBGM)
+void bgm_setVolume(BackgroundMusic_t *aBGM, float aVolume)
 {
-	sfx_unload(aBGM->soundEffect);
+	if(!aBGM->stream)
+		return;
+	_sound_lockOpenAl();
+	alSourcef(aBGM->source, AL_GAIN, aVolume);
+	_sound_unlockOpenAl();
 }
 
-static void bgm_destroy(BackgroundMusic_t *aBGM)
+void bgm_setLooping(BackgroundMusic_t *aBGM, bool aLoops)
 {
-	bgm_unload(aBGM);
-	obj_release(aBGM->soundEffect);
+	if(!aBGM->stream)
+		return;
+	pthread_mutex_lock(&aBGM->manager->streamLock);
+	aBGM->isLooping = aLoops;
+	// If the end has already been decoded, the next buffer picks up from the start
+	if(aLoops)
+		aBGM->reachedEnd = false;
+	pthread_mutex_unlock(&aBGM->manager->streamLock);
 }
 
-void bgm_play(BackgroundMusic_t *aBGM)
+#pragma mark - BGM streaming
+// Everything below runs on the streaming thread with the stream & OpenAL locks held
+
+// Decodes the next piece of the stream into a buffer. Returns false if there was nothing left to decode
+static bool _bgm_fillBuffer(BackgroundMusic_t *aBGM, ALuint aBuffer, char *aScratch)
 {
-	sfx_play(aBGM->soundEffect);
+	if(aBGM->reachedEnd)
+		return false;
+	// Buffers hold whole sample frames
+	int frameSize = 2*aBGM->stream->channels;
+	int capacity = kBGMBufferSize - kBGMBufferSize%frameSize;
+	int length = 0;
+	bool hasRewound = false;
+	while(length < capacity) {
+		int count = ogg_readStream(aBGM->stream, aScratch + length, capacity - length);
+		if(count > 0) {
+			length += count;
+			hasRewound = false;
+			continue;
+		}
+		// Loops carry on from the start in the same buffer, so that there is no gap between them
+		if(count == 0 && aBGM->isLooping && !hasRewound && ogg_seekStream(aBGM->stream, 0.0)) {
+			hasRewound = true;
+			continue;
+		}
+		aBGM->reachedEnd = true;
+		break;
+	}
+	if(length == 0)
+		return false;
+	alBufferData(aBuffer, aBGM->format, aScratch, length, aBGM->stream->rate);
+	return !_sound_checkForOpenAlError();
 }
-void bgm_stop(BackgroundMusic_t *aBGM)
+
+// Fills & queues the free buffers, for as long as there is something to decode
+static void _bgm_refill(BackgroundMusic_t *aBGM, char *aScratch)
 {
-	sfx_stop(aBGM->soundEffect);
+	while(aBGM->numberOfFreeBuffers > 0) {
+		ALuint buffer = aBGM->freeBuffers[aBGM->numberOfFreeBuffers - 1];
+		if(!_bgm_fillBuffer(aBGM, buffer, aScratch))
+			break;
+		alSourceQueueBuffers(aBGM->source, 1, &buffer);
+		--aBGM->numberOfFreeBuffers;
+	}
 }
-bool bgm_isPlaying(BackgroundMusic_t *aBGM)
+
+// Unqueues buffers that have played (Buffers are played, & unqueued, in the order they were queued)
+static void _bgm_unqueue(BackgroundMusic_t *aBGM, int aCount)
 {
-	return sfx_isPlaying(aBGM->soundEffect);
+	if(aCount <= 0)
+		return;
+	alSourceUnqueueBuffers(aBGM->source, aCount, aBGM->freeBuffers + aBGM->numberOfFreeBuffers);
+	aBGM->numberOfFreeBuffers += aCount;
 }
-void bgm_seek(BackgroundMusic_t *aBGM, float aSeconds)
+
+// Starts over from the current position of the stream, or the pending seek
+static void _bgm_restart(BackgroundMusic_t *aBGM, char *aScratch)
 {
-	_sfx_seek(aBGM->soundEffect, aSeconds);
+	if(aBGM->hasPendingSeek) {
+		if(!ogg_seekStream(aBGM->stream, aBGM->seekPosition))
+			dynamo_log("Unable to seek to %.2f seconds", aBGM->seekPosition);
+		aBGM->hasPendingSeek = false;
+	}
+	aBGM->reachedEnd = false;
+	aBGM->needsRestart = false;
+	_bgm_clearQueue(aBGM);
+	_bgm_refill(aBGM, aScratch);
 }
-void bgm_setVolume(BackgroundMusic_t *aBGM, float aVolume)
+
+// Refills the buffers that have played. Returns false once the BGM has played out
+static bool _bgm_update(BackgroundMusic_t *aBGM, char *aScratch)
 {
-	sfx_setVolume(aBGM->soundEffect, aVolume);
+	ALint state, queued = 0;
+	alGetSourcei(aBGM->source, AL_SOURCE_STATE, &state);
+	if(state == AL_PLAYING) {
+		ALint processed = 0;
+		alGetSourcei(aBGM->source, AL_BUFFERS_PROCESSED, &processed);
+		_bgm_unqueue(aBGM, processed);
+		int numberRefilled = aBGM->numberOfFreeBuffers;
+		_bgm_refill(aBGM, aScratch);
+		numberRefilled -= aBGM->numberOfFreeBuffers;
+
+		alGetSourcei(aBGM->source, AL_SOURCE_STATE, &state);
+		if(state == AL_PLAYING)
+			return true;
+		// It ran dry while being refilled, so the buffers it had left have played but the ones just queued have not
+		alGetSourcei(aBGM->source, AL_BUFFERS_QUEUED, &queued);
+		_bgm_unqueue(aBGM, queued - numberRefilled);
+		_bgm_refill(aBGM, aScratch);
+	} else if(state == AL_STOPPED) {
+		// Everything queued has played, either because the end was reached or because it was not refilled in time
+		_bgm_clearQueue(aBGM);
+		_bgm_refill(aBGM, aScratch);
+	}
+
+	alGetSourcei(aBGM->source, AL_BUFFERS_QUEUED, &queued);
+	if(queued == 0) {
+		// Played out, so the next bgm_play starts over
+		aBGM->isPlaying = false;
+		aBGM->hasPendingSeek = true;
+		aBGM->seekPosition = 0.0f;
+		return false;
+	}
+	alSourcePlay(aBGM->source);
+	return !_sound_checkForOpenAlError();
 }
 
+static void *_soundManager_stream(SoundManager_t *aManager)
+{
+	char *scratch = malloc(kBGMBufferSize);
+	pthread_mutex_lock(&aManager->streamLock);
+	while(!aManager->shouldStopStreaming) {
+		BackgroundMusic_t *next;
+		_sound_lockOpenAl();
+		for(BackgroundMusic_t *bgm = aManager->streams; bgm; bgm = next) {
+			next = bgm->nextStream;
+			if(bgm->needsRestart)
+				_bgm_restart(bgm, scratch);
+			if(!_bgm_update(bgm, scratch)) {
+				_soundManager_removeStream(aManager, bgm);
+				bgm->isPlaying = false;
+			}
+		}
+		_sound_unlockOpenAl();
+		if(!aManager->streams) {
+			pthread_cond_wait(&aManager->streamCondition, &aManager->streamLock);
+			continue;
+		}
+		struct timespec until;
+		clock_gettime(CLOCK_REALTIME, &until);
+		until.tv_nsec += (long)(kBGMUpdateInterval*1000000000.0);
+		until.tv_sec += until.tv_nsec / 1000000000;
+		until.tv_nsec %= 1000000000;
+		pthread_cond_timedwait(&aManager->streamCondition, &aManager->streamLock, &until);
+	}
+	pthread_mutex_unlock(&aManager->streamLock);
+	free(scratch);
+	return NULL;
+}
 
 #pragma mark - Sound manager
 
 SoundManager_t *soundManager_create()
 {
-	SoundManager_t *out = malloc(sizeof(SoundManager_t));
-	out->device = alcOpenDevice(NULL);
-	if(!out->device) return NULL;
-	out->context = alcCreateContext(out->device, NULL);
-	if(!out->context){
-		alcCloseDevice(out->device);
-		free(out);
+	ALCdevice *device = alcOpenDevice(NULL);
+	if(!device) {
+		dynamo_log("Unable to open audio device");
 		return NULL;
 	}
-	if(!soundManager_makeCurrent(out)) {
-		alcDestroyContext(out->context);
-		alcCloseDevice(out->device);
-		free(out);
+	ALCcontext *context = alcCreateContext(device, NULL);
+	if(!context) {
+		alcCloseDevice(device);
 		return NULL;
 	}
+
+	SoundManager_t *out = obj_create_autoreleased(&Class_SoundManager);
+	out->device = device;
+	out->context = context;
+	pthread_mutex_init(&out->streamLock, NULL);
+	pthread_cond_init(&out->streamCondition, NULL);
+	out->hasStreamThread = pthread_create(&out->streamThread, NULL, (void *(*)(void *))&_soundManager_stream, out) == 0;
+	if(!out->hasStreamThread)
+		dynamo_log("Unable to create BGM streaming thread");
+
+	if(!soundManager_makeCurrent(out))
+		return NULL;
 	return out;
 }
 
-void soundManager_destroy(SoundManager_t *aManager)
+// BGM retains the manager it was loaded with, so none is left streaming by the time it is destroyed
+static void soundManager_destroy(SoundManager_t *aManager)
 {
+	if(aManager->hasStreamThread) {
+		pthread_mutex_lock(&aManager->streamLock);
+		aManager->shouldStopStreaming = true;
+		pthread_cond_signal(&aManager->streamCondition);
+		pthread_mutex_unlock(&aManager->streamLock);
+		pthread_join(aManager->streamThread, NULL);
+	}
+	pthread_mutex_destroy(&aManager->streamLock);
+	pthread_cond_destroy(&aManager->streamCondition);
+
+	if(alcGetCurrentContext() == aManager->context) {
+		_sfx_destroyVoices();
+		alcMakeContextCurrent(NULL);
+	}
 	alcDestroyContext(aManager->context);
 	alcCloseDevice(aManager->device);
-	free(aManager);
 }
 
 bool soundManager_makeCurrent(SoundManager_t *aManager)
 {
-	return alcMakeContextCurrent(aManager->context);
+	// The voices belong to the context that was current when they were created
+	if(aManager != _CurrentSoundManager && alcGetCurrentContext())
+		_sfx_destroyVoices();
+	_sound_lockOpenAl();
+	bool madeCurrent = alcMakeContextCurrent(aManager ? aManager->context : NULL);
+	_sound_unlockOpenAl();
+	if(!madeCurrent)
+		return false;
+	if(aManager)             obj_retain(aManager);
+	if(_CurrentSoundManager) obj_release(_CurrentSoundManager);
+	_CurrentSoundManager = aManager;
+	return true;
 }
-
-#pragma mark - Utilities
-
-static char *_openAlErrorString(int aCode)
-{
-		switch(aCode) {
-		case AL_INVALID_NAME:
-			return "Read from media.";
-		case AL_INVALID_ENUM:
-			return "Invalid parameter passed to AL call.";
-		case AL_INVALID_VALUE:
-			return "Invalid enum parameter value.";
-		case AL_INVALID_OPERATION:
-			return "Illegal OpenAL call.";
-		default:
-			return "Unknown OpenAL error.";
-	}
-}
-
-static bool _checkForOpenAlError()
-{
-	int error = alGetError();
-	if(error != AL_NO_ERROR) {
-		debug_log("OpenAL error occurred(%d): %s", error, _openAlErrorString(error));
-		return true;
-	}
-	return false;
-}
-
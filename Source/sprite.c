@@ -6,7 +6,14 @@
 static void sprite_destroy(Sprite_t *aSprite);
 static void _sprite_draw(Renderer_t *aRenderer, Sprite_t *aSprite, GLMFloat aTimeSinceLastFrame, GLMFloat aInterpolation);
 static void spriteBatch_destroy(SpriteBatch_t *aBatch);
+static void _spriteBatch_setAttributes(SpriteBatch_t *aBatch);
 static void _spriteBatch_draw(Renderer_t *aRenderer, SpriteBatch_t *aBatch, GLMFloat aTimeSinceLastFrame, GLMFloat aInterpolation);
+static SpriteState_t _sprite_liveState(Sprite_t *aSprite);
+static SpriteState_t _sprite_stateForDrawing(Sprite_t *aSprite, GLMFloat aInterpolation);
+
+// Set on stateMiddle when it holds a snapshot the renderer has not yet picked up
+#define kSpriteStateFresh 0x4
+#define kSpriteStateIndexMask 0x3
 
 Class_t Class_Sprite = {
     "Sprite",
@@ -36,6 +43,12 @@ Sprite_t *sprite_create(vec3_t aLocation, vec2_t aSize, TextureAtlas_t *aAtlas,
     out->activeAnimation = 0;
     out->animations = calloc(aAnimationCapacity, sizeof(SpriteAnimation_t));
 
+    out->usesPublishedState = false;
+    out->stateFront = 0;
+    out->stateMiddle = 1;
+    out->stateBack = 2;
+    out->states[0] = out->states[1] = out->states[2] = out->previousState = _sprite_liveState(out);
+
     return out;
 }
 void sprite_destroy(Sprite_t *aSprite)
@@ -67,14 +80,61 @@ void sprite_step(Sprite_t *aSprite)
     }
 }
 
+#pragma mark - State snapshots
+
+static SpriteState_t _sprite_liveState(Sprite_t *aSprite)
+{
+    SpriteState_t out = {
+        aSprite->location,
+        aSprite->scale, aSprite->angle,
+        aSprite->activeAnimation,
+        aSprite->animations ? aSprite->animations[aSprite->activeAnimation].currentFrame : 0
+    };
+    return out;
+}
+
+void sprite_publishState(Sprite_t *aSprite)
+{
+    aSprite->states[aSprite->stateBack] = _sprite_liveState(aSprite);
+    // Ordered before the state by the CAS below, until then the renderer keeps finding the initial state in stateFront
+    if(!aSprite->usesPublishedState)
+        __sync_lock_test_and_set(&aSprite->usesPublishedState, true);
+
+    // Swap the back buffer into the middle slot, the CAS doubles as a full barrier so the
+    // renderer never sees a partially written state
+    int middle;
+    do {
+        middle = aSprite->stateMiddle;
+    } while(!__sync_bool_compare_and_swap(&aSprite->stateMiddle, middle, aSprite->stateBack | kSpriteStateFresh));
+    aSprite->stateBack = middle & kSpriteStateIndexMask;
+}
+
+static SpriteState_t _sprite_stateForDrawing(Sprite_t *aSprite, GLMFloat aInterpolation)
+{
+    if(!aSprite->usesPublishedState)
+        return _sprite_liveState(aSprite);
+
+    if(aSprite->stateMiddle & kSpriteStateFresh) {
+        aSprite->previousState = aSprite->states[aSprite->stateFront];
+        aSprite->stateFront = __sync_lock_test_and_set(&aSprite->stateMiddle, aSprite->stateFront) & kSpriteStateIndexMask;
+    }
+    SpriteState_t *prev = &aSprite->previousState;
+    SpriteState_t out = aSprite->states[aSprite->stateFront];
+    aInterpolation = CLAMP(aInterpolation, 0.0, 1.0);
+    out.location = vec3_add(prev->location, vec3_scalarMul(vec3_sub(out.location, prev->location), aInterpolation));
+    out.scale = prev->scale + (out.scale - prev->scale)*aInterpolation;
+    out.angle = prev->angle + (out.angle - prev->angle)*aInterpolation;
+    return out;
+}
+
 #pragma mark - Rendering
 
 void _sprite_draw(Renderer_t *aRenderer, Sprite_t *aSprite, GLMFloat aTimeSinceLastFrame, GLMFloat aInterpolation)
 {
-    SpriteAnimation_t *animation = &aSprite->animations[aSprite->activeAnimation];
+    SpriteState_t state = _sprite_stateForDrawing(aSprite, aInterpolation);
 
-    TextureRect_t cropRect = texAtlas_getTextureRect(aSprite->atlas, animation->currentFrame, aSprite->activeAnimation);
-    draw_texturePortion(aSprite->location, aSprite->atlas->texture, cropRect, aSprite->scale, aSprite->angle, aSprite->opacity, aSprite->flippedHorizontally, aSprite->flippedVertically);
+    TextureRect_t cropRect = texAtlas_getTextureRect(aSprite->atlas, state.currentFrame, state.activeAnimation);
+    draw_texturePortion(state.location, aSprite->atlas->texture, cropRect, state.scale, state.angle, aSprite->opacity, aSprite->flippedHorizontally, aSprite->flippedVertically);
 }
 
 
@@ -94,17 +154,40 @@ SpriteBatch_t *spriteBatch_create(TextureAtlas_t *aAtlas)
     out->luaDisplayCallback = -1;
     
     glGenBuffers(2, &out->vbo);
+
+    out->vao = 0;
+    if(dynamo_glVAOSupported()) {
+        dynamo_glGenVertexArrays(1, &out->vao);
+        dynamo_glBindVertexArray(out->vao);
+        _spriteBatch_setAttributes(out);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, out->ibo);
+        dynamo_glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
     
     return out;
 }
 
 void spriteBatch_destroy(SpriteBatch_t *aBatch)
 {
+    if(aBatch->vao)
+        dynamo_glDeleteVertexArrays(1, &aBatch->vao);
     glDeleteBuffers(2, &aBatch->vbo);
     obj_release(aBatch->sprites);
 }
 
-static void _spriteBatch_updateVbo(SpriteBatch_t *aBatch);
+static void _spriteBatch_updateVbo(SpriteBatch_t *aBatch, GLMFloat aInterpolation);
+
+// Binds the vertex buffer & points the textured shader's attributes into it
+static void _spriteBatch_setAttributes(SpriteBatch_t *aBatch)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, aBatch->vbo);
+    glVertexAttribPointer(gTexturedShader->attributes[kShader_positionAttribute], 3, GL_FLOAT, GL_FALSE, sizeof(struct _BatchVertex), (void*)offsetof(struct _BatchVertex, loc));
+    glEnableVertexAttribArray(gTexturedShader->attributes[kShader_positionAttribute]);
+    glVertexAttribPointer(gTexturedShader->attributes[kShader_texCoord0Attribute], 2, GL_FLOAT, GL_FALSE, sizeof(struct _BatchVertex), (void*)offsetof(struct _BatchVertex, texCoord));
+    glEnableVertexAttribArray(gTexturedShader->attributes[kShader_texCoord0Attribute]);
+}
 
 void _spriteBatch_draw(Renderer_t *aRenderer, SpriteBatch_t *aBatch, GLMFloat aTimeSinceLastFrame, GLMFloat aInterpolation)
 {
@@ -115,31 +198,32 @@ void _spriteBatch_draw(Renderer_t *aRenderer, SpriteBatch_t *aBatch, GLMFloat aT
     if(!item) return;
     Sprite_t *firstSprite = item->value;
     Texture_t *tex = firstSprite->atlas->texture;
-    _spriteBatch_updateVbo(aBatch);
+    _spriteBatch_updateVbo(aBatch, aInterpolation);
 
     shader_makeActive(gTexturedShader);
     shader_updateMatrices(gTexturedShader, aRenderer);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, tex->id);
+    texture_bind(tex);
     glUniform1i(gTexturedShader->uniforms[kShader_colormap0Uniform], 0);
     GLfloat white[4] = { 1,1,1,1 };
     glUniform4fv(gTexturedShader->uniforms[kShader_colorUniform], 1, white);
     
-    glBindBuffer(GL_ARRAY_BUFFER, aBatch->vbo);
-    glVertexAttribPointer(gTexturedShader->attributes[kShader_positionAttribute], 3, GL_FLOAT, GL_FALSE, sizeof(struct _BatchVertex), (void*)offsetof(struct _BatchVertex, loc));
-    glEnableVertexAttribArray(gTexturedShader->attributes[kShader_positionAttribute]);
-    glVertexAttribPointer(gTexturedShader->attributes[kShader_texCoord0Attribute], 2, GL_FLOAT, GL_FALSE, sizeof(struct _BatchVertex), (void*)offsetof(struct _BatchVertex, texCoord));
-    glEnableVertexAttribArray(gTexturedShader->attributes[kShader_texCoord0Attribute]);
-    
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, aBatch->ibo);
-    glDrawElements(GL_TRIANGLE_STRIP, aBatch->indexCount, GL_UNSIGNED_SHORT, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    if(aBatch->vao) {
+        dynamo_glBindVertexArray(aBatch->vao);
+        glDrawElements(GL_TRIANGLE_STRIP, aBatch->indexCount, GL_UNSIGNED_SHORT, 0);
+        dynamo_glBindVertexArray(0);
+    } else {
+        _spriteBatch_setAttributes(aBatch);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, aBatch->ibo);
+        glDrawElements(GL_TRIANGLE_STRIP, aBatch->indexCount, GL_UNSIGNED_SHORT, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
     glBindTexture(GL_TEXTURE_2D, 0);
     shader_makeInactive(gTexturedShader);
 }
 
-void _spriteBatch_updateVbo(SpriteBatch_t *aBatch)
+void _spriteBatch_updateVbo(SpriteBatch_t *aBatch, GLMFloat aInterpolation)
 {
     if(aBatch->spriteCount == 0)
         aBatch->indexCount = 0;
@@ -148,7 +232,7 @@ void _spriteBatch_updateVbo(SpriteBatch_t *aBatch)
     if(!item) return;
     
     Sprite_t *sprite = item->value;
-    SpriteAnimation_t *animation;
+    SpriteState_t state;
     TextureRect_t cropRect;
     TextureAtlas_t *atlas;
     float maxTexX, maxTexY;
@@ -180,8 +264,8 @@ void _spriteBatch_updateVbo(SpriteBatch_t *aBatch)
     do {
         sprite = item->value;
         atlas = sprite->atlas;
-        animation = &sprite->animations[sprite->activeAnimation];
-        cropRect = texAtlas_getTextureRect(atlas, animation->currentFrame, sprite->activeAnimation);
+        state = _sprite_stateForDrawing(sprite, aInterpolation);
+        cropRect = texAtlas_getTextureRect(atlas, state.currentFrame, state.activeAnimation);
         
         if(i > 0)
             indices[iIdx++] = i;
@@ -200,25 +284,25 @@ void _spriteBatch_updateVbo(SpriteBatch_t *aBatch)
         vertices[i+3].loc = (vec3_t){  sprite->size.w/2,  sprite->size.h/2, 0 };
         
         // Rotate if necessary
-        if(fabs(sprite->angle) > 0.01) {
-            rot = quat_createv((vec3_t){0,0,1}, sprite->angle);
+        if(fabs(state.angle) > 0.01) {
+            rot = quat_createv((vec3_t){0,0,1}, state.angle);
             vertices[i+0].loc = quat_rotateVec3(rot, vertices[i+0].loc);
             vertices[i+1].loc = quat_rotateVec3(rot, vertices[i+1].loc);
             vertices[i+2].loc = quat_rotateVec3(rot, vertices[i+2].loc);
             vertices[i+3].loc = quat_rotateVec3(rot, vertices[i+3].loc);
         }
         // Scale if necessary
-        if(sprite->scale != 1.0) {
-            vertices[i+0].loc = vec3_scalarMul(vertices[i+0].loc, sprite->scale);
-            vertices[i+1].loc = vec3_scalarMul(vertices[i+1].loc, sprite->scale);
-            vertices[i+2].loc = vec3_scalarMul(vertices[i+2].loc, sprite->scale);
-            vertices[i+3].loc = vec3_scalarMul(vertices[i+3].loc, sprite->scale);
+        if(state.scale != 1.0) {
+            vertices[i+0].loc = vec3_scalarMul(vertices[i+0].loc, state.scale);
+            vertices[i+1].loc = vec3_scalarMul(vertices[i+1].loc, state.scale);
+            vertices[i+2].loc = vec3_scalarMul(vertices[i+2].loc, state.scale);
+            vertices[i+3].loc = vec3_scalarMul(vertices[i+3].loc, state.scale);
         }
         
-        vertices[i+0].loc = vec3_add(vertices[i+0].loc, sprite->location);
-        vertices[i+1].loc = vec3_add(vertices[i+1].loc, sprite->location);
-        vertices[i+2].loc = vec3_add(vertices[i+2].loc, sprite->location);
-        vertices[i+3].loc = vec3_add(vertices[i+3].loc, sprite->location);
+        vertices[i+0].loc = vec3_add(vertices[i+0].loc, state.location);
+        vertices[i+1].loc = vec3_add(vertices[i+1].loc, state.location);
+        vertices[i+2].loc = vec3_add(vertices[i+2].loc, state.location);
+        vertices[i+3].loc = vec3_add(vertices[i+3].loc, state.location);
         
         
         maxTexX = cropRect.origin.x + cropRect.size.w;
@@ -22,6 +22,16 @@ typedef struct _SpriteAnimation {
     bool loops;
 } SpriteAnimation_t;
 
+/*!
+    A snapshot of the sprite's transform & frame as seen by the renderer.
+*/
+typedef struct _SpriteState {
+    vec3_t location;
+    float scale, angle;
+    int activeAnimation;
+    int currentFrame;
+} SpriteState_t;
+
 /*!
     A sprite
 
@@ -33,6 +43,7 @@ typedef struct _SpriteAnimation {
     @field flippedVertically Indicates whether or not the sprite is drawn flipped over the X axis.
     @field flippedHorizontally Indicates whether or not the sprite is drawn flipped over the Y axis.
     @field activeAnimation Indicates the active animation (0 being the bottom animation in an atlas)
+    @field usesPublishedState Indicates whether the sprite is drawn from the states published using sprite_publishState (Set on the first publish)
 */
 typedef struct _Sprite {
     OBJ_GUTS
@@ -45,6 +56,14 @@ typedef struct _Sprite {
     bool flippedVertically;
     int activeAnimation; // The y offset of the active animation
     SpriteAnimation_t *animations;
+
+    // Triple buffered snapshots: the simulation thread owns stateBack, the render thread owns stateFront
+    // and they are exchanged through stateMiddle
+    volatile bool usesPublishedState;
+    int stateFront, stateBack;
+    volatile int stateMiddle;
+    SpriteState_t states[3];
+    SpriteState_t previousState;
 } Sprite_t;
 extern Class_t Class_Sprite;
 
@@ -56,6 +75,7 @@ typedef struct _SpriteBatch {
     int spriteCount;
     LinkedList_t *sprites;
     unsigned vbo, ibo, indexCount, vertCapacity;
+    unsigned vao; // 0 if vertex array objects are unsupported
 } SpriteBatch_t;
 extern Class_t Class_SpriteBatch;
 
@@ -73,6 +93,14 @@ extern SpriteAnimation_t sprite_createAnimation(int aNumberOfFrames);
 */
 extern void sprite_step(Sprite_t *aSprite);
 
+/*!
+    Publishes a snapshot of the sprite's current transform & frame for the renderer.
+    Call this from the simulation thread at the end of each update when using a threaded game timer.
+    Sprites owning a world entity are moved onto it & published by world_timerUpdate after each threaded step.
+    Once a sprite has published it's state it is drawn interpolated between the two latest snapshots.
+*/
+extern void sprite_publishState(Sprite_t *aSprite);
+
 /*!
  Creates a sprite batch
 */
@@ -1,8 +1,16 @@
 #include "texture.h"
 #include "png_loader.h"
+#include "ktx_loader.h"
 #include "util.h"
 #include "drawutils.h"
 #include "json.h"
+#include "json_query.h"
+#include "texture_cache.h"
+#include "texture_manager.h"
+#include "pixel_convert.h"
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
 
 static void texture_destroy(Texture_t *aTexture);
 static void _texture_draw(Renderer_t *aRenderer, Texture_t *aTexture, GLMFloat aTimeSinceLastFrame, GLMFloat aInterpolation);
@@ -20,52 +28,329 @@ static inline bool _isPowerOfTwo(int n)
     return (n != 0) && ((n & (n - 1)) == 0);
 }
 
+static void _texture_updateSubTextureRects(Texture_t *aTexture, float aPreviousHeight);
+static void _texture_setPixels(Texture_t *aTexture, const unsigned char *aData, uint16_t *aoPacked, int aWidth, int aHeight,
+                               bool aHasAlpha, TexturePixelFormat_t aFormat, bool aRepeatHorizontal, bool aRepeatVertical);
+
+// Images are decoded & converted in this buffer before being uploaded. It is kept between loads so that loading
+// a level only allocates it once. (Only used on the GL thread)
+static unsigned char *_stagingBuffer = NULL;
+static size_t _stagingBufferSize = 0;
+
+static unsigned char *_texture_getStagingBuffer(size_t aBytes)
+{
+    if(aBytes > _stagingBufferSize) {
+        free(_stagingBuffer);
+        _stagingBuffer = malloc(aBytes);
+        _stagingBufferSize = aBytes;
+    }
+    return _stagingBuffer;
+}
+
+void texture_releaseStagingBuffer(void)
+{
+    free(_stagingBuffer);
+    _stagingBuffer = NULL;
+    _stagingBufferSize = 0;
+}
+
+// Decodes a png into the staging buffer, converts it in place & uploads it
+static bool _texture_uploadPng(Texture_t *aTexture, const char *aPath, TexturePixelFormat_t aFormat, bool aPremultiplyAlpha,
+                               bool aRepeatHorizontal, bool aRepeatVertical)
+{
+    PngDecoder_t decoder;
+    if(!png_openDecoder(&decoder, aPath, false))
+        return false;
+    size_t rowBytes = (size_t)decoder.width*decoder.channels;
+    unsigned char *pixels = _texture_getStagingBuffer(rowBytes*decoder.height);
+    bool succeeded = png_decodeInto(&decoder, pixels, rowBytes, aPremultiplyAlpha);
+    png_closeDecoder(&decoder);
+    if(succeeded) {
+        _texture_setPixels(aTexture, pixels, (uint16_t *)pixels, decoder.width, decoder.height, decoder.channels == 4,
+                           aFormat, aRepeatHorizontal, aRepeatVertical);
+    }
+    return succeeded;
+}
+
 Texture_t *texture_loadFromPng(const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical)
+{
+    return texture_loadFromPngWithFormat(aPath, kTexturePixelFormat_Auto, true, aRepeatHorizontal, aRepeatVertical);
+}
+
+Texture_t *texture_loadFromPngWithFormat(const char *aPath, TexturePixelFormat_t aFormat, bool aPremultiplyAlpha,
+                                         bool aRepeatHorizontal, bool aRepeatVertical)
 {
     Texture_t *out = obj_create_autoreleased(&Class_Texture);
     out->displayCallback = (RenderableDisplayCallback_t)&_texture_draw;
-    
-    Png_t *png = png_load(aPath);
-    if(!png) {
+    out->pixelFormat = aFormat;
+    out->premultipliesAlpha = aPremultiplyAlpha;
+    glGenTextures(1, &out->id);
+    if(!_texture_uploadPng(out, aPath, aFormat, aPremultiplyAlpha, aRepeatHorizontal, aRepeatVertical)) {
         dynamo_log("Unable to load png file from %s", aPath);
-        return NULL;
+        return NULL; // The autoreleased texture deletes its id
     }
+    texture_setSource(out, aPath, aRepeatHorizontal, aRepeatVertical);
+    return out;
+}
+
+void texture_setSource(Texture_t *aTexture, const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical)
+{
+    bool isTracked = aTexture->sourcePath != NULL;
+    free(aTexture->sourcePath);
+    aTexture->sourcePath = strdup(aPath);
+    aTexture->repeatHorizontal = aRepeatHorizontal;
+    aTexture->repeatVertical = aRepeatVertical;
+    if(!isTracked)
+        _texManager_register(aTexture);
+}
+
+Texture_t *texture_createFromData(const unsigned char *aData, int aWidth, int aHeight, bool aHasAlpha, bool aRepeatHorizontal, bool aRepeatVertical)
+{
+    Texture_t *out = obj_create_autoreleased(&Class_Texture);
+    out->displayCallback = (RenderableDisplayCallback_t)&_texture_draw;
     
     glGenTextures(1, &out->id);
-    glBindTexture(GL_TEXTURE_2D, out->id);
+    texture_setData(out, aData, aWidth, aHeight, aHasAlpha, aRepeatHorizontal, aRepeatVertical);
+    return out;
+}
+
+void texture_setData(Texture_t *aTexture, const unsigned char *aData, int aWidth, int aHeight, bool aHasAlpha, bool aRepeatHorizontal, bool aRepeatVertical)
+{
+    texture_setDataWithFormat(aTexture, aData, aWidth, aHeight, aHasAlpha, kTexturePixelFormat_Auto, aRepeatHorizontal, aRepeatVertical);
+}
+
+void texture_setDataWithFormat(Texture_t *aTexture, const unsigned char *aData, int aWidth, int aHeight, bool aHasAlpha,
+                               TexturePixelFormat_t aFormat, bool aRepeatHorizontal, bool aRepeatVertical)
+{
+    uint16_t *packed = NULL;
+    if(aFormat != kTexturePixelFormat_Auto)
+        packed = (uint16_t *)_texture_getStagingBuffer((size_t)aWidth*aHeight*sizeof(uint16_t));
+    _texture_setPixels(aTexture, aData, packed, aWidth, aHeight, aHasAlpha, aFormat, aRepeatHorizontal, aRepeatVertical);
+}
+
+// Uploads 8 bit per channel pixels, converting them into aoPacked first if aFormat is a 16 bit one (aoPacked may be aData)
+static void _texture_setPixels(Texture_t *aTexture, const unsigned char *aData, uint16_t *aoPacked, int aWidth, int aHeight,
+                               bool aHasAlpha, TexturePixelFormat_t aFormat, bool aRepeatHorizontal, bool aRepeatVertical)
+{
+    GLenum format = aHasAlpha ? GL_RGBA : GL_RGB;
+    GLenum type = GL_UNSIGNED_BYTE;
+    int bytesPerPixel = aHasAlpha ? 4 : 3;
+    size_t count = (size_t)aWidth*aHeight;
+    uint16_t *packed = NULL;
+    if(aFormat != kTexturePixelFormat_Auto) {
+        packed = aoPacked;
+        bytesPerPixel = 2;
+        switch(aFormat) {
+            case kTexturePixelFormat_RGBA4444:
+                pixel_convertToRGBA4444(aData, aHasAlpha ? 4 : 3, packed, count);
+                format = GL_RGBA;
+                type = GL_UNSIGNED_SHORT_4_4_4_4;
+                break;
+            case kTexturePixelFormat_RGBA5551:
+                pixel_convertToRGBA5551(aData, aHasAlpha ? 4 : 3, packed, count);
+                format = GL_RGBA;
+                type = GL_UNSIGNED_SHORT_5_5_5_1;
+                break;
+            default:
+                pixel_convertToRGB565(aData, aHasAlpha ? 4 : 3, packed, count);
+                format = GL_RGB;
+                type = GL_UNSIGNED_SHORT_5_6_5;
+        }
+    }
+
+    glBindTexture(GL_TEXTURE_2D, aTexture->id);
     glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
     
-    glTexImage2D(GL_TEXTURE_2D, 0, png->hasAlpha ? GL_RGBA : GL_RGB, png->width, png->height,
-                 0, png->hasAlpha ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, png->data);
+    glTexImage2D(GL_TEXTURE_2D, 0, format, aWidth, aHeight, 0, format, type, packed ? (const void *)packed : aData);
     glError()
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, aRepeatHorizontal ? GL_REPEAT : GL_CLAMP_TO_EDGE);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, aRepeatVertical   ? GL_REPEAT : GL_CLAMP_TO_EDGE);
     glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     // Mipmaps can only be generated if the texture size is a power of 2
-    if(_isPowerOfTwo(png->width) && _isPowerOfTwo(png->height) && !aRepeatHorizontal && !aRepeatVertical) {
+    if(_isPowerOfTwo(aWidth) && _isPowerOfTwo(aHeight) && !aRepeatHorizontal && !aRepeatVertical) {
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST);
         glGenerateMipmap(GL_TEXTURE_2D);
     } else {
-            dynamo_assert(!( (!_isPowerOfTwo(png->width) || !_isPowerOfTwo(png->height))
+            dynamo_assert(!( (!_isPowerOfTwo(aWidth) || !_isPowerOfTwo(aHeight))
                               && (aRepeatHorizontal || aRepeatVertical) ),
                           "Repeating textures must have power of 2 dimensions");
         glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     }
     glError()
     
-    out->size = vec2_create(png->width, png->height);
-    out->pxAlignInset = vec2_create(
-                                    (1.0f/out->size.w) * 0.5,
-                                    (1.0f/out->size.h) * 0.5
+    size_t bytes = count*bytesPerPixel;
+    bool hasMipmaps = _isPowerOfTwo(aWidth) && _isPowerOfTwo(aHeight) && !aRepeatHorizontal && !aRepeatVertical;
+    _texManager_setByteSize(aTexture, hasMipmaps ? bytes*4/3 : bytes);
+    float previousHeight = aTexture->size.h;
+    aTexture->size = vec2_create(aWidth, aHeight);
+    aTexture->pxAlignInset = vec2_create(
+                                    (1.0f/aTexture->size.w) * 0.5,
+                                    (1.0f/aTexture->size.h) * 0.5
                                     );
-    
+    _texture_updateSubTextureRects(aTexture, previousHeight);
+}
+
+static bool _texture_isKtxPath(const char *aPath)
+{
+    const char *extension = strrchr(aPath, '.');
+    return extension && (strcasecmp(extension, ".ktx") == 0 || strcasecmp(extension, ".ktx2") == 0);
+}
+
+Texture_t *texture_load(const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical)
+{
+    if(_texture_isKtxPath(aPath))
+        return texture_loadFromKtx(aPath, aRepeatHorizontal, aRepeatVertical);
+    return texture_loadFromPng(aPath, aRepeatHorizontal, aRepeatVertical);
+}
+
+// Returns the format to upload compressed data of aFormat as, or 0 if the GPU does not support it
+// Checks the formats reported by the driver (Queried once, since they do not change)
+static GLenum _texture_compressedUploadFormat(GLenum aFormat)
+{
+    static GLint numberOfFormats = -1;
+    static GLint *formats = NULL;
+    if(numberOfFormats == -1) {
+        glGetIntegerv(GL_NUM_COMPRESSED_TEXTURE_FORMATS, &numberOfFormats);
+        formats = calloc(MAX(1, numberOfFormats), sizeof(GLint));
+        glGetIntegerv(GL_COMPRESSED_TEXTURE_FORMATS, formats);
+    }
+    for(int i = 0; i < numberOfFormats; ++i) {
+        if((GLenum)formats[i] == aFormat)
+            return aFormat;
+    }
+    // ETC1 data is valid ETC2 data, but has to be uploaded as such when the GPU lacks the ETC1 extension
+    if(aFormat == kKTXFormat_ETC1_RGB8)
+        return _texture_compressedUploadFormat(kKTXFormat_ETC2_RGB8);
+    return 0;
+}
+
+// Flips rows of pixels in place, for images stored top row first
+static void _texture_flipRows(unsigned char *aPixels, size_t aRowBytes, int aHeight)
+{
+    unsigned char *row = malloc(aRowBytes);
+    for(int y = 0; y < aHeight/2; ++y) {
+        unsigned char *top = aPixels + (size_t)y*aRowBytes, *bottom = aPixels + (size_t)(aHeight - y - 1)*aRowBytes;
+        memcpy(row, top, aRowBytes);
+        memcpy(top, bottom, aRowBytes);
+        memcpy(bottom, row, aRowBytes);
+    }
+    free(row);
+}
+
+// Uploads a KTX image into a texture, compressed if the GPU supports the format, decompressed otherwise
+static void _texture_uploadKtx(Texture_t *aTexture, Ktx_t *aKtx, bool aRepeatHorizontal, bool aRepeatVertical)
+{
+    GLenum uploadFormat = _texture_compressedUploadFormat(aKtx->glInternalFormat);
+    bool isCompressed = uploadFormat != 0;
+    if(isCompressed && aKtx->isTopDown)
+        dynamo_log("Compressed KTX images can not be flipped, so one stored top row first is displayed upside down");
+    glBindTexture(GL_TEXTURE_2D, aTexture->id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // Mipmaps are only usable if the chain is complete (GLES2 has no GL_TEXTURE_MAX_LEVEL)
+    int fullChainLength = 1;
+    while((MAX(aKtx->width, aKtx->height) >> fullChainLength) > 0)
+        ++fullChainLength;
+    bool useMipmaps = aKtx->numberOfLevels >= fullChainLength && !aRepeatHorizontal && !aRepeatVertical;
+    int numberOfLevels = useMipmaps ? fullChainLength : 1;
+
+    bool hasAlpha = ktx_formatHasAlpha(aKtx->glInternalFormat);
+    size_t bytes = 0;
+    for(int i = 0; i < numberOfLevels; ++i) {
+        KTXLevel_t *level = &aKtx->levels[i];
+        if(isCompressed) {
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, uploadFormat, level->width, level->height, 0, level->size, level->data);
+            bytes += level->size;
+        } else {
+            unsigned char *pixels = ktx_decompressLevel(aKtx, i);
+            if(pixels && aKtx->isTopDown)
+                _texture_flipRows(pixels, (size_t)level->width*(hasAlpha ? 4 : 3), level->height);
+            // Premultiplied like PNG images, as the renderer's blend function expects
+            if(pixels && hasAlpha)
+                pixel_premultiplyRGBA8(pixels, (size_t)level->width*level->height);
+            glTexImage2D(GL_TEXTURE_2D, i, hasAlpha ? GL_RGBA : GL_RGB, level->width, level->height,
+                         0, hasAlpha ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, pixels);
+            free(pixels);
+            bytes += (size_t)level->width*level->height*(hasAlpha ? 4 : 3);
+        }
+    }
+    glError()
+    dynamo_assert(!( (!_isPowerOfTwo(aKtx->width) || !_isPowerOfTwo(aKtx->height))
+                      && (aRepeatHorizontal || aRepeatVertical) ),
+                  "Repeating textures must have power of 2 dimensions");
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, aRepeatHorizontal ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, aRepeatVertical   ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, useMipmaps ? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR);
+    glError()
+
+    aTexture->premultipliesAlpha = !isCompressed; // Compressed images are sampled as stored
+    _texManager_setByteSize(aTexture, bytes);
+    float previousHeight = aTexture->size.h;
+    aTexture->size = vec2_create(aKtx->width, aKtx->height);
+    aTexture->pxAlignInset = vec2_create(
+                                    (1.0f/aTexture->size.w) * 0.5,
+                                    (1.0f/aTexture->size.h) * 0.5
+                                    );
+    _texture_updateSubTextureRects(aTexture, previousHeight);
+}
+
+Texture_t *texture_loadFromKtx(const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical)
+{
+    Ktx_t *ktx = ktx_load(aPath);
+    if(!ktx) {
+        dynamo_log("Unable to load ktx file from %s", aPath);
+        return NULL;
+    }
+
+    if(!_texture_compressedUploadFormat(ktx->glInternalFormat) && !ktx_canDecompress(ktx->glInternalFormat)) {
+        // Fall back on a png with the same name
+        char pngPath[PATH_MAX];
+        strncpy(pngPath, aPath, PATH_MAX - 5);
+        pngPath[PATH_MAX - 5] = '\0';
+        char *extension = strrchr(pngPath, '.');
+        strcpy(extension ? extension : pngPath + strlen(pngPath), ".png");
+        dynamo_log("Compressed format 0x%x of %s is not supported, falling back on %s", ktx->glInternalFormat, aPath, pngPath);
+        return texture_loadFromPng(pngPath, aRepeatHorizontal, aRepeatVertical);
+    }
+
+    Texture_t *out = obj_create_autoreleased(&Class_Texture);
+    out->displayCallback = (RenderableDisplayCallback_t)&_texture_draw;
+    glGenTextures(1, &out->id);
+    _texture_uploadKtx(out, ktx, aRepeatHorizontal, aRepeatVertical);
+    texture_setSource(out, aPath, aRepeatHorizontal, aRepeatVertical);
     return out;
 }
 
+bool texture_reload(Texture_t *aTexture)
+{
+    if(!aTexture->sourcePath)
+        return false;
+    if(_texture_isKtxPath(aTexture->sourcePath)) {
+        Ktx_t *ktx = ktx_load(aTexture->sourcePath);
+        if(!ktx)
+            return false;
+        _texture_uploadKtx(aTexture, ktx, aTexture->repeatHorizontal, aTexture->repeatVertical);
+    } else {
+        if(!_texture_uploadPng(aTexture, aTexture->sourcePath, aTexture->pixelFormat, aTexture->premultipliesAlpha,
+                               aTexture->repeatHorizontal, aTexture->repeatVertical))
+            return false;
+    }
+    return true;
+}
+
+void texture_bind(Texture_t *aTexture)
+{
+    texManager_touch(aTexture);
+    glBindTexture(GL_TEXTURE_2D, aTexture->id);
+}
+
 void texture_destroy(Texture_t *aTexture)
 {
-    if(aTexture->subtextures)
-        obj_release(aTexture->subtextures);
+    _texCache_textureDestroyed(aTexture);
+    _texManager_unregister(aTexture);
+    free(aTexture->sourcePath);
+    free(aTexture->subtextures);
     glDeleteTextures(1, &aTexture->id);
     aTexture->id = 0;
 }
@@ -95,70 +380,262 @@ static void _texture_draw(Renderer_t *aRenderer, Texture_t *aTexture, GLMFloat a
 }
 
 
-extern bool texture_loadPackingInfo(Texture_t *aTexture, const char *aPath)
+#pragma mark - Subtextures
+
+// Origins (From the bottom) & UV rects depend on the texture size, which changes when a placeholder is replaced by its image
+static void _texture_updateSubTextureRects(Texture_t *aTexture, float aPreviousHeight)
 {
-    char *jsonInput;
-    util_readFile(aPath, NULL, &jsonInput);
-    dynamo_assert(jsonInput != NULL, "No file at %s", aPath);
-    Dictionary_t *info = parseJSON(jsonInput);
-    free(jsonInput);
-    dynamo_assert(info != NULL && dict_get(info, "frames") != NULL, "Could not load texture packing info from %s", aPath);
-    
-    aTexture->subtextures = obj_retain(dict_get(info, "frames"));
-    
-    return true;
+    for(int i = 0; i < aTexture->numberOfSubtextures; ++i) {
+        SubTexture_t *subtexture = &aTexture->subtextures[i];
+        subtexture->origin.y += aTexture->size.h - aPreviousHeight;
+        vec2_t area = subtexture->isRotated ? vec2_create(subtexture->size.h, subtexture->size.w) : subtexture->size;
+        subtexture->rect = textureRectangle_createWithPixelCoordinates(aTexture, subtexture->origin, area);
+    }
+}
+
+static int _texture_compareSubTextures(const void *a, const void *b)
+{
+    return strcmp(((const SubTexture_t *)a)->name, ((const SubTexture_t *)b)->name);
+}
+
+void texture_setSubTextures(Texture_t *aTexture, const SubTexture_t *aSubTextures, int aCount)
+{
+    free(aTexture->subtextures);
+    aTexture->subtextures = malloc(MAX(1, aCount)*sizeof(SubTexture_t));
+    memcpy(aTexture->subtextures, aSubTextures, aCount*sizeof(SubTexture_t));
+    aTexture->numberOfSubtextures = aCount;
+    qsort(aTexture->subtextures, aCount, sizeof(SubTexture_t), &_texture_compareSubTextures);
+    _texture_updateSubTextureRects(aTexture, aTexture->size.h);
+}
+
+static float _texture_getNumber(Dictionary_t *aDict, const char *aKey, float aDefault)
+{
+    Number_t *number = aDict ? dict_get(aDict, aKey) : NULL;
+    return (number && obj_isClass(number, &Class_Number)) ? number->floatValue : aDefault;
+}
+
+typedef struct _PackingInfoContext {
+    Texture_t *texture;
+    SubTexture_t *subtextures;
+    int count, capacity;
+    bool isValid;
+    bool hasFrames;
+} PackingInfoContext_t;
+
+// The values of a TexturePacker frame definition
+typedef struct _PackedFrame {
+    char filename[DICT_MAXKEYLEN + 2]; // Room for one character too many, to tell names that are too long
+    float x, y, w, h;
+    bool isRotated, isTrimmed;
+    float sourceWidth, sourceHeight;
+    float trimX, trimY;
+} PackedFrame_t;
+
+enum {
+    kPackedFrame_filename,
+    kPackedFrame_x, kPackedFrame_y, kPackedFrame_w, kPackedFrame_h,
+    kPackedFrame_rotated, kPackedFrame_trimmed,
+    kPackedFrame_sourceWidth, kPackedFrame_sourceHeight,
+    kPackedFrame_trimX, kPackedFrame_trimY
+};
+
+static const JSONQueryField_t _PackedFrameFields[] = {
+    [kPackedFrame_filename]     = { "filename", kJSONField_string, offsetof(PackedFrame_t, filename), DICT_MAXKEYLEN + 2 },
+    [kPackedFrame_x]            = { "frame.x", kJSONField_float, offsetof(PackedFrame_t, x) },
+    [kPackedFrame_y]            = { "frame.y", kJSONField_float, offsetof(PackedFrame_t, y) },
+    [kPackedFrame_w]            = { "frame.w", kJSONField_float, offsetof(PackedFrame_t, w) },
+    [kPackedFrame_h]            = { "frame.h", kJSONField_float, offsetof(PackedFrame_t, h) },
+    [kPackedFrame_rotated]      = { "rotated", kJSONField_bool, offsetof(PackedFrame_t, isRotated) },
+    [kPackedFrame_trimmed]      = { "trimmed", kJSONField_bool, offsetof(PackedFrame_t, isTrimmed) },
+    [kPackedFrame_sourceWidth]  = { "sourceSize.w", kJSONField_float, offsetof(PackedFrame_t, sourceWidth) },
+    [kPackedFrame_sourceHeight] = { "sourceSize.h", kJSONField_float, offsetof(PackedFrame_t, sourceHeight) },
+    [kPackedFrame_trimX]        = { "spriteSourceSize.x", kJSONField_float, offsetof(PackedFrame_t, trimX) },
+    [kPackedFrame_trimY]        = { "spriteSourceSize.y", kJSONField_float, offsetof(PackedFrame_t, trimY) }
+};
+#define kPackedFrame_frameFields ((1 << kPackedFrame_x) | (1 << kPackedFrame_y) | (1 << kPackedFrame_w) | (1 << kPackedFrame_h))
+
+// Compiles a TexturePacker frame definition
+static void _texture_addFrame(PackingInfoContext_t *aCtx, const char *aName, size_t aNameLength, const PackedFrame_t *aFrame)
+{
+    if(!aName || aNameLength > DICT_MAXKEYLEN) {
+        aCtx->isValid = false;
+        return;
+    }
+    if(aCtx->count == aCtx->capacity) {
+        aCtx->capacity = MAX(64, aCtx->capacity*2);
+        aCtx->subtextures = realloc(aCtx->subtextures, aCtx->capacity*sizeof(SubTexture_t));
+    }
+    SubTexture_t *subtexture = &aCtx->subtextures[aCtx->count++];
+    memset(subtexture, 0, sizeof(SubTexture_t));
+    memcpy(subtexture->name, aName, aNameLength);
+    subtexture->size = vec2_create(aFrame->w, aFrame->h);
+    subtexture->isRotated = aFrame->isRotated;
+    subtexture->isTrimmed = aFrame->isTrimmed;
+
+    // Frames are defined from the top left, and rotated ones take up their width vertically
+    float areaHeight = subtexture->isRotated ? subtexture->size.w : subtexture->size.h;
+    subtexture->origin = vec2_create(aFrame->x, aCtx->texture->size.h - aFrame->y - areaHeight);
+    subtexture->sourceSize = vec2_create(aFrame->sourceWidth, aFrame->sourceHeight);
+    subtexture->trimOffset = vec2_create(aFrame->trimX, aFrame->trimY);
+}
+
+static void _texture_compileFrame(const char *aName, void *aInfo, void *aCtx)
+{
+    Dictionary_t *frameDef = obj_isClass(aInfo, &Class_Dictionary) ? dict_get(aInfo, "frame") : NULL;
+    if(!frameDef) {
+        ((PackingInfoContext_t *)aCtx)->isValid = false;
+        return;
+    }
+    PackedFrame_t frame = {
+        .x = _texture_getNumber(frameDef, "x", 0.0f),
+        .y = _texture_getNumber(frameDef, "y", 0.0f),
+        .w = _texture_getNumber(frameDef, "w", 0.0f),
+        .h = _texture_getNumber(frameDef, "h", 0.0f),
+        .isRotated = _texture_getNumber(aInfo, "rotated", 0.0f) != 0.0f,
+        .isTrimmed = _texture_getNumber(aInfo, "trimmed", 0.0f) != 0.0f
+    };
+    Dictionary_t *sourceSize = dict_get(aInfo, "sourceSize");
+    Dictionary_t *spriteSourceSize = dict_get(aInfo, "spriteSourceSize");
+    frame.sourceWidth = _texture_getNumber(sourceSize, "w", frame.w);
+    frame.sourceHeight = _texture_getNumber(sourceSize, "h", frame.h);
+    frame.trimX = _texture_getNumber(spriteSourceSize, "x", 0.0f);
+    frame.trimY = _texture_getNumber(spriteSourceSize, "y", 0.0f);
+    _texture_addFrame(aCtx, aName, aName ? strlen(aName) : 0, &frame);
+}
+
+// Called with the values of each member of "frames", which is a dictionary keyed by frame name (Hash format) or an array
+static void _texture_compilePackedFrame(JSONQuery_t *aQuery, const JSONQueryMatch_t *aMatch, void *aRecord,
+                                        uint64_t aFieldsFound, void *aCtx)
+{
+    PackedFrame_t *frame = aRecord;
+    if((aFieldsFound & kPackedFrame_frameFields) != kPackedFrame_frameFields) { // Every one of x, y, w & h is required
+        ((PackingInfoContext_t *)aCtx)->isValid = false;
+        return;
+    }
+    if(!(aFieldsFound & (1 << kPackedFrame_sourceWidth)))
+        frame->sourceWidth = frame->w;
+    if(!(aFieldsFound & (1 << kPackedFrame_sourceHeight)))
+        frame->sourceHeight = frame->h;
+
+    const JSONQueryWildcard_t *member = &aMatch->wildcards[0];
+    if(member->key)
+        _texture_addFrame(aCtx, member->key, member->keyLength, frame);
+    else if(aFieldsFound & (1 << kPackedFrame_filename))
+        _texture_addFrame(aCtx, frame->filename, strlen(frame->filename), frame);
+    else
+        _texture_addFrame(aCtx, NULL, 0, frame);
+}
+
+static void _texture_foundFrames(JSONQuery_t *aQuery, const JSONQueryMatch_t *aMatch, void *aRecord,
+                                 uint64_t aFieldsFound, void *aCtx)
+{
+    ((PackingInfoContext_t *)aCtx)->hasFrames = true;
+}
+
+bool texture_loadPackingInfo(Texture_t *aTexture, const char *aPath)
+{
+    MappedFile_t file;
+    bool found = util_mapFile(aPath, kMappedFileAccess_sequential, &file);
+    dynamo_assert(found, "Could not load texture packing info from %s", aPath);
+    if(!found)
+        return false;
+    bool succeeded = texture_setPackingInfoData(aTexture, file.data, file.length);
+    util_unmapFile(&file);
+    dynamo_assert(succeeded, "Invalid texture packing data in %s", aPath);
+    return succeeded;
+}
+
+bool texture_setPackingInfoData(Texture_t *aTexture, const char *aData, size_t aLength)
+{
+    // Only the frames are read, the rest of the file is skipped over
+    PackingInfoContext_t ctx = { aTexture, NULL, 0, 0, true, false };
+    JSONQuery_t *query = jsonQuery_create();
+    jsonQuery_addRecord(query, "frames", NULL, 0, 0, &_texture_foundFrames, &ctx);
+    jsonQuery_addRecord(query, "frames.*", _PackedFrameFields, sizeof(_PackedFrameFields)/sizeof(JSONQueryField_t),
+                        sizeof(PackedFrame_t), &_texture_compilePackedFrame, &ctx);
+    bool succeeded = jsonQuery_runData(query, aData, aLength) && ctx.hasFrames && ctx.isValid;
+    obj_release(query);
+
+    if(succeeded)
+        texture_setSubTextures(aTexture, ctx.subtextures, ctx.count);
+    free(ctx.subtextures);
+    return succeeded;
+}
+
+bool texture_setPackingInfo(Texture_t *aTexture, Dictionary_t *aInfo)
+{
+    void *frames = obj_isClass(aInfo, &Class_Dictionary) ? dict_get(aInfo, "frames") : NULL;
+    if(!frames)
+        return false;
+
+    PackingInfoContext_t ctx = { aTexture, NULL, 0, 0, true, true };
+    if(obj_isClass(frames, &Class_Array)) {
+        Array_t *frameArray = frames;
+        for(int i = 0; i < frameArray->count; ++i) {
+            Dictionary_t *frame = frameArray->items[i];
+            String_t *filename = obj_isClass(frame, &Class_Dictionary) ? dict_get(frame, "filename") : NULL;
+            _texture_compileFrame(filename ? filename->cString : NULL, frame, &ctx);
+        }
+    } else
+        dict_apply(frames, &_texture_compileFrame, &ctx);
+    if(ctx.isValid)
+        texture_setSubTextures(aTexture, ctx.subtextures, ctx.count);
+    free(ctx.subtextures);
+    return ctx.isValid;
 }
 
-static Dictionary_t *_texture_getSubTexInfoDict(Texture_t *aTexture, const char *aTexName)
+int texture_getSubTextureId(Texture_t *aTexture, const char *aTexName)
+{
+    int low = 0, high = aTexture->numberOfSubtextures - 1;
+    while(low <= high) {
+        int middle = (low + high)/2;
+        int order = strcmp(aTexName, aTexture->subtextures[middle].name);
+        if(order == 0)
+            return middle;
+        else if(order < 0)
+            high = middle - 1;
+        else
+            low = middle + 1;
+    }
+    return -1;
+}
+
+const SubTexture_t *texture_getSubTexture(Texture_t *aTexture, int aId)
+{
+    dynamo_assert(aId >= 0 && aId < aTexture->numberOfSubtextures, "Invalid subtexture id %d", aId);
+    return &aTexture->subtextures[aId];
+}
+
+static SubTexture_t *_texture_findSubTexture(Texture_t *aTexture, const char *aTexName)
 {
     dynamo_assert(aTexture->subtextures != NULL, "The texture contains no packing info");
-    Dictionary_t *info = dict_get(aTexture->subtextures, aTexName);
-    dynamo_assert(info != NULL, "Subtexture %s not found", aTexName);
-    if(!info) return NULL;
-    
-    Dictionary_t *frameDef = dict_get(info, "frame");
-    dynamo_assert(frameDef != NULL, "Invalid texture packing data!");
-    
-    return frameDef;
+    int id = texture_getSubTextureId(aTexture, aTexName);
+    dynamo_assert(id != -1, "Subtexture %s not found", aTexName);
+    return id != -1 ? &aTexture->subtextures[id] : NULL;
 }
 
 TextureRect_t texture_getSubTextureRect(Texture_t *aTexture, const char *aTexName)
 {
-    Dictionary_t *frameDef = _texture_getSubTexInfoDict(aTexture, aTexName);
-    if(!frameDef)
+    SubTexture_t *subtexture = _texture_findSubTexture(aTexture, aTexName);
+    if(!subtexture)
         return textureRectangle_create(-1, -1, 0, 0);
-    
-    vec2_t origin = vec2_create(((Number_t*)dict_get(frameDef, "x"))->floatValue,
-                                ((Number_t*)dict_get(frameDef, "y"))->floatValue);
-    vec2_t size   = vec2_create(((Number_t*)dict_get(frameDef, "w"))->floatValue,
-                                ((Number_t*)dict_get(frameDef, "h"))->floatValue);
-    
-    return textureRectangle_createWithPixelCoordinates(aTexture, origin, size);
+    return subtexture->rect;
 }
 
 vec2_t texture_getSubTextureOrigin(Texture_t *aTexture, const char *aTexName)
 {
-    Dictionary_t *frameDef = _texture_getSubTexInfoDict(aTexture, aTexName);
-    if(!frameDef)
+    SubTexture_t *subtexture = _texture_findSubTexture(aTexture, aTexName);
+    if(!subtexture)
         return vec2_create(-1, -1);
-    
-    float texHeight = aTexture->size.h;
-    float subTexHeight = ((Number_t*)dict_get(frameDef, "h"))->floatValue;
-    vec2_t origin = vec2_create(((Number_t*)dict_get(frameDef, "x"))->floatValue,
-                                ((Number_t*)dict_get(frameDef, "y"))->floatValue);
-    origin.y = texHeight - origin.y - subTexHeight;
-    
-    return origin;
+    return subtexture->origin;
 }
 
 vec2_t texture_getSubTextureSize(Texture_t *aTexture, const char *aTexName)
 {
-    Dictionary_t *frameDef = _texture_getSubTexInfoDict(aTexture, aTexName);
-    if(!frameDef)
+    SubTexture_t *subtexture = _texture_findSubTexture(aTexture, aTexName);
+    if(!subtexture)
         return vec2_create(-1, -1);
-    
-    return vec2_create(((Number_t*)dict_get(frameDef, "w"))->floatValue,
-                       ((Number_t*)dict_get(frameDef, "h"))->floatValue);
+    return subtexture->size;
 }
 
 TextureAtlas_t *texture_getSubTextureAtlas(Texture_t *aTexture, const char *aTexName, vec2_t aAtlasSize)
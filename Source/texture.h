@@ -13,14 +13,78 @@
 #ifndef _TEXTURE_H_
 #define _TEXTURE_H_
 
+/*!
+    The format images are stored in on the GPU. The 16 bit formats halve the memory used by RGBA textures
+    at the cost of color precision.
+
+    @constant kTexturePixelFormat_Auto 8 bit per channel RGBA, or RGB if the image has no alpha
+    @constant kTexturePixelFormat_RGBA4444 4 bit per channel RGBA
+    @constant kTexturePixelFormat_RGBA5551 5 bit per color channel & 1 bit alpha
+    @constant kTexturePixelFormat_RGB565 5/6/5 bit RGB without alpha
+*/
+typedef enum {
+    kTexturePixelFormat_Auto,
+    kTexturePixelFormat_RGBA4444,
+    kTexturePixelFormat_RGBA5551,
+    kTexturePixelFormat_RGB565
+} TexturePixelFormat_t;
+
+/*!
+    A  structure to specify areas to sample from a texture (in UV coordinates)
+*/
+typedef union _TextureRect {
+    vec4_t vec;
+    float *f;
+    struct {
+        vec2_t origin;
+        vec2_t size;
+    };
+    struct {
+        float u, v;
+        float w, h;
+    };
+} TextureRect_t;
+
+/*!
+    A subtexture packed within a texture, compiled from its packing info
+
+    @field name The name the subtexture is looked up by
+    @field origin The location of the subtexture's area within the texture in pixels (From the bottom left)
+    @field size The size of the subtexture's image in pixels (Its area within the texture is rotated if isRotated)
+    @field rect The UV rectangle of the subtexture's area
+    @field isRotated True if the image is stored rotated 90° clockwise
+    @field isTrimmed True if the image's transparent borders were trimmed off
+    @field sourceSize The size of the image before trimming
+    @field trimOffset The location of the trimmed image within the untrimmed one (From the top left)
+*/
+typedef struct _SubTexture {
+    char name[DICT_MAXKEYLEN + 1];
+    vec2_t origin;
+    vec2_t size;
+    TextureRect_t rect;
+    bool isRotated;
+    bool isTrimmed;
+    vec2_t sourceSize;
+    vec2_t trimOffset;
+} SubTexture_t;
+
 /*!
     A texture
 
     @field location The location to use if the texture is drawn directly as a renderable
     @field id The OpenGL texture id
     @field size The image size in pixels
-    @field subtextures Contains information about subtextures packed within the image data of this texture. (NULL by default)
+    @field subtextures The subtextures packed within the image data of this texture, sorted by name. (NULL by default)
                        Packed textures can be generated using JSON export in TexturePacker. (http://texturepacker.com)
+                       A subtexture's index in this array is its id.
+    @field cacheEntry The texture's entry in the texture cache (NULL if it was not loaded through the cache)
+    @field isLoading True while the texture is a placeholder waiting for an asynchronous load to complete
+    @field sourcePath The file the texture was loaded from (NULL for textures created from memory, which are never evicted)
+    @field byteSize Estimated video memory used by the image
+    @field lastUsedFrame The texture manager frame in which the texture was last bound
+    @field isEvicted True while the image has been unloaded by the texture manager
+    @field pixelFormat The GPU format the source file is converted to when (re)loaded
+    @field premultipliesAlpha True if the source file's colors are multiplied by alpha when (re)loaded
 */
 typedef struct _Texture {
     OBJ_GUTS
@@ -32,33 +96,76 @@ typedef struct _Texture {
     // to prevent bleeding when using texture atlases
     vec2_t pxAlignInset;
 
-    Dictionary_t *subtextures;
+    int numberOfSubtextures;
+    SubTexture_t *subtextures;
+    struct _TextureCacheEntry *cacheEntry; // Set if the texture is shared through the texture cache
+    bool isLoading;
+
+    char *sourcePath;
+    bool repeatHorizontal, repeatVertical;
+    size_t byteSize;
+    unsigned long lastUsedFrame;
+    bool isEvicted;
+    struct _Texture *lessRecentlyUsed, *moreRecentlyUsed; // Links in the texture manager's lists
+    TexturePixelFormat_t pixelFormat;
+    bool premultipliesAlpha;
 } Texture_t;
 extern Class_t Class_Texture;
 
 
-/*!
-    A  structure to specify areas to sample from a texture (in UV coordinates)
-*/
-typedef union _TextureRect {
-    vec4_t vec;
-    float *f;
-    struct {
-        vec2_t origin;
-        vec2_t size;
-    };
-    struct {
-        float u, v;
-        float w, h;
-    };
-} TextureRect_t;
-
 extern const TextureRect_t kTextureRectEntire;
 
 /*!
-    Loads a texture from a PNG file.
+    Loads a texture from a PNG or KTX file, depending on its extension.
+*/
+extern Texture_t *texture_load(const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical);
+/*!
+    Loads a texture from a PNG file, premultiplying its alpha & keeping 8 bits per channel.
 */
 extern Texture_t *texture_loadFromPng(const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical);
+/*!
+    Loads a texture from a PNG file, converting it to the given pixel format.
+    Premultiplied alpha is required by the renderer's blend function; only disable it for data that is not drawn as color.
+*/
+extern Texture_t *texture_loadFromPngWithFormat(const char *aPath, TexturePixelFormat_t aFormat, bool aPremultiplyAlpha,
+                                                bool aRepeatHorizontal, bool aRepeatVertical);
+/*!
+    Loads a texture from a KTX file containing ETC1, ETC2 or ASTC data, including its prebuilt mipmaps.
+    If the GPU does not support the format, ETC data is decompressed in software and other formats fall back on
+    the PNG with the same name. (e.g. hero.ktx => hero.png)
+*/
+extern Texture_t *texture_loadFromKtx(const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical);
+/*!
+    Creates a texture from 8 bit per channel RGB(A) pixel data. (Rows ordered bottom to top)
+*/
+extern Texture_t *texture_createFromData(const unsigned char *aData, int aWidth, int aHeight, bool aHasAlpha, bool aRepeatHorizontal, bool aRepeatVertical);
+/*!
+    Replaces the image of an existing texture, keeping its OpenGL id. (Rows ordered bottom to top)
+*/
+extern void texture_setData(Texture_t *aTexture, const unsigned char *aData, int aWidth, int aHeight, bool aHasAlpha, bool aRepeatHorizontal, bool aRepeatVertical);
+/*!
+    Replaces the image of an existing texture with 8 bit per channel RGB(A) data converted to the given pixel format.
+*/
+extern void texture_setDataWithFormat(Texture_t *aTexture, const unsigned char *aData, int aWidth, int aHeight, bool aHasAlpha,
+                                      TexturePixelFormat_t aFormat, bool aRepeatHorizontal, bool aRepeatVertical);
+/*!
+    Frees the buffer PNGs are decoded into before being uploaded. It is kept at the size of the largest image loaded so far
+    to avoid reallocating it on every load; release it once loading is done if memory is tight.
+*/
+extern void texture_releaseStagingBuffer(void);
+/*!
+    Records the file a texture was loaded from, letting the texture manager evict & reload it.
+*/
+extern void texture_setSource(Texture_t *aTexture, const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical);
+/*!
+    Reloads the image of a texture from its source file, keeping its OpenGL id. Returns false if it has no source.
+*/
+extern bool texture_reload(Texture_t *aTexture);
+/*!
+    Binds a texture to GL_TEXTURE_2D for drawing. Draw paths must bind through this so that the texture manager
+    knows the texture is in use, and can reload it if it had been evicted.
+*/
+extern void texture_bind(Texture_t *aTexture);
 /*!
     Generates a UV texture rectangle from pixel coordinates.
 */
@@ -73,9 +180,32 @@ extern TextureRect_t textureRectangle_createWithSizeInPixels(Texture_t *aTexture
 extern TextureRect_t textureRectangle_create(float aX, float aY, float aWidth, float aHeight);
 
 /*!
-    Loads texture packing info from a JSON file.
+    Loads texture packing info from a JSON file (In TexturePacker's hash or array format) & compiles it into the
+    texture's subtexture index. Only the frame definitions are read, without building the JSON objects.
 */
 extern bool texture_loadPackingInfo(Texture_t *aTexture, const char *aPath);
+/*!
+    Compiles aLength bytes of texture packing info JSON into the texture's subtexture index. Returns false if the info is invalid.
+*/
+extern bool texture_setPackingInfoData(Texture_t *aTexture, const char *aData, size_t aLength);
+/*!
+    Compiles already parsed texture packing info into the texture's subtexture index. Returns false if the info is invalid.
+*/
+extern bool texture_setPackingInfo(Texture_t *aTexture, Dictionary_t *aInfo);
+/*!
+    Replaces the subtextures of a texture. Only the name, origin, size & metadata of each one need to be set,
+    the UV rectangles are computed. (Used by the texture packer)
+*/
+extern void texture_setSubTextures(Texture_t *aTexture, const SubTexture_t *aSubTextures, int aCount);
+/*!
+    Returns the id of the subtexture matching aTexName (-1 if there is none). Ids stay valid until the packing info is
+    replaced, so they can be looked up once & cached.
+*/
+extern int texture_getSubTextureId(Texture_t *aTexture, const char *aTexName);
+/*!
+    Returns the subtexture with the given id.
+*/
+extern const SubTexture_t *texture_getSubTexture(Texture_t *aTexture, int aId);
 /*!
     Returns the texture rect for a subtexture matching aTexName.
 */
@@ -0,0 +1,150 @@
+#include "texture_cache.h"
+#include "util.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+
+#define kTexCacheBucketCount (256)
+
+typedef struct _TextureCacheEntry {
+    char *key;
+    Texture_t *texture; // Weak unless pinned
+    bool pinned;
+    size_t bytes;
+    struct _TextureCacheEntry *next;
+} TextureCacheEntry_t;
+
+static TextureCacheEntry_t *_buckets[kTexCacheBucketCount];
+static TextureCacheStats_t _stats;
+
+static unsigned _texCache_hash(const char *aKey)
+{
+    unsigned hash = 5381;
+    while(*aKey)
+        hash = ((hash << 5) + hash) + (unsigned char)*aKey++;
+    return hash % kTexCacheBucketCount;
+}
+
+// Builds the key for a file: its canonical path along with the wrapping flags (Which are part of the texture state)
+static void _texCache_makeKey(const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical, char *aoKey, size_t aKeyLen)
+{
+    char canonical[PATH_MAX];
+    if(!realpath(aPath, canonical))
+        strncpy(canonical, aPath, PATH_MAX - 1), canonical[PATH_MAX - 1] = '\0';
+    snprintf(aoKey, aKeyLen, "%s|%d%d", canonical, aRepeatHorizontal, aRepeatVertical);
+}
+
+static TextureCacheEntry_t *_texCache_find(const char *aKey)
+{
+    for(TextureCacheEntry_t *entry = _buckets[_texCache_hash(aKey)]; entry; entry = entry->next) {
+        if(strcmp(entry->key, aKey) == 0)
+            return entry;
+    }
+    return NULL;
+}
+
+Texture_t *texCache_find(const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical)
+{
+    char key[PATH_MAX + 8];
+    _texCache_makeKey(aPath, aRepeatHorizontal, aRepeatVertical, key, sizeof(key));
+    TextureCacheEntry_t *entry = _texCache_find(key);
+    return entry ? entry->texture : NULL;
+}
+
+void texCache_insert(Texture_t *aTexture, const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical)
+{
+    dynamo_assert(aTexture->cacheEntry == NULL, "Texture already cached");
+    char key[PATH_MAX + 8];
+    _texCache_makeKey(aPath, aRepeatHorizontal, aRepeatVertical, key, sizeof(key));
+    dynamo_assert(_texCache_find(key) == NULL, "A texture is already cached for %s", aPath);
+
+    TextureCacheEntry_t *entry = calloc(1, sizeof(TextureCacheEntry_t));
+    entry->key = strdup(key);
+    entry->texture = aTexture;
+    entry->bytes = aTexture->byteSize;
+    unsigned bucket = _texCache_hash(key);
+    entry->next = _buckets[bucket];
+    _buckets[bucket] = entry;
+    aTexture->cacheEntry = entry;
+
+    ++_stats.residentTextures;
+    _stats.bytesResident += entry->bytes;
+}
+
+Texture_t *texCache_loadPng(const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical)
+{
+    Texture_t *texture = texCache_find(aPath, aRepeatHorizontal, aRepeatVertical);
+    if(texture) {
+        ++_stats.hits;
+        return obj_autorelease(obj_retain(texture));
+    }
+
+    ++_stats.misses;
+    texture = texture_load(aPath, aRepeatHorizontal, aRepeatVertical);
+    if(texture)
+        texCache_insert(texture, aPath, aRepeatHorizontal, aRepeatVertical);
+    return texture;
+}
+
+Texture_t *texCache_preload(const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical)
+{
+    Texture_t *texture = texCache_loadPng(aPath, aRepeatHorizontal, aRepeatVertical);
+    if(texture)
+        texCache_pin(texture);
+    return texture;
+}
+
+void texCache_pin(Texture_t *aTexture)
+{
+    TextureCacheEntry_t *entry = aTexture->cacheEntry;
+    if(!entry || entry->pinned)
+        return;
+    entry->pinned = true;
+    obj_retain(aTexture);
+}
+
+void texCache_unpin(Texture_t *aTexture)
+{
+    TextureCacheEntry_t *entry = aTexture->cacheEntry;
+    if(!entry || !entry->pinned)
+        return;
+    entry->pinned = false;
+    obj_release(aTexture); // May destroy the texture & with it the entry
+}
+
+void texCache_unpinAll(void)
+{
+    for(int i = 0; i < kTexCacheBucketCount; ++i) {
+        TextureCacheEntry_t *entry = _buckets[i];
+        while(entry) {
+            // Unpinning can remove the entry, so move on first
+            TextureCacheEntry_t *next = entry->next;
+            texCache_unpin(entry->texture);
+            entry = next;
+        }
+    }
+}
+
+TextureCacheStats_t texCache_getStats(void)
+{
+    return _stats;
+}
+
+void _texCache_textureDestroyed(Texture_t *aTexture)
+{
+    TextureCacheEntry_t *entry = aTexture->cacheEntry;
+    if(!entry)
+        return;
+    TextureCacheEntry_t **link = &_buckets[_texCache_hash(entry->key)];
+    while(*link && *link != entry)
+        link = &(*link)->next;
+    if(*link)
+        *link = entry->next;
+
+    --_stats.residentTextures;
+    _stats.bytesResident -= entry->bytes;
+    aTexture->cacheEntry = NULL;
+    free(entry->key);
+    free(entry);
+}
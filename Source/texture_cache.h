@@ -0,0 +1,66 @@
+/*!
+    @header Texture Cache
+    @abstract
+    @discussion Shares textures loaded from the same image file.
+
+    The cache only holds weak references: a cached texture is removed from the cache when its last owner releases it,
+    unless it has been pinned. Must only be used from the GL thread.
+*/
+
+#ifndef _TEXTURECACHE_H_
+#define _TEXTURECACHE_H_
+
+#include "texture.h"
+
+/*!
+    Cache statistics
+
+    @field hits Loads satisfied by an existing texture
+    @field misses Loads that had to decode & upload the image
+    @field residentTextures The number of textures currently in the cache
+    @field bytesResident Estimated video memory used by the textures in the cache
+*/
+typedef struct _TextureCacheStats {
+    unsigned long hits;
+    unsigned long misses;
+    int residentTextures;
+    size_t bytesResident;
+} TextureCacheStats_t;
+
+/*!
+    Loads a texture from a PNG (or KTX) file, returning the existing texture if the same file (With the same wrapping) is already loaded.
+*/
+extern Texture_t *texCache_loadPng(const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical);
+/*!
+    Returns the cached texture for a file (With the given wrapping), or NULL if it is not loaded. The texture is not retained.
+*/
+extern Texture_t *texCache_find(const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical);
+/*!
+    Adds a texture loaded from a file by other means (Such as a background loader) to the cache.
+    No texture may already be cached for the file.
+*/
+extern void texCache_insert(Texture_t *aTexture, const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical);
+/*!
+    Loads & pins a texture so that it stays loaded until unpinned, even when unused.
+*/
+extern Texture_t *texCache_preload(const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical);
+/*!
+    Keeps a cached texture alive while it is not in use. (Has no effect on textures not in the cache)
+*/
+extern void texCache_pin(Texture_t *aTexture);
+/*!
+    Allows a pinned texture to be unloaded once it is no longer used.
+*/
+extern void texCache_unpin(Texture_t *aTexture);
+/*!
+    Unpins every pinned texture.
+*/
+extern void texCache_unpinAll(void);
+/*!
+    Gets the cache statistics.
+*/
+extern TextureCacheStats_t texCache_getStats(void);
+
+// Called by texture_destroy to drop the cache's reference
+extern void _texCache_textureDestroyed(Texture_t *aTexture);
+#endif
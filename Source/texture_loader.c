@@ -0,0 +1,243 @@
+#include "texture_loader.h"
+#include "png_loader.h"
+#include "luacontext.h"
+#include "util.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct _TextureLoadJob {
+    char *path;
+    bool repeatHorizontal, repeatVertical;
+    bool premultiplyAlpha;
+    Texture_t *texture; // Retained, only touched on the GL thread
+    unsigned char *pixels; // Decoded by the worker (NULL if decoding failed)
+    int width, height;
+    bool hasAlpha;
+    TextureLoadCallback_t callback;
+    void *context;
+    int luaCallback;
+    unsigned long generation;
+    struct _TextureLoadJob *next;
+} TextureLoadJob_t;
+
+typedef struct _TextureLoadQueue {
+    TextureLoadJob_t *head, *tail;
+    int count;
+} TextureLoadQueue_t;
+
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER; // Guards everything below
+static pthread_cond_t _workAvailable = PTHREAD_COND_INITIALIZER;
+static bool _hasWorker = false;
+static pthread_t _workerThread;
+static TextureLoadQueue_t _queued, _decoded;
+static int _decoding = 0;
+static unsigned long _generation = 0; // Incremented by texLoader_cancelAll to invalidate loads in flight
+
+// Only accessed on the GL thread
+static size_t _uploadBudget = 1024*1024;
+static size_t _bytesUploaded = 0;
+
+static void *_texLoader_worker(void *aUnused);
+
+static void _texLoader_push(TextureLoadQueue_t *aQueue, TextureLoadJob_t *aJob)
+{
+    aJob->next = NULL;
+    if(aQueue->tail)
+        aQueue->tail->next = aJob;
+    else
+        aQueue->head = aJob;
+    aQueue->tail = aJob;
+    ++aQueue->count;
+}
+
+static TextureLoadJob_t *_texLoader_pop(TextureLoadQueue_t *aQueue)
+{
+    TextureLoadJob_t *job = aQueue->head;
+    if(!job)
+        return NULL;
+    aQueue->head = job->next;
+    if(!aQueue->head)
+        aQueue->tail = NULL;
+    --aQueue->count;
+    return job;
+}
+
+// Releases a job's resources (Must be called on the GL thread since it may destroy the texture)
+static void _texLoader_freeJob(TextureLoadJob_t *aJob)
+{
+    free(aJob->pixels);
+    if(aJob->luaCallback != -1)
+        luaCtx_unregisterScriptHandler(GlobalLuaContext, aJob->luaCallback);
+    obj_release(aJob->texture);
+    free(aJob->path);
+    free(aJob);
+}
+
+static void _texLoader_enqueue(Texture_t *aTexture, const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical,
+                               TextureLoadCallback_t aCallback, void *aContext, int aLuaCallback)
+{
+    aTexture->isLoading = true;
+
+    TextureLoadJob_t *job = calloc(1, sizeof(TextureLoadJob_t));
+    job->path = strdup(aPath);
+    job->repeatHorizontal = aRepeatHorizontal;
+    job->repeatVertical = aRepeatVertical;
+    job->premultiplyAlpha = aTexture->premultipliesAlpha;
+    job->texture = obj_retain(aTexture);
+    job->callback = aCallback;
+    job->context = aContext;
+    job->luaCallback = aLuaCallback;
+
+    pthread_mutex_lock(&_lock);
+    if(!_hasWorker) {
+        _hasWorker = pthread_create(&_workerThread, NULL, &_texLoader_worker, NULL) == 0;
+        if(!_hasWorker)
+            dynamo_log("Unable to create texture loading thread");
+    }
+    job->generation = _generation;
+    // Without a worker the image is decoded on the next call to texLoader_processUploads instead
+    _texLoader_push(_hasWorker ? &_queued : &_decoded, job);
+    pthread_cond_signal(&_workAvailable);
+    pthread_mutex_unlock(&_lock);
+}
+
+Texture_t *texLoader_loadPng(const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical,
+                             TextureLoadCallback_t aCallback, void *aContext, int aLuaCallback)
+{
+    dynamo_assert(aPath != NULL, "Invalid path");
+
+    static const unsigned char transparentPixel[4] = { 0, 0, 0, 0 };
+    Texture_t *placeholder = texture_createFromData(transparentPixel, 1, 1, true, false, false);
+    placeholder->premultipliesAlpha = true;
+    texture_setSource(placeholder, aPath, aRepeatHorizontal, aRepeatVertical);
+    _texLoader_enqueue(placeholder, aPath, aRepeatHorizontal, aRepeatVertical, aCallback, aContext, aLuaCallback);
+    return placeholder;
+}
+
+void texLoader_reloadPng(Texture_t *aTexture)
+{
+    dynamo_assert(aTexture->sourcePath != NULL, "The texture has no source file");
+    if(aTexture->isLoading)
+        return;
+    _texLoader_enqueue(aTexture, aTexture->sourcePath, aTexture->repeatHorizontal, aTexture->repeatVertical, NULL, NULL, -1);
+}
+
+// Decodes a job's image straight into the buffer it is uploaded from, premultiplying it on the decoding thread
+static void _texLoader_decode(TextureLoadJob_t *aJob)
+{
+    PngDecoder_t decoder;
+    if(!png_openDecoder(&decoder, aJob->path, false))
+        return;
+    size_t rowBytes = (size_t)decoder.width*decoder.channels;
+    aJob->pixels = malloc(rowBytes*decoder.height);
+    if(png_decodeInto(&decoder, aJob->pixels, rowBytes, aJob->premultiplyAlpha)) {
+        aJob->width = decoder.width;
+        aJob->height = decoder.height;
+        aJob->hasAlpha = decoder.channels == 4;
+    } else {
+        free(aJob->pixels);
+        aJob->pixels = NULL;
+    }
+    png_closeDecoder(&decoder);
+}
+
+static void _texLoader_complete(TextureLoadJob_t *aJob)
+{
+    bool succeeded = aJob->pixels != NULL;
+    if(succeeded) {
+        TexturePixelFormat_t format = aJob->texture->pixelFormat;
+        texture_setDataWithFormat(aJob->texture, aJob->pixels, aJob->width, aJob->height, aJob->hasAlpha,
+                                  format, aJob->repeatHorizontal, aJob->repeatVertical);
+        int bytesPerPixel = format != kTexturePixelFormat_Auto ? 2 : (aJob->hasAlpha ? 4 : 3);
+        _bytesUploaded += (size_t)aJob->width * aJob->height * bytesPerPixel;
+    } else
+        dynamo_log("Unable to load png file from %s", aJob->path);
+    aJob->texture->isLoading = false;
+
+    if(aJob->callback)
+        aJob->callback(aJob->texture, succeeded, aJob->context);
+    if(aJob->luaCallback != -1) {
+        luaCtx_pushScriptHandler(GlobalLuaContext, aJob->luaCallback);
+        luaCtx_pushlightuserdata(GlobalLuaContext, aJob->texture);
+        luaCtx_pushboolean(GlobalLuaContext, succeeded);
+        luaCtx_pcall(GlobalLuaContext, 2, 0, 0);
+    }
+}
+
+void texLoader_processUploads(void)
+{
+    size_t budgetStart = _bytesUploaded;
+    bool uploadedAny = false;
+    while(!uploadedAny || _bytesUploaded - budgetStart < _uploadBudget) {
+        pthread_mutex_lock(&_lock);
+        TextureLoadJob_t *job = _texLoader_pop(&_decoded);
+        bool isStale = job && job->generation != _generation;
+        pthread_mutex_unlock(&_lock);
+        if(!job)
+            return;
+
+        if(!isStale) {
+            if(!_hasWorker && !job->pixels)
+                _texLoader_decode(job);
+            _texLoader_complete(job);
+            uploadedAny = true;
+        } else
+            job->texture->isLoading = false;
+        _texLoader_freeJob(job);
+    }
+}
+
+void texLoader_setUploadBudget(size_t aBytes)
+{
+    _uploadBudget = aBytes;
+}
+
+void texLoader_cancelAll(void)
+{
+    pthread_mutex_lock(&_lock);
+    ++_generation;
+    TextureLoadQueue_t queued = _queued, decoded = _decoded;
+    memset(&_queued, 0, sizeof(TextureLoadQueue_t));
+    memset(&_decoded, 0, sizeof(TextureLoadQueue_t));
+    pthread_mutex_unlock(&_lock);
+
+    // The job being decoded, if any, is discarded by texLoader_processUploads once it shows up
+    TextureLoadJob_t *job;
+    while((job = _texLoader_pop(&queued)) || (job = _texLoader_pop(&decoded))) {
+        job->texture->isLoading = false;
+        _texLoader_freeJob(job);
+    }
+}
+
+TextureLoaderStats_t texLoader_getStats(void)
+{
+    pthread_mutex_lock(&_lock);
+    TextureLoaderStats_t stats = { _queued.count + _decoding, _decoded.count, _bytesUploaded };
+    pthread_mutex_unlock(&_lock);
+    return stats;
+}
+
+#pragma mark - Worker
+
+static void *_texLoader_worker(void *aUnused)
+{
+    pthread_mutex_lock(&_lock);
+    while(true) {
+        TextureLoadJob_t *job = _texLoader_pop(&_queued);
+        if(!job) {
+            pthread_cond_wait(&_workAvailable, &_lock);
+            continue;
+        }
+        ++_decoding;
+        pthread_mutex_unlock(&_lock);
+
+        // The job is owned by this thread until it is pushed to the decoded queue
+        _texLoader_decode(job);
+
+        pthread_mutex_lock(&_lock);
+        --_decoding;
+        _texLoader_push(&_decoded, job);
+    }
+    return NULL;
+}
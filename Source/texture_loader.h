@@ -0,0 +1,65 @@
+/*!
+    @header Texture Loader
+    @abstract
+    @discussion Loads textures in the background.
+
+    Image files are read & decoded on a worker thread while the caller immediately gets a placeholder texture (A single
+    transparent pixel) that can be used right away. The decoded images are then uploaded into the placeholders' OpenGL
+    textures on the GL thread, by texLoader_processUploads, within a per frame byte budget.
+*/
+
+#ifndef _TEXTURELOADER_H_
+#define _TEXTURELOADER_H_
+
+#include "texture.h"
+
+/*!
+    Called on the GL thread once an asynchronous load has completed (Or failed, in which case the texture stays a placeholder).
+*/
+typedef void (*TextureLoadCallback_t)(Texture_t *aTexture, bool aSucceeded, void *aContext);
+
+/*!
+    Texture loader statistics
+
+    @field queuedLoads Textures waiting for, or being decoded by the worker thread
+    @field pendingUploads Textures decoded but not yet uploaded
+    @field bytesUploaded Total number of bytes uploaded so far
+*/
+typedef struct _TextureLoaderStats {
+    int queuedLoads;
+    int pendingUploads;
+    size_t bytesUploaded;
+} TextureLoaderStats_t;
+
+/*!
+    Starts loading a texture from a PNG file in the background (Premultiplied, 8 bit per channel) and returns its placeholder.
+
+    @param aCallback Optional C function to call once the load completes
+    @param aLuaCallback Optional registered lua callback (-1 for none), called with the texture & a success boolean.
+                        The callback is unregistered after it has been called.
+*/
+extern Texture_t *texLoader_loadPng(const char *aPath, bool aRepeatHorizontal, bool aRepeatVertical,
+                                    TextureLoadCallback_t aCallback, void *aContext, int aLuaCallback);
+/*!
+    Reloads the image of a texture loaded from a PNG file in the background, into the same OpenGL texture.
+    (Used by the texture manager to bring back evicted textures)
+*/
+extern void texLoader_reloadPng(Texture_t *aTexture);
+/*!
+    Uploads decoded textures and runs their completion callbacks until the upload budget is used up.
+    At least one texture is uploaded per call so that large images do not stall forever. Must be called on the GL thread.
+*/
+extern void texLoader_processUploads(void);
+/*!
+    Sets the maximum number of bytes uploaded per call to texLoader_processUploads. (1MB by default)
+*/
+extern void texLoader_setUploadBudget(size_t aBytes);
+/*!
+    Drops every load that has not completed yet, without calling their callbacks.
+*/
+extern void texLoader_cancelAll(void);
+/*!
+    Gets the current loader statistics.
+*/
+extern TextureLoaderStats_t texLoader_getStats(void);
+#endif
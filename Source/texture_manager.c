@@ -0,0 +1,157 @@
+#include "texture_manager.h"
+#include "texture_loader.h"
+#include "util.h"
+#include <string.h>
+#include <strings.h>
+
+// A list of textures, from most to least recently used
+typedef struct _TextureList {
+    Texture_t *mostRecent, *leastRecent;
+    int count;
+} TextureList_t;
+
+static TextureList_t _resident, _evicted;
+static TextureManagerStats_t _stats;
+static unsigned long _frame = 1;
+static bool _asyncReload = false;
+
+static void _texManager_listRemove(TextureList_t *aList, Texture_t *aTexture)
+{
+    if(aTexture->moreRecentlyUsed)
+        aTexture->moreRecentlyUsed->lessRecentlyUsed = aTexture->lessRecentlyUsed;
+    else
+        aList->mostRecent = aTexture->lessRecentlyUsed;
+    if(aTexture->lessRecentlyUsed)
+        aTexture->lessRecentlyUsed->moreRecentlyUsed = aTexture->moreRecentlyUsed;
+    else
+        aList->leastRecent = aTexture->moreRecentlyUsed;
+    aTexture->moreRecentlyUsed = aTexture->lessRecentlyUsed = NULL;
+    --aList->count;
+}
+
+static void _texManager_listPush(TextureList_t *aList, Texture_t *aTexture)
+{
+    aTexture->moreRecentlyUsed = NULL;
+    aTexture->lessRecentlyUsed = aList->mostRecent;
+    if(aList->mostRecent)
+        aList->mostRecent->moreRecentlyUsed = aTexture;
+    else
+        aList->leastRecent = aTexture;
+    aList->mostRecent = aTexture;
+    ++aList->count;
+}
+
+void _texManager_register(Texture_t *aTexture)
+{
+    aTexture->lastUsedFrame = _frame;
+    _texManager_listPush(&_resident, aTexture);
+    _stats.bytesResident += aTexture->byteSize;
+}
+
+void _texManager_unregister(Texture_t *aTexture)
+{
+    if(!aTexture->sourcePath)
+        return;
+    if(aTexture->isEvicted)
+        _texManager_listRemove(&_evicted, aTexture);
+    else {
+        _texManager_listRemove(&_resident, aTexture);
+        _stats.bytesResident -= aTexture->byteSize;
+    }
+}
+
+void _texManager_setByteSize(Texture_t *aTexture, size_t aBytes)
+{
+    if(aTexture->sourcePath && !aTexture->isEvicted)
+        _stats.bytesResident = _stats.bytesResident - aTexture->byteSize + aBytes;
+    aTexture->byteSize = aBytes;
+}
+
+void texManager_setBudget(size_t aBytes)
+{
+    _stats.budget = aBytes;
+}
+
+void texManager_setAsyncReload(bool aAsync)
+{
+    _asyncReload = aAsync;
+}
+
+// Replaces the image of a texture by a single transparent pixel, releasing its memory while keeping its id & size
+static void _texManager_clearImage(Texture_t *aTexture)
+{
+    static const unsigned char transparentPixel[4] = { 0, 0, 0, 0 };
+    glBindTexture(GL_TEXTURE_2D, aTexture->id);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, transparentPixel);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+static void _texManager_evict(Texture_t *aTexture)
+{
+    _texManager_clearImage(aTexture);
+    _texManager_listRemove(&_resident, aTexture);
+    _stats.bytesResident -= aTexture->byteSize;
+    aTexture->isEvicted = true;
+    _texManager_listPush(&_evicted, aTexture);
+    ++_stats.evictions;
+}
+
+static bool _texManager_isPng(const char *aPath)
+{
+    const char *extension = strrchr(aPath, '.');
+    return extension && strcasecmp(extension, ".png") == 0;
+}
+
+// Loads the image of a texture back, in the background if possible
+static void _texManager_reload(Texture_t *aTexture)
+{
+    if(_asyncReload && _texManager_isPng(aTexture->sourcePath))
+        texLoader_reloadPng(aTexture);
+    else if(!texture_reload(aTexture))
+        dynamo_log("Unable to reload texture from %s", aTexture->sourcePath);
+}
+
+void texManager_touch(Texture_t *aTexture)
+{
+    if(!aTexture->sourcePath || aTexture->lastUsedFrame == _frame)
+        return;
+    aTexture->lastUsedFrame = _frame;
+    if(aTexture->isEvicted) {
+        _texManager_listRemove(&_evicted, aTexture);
+        aTexture->isEvicted = false;
+        _texManager_listPush(&_resident, aTexture);
+        _stats.bytesResident += aTexture->byteSize; // Counted from now on, even while reloading asynchronously
+        ++_stats.reloads;
+        _texManager_reload(aTexture);
+    } else {
+        _texManager_listRemove(&_resident, aTexture);
+        _texManager_listPush(&_resident, aTexture);
+    }
+}
+
+void texManager_update(void)
+{
+    ++_frame;
+    if(_stats.budget == 0)
+        return;
+
+    Texture_t *texture = _resident.leastRecent;
+    while(texture && _stats.bytesResident > _stats.budget) {
+        // Everything past this point was drawn in the last frame
+        if(texture->lastUsedFrame + 2 > _frame)
+            break;
+        Texture_t *next = texture->moreRecentlyUsed;
+        if(!texture->isLoading)
+            _texManager_evict(texture);
+        texture = next;
+    }
+}
+
+TextureManagerStats_t texManager_getStats(void)
+{
+    TextureManagerStats_t stats = _stats;
+    stats.residentTextures = _resident.count;
+    stats.evictedTextures = _evicted.count;
+    return stats;
+}
@@ -0,0 +1,65 @@
+/*!
+    @header Texture Manager
+    @abstract
+    @discussion Keeps the video memory used by textures within a budget.
+
+    Every texture loaded from a file is tracked in least recently drawn order. When the budget is exceeded, the images of
+    the textures that have gone unused the longest are unloaded (Their Texture_t & OpenGL id stay valid) and reloaded from
+    their files when next bound, either synchronously or in the background while a transparent placeholder is shown.
+    Textures created from memory are never evicted.
+
+    Must only be used from the GL thread.
+*/
+
+#ifndef _TEXTUREMANAGER_H_
+#define _TEXTUREMANAGER_H_
+
+#include "texture.h"
+
+/*!
+    Residency statistics
+
+    @field budget The maximum number of bytes resident textures may use (0 if unlimited)
+    @field bytesResident Estimated video memory used by the tracked textures that are currently loaded
+    @field residentTextures The number of tracked textures currently loaded
+    @field evictedTextures The number of tracked textures currently unloaded
+    @field evictions The number of times a texture has been unloaded
+    @field reloads The number of times an unloaded texture has been reloaded
+*/
+typedef struct _TextureManagerStats {
+    size_t budget;
+    size_t bytesResident;
+    int residentTextures;
+    int evictedTextures;
+    unsigned long evictions;
+    unsigned long reloads;
+} TextureManagerStats_t;
+
+/*!
+    Sets the texture memory budget in bytes. (0, the default, disables eviction)
+*/
+extern void texManager_setBudget(size_t aBytes);
+/*!
+    Chooses whether evicted textures are reloaded in the background (Showing a transparent placeholder meanwhile)
+    or immediately when bound. (Synchronous by default; KTX textures are always reloaded synchronously)
+*/
+extern void texManager_setAsyncReload(bool aAsync);
+/*!
+    Advances the frame counter & evicts least recently drawn textures until the budget is met.
+    Textures drawn in the current or previous frame are never evicted. Call once per frame.
+*/
+extern void texManager_update(void);
+/*!
+    Marks a texture as used in the current frame, reloading it if it had been evicted. (Called by texture_bind)
+*/
+extern void texManager_touch(Texture_t *aTexture);
+/*!
+    Gets the residency statistics.
+*/
+extern TextureManagerStats_t texManager_getStats(void);
+
+// Called by texture.c to track textures with a source file & their size
+extern void _texManager_register(Texture_t *aTexture);
+extern void _texManager_unregister(Texture_t *aTexture);
+extern void _texManager_setByteSize(Texture_t *aTexture, size_t aBytes);
+#endif
@@ -0,0 +1,327 @@
+#include "texture_packer.h"
+#include "png_loader.h"
+#include "dictionary.h"
+#include "util.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct _TexturePackerImage {
+    char *name;
+    int width, height;
+    unsigned char *pixels; // RGBA, freed once packed
+    int page; // -1 if the image did not fit
+    int x, y; // Location of the padded image within its page, from the bottom left
+};
+
+typedef struct _SkylineNode {
+    int x, y, width;
+} SkylineNode_t;
+
+// The skyline of a page: the top edge of the packed area, as a series of horizontal segments from left to right
+typedef struct _Skyline {
+    int numberOfNodes;
+    SkylineNode_t *nodes; // Never more nodes than the page is wide (+1 while inserting)
+    int usedHeight;
+} Skyline_t;
+
+static void texPacker_destroy(TexturePacker_t *aPacker);
+
+Class_t Class_TexturePacker = {
+    "TexturePacker",
+    sizeof(TexturePacker_t),
+    (Obj_destructor_t)&texPacker_destroy
+};
+
+TexturePacker_t *texPacker_create(vec2_t aPageSize, int aPadding)
+{
+    dynamo_assert(aPageSize.w >= 1.0 && aPageSize.h >= 1.0, "Invalid page size");
+    dynamo_assert(aPadding >= 0, "Invalid padding");
+
+    TexturePacker_t *out = obj_create_autoreleased(&Class_TexturePacker);
+    out->pageSize = aPageSize;
+    out->padding = aPadding;
+    out->imageCapacity = 16;
+    out->images = malloc(out->imageCapacity*sizeof(TexturePackerImage_t));
+    return out;
+}
+
+void texPacker_destroy(TexturePacker_t *aPacker)
+{
+    for(int i = 0; i < aPacker->numberOfImages; ++i) {
+        free(aPacker->images[i].name);
+        free(aPacker->images[i].pixels);
+    }
+    free(aPacker->images);
+    for(int i = 0; i < aPacker->numberOfPages; ++i)
+        obj_release(aPacker->pages[i]);
+    free(aPacker->pages);
+}
+
+// Appends an image with room for its RGBA pixels
+static TexturePackerImage_t *_texPacker_appendImage(TexturePacker_t *aPacker, const char *aName, int aWidth, int aHeight)
+{
+    if(aPacker->numberOfImages == aPacker->imageCapacity) {
+        aPacker->imageCapacity *= 2;
+        aPacker->images = realloc(aPacker->images, aPacker->imageCapacity*sizeof(TexturePackerImage_t));
+    }
+    TexturePackerImage_t *image = &aPacker->images[aPacker->numberOfImages++];
+    image->name = strdup(aName);
+    image->width = aWidth;
+    image->height = aHeight;
+    image->page = -1;
+    image->x = image->y = 0;
+    image->pixels = malloc((size_t)aWidth*aHeight*4);
+    return image;
+}
+
+bool texPacker_addImage(TexturePacker_t *aPacker, const char *aName, const unsigned char *aData, int aWidth, int aHeight, bool aHasAlpha)
+{
+    dynamo_assert(!aPacker->isPacked, "Images can not be added once packed");
+    dynamo_assert(aName != NULL && strlen(aName) <= DICT_MAXKEYLEN, "Invalid image name");
+    if(aWidth <= 0 || aHeight <= 0 || !aData)
+        return false;
+
+    TexturePackerImage_t *image = _texPacker_appendImage(aPacker, aName, aWidth, aHeight);
+    if(aHasAlpha)
+        memcpy(image->pixels, aData, (size_t)aWidth*aHeight*4);
+    else {
+        for(size_t i = 0; i < (size_t)aWidth*aHeight; ++i) {
+            memcpy(image->pixels + i*4, aData + i*3, 3);
+            image->pixels[i*4 + 3] = 255;
+        }
+    }
+    return true;
+}
+
+bool texPacker_addPng(TexturePacker_t *aPacker, const char *aName, const char *aPath)
+{
+    dynamo_assert(!aPacker->isPacked, "Images can not be added once packed");
+    dynamo_assert(aName != NULL && strlen(aName) <= DICT_MAXKEYLEN, "Invalid image name");
+
+    // Decoded straight into the image's own buffer
+    PngDecoder_t decoder;
+    bool succeeded = png_openDecoder(&decoder, aPath, true);
+    if(succeeded) {
+        TexturePackerImage_t *image = _texPacker_appendImage(aPacker, aName, decoder.width, decoder.height);
+        succeeded = png_decodeInto(&decoder, image->pixels, (size_t)decoder.width*4, true);
+        png_closeDecoder(&decoder);
+        if(!succeeded) {
+            free(image->name);
+            free(image->pixels);
+            --aPacker->numberOfImages;
+        }
+    }
+    if(!succeeded)
+        dynamo_log("Unable to load png file from %s", aPath);
+    return succeeded;
+}
+
+#pragma mark - Packing
+
+// Returns the height at which a rectangle would rest when placed at the given node, or -1 if it does not fit
+static int _texPacker_skylineFit(Skyline_t *aSkyline, int aNode, int aWidth, int aHeight, int aPageWidth, int aPageHeight)
+{
+    int x = aSkyline->nodes[aNode].x;
+    if(x + aWidth > aPageWidth)
+        return -1;
+    int y = 0;
+    int widthLeft = aWidth;
+    for(int i = aNode; widthLeft > 0; ++i) {
+        y = MAX(y, aSkyline->nodes[i].y);
+        if(y + aHeight > aPageHeight)
+            return -1;
+        widthLeft -= aSkyline->nodes[i].width;
+    }
+    return y;
+}
+
+// Finds the position where the rectangle's top edge is the lowest, returns false if it does not fit
+static bool _texPacker_skylineFind(Skyline_t *aSkyline, int aWidth, int aHeight, int aPageWidth, int aPageHeight,
+                                   int *aoNode, int *aoX, int *aoY)
+{
+    int bestTop = -1, bestWidth = 0;
+    for(int i = 0; i < aSkyline->numberOfNodes; ++i) {
+        int y = _texPacker_skylineFit(aSkyline, i, aWidth, aHeight, aPageWidth, aPageHeight);
+        if(y == -1)
+            continue;
+        if(bestTop == -1 || y + aHeight < bestTop || (y + aHeight == bestTop && aSkyline->nodes[i].width < bestWidth)) {
+            bestTop = y + aHeight;
+            bestWidth = aSkyline->nodes[i].width;
+            *aoNode = i;
+            *aoX = aSkyline->nodes[i].x;
+            *aoY = y;
+        }
+    }
+    return bestTop != -1;
+}
+
+static void _texPacker_skylineInsert(Skyline_t *aSkyline, int aNode, int aX, int aY, int aWidth, int aHeight)
+{
+    SkylineNode_t *nodes = aSkyline->nodes;
+    memmove(&nodes[aNode + 1], &nodes[aNode], (aSkyline->numberOfNodes - aNode)*sizeof(SkylineNode_t));
+    nodes[aNode] = (SkylineNode_t){ aX, aY + aHeight, aWidth };
+    ++aSkyline->numberOfNodes;
+
+    // Shrink or remove the segments now covered by the new one
+    for(int i = aNode + 1; i < aSkyline->numberOfNodes; ++i) {
+        int prevRight = nodes[i - 1].x + nodes[i - 1].width;
+        if(nodes[i].x >= prevRight)
+            break;
+        int shrink = prevRight - nodes[i].x;
+        nodes[i].x += shrink;
+        nodes[i].width -= shrink;
+        if(nodes[i].width > 0)
+            break;
+        memmove(&nodes[i], &nodes[i + 1], (aSkyline->numberOfNodes - i - 1)*sizeof(SkylineNode_t));
+        --aSkyline->numberOfNodes;
+        --i;
+    }
+    // Merge neighbouring segments at the same height
+    for(int i = 0; i < aSkyline->numberOfNodes - 1; ++i) {
+        if(nodes[i].y == nodes[i + 1].y) {
+            nodes[i].width += nodes[i + 1].width;
+            memmove(&nodes[i + 1], &nodes[i + 2], (aSkyline->numberOfNodes - i - 2)*sizeof(SkylineNode_t));
+            --aSkyline->numberOfNodes;
+            --i;
+        }
+    }
+    aSkyline->usedHeight = MAX(aSkyline->usedHeight, aY + aHeight);
+}
+
+static int _texPacker_compareHeights(const void *a, const void *b)
+{
+    const TexturePackerImage_t *imageA = *(TexturePackerImage_t * const *)a;
+    const TexturePackerImage_t *imageB = *(TexturePackerImage_t * const *)b;
+    if(imageA->height != imageB->height)
+        return imageB->height - imageA->height;
+    return imageB->width - imageA->width;
+}
+
+// Copies an image into a page, extruding its edges into the padding
+static void _texPacker_blit(TexturePackerImage_t *aImage, unsigned char *aPage, int aPageWidth, int aPadding)
+{
+    int paddedWidth = aImage->width + 2*aPadding, paddedHeight = aImage->height + 2*aPadding;
+    for(int row = 0; row < paddedHeight; ++row) {
+        int srcRow = CLAMP(row - aPadding, 0, aImage->height - 1);
+        unsigned char *dst = aPage + ((size_t)(aImage->y + row)*aPageWidth + aImage->x)*4;
+        const unsigned char *src = aImage->pixels + (size_t)srcRow*aImage->width*4;
+        for(int col = 0; col < aPadding; ++col)
+            memcpy(dst + col*4, src, 4);
+        memcpy(dst + aPadding*4, src, (size_t)aImage->width*4);
+        for(int col = aPadding + aImage->width; col < paddedWidth; ++col)
+            memcpy(dst + col*4, src + (aImage->width - 1)*4, 4);
+    }
+}
+
+static int _texPacker_nextPowerOfTwo(int n)
+{
+    int out = 1;
+    while(out < n)
+        out <<= 1;
+    return out;
+}
+
+// Sets the subtextures of a page from the images packed into it
+static void _texPacker_setSubTextures(TexturePacker_t *aPacker, int aPage, Texture_t *aTexture)
+{
+    SubTexture_t *subtextures = calloc(MAX(1, aPacker->numberOfImages), sizeof(SubTexture_t));
+    int count = 0;
+    for(int i = 0; i < aPacker->numberOfImages; ++i) {
+        TexturePackerImage_t *image = &aPacker->images[i];
+        if(image->page != aPage)
+            continue;
+        SubTexture_t *subtexture = &subtextures[count++];
+        strcpy(subtexture->name, image->name);
+        subtexture->origin = vec2_create(image->x + aPacker->padding, image->y + aPacker->padding);
+        subtexture->size = vec2_create(image->width, image->height);
+        subtexture->sourceSize = subtexture->size;
+    }
+    texture_setSubTextures(aTexture, subtextures, count);
+    free(subtextures);
+}
+
+bool texPacker_pack(TexturePacker_t *aPacker)
+{
+    dynamo_assert(!aPacker->isPacked, "Already packed");
+    aPacker->isPacked = true;
+
+    int pageWidth = aPacker->pageSize.w, pageHeight = aPacker->pageSize.h;
+    bool packedAll = true;
+
+    TexturePackerImage_t **sorted = malloc(MAX(1, aPacker->numberOfImages)*sizeof(TexturePackerImage_t *));
+    for(int i = 0; i < aPacker->numberOfImages; ++i)
+        sorted[i] = &aPacker->images[i];
+    qsort(sorted, aPacker->numberOfImages, sizeof(TexturePackerImage_t *), &_texPacker_compareHeights);
+
+    // Place the images, tallest first, into the first page they fit in
+    int numberOfSkylines = 0;
+    Skyline_t *skylines = NULL;
+    for(int i = 0; i < aPacker->numberOfImages; ++i) {
+        TexturePackerImage_t *image = sorted[i];
+        int width = image->width + 2*aPacker->padding, height = image->height + 2*aPacker->padding;
+        if(width > pageWidth || height > pageHeight) {
+            dynamo_log("Image %s (%dx%d) does not fit in a page", image->name, image->width, image->height);
+            packedAll = false;
+            continue;
+        }
+        int node, x, y;
+        int page = 0;
+        for(; page < numberOfSkylines; ++page) {
+            if(_texPacker_skylineFind(&skylines[page], width, height, pageWidth, pageHeight, &node, &x, &y))
+                break;
+        }
+        if(page == numberOfSkylines) {
+            skylines = realloc(skylines, ++numberOfSkylines*sizeof(Skyline_t));
+            skylines[page].nodes = malloc((pageWidth + 1)*sizeof(SkylineNode_t));
+            skylines[page].nodes[0] = (SkylineNode_t){ 0, 0, pageWidth };
+            skylines[page].numberOfNodes = 1;
+            skylines[page].usedHeight = 0;
+            _texPacker_skylineFind(&skylines[page], width, height, pageWidth, pageHeight, &node, &x, &y);
+        }
+        _texPacker_skylineInsert(&skylines[page], node, x, y, width, height);
+        image->page = page;
+        image->x = x;
+        image->y = y;
+    }
+    free(sorted);
+
+    // Compose & upload the pages
+    aPacker->numberOfPages = numberOfSkylines;
+    aPacker->pages = calloc(MAX(1, numberOfSkylines), sizeof(Texture_t *));
+    for(int page = 0; page < numberOfSkylines; ++page) {
+        int height = MIN(_texPacker_nextPowerOfTwo(skylines[page].usedHeight), pageHeight);
+        unsigned char *pixels = calloc((size_t)pageWidth*height, 4);
+        for(int i = 0; i < aPacker->numberOfImages; ++i) {
+            if(aPacker->images[i].page == page)
+                _texPacker_blit(&aPacker->images[i], pixels, pageWidth, aPacker->padding);
+        }
+        Texture_t *texture = texture_createFromData(pixels, pageWidth, height, true, false, false);
+        free(pixels);
+        _texPacker_setSubTextures(aPacker, page, texture);
+        aPacker->pages[page] = obj_retain(texture);
+        free(skylines[page].nodes);
+    }
+    free(skylines);
+
+    for(int i = 0; i < aPacker->numberOfImages; ++i) {
+        free(aPacker->images[i].pixels);
+        aPacker->images[i].pixels = NULL;
+    }
+    return packedAll;
+}
+
+PackedImage_t texPacker_getImage(TexturePacker_t *aPacker, const char *aName)
+{
+    PackedImage_t out = { NULL, GLMVec2_zero, GLMVec2_zero, { 0.0f, 0.0f, 0.0f, 0.0f } };
+    for(int i = 0; i < aPacker->numberOfImages; ++i) {
+        TexturePackerImage_t *image = &aPacker->images[i];
+        if(image->page == -1 || strcmp(image->name, aName) != 0)
+            continue;
+        out.texture = aPacker->pages[image->page];
+        out.origin = vec2_create(image->x + aPacker->padding, image->y + aPacker->padding);
+        out.size = vec2_create(image->width, image->height);
+        out.rect = textureRectangle_createWithPixelCoordinates(out.texture, out.origin, out.size);
+        break;
+    }
+    return out;
+}
@@ -0,0 +1,75 @@
+/*!
+    @header Texture Packer
+    @abstract
+    @discussion Packs individual images into shared textures (pages) at runtime.
+
+    Images are placed using the skyline bottom-left algorithm, tallest first, with their edge pixels extruded into a
+    padding border to prevent bleeding when filtering. Each page is uploaded once, and has its images as subtextures
+    so texture_getSubTextureAtlas & co. work on it by image name.
+*/
+
+#ifndef _TEXTUREPACKER_H_
+#define _TEXTUREPACKER_H_
+
+#include "object.h"
+#include "texture.h"
+
+/*!
+    A packed image
+
+    @field texture The page containing the image (NULL if no image with the requested name was packed)
+    @field origin The location of the image within the page in pixels (From the bottom left)
+    @field size The size of the image in pixels
+    @field rect The sampling rectangle of the image
+*/
+typedef struct _PackedImage {
+    Texture_t *texture;
+    vec2_t origin;
+    vec2_t size;
+    TextureRect_t rect;
+} PackedImage_t;
+
+typedef struct _TexturePackerImage TexturePackerImage_t;
+
+/*!
+    A texture packer
+
+    @field pageSize The size of each page in pixels (Pages are shrunk vertically to the nearest power of two that fits)
+    @field padding The number of extruded pixels around each image
+    @field pages The packed textures (Set once texPacker_pack has been called)
+*/
+typedef struct _TexturePacker {
+    OBJ_GUTS
+    vec2_t pageSize;
+    int padding;
+    int numberOfImages, imageCapacity;
+    TexturePackerImage_t *images;
+    bool isPacked;
+    int numberOfPages;
+    Texture_t **pages;
+} TexturePacker_t;
+extern Class_t Class_TexturePacker;
+
+/*!
+    Creates a texture packer.
+*/
+extern TexturePacker_t *texPacker_create(vec2_t aPageSize, int aPadding);
+/*!
+    Adds 8 bit per channel RGB(A) pixel data (Rows ordered bottom to top, alpha premultiplied) to be packed. The data is copied.
+    Names are limited to DICT_MAXKEYLEN characters.
+*/
+extern bool texPacker_addImage(TexturePacker_t *aPacker, const char *aName, const unsigned char *aData, int aWidth, int aHeight, bool aHasAlpha);
+/*!
+    Adds a PNG file to be packed, premultiplying its alpha.
+*/
+extern bool texPacker_addPng(TexturePacker_t *aPacker, const char *aName, const char *aPath);
+/*!
+    Packs the added images into as few pages as possible & uploads them. Must be called on the GL thread, once.
+    Returns false if an image could not fit into a page (The other images are still packed)
+*/
+extern bool texPacker_pack(TexturePacker_t *aPacker);
+/*!
+    Gets a packed image by name.
+*/
+extern PackedImage_t texPacker_getImage(TexturePacker_t *aPacker, const char *aName);
+#endif
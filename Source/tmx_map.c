@@ -3,12 +3,19 @@
 #include <stdlib.h>
 #include <mxml.h>
 #include <string.h>
+#include <stdint.h>
+#include <zlib.h>
 #include "drawutils.h"
+#include "png_loader.h"
+#include "texture_cache.h"
 
 const unsigned FLIPPED_HORIZONTALLY_FLAG = 0x80000000;
 const unsigned FLIPPED_VERTICALLY_FLAG   = 0x40000000;
+const unsigned FLIPPED_DIAGONALLY_FLAG   = 0x20000000;
+#define kTMXTileFlipFlags (FLIPPED_HORIZONTALLY_FLAG | FLIPPED_VERTICALLY_FLAG | FLIPPED_DIAGONALLY_FLAG)
 
 static void tmx_destroyMap(TMXMap_t *aMap);
+static void _tmx_mapFree(TMXMap_t *aMap, void *aPtr);
 
 // Private helpers
 static void _mxmlElementPrintAttrs(mxml_node_t *aNode);
@@ -17,9 +24,38 @@ static float _mxmlElementGetAttrAsFloat(mxml_node_t *aNode, const char *aAttrNam
 static int _mxmlElementGetAttrAsInt(mxml_node_t *aNode, const char *aAttrName, int aDefault);
 static mxml_node_t **_mxmlFindChildren(mxml_node_t *aNode, mxml_node_t *aTop, const char *aName, int *aoCount);
 static TMXProperty_t *_tmx_readPropertiesFromMxmlNode(mxml_node_t *aParentNode, mxml_node_t *aTopNode, int *aoCount);
+static TMXTileAnimation_t *_tmx_readAnimationsFromMxmlNode(mxml_node_t *aTilesetNode, mxml_node_t *aTopNode, int *aoCount);
 
 static TMXTile_t _tmx_mapCreateTileForTileGID(TMXMap_t *aMap, int aTileGID);
 static TMXTileset_t *_tmx_mapGetTilesetForTileGID(TMXMap_t *aMap, int aTileID);
+static void _tmx_mapBuildGidTable(TMXMap_t *aMap);
+
+static bool _tmx_tileIsSolid(TMXLayerCollision_t *aCollision, TMXTile_t *aTile);
+static void _tmx_buildCollisionShapes(TMXMap_t *aMap, TMXLayer_t *aLayer);
+static void _tmx_rebuildCollisionShapesAt(TMXMap_t *aMap, TMXLayer_t *aLayer, int aX, int aY);
+static void _tmx_removeCollisionShapes(TMXLayerCollision_t *aCollision);
+
+// Tile data collected while streaming the file, in the order the layers appear
+typedef struct _TMXLayerData {
+    uint32_t *gids;
+    int count, capacity;
+} TMXLayerData_t;
+
+typedef struct _TMXParseContext {
+    int expectedTileCount; // Tiles per layer, known once the map element has been read
+    TMXLayerData_t *layers;
+    int layerCount, layerCapacity;
+    // State for the data element being read
+    bool inData;
+    char *encoding, *compression;
+    char *text;
+    size_t textLength, textCapacity;
+} TMXParseContext_t;
+
+static void _tmx_saxCallback(mxml_node_t *aNode, mxml_sax_event_t aEvent, TMXParseContext_t *aCtx);
+static void _tmx_parseContextCleanup(TMXParseContext_t *aCtx);
+static TMXMap_t *_tmx_loadBinaryMapFile(const char *aFilename);
+static TMXMap_t *_tmx_createBinaryMap(const char *aFilename, MappedFile_t *aFile);
 
 Class_t Class_TMXMap = {
     "TMXMap",
@@ -29,13 +65,31 @@ Class_t Class_TMXMap = {
 
 TMXMap_t *tmx_readMapFile(const char *aFilename)
 {
-    FILE *fp = fopen(aFilename, "rb");
-    if(!fp) return NULL;
-    mxml_node_t *tree = mxmlLoadFile(NULL, fp, MXML_OPAQUE_CALLBACK);
-    dynamo_assert(tree != NULL, "Could not load map XML");
-    fclose(fp);
+    TMXMap_t *map = tmx_loadMapFile(aFilename);
+    return map ? obj_autorelease(map) : NULL;
+}
 
-    TMXMap_t *out = obj_create_autoreleased(&Class_TMXMap);
+TMXMap_t *tmx_loadMapFile(const char *aFilename)
+{
+    // Stream the file, decoding the layer data as it comes in so the tree never holds per tile nodes
+    TMXParseContext_t ctx;
+    memset(&ctx, 0, sizeof(TMXParseContext_t));
+    MappedFile_t file;
+    if(!util_mapFile(aFilename, kMappedFileAccess_sequential, &file))
+        return NULL;
+    // Maps that have been baked using tmx_writeBinaryMapFile are used straight out of the mapping
+    if(file.length >= 4 && memcmp(file.data, kTMXBinaryMagic, 4) == 0)
+        return _tmx_createBinaryMap(aFilename, &file);
+    // The mapping is NUL terminated, so the XML is parsed in place
+    mxml_node_t *tree = mxmlSAXLoadString(NULL, file.data, MXML_OPAQUE_CALLBACK, (mxml_sax_cb_t)&_tmx_saxCallback, &ctx);
+    util_unmapFile(&file);
+    if(!tree) {
+        dynamo_log("Could not load map XML from %s", aFilename);
+        _tmx_parseContextCleanup(&ctx);
+        return NULL;
+    }
+
+    TMXMap_t *out = obj_create(&Class_TMXMap);
     // Start walking through the file
     mxml_node_t *mapNode = mxmlFindElement(tree, tree, "map", NULL, NULL, MXML_DESCEND);
 
@@ -68,33 +122,47 @@ TMXMap_t *tmx_readMapFile(const char *aFilename)
         out->tilesets[i].imageWidth = _mxmlElementGetAttrAsInt(imageNode, "width", 0);
         out->tilesets[i].imageHeight = _mxmlElementGetAttrAsInt(imageNode, "height", 0);
         out->tilesets[i].imagePath = strdup(mxmlElementGetAttr(imageNode, "source"));
+        out->tilesets[i].animations = _tmx_readAnimationsFromMxmlNode(tempNode, tree, &out->tilesets[i].numberOfAnimations);
     }
     free(tilesetNodes);
+    _tmx_mapBuildGidTable(out);
 
     // Read the layers
     mxml_node_t **layerNodes = _mxmlFindChildren(mapNode, tree, "layer", &out->numberOfLayers);
-    out->layers = malloc(sizeof(TMXLayer_t)*out->numberOfLayers);
-    for(int i = 0; i < out->numberOfLayers; ++i) {
+    // Zeroed so that the map can be destroyed with only some of its layers read
+    out->layers = calloc(MAX(1, out->numberOfLayers), sizeof(TMXLayer_t));
+    bool layersValid = out->numberOfLayers == ctx.layerCount;
+    if(!layersValid)
+        dynamo_log("%s: Number of layers (%d) does not match the number of data elements (%d)", aFilename, out->numberOfLayers, ctx.layerCount);
+    for(int i = 0; layersValid && i < out->numberOfLayers; ++i) {
         tempNode = layerNodes[i];
         out->layers[i].name = _mxmlElementCopyAttr(tempNode, "name");
         out->layers[i].opacity = _mxmlElementGetAttrAsFloat(tempNode, "opacity", 1.0);
         out->layers[i].isVisible = _mxmlElementGetAttrAsInt(tempNode, "visible", 1);
         out->layers[i].properties = _tmx_readPropertiesFromMxmlNode(tempNode, tree, &out->layers[i].numberOfProperties);
-
-        // Parse the tiles and resolve the global tile ids
-        mxml_node_t *dataNode = mxmlFindElement(tempNode, tree, "data", NULL, NULL, MXML_DESCEND_FIRST);
-        dynamo_assert(dataNode, "Data node not found");
-        mxml_node_t **tileNodes = _mxmlFindChildren(dataNode, tree, "tile", &out->layers[i].numberOfTiles);
-        dynamo_assert(out->layers[i].numberOfTiles == out->width*out->height, "Number of tiles does not match map dimensions");
-
+        out->layers[i].collision = NULL;
+
+        // Resolve the global tile ids collected while streaming
+        TMXLayerData_t *data = &ctx.layers[i];
+        if(data->count != out->width*out->height) {
+            // Also the case when the layer's data could not be decoded
+            dynamo_log("%s: Number of tiles in layer %s (%d) does not match map dimensions", aFilename, out->layers[i].name, data->count);
+            layersValid = false;
+            break;
+        }
+        out->layers[i].numberOfTiles = data->count;
         out->layers[i].tiles = malloc(sizeof(TMXTile_t)*out->layers[i].numberOfTiles);
         for(int j = 0; j < out->layers[i].numberOfTiles; ++j) {
-            int gid = _mxmlElementGetAttrAsInt(tileNodes[j], "gid", 0);
-            out->layers[i].tiles[j] = _tmx_mapCreateTileForTileGID(out, gid);
+            out->layers[i].tiles[j] = _tmx_mapCreateTileForTileGID(out, data->gids[j]);
         }
-        free(tileNodes);
     }
     free(layerNodes);
+    _tmx_parseContextCleanup(&ctx);
+    if(!layersValid) {
+        mxmlRelease(tree);
+        obj_release(out);
+        return NULL;
+    }
 
     // Read the object groups
     mxml_node_t **objGroupNodes = _mxmlFindChildren(mapNode, tree, "objectgroup", &out->numberOfObjectGroups);
@@ -107,14 +175,16 @@ TMXMap_t *tmx_readMapFile(const char *aFilename)
         mxml_node_t **objNodes = _mxmlFindChildren(tempNode, tree, "object", &out->objectGroups[i].numberOfObjects);
         out->objectGroups[i].objects = malloc(sizeof(TMXObject_t)*out->objectGroups[i].numberOfObjects);
         for(int j = 0; j < out->objectGroups[i].numberOfObjects; ++j) {
-            out->objectGroups[i].objects[j].name = _mxmlElementCopyAttr(objNodes[i], "name");
-            out->objectGroups[i].objects[j].type = _mxmlElementCopyAttr(objNodes[i], "type");
-            out->objectGroups[i].objects[j].x = _mxmlElementGetAttrAsInt(objNodes[i], "x", 0);
-            out->objectGroups[i].objects[j].y = _mxmlElementGetAttrAsInt(objNodes[i], "y", 0);
-            out->objectGroups[i].objects[j].width = _mxmlElementGetAttrAsInt(objNodes[i], "width", 0);
-            out->objectGroups[i].objects[j].height = _mxmlElementGetAttrAsInt(objNodes[i], "height", 0);
-            int tileGid = _mxmlElementGetAttrAsInt(objNodes[i], "gid", -1);
+            out->objectGroups[i].objects[j].name = _mxmlElementCopyAttr(objNodes[j], "name");
+            out->objectGroups[i].objects[j].type = _mxmlElementCopyAttr(objNodes[j], "type");
+            out->objectGroups[i].objects[j].x = _mxmlElementGetAttrAsInt(objNodes[j], "x", 0);
+            out->objectGroups[i].objects[j].y = _mxmlElementGetAttrAsInt(objNodes[j], "y", 0);
+            out->objectGroups[i].objects[j].width = _mxmlElementGetAttrAsInt(objNodes[j], "width", 0);
+            out->objectGroups[i].objects[j].height = _mxmlElementGetAttrAsInt(objNodes[j], "height", 0);
+            const char *gidAttr = mxmlElementGetAttr(objNodes[j], "gid");
+            int tileGid = gidAttr ? (int)strtoul(gidAttr, NULL, 10) : -1;
             out->objectGroups[i].objects[j].tile = _tmx_mapCreateTileForTileGID(out, tileGid);
+            out->objectGroups[i].objects[j].properties = _tmx_readPropertiesFromMxmlNode(objNodes[j], tree, &out->objectGroups[i].objects[j].numberOfProperties);
         }
         free(objNodes);
     }
@@ -129,41 +199,69 @@ TMXMap_t *tmx_readMapFile(const char *aFilename)
 void tmx_destroyMap(TMXMap_t *aMap)
 {
     for(int i = 0; i < aMap->numberOfLayers; ++i) {
-        for(int j = 0; aMap->layers[i].numberOfProperties; ++j) {
-            free(aMap->layers[i].properties[j].name);
-            free(aMap->layers[i].properties[j].value);
+        for(int j = 0; j < aMap->layers[i].numberOfProperties; ++j) {
+            _tmx_mapFree(aMap, aMap->layers[i].properties[j].name);
+            _tmx_mapFree(aMap, aMap->layers[i].properties[j].value);
         }
         if(aMap->layers[i].properties) free(aMap->layers[i].properties);
-        free(aMap->layers[i].name);
+        _tmx_mapFree(aMap, aMap->layers[i].name);
         free(aMap->layers[i].tiles);
+        TMXLayerCollision_t *collision = aMap->layers[i].collision;
+        if(collision) {
+            _tmx_removeCollisionShapes(collision);
+            obj_release(collision->world);
+            free(collision->solidGids);
+            free(collision);
+        }
     }
     free(aMap->layers);
 
     for(int i = 0; i < aMap->numberOfObjectGroups; ++i) {
         for(int j = 0; j < aMap->objectGroups[i].numberOfObjects; ++j) {
-            free(aMap->objectGroups[i].objects[j].name);
-            free(aMap->objectGroups[i].objects[j].type);
+            _tmx_mapFree(aMap, aMap->objectGroups[i].objects[j].name);
+            _tmx_mapFree(aMap, aMap->objectGroups[i].objects[j].type);
+            for(int k = 0; k < aMap->objectGroups[i].objects[j].numberOfProperties; ++k) {
+                _tmx_mapFree(aMap, aMap->objectGroups[i].objects[j].properties[k].name);
+                _tmx_mapFree(aMap, aMap->objectGroups[i].objects[j].properties[k].value);
+            }
+            free(aMap->objectGroups[i].objects[j].properties);
         }
         free(aMap->objectGroups[i].objects);
-        for(int j = 0; aMap->objectGroups[i].numberOfProperties; ++j) {
-            free(aMap->objectGroups[i].properties[j].name);
-            free(aMap->objectGroups[i].properties[j].value);
+        for(int j = 0; j < aMap->objectGroups[i].numberOfProperties; ++j) {
+            _tmx_mapFree(aMap, aMap->objectGroups[i].properties[j].name);
+            _tmx_mapFree(aMap, aMap->objectGroups[i].properties[j].value);
         }
         if(aMap->objectGroups[i].properties) free(aMap->objectGroups[i].properties);
 
-        free(aMap->objectGroups[i].name);
+        _tmx_mapFree(aMap, aMap->objectGroups[i].name);
     }
     free(aMap->objectGroups);
 
-    for(int i = 0; i < aMap->numberOfTilesets; ++i) free(aMap->tilesets[i].imagePath);
+    for(int i = 0; i < aMap->numberOfTilesets; ++i) {
+        _tmx_mapFree(aMap, aMap->tilesets[i].imagePath);
+        for(int j = 0; j < aMap->tilesets[i].numberOfAnimations; ++j)
+            _tmx_mapFree(aMap, aMap->tilesets[i].animations[j].frames);
+        free(aMap->tilesets[i].animations);
+    }
     free(aMap->tilesets);
+    free(aMap->gidTable);
 
     for(int i = 0; i < aMap->numberOfProperties; ++i) {
-        free(aMap->properties[i].name);
-        free(aMap->properties[i].value);
+        _tmx_mapFree(aMap, aMap->properties[i].name);
+        _tmx_mapFree(aMap, aMap->properties[i].value);
     }
     if(aMap->properties) free(aMap->properties);
-    free(aMap);
+
+    util_unmapFile(&aMap->mappedFile);
+}
+
+// Strings & animation frames in maps loaded from binary files point into the mapping
+static void _tmx_mapFree(TMXMap_t *aMap, void *aPtr)
+{
+    const char *mapped = aMap->mappedFile.data;
+    if(mapped && (char *)aPtr >= mapped && (char *)aPtr < mapped + aMap->mappedFile.length)
+        return;
+    free(aPtr);
 }
 
 
@@ -209,13 +307,14 @@ TMXObject_t *tmx_objGroupGetObjectNamed(TMXObjectGroup_t *aGroup, const char *aO
 
 static TMXTile_t _tmx_mapCreateTileForTileGID(TMXMap_t *aMap, int aTileGID)
 {
-    TMXTile_t out = { NULL, -1, 0, 0 };
+    TMXTile_t out = { NULL, -1, 0, 0, 0 };
     if(aTileGID == -1) return out;
 
     out.flippedHorizontally = (aTileGID & FLIPPED_HORIZONTALLY_FLAG);
     out.flippedVertically = (aTileGID & FLIPPED_VERTICALLY_FLAG);
+    out.flippedDiagonally = (aTileGID & FLIPPED_DIAGONALLY_FLAG);
     // Clear the flags
-    aTileGID &= ~(FLIPPED_HORIZONTALLY_FLAG | FLIPPED_VERTICALLY_FLAG);
+    aTileGID &= ~kTMXTileFlipFlags;
     TMXTileset_t *tileset = _tmx_mapGetTilesetForTileGID(aMap, aTileGID);
     if(!tileset) return out;
     out.tileset = tileset;
@@ -226,11 +325,36 @@ static TMXTile_t _tmx_mapCreateTileForTileGID(TMXMap_t *aMap, int aTileGID)
 
 static TMXTileset_t *_tmx_mapGetTilesetForTileGID(TMXMap_t *aMap, int aTileGID)
 {
+    if(aTileGID <= 0 || aTileGID >= aMap->gidTableSize)
+        return NULL;
+    return aMap->gidTable[aTileGID];
+}
+
+static int _tmx_tilesetTileCount(TMXTileset_t *aTileset)
+{
+    if(aTileset->tileWidth <= 0 || aTileset->tileHeight <= 0)
+        return 0;
+    int tilesPerRow = (aTileset->imageWidth - 2*aTileset->margin + aTileset->spacing) / (aTileset->tileWidth + aTileset->spacing);
+    int rows = (aTileset->imageHeight - 2*aTileset->margin + aTileset->spacing) / (aTileset->tileHeight + aTileset->spacing);
+    return MAX(0, tilesPerRow) * MAX(0, rows);
+}
+
+// Builds a table mapping every global tile id in use by the map's tilesets to its tileset
+static void _tmx_mapBuildGidTable(TMXMap_t *aMap)
+{
+    int maxGid = 0;
+    for(int i = 0; i < aMap->numberOfTilesets; ++i)
+        maxGid = MAX(maxGid, aMap->tilesets[i].firstTileGid + _tmx_tilesetTileCount(&aMap->tilesets[i]) - 1);
+
+    aMap->gidTableSize = maxGid + 1;
+    aMap->gidTable = calloc(aMap->gidTableSize, sizeof(TMXTileset_t *));
+    // Tilesets are stored in order of their first gid, so later ones take precedence just as in Tiled
     for(int i = 0; i < aMap->numberOfTilesets; ++i) {
-        if(aMap->tilesets[i].firstTileGid <= aTileGID)
-            return &aMap->tilesets[i];
+        TMXTileset_t *tileset = &aMap->tilesets[i];
+        int lastGid = tileset->firstTileGid + _tmx_tilesetTileCount(tileset);
+        for(int gid = MAX(1, tileset->firstTileGid); gid < lastGid; ++gid)
+            aMap->gidTable[gid] = tileset;
     }
-    return NULL;
 }
 
 static void _mxmlElementPrintAttrs(mxml_node_t *aNode)
@@ -244,6 +368,571 @@ static void _mxmlElementPrintAttrs(mxml_node_t *aNode)
 }
 
 
+#pragma mark - Streaming
+
+static void _tmx_layerDataPush(TMXLayerData_t *aData, uint32_t aGid)
+{
+    if(aData->count >= aData->capacity) {
+        aData->capacity = MAX(64, aData->capacity*2);
+        aData->gids = realloc(aData->gids, aData->capacity*sizeof(uint32_t));
+    }
+    aData->gids[aData->count++] = aGid;
+}
+
+static int _tmx_base64Value(char aChar)
+{
+    if(aChar >= 'A' && aChar <= 'Z') return aChar - 'A';
+    if(aChar >= 'a' && aChar <= 'z') return aChar - 'a' + 26;
+    if(aChar >= '0' && aChar <= '9') return aChar - '0' + 52;
+    if(aChar == '+') return 62;
+    if(aChar == '/') return 63;
+    return -1;
+}
+
+// Decodes base64 text in place, ignoring whitespace. Returns the number of bytes decoded
+static size_t _tmx_base64DecodeInPlace(char *aText, size_t aLength)
+{
+    unsigned char *out = (unsigned char *)aText;
+    size_t outLen = 0;
+    uint32_t accum = 0;
+    int bits = 0, value;
+    for(size_t i = 0; i < aLength; ++i) {
+        if(aText[i] == '=')
+            break;
+        if((value = _tmx_base64Value(aText[i])) < 0)
+            continue;
+        accum = (accum << 6) | value;
+        bits += 6;
+        if(bits >= 8) {
+            bits -= 8;
+            out[outLen++] = (accum >> bits) & 0xff;
+        }
+    }
+    return outLen;
+}
+
+// Inflates zlib or gzip data (Detected from the header)
+static bool _tmx_inflate(const unsigned char *aInput, size_t aInputLength, unsigned char *aOutput, size_t aOutputLength)
+{
+    z_stream stream;
+    memset(&stream, 0, sizeof(z_stream));
+    if(inflateInit2(&stream, 15 + 32) != Z_OK)
+        return false;
+    stream.next_in = (Bytef *)aInput;
+    stream.avail_in = (uInt)aInputLength;
+    stream.next_out = aOutput;
+    stream.avail_out = (uInt)aOutputLength;
+    int status = inflate(&stream, Z_FINISH);
+    inflateEnd(&stream);
+    return status == Z_STREAM_END && stream.avail_out == 0;
+}
+
+// Decodes the text of a data element into the layer's gids
+static void _tmx_decodeLayerData(TMXParseContext_t *aCtx, TMXLayerData_t *aData)
+{
+    if(!aCtx->encoding)
+        return; // XML encoded tiles were read as they streamed in
+    if(!aCtx->text)
+        return;
+
+    if(strcmp(aCtx->encoding, "csv") == 0) {
+        char *cursor = aCtx->text, *end;
+        while(*cursor) {
+            uint32_t gid = (uint32_t)strtoul(cursor, &end, 10);
+            if(end == cursor) {
+                ++cursor;
+                continue;
+            }
+            _tmx_layerDataPush(aData, gid);
+            cursor = end;
+        }
+    } else if(strcmp(aCtx->encoding, "base64") == 0) {
+        size_t length = _tmx_base64DecodeInPlace(aCtx->text, aCtx->textLength);
+        const unsigned char *bytes = (unsigned char *)aCtx->text;
+        unsigned char *inflated = NULL;
+        if(aCtx->compression) {
+            size_t expectedLength = aCtx->expectedTileCount*4;
+            inflated = malloc(expectedLength);
+            if(!_tmx_inflate(bytes, length, inflated, expectedLength)) {
+                dynamo_log("Could not decompress layer data (%s)", aCtx->compression);
+                free(inflated);
+                return;
+            }
+            bytes = inflated;
+            length = expectedLength;
+        }
+        aData->capacity = (int)(length / 4);
+        aData->gids = realloc(aData->gids, MAX(1, aData->capacity)*sizeof(uint32_t));
+        // Global ids are stored as little endian 32 bit integers
+        for(size_t i = 0; i + 3 < length; i += 4)
+            aData->gids[aData->count++] = bytes[i] | (bytes[i+1] << 8) | (bytes[i+2] << 16) | ((uint32_t)bytes[i+3] << 24);
+        free(inflated);
+    } else
+        dynamo_log("Unsupported layer encoding: %s", aCtx->encoding);
+}
+
+static void _tmx_saxCallback(mxml_node_t *aNode, mxml_sax_event_t aEvent, TMXParseContext_t *aCtx)
+{
+    const char *name;
+    switch(aEvent) {
+        case MXML_SAX_ELEMENT_OPEN:
+            name = mxmlGetElement(aNode);
+            if(aCtx->inData && strcmp(name, "tile") == 0) {
+                // XML encoded tile, read it and let mxml discard the node
+                const char *gid = mxmlElementGetAttr(aNode, "gid");
+                _tmx_layerDataPush(&aCtx->layers[aCtx->layerCount-1], gid ? (uint32_t)strtoul(gid, NULL, 10) : 0);
+                return;
+            } else if(strcmp(name, "map") == 0) {
+                aCtx->expectedTileCount = _mxmlElementGetAttrAsInt(aNode, "width", 0) * _mxmlElementGetAttrAsInt(aNode, "height", 0);
+            } else if(strcmp(name, "data") == 0) {
+                if(aCtx->layerCount >= aCtx->layerCapacity) {
+                    aCtx->layerCapacity = MAX(4, aCtx->layerCapacity*2);
+                    aCtx->layers = realloc(aCtx->layers, aCtx->layerCapacity*sizeof(TMXLayerData_t));
+                }
+                memset(&aCtx->layers[aCtx->layerCount++], 0, sizeof(TMXLayerData_t));
+                aCtx->inData = true;
+                aCtx->encoding = _mxmlElementCopyAttr(aNode, "encoding");
+                aCtx->compression = _mxmlElementCopyAttr(aNode, "compression");
+                aCtx->textLength = 0;
+            }
+            mxmlRetain(aNode);
+            break;
+        case MXML_SAX_ELEMENT_CLOSE:
+            if(aCtx->inData && strcmp(mxmlGetElement(aNode), "data") == 0) {
+                if(aCtx->text)
+                    aCtx->text[aCtx->textLength] = '\0';
+                _tmx_decodeLayerData(aCtx, &aCtx->layers[aCtx->layerCount-1]);
+                free(aCtx->encoding), aCtx->encoding = NULL;
+                free(aCtx->compression), aCtx->compression = NULL;
+                aCtx->inData = false;
+            }
+            break;
+        case MXML_SAX_DATA:
+            // Only the contents of data elements are of interest, everything else is whitespace
+            if(aCtx->inData && aCtx->encoding) {
+                const char *text = mxmlGetOpaque(aNode);
+                size_t length = text ? strlen(text) : 0;
+                if(aCtx->textLength + length + 1 > aCtx->textCapacity) {
+                    aCtx->textCapacity = MAX(aCtx->textCapacity*2, aCtx->textLength + length + 1);
+                    aCtx->text = realloc(aCtx->text, aCtx->textCapacity);
+                }
+                memcpy(aCtx->text + aCtx->textLength, text, length);
+                aCtx->textLength += length;
+            }
+            break;
+        case MXML_SAX_DIRECTIVE:
+            mxmlRetain(aNode);
+            break;
+        default:
+            break;
+    }
+}
+
+static void _tmx_parseContextCleanup(TMXParseContext_t *aCtx)
+{
+    for(int i = 0; i < aCtx->layerCount; ++i)
+        free(aCtx->layers[i].gids);
+    free(aCtx->layers);
+    free(aCtx->encoding);
+    free(aCtx->compression);
+    free(aCtx->text);
+    memset(aCtx, 0, sizeof(TMXParseContext_t));
+}
+
+
+#pragma mark - Binary maps
+//
+// Layout (All values are native endian 32 bit, offsets are from the start of the file and 0 means none):
+// Header, followed by the tileset, layer, object group and property records and tile arrays they point to.
+// Strings (Null terminated) & animation frames are referenced in place; every other record is copied into the map on load.
+// Tiles can't be used in place: TMXTile_t points to its tileset, tmx_layerSetTile edits them and the mapping is read only.
+// Chunk meshes are not stored either since they depend on how the tilesets are paged for the maximum texture size of the
+// device, tmx_prepareRenderableForLayer builds them off the GL thread instead
+
+const char *kTMXBinaryMagic = "DTMB";
+#define kTMXBinaryVersion (2)
+
+typedef struct _TMXBinaryHeader {
+    char magic[4];
+    uint32_t version;
+    int32_t orientation;
+    int32_t width, height;
+    int32_t tileWidth, tileHeight;
+    int32_t numberOfTilesets;   uint32_t tilesets;
+    int32_t numberOfLayers;     uint32_t layers;
+    int32_t numberOfObjectGroups; uint32_t objectGroups;
+    int32_t numberOfProperties; uint32_t properties;
+} TMXBinaryHeader_t;
+
+typedef struct _TMXBinaryProperty {
+    uint32_t name, value;
+} TMXBinaryProperty_t;
+
+typedef struct _TMXBinaryTileset {
+    int32_t firstTileGid;
+    int32_t imageWidth, imageHeight;
+    int32_t tileWidth, tileHeight;
+    int32_t spacing, margin;
+    uint32_t imagePath;
+    int32_t numberOfAnimations; uint32_t animations;
+} TMXBinaryTileset_t;
+
+typedef struct _TMXBinaryAnimation {
+    int32_t tileId;
+    int32_t numberOfFrames; uint32_t frames; // Stored as TMXAnimationFrame_t
+    int32_t totalDuration;
+} TMXBinaryAnimation_t;
+
+// A tile with its tileset already resolved
+typedef struct _TMXBinaryTile {
+    int16_t tileset; // Index into the tilesets, -1 for none
+    uint16_t flags; // kTMXBinaryFlippedHorizontally | kTMXBinaryFlippedVertically | kTMXBinaryFlippedDiagonally
+    int32_t id;
+} TMXBinaryTile_t;
+#define kTMXBinaryFlippedHorizontally (1)
+#define kTMXBinaryFlippedVertically   (2)
+#define kTMXBinaryFlippedDiagonally   (4)
+
+typedef struct _TMXBinaryLayer {
+    uint32_t name;
+    float opacity;
+    int32_t isVisible;
+    int32_t numberOfTiles;      uint32_t tiles;
+    int32_t numberOfProperties; uint32_t properties;
+} TMXBinaryLayer_t;
+
+typedef struct _TMXBinaryObject {
+    uint32_t name, type;
+    int32_t x, y, width, height;
+    TMXBinaryTile_t tile;
+    int32_t numberOfProperties; uint32_t properties;
+} TMXBinaryObject_t;
+
+typedef struct _TMXBinaryObjectGroup {
+    uint32_t name;
+    int32_t numberOfObjects;    uint32_t objects;
+    int32_t numberOfProperties; uint32_t properties;
+} TMXBinaryObjectGroup_t;
+
+// A growable buffer that records are appended to. Records are addressed by offset since the buffer moves
+typedef struct _TMXBinaryWriter {
+    unsigned char *bytes;
+    size_t length, capacity;
+} TMXBinaryWriter_t;
+
+#define _TMXW_AT(writer, type, offset) ((type *)((writer)->bytes + (offset)))
+
+// Appends aSize zeroed bytes (4 byte aligned) and returns their offset
+static uint32_t _tmxw_reserve(TMXBinaryWriter_t *aWriter, size_t aSize)
+{
+    size_t offset = aWriter->length;
+    size_t newLength = offset + ((aSize + 3) & ~(size_t)3);
+    if(newLength > aWriter->capacity) {
+        aWriter->capacity = MAX(newLength, aWriter->capacity*2);
+        aWriter->bytes = realloc(aWriter->bytes, aWriter->capacity);
+    }
+    memset(aWriter->bytes + offset, 0, newLength - offset);
+    aWriter->length = newLength;
+    return (uint32_t)offset;
+}
+
+static uint32_t _tmxw_string(TMXBinaryWriter_t *aWriter, const char *aString)
+{
+    if(!aString)
+        return 0;
+    size_t length = strlen(aString) + 1;
+    uint32_t offset = _tmxw_reserve(aWriter, length);
+    memcpy(aWriter->bytes + offset, aString, length);
+    return offset;
+}
+
+static uint32_t _tmxw_properties(TMXBinaryWriter_t *aWriter, TMXProperty_t *aProperties, int aCount)
+{
+    if(aCount <= 0)
+        return 0;
+    uint32_t offset = _tmxw_reserve(aWriter, aCount*sizeof(TMXBinaryProperty_t));
+    for(int i = 0; i < aCount; ++i) {
+        uint32_t name = _tmxw_string(aWriter, aProperties[i].name);
+        uint32_t value = _tmxw_string(aWriter, aProperties[i].value);
+        _TMXW_AT(aWriter, TMXBinaryProperty_t, offset)[i].name = name;
+        _TMXW_AT(aWriter, TMXBinaryProperty_t, offset)[i].value = value;
+    }
+    return offset;
+}
+
+static TMXBinaryTile_t _tmx_binaryTileFromTile(TMXMap_t *aMap, TMXTile_t *aTile)
+{
+    TMXBinaryTile_t out = {
+        aTile->tileset ? (int16_t)(aTile->tileset - aMap->tilesets) : -1,
+        (aTile->flippedHorizontally ? kTMXBinaryFlippedHorizontally : 0) | (aTile->flippedVertically ? kTMXBinaryFlippedVertically : 0)
+            | (aTile->flippedDiagonally ? kTMXBinaryFlippedDiagonally : 0),
+        aTile->id
+    };
+    return out;
+}
+
+static TMXTile_t _tmx_tileFromBinaryTile(TMXMap_t *aMap, const TMXBinaryTile_t *aTile)
+{
+    TMXTile_t out = {
+        NULL, aTile->id,
+        (aTile->flags & kTMXBinaryFlippedVertically) != 0,
+        (aTile->flags & kTMXBinaryFlippedHorizontally) != 0,
+        (aTile->flags & kTMXBinaryFlippedDiagonally) != 0
+    };
+    if(aTile->tileset >= 0 && aTile->tileset < aMap->numberOfTilesets)
+        out.tileset = &aMap->tilesets[aTile->tileset];
+    return out;
+}
+
+bool tmx_writeBinaryMapFile(TMXMap_t *aMap, const char *aFilename)
+{
+    TMXBinaryWriter_t writer = { NULL, 0, 0 };
+    TMXBinaryWriter_t *w = &writer;
+
+    uint32_t header = _tmxw_reserve(w, sizeof(TMXBinaryHeader_t));
+    memcpy(_TMXW_AT(w, TMXBinaryHeader_t, header)->magic, kTMXBinaryMagic, 4);
+    _TMXW_AT(w, TMXBinaryHeader_t, header)->version = kTMXBinaryVersion;
+    _TMXW_AT(w, TMXBinaryHeader_t, header)->orientation = aMap->orientation;
+    _TMXW_AT(w, TMXBinaryHeader_t, header)->width = aMap->width;
+    _TMXW_AT(w, TMXBinaryHeader_t, header)->height = aMap->height;
+    _TMXW_AT(w, TMXBinaryHeader_t, header)->tileWidth = aMap->tileWidth;
+    _TMXW_AT(w, TMXBinaryHeader_t, header)->tileHeight = aMap->tileHeight;
+
+    uint32_t tilesets = _tmxw_reserve(w, aMap->numberOfTilesets*sizeof(TMXBinaryTileset_t));
+    for(int i = 0; i < aMap->numberOfTilesets; ++i) {
+        TMXTileset_t *tileset = &aMap->tilesets[i];
+        uint32_t imagePath = _tmxw_string(w, tileset->imagePath);
+        uint32_t animations = tileset->numberOfAnimations > 0 ? _tmxw_reserve(w, tileset->numberOfAnimations*sizeof(TMXBinaryAnimation_t)) : 0;
+        for(int j = 0; j < tileset->numberOfAnimations; ++j) {
+            TMXTileAnimation_t *animation = &tileset->animations[j];
+            uint32_t frames = _tmxw_reserve(w, animation->numberOfFrames*sizeof(TMXAnimationFrame_t));
+            memcpy(w->bytes + frames, animation->frames, animation->numberOfFrames*sizeof(TMXAnimationFrame_t));
+            TMXBinaryAnimation_t animationRecord = { animation->tileId, animation->numberOfFrames, frames, animation->totalDuration };
+            _TMXW_AT(w, TMXBinaryAnimation_t, animations)[j] = animationRecord;
+        }
+        TMXBinaryTileset_t record = {
+            tileset->firstTileGid, tileset->imageWidth, tileset->imageHeight,
+            tileset->tileWidth, tileset->tileHeight, tileset->spacing, tileset->margin,
+            imagePath, tileset->numberOfAnimations, animations
+        };
+        _TMXW_AT(w, TMXBinaryTileset_t, tilesets)[i] = record;
+    }
+
+    uint32_t layers = _tmxw_reserve(w, aMap->numberOfLayers*sizeof(TMXBinaryLayer_t));
+    for(int i = 0; i < aMap->numberOfLayers; ++i) {
+        TMXLayer_t *layer = &aMap->layers[i];
+        TMXBinaryLayer_t record = {
+            _tmxw_string(w, layer->name), layer->opacity, layer->isVisible,
+            layer->numberOfTiles, _tmxw_reserve(w, layer->numberOfTiles*sizeof(TMXBinaryTile_t)),
+            layer->numberOfProperties, _tmxw_properties(w, layer->properties, layer->numberOfProperties)
+        };
+        for(int j = 0; j < layer->numberOfTiles; ++j)
+            _TMXW_AT(w, TMXBinaryTile_t, record.tiles)[j] = _tmx_binaryTileFromTile(aMap, &layer->tiles[j]);
+        _TMXW_AT(w, TMXBinaryLayer_t, layers)[i] = record;
+    }
+
+    uint32_t objectGroups = _tmxw_reserve(w, aMap->numberOfObjectGroups*sizeof(TMXBinaryObjectGroup_t));
+    for(int i = 0; i < aMap->numberOfObjectGroups; ++i) {
+        TMXObjectGroup_t *group = &aMap->objectGroups[i];
+        TMXBinaryObjectGroup_t record = {
+            _tmxw_string(w, group->name),
+            group->numberOfObjects, _tmxw_reserve(w, group->numberOfObjects*sizeof(TMXBinaryObject_t)),
+            group->numberOfProperties, _tmxw_properties(w, group->properties, group->numberOfProperties)
+        };
+        for(int j = 0; j < group->numberOfObjects; ++j) {
+            TMXObject_t *obj = &group->objects[j];
+            TMXBinaryObject_t objRecord = {
+                _tmxw_string(w, obj->name), _tmxw_string(w, obj->type),
+                obj->x, obj->y, obj->width, obj->height,
+                _tmx_binaryTileFromTile(aMap, &obj->tile),
+                obj->numberOfProperties, _tmxw_properties(w, obj->properties, obj->numberOfProperties)
+            };
+            _TMXW_AT(w, TMXBinaryObject_t, record.objects)[j] = objRecord;
+        }
+        _TMXW_AT(w, TMXBinaryObjectGroup_t, objectGroups)[i] = record;
+    }
+
+    uint32_t properties = _tmxw_properties(w, aMap->properties, aMap->numberOfProperties);
+    // Terminate the file so that no string can run past the end of the mapping
+    _tmxw_reserve(w, 1);
+
+    TMXBinaryHeader_t *headerRecord = _TMXW_AT(w, TMXBinaryHeader_t, header);
+    headerRecord->numberOfTilesets = aMap->numberOfTilesets;
+    headerRecord->tilesets = tilesets;
+    headerRecord->numberOfLayers = aMap->numberOfLayers;
+    headerRecord->layers = layers;
+    headerRecord->numberOfObjectGroups = aMap->numberOfObjectGroups;
+    headerRecord->objectGroups = objectGroups;
+    headerRecord->numberOfProperties = aMap->numberOfProperties;
+    headerRecord->properties = properties;
+
+    FILE *fp = fopen(aFilename, "wb");
+    bool success = fp && fwrite(w->bytes, 1, w->length, fp) == w->length;
+    if(fp) fclose(fp);
+    free(w->bytes);
+    if(!success)
+        dynamo_log("Could not write binary map to %s", aFilename);
+    return success;
+}
+
+// Returns a pointer to aCount records of aSize at aOffset, or NULL if they do not fit in the mapping
+static const void *_tmx_binaryRecords(TMXMap_t *aMap, uint32_t aOffset, int aCount, size_t aSize)
+{
+    if(aCount < 0 || aOffset == 0 || aOffset % 4 != 0)
+        return NULL;
+    if(aOffset > aMap->mappedFile.length || (aMap->mappedFile.length - aOffset) / aSize < (size_t)aCount)
+        return NULL;
+    return (char *)aMap->mappedFile.data + aOffset;
+}
+
+static char *_tmx_binaryString(TMXMap_t *aMap, uint32_t aOffset)
+{
+    if(aOffset == 0 || aOffset >= aMap->mappedFile.length)
+        return NULL;
+    return (char *)aMap->mappedFile.data + aOffset;
+}
+
+static TMXProperty_t *_tmx_binaryProperties(TMXMap_t *aMap, uint32_t aOffset, int *aoCount)
+{
+    const TMXBinaryProperty_t *records = *aoCount > 0 ? _tmx_binaryRecords(aMap, aOffset, *aoCount, sizeof(TMXBinaryProperty_t)) : NULL;
+    if(!records) {
+        *aoCount = 0;
+        return NULL;
+    }
+    TMXProperty_t *properties = malloc(*aoCount*sizeof(TMXProperty_t));
+    for(int i = 0; i < *aoCount; ++i) {
+        properties[i].name = _tmx_binaryString(aMap, records[i].name);
+        properties[i].value = _tmx_binaryString(aMap, records[i].value);
+    }
+    return properties;
+}
+
+TMXMap_t *tmx_readBinaryMapFile(const char *aFilename)
+{
+    TMXMap_t *map = _tmx_loadBinaryMapFile(aFilename);
+    return map ? obj_autorelease(map) : NULL;
+}
+
+static TMXMap_t *_tmx_loadBinaryMapFile(const char *aFilename)
+{
+    MappedFile_t file;
+    if(!util_mapFile(aFilename, kMappedFileAccess_sequential, &file)) {
+        dynamo_log("Could not map %s", aFilename);
+        return NULL;
+    }
+    return _tmx_createBinaryMap(aFilename, &file);
+}
+
+// Takes ownership of the mapping
+static TMXMap_t *_tmx_createBinaryMap(const char *aFilename, MappedFile_t *aFile)
+{
+    const unsigned char *bytes = aFile->data;
+    const TMXBinaryHeader_t *header = aFile->data;
+    if(aFile->length < sizeof(TMXBinaryHeader_t) || memcmp(header->magic, kTMXBinaryMagic, 4) != 0
+       || header->version != kTMXBinaryVersion || bytes[aFile->length - 1] != '\0') {
+        dynamo_log("%s is not a compatible binary map", aFilename);
+        util_unmapFile(aFile);
+        return NULL;
+    }
+
+    TMXMap_t *out = obj_create(&Class_TMXMap);
+    out->mappedFile = *aFile;
+    out->orientation = header->orientation;
+    out->width = header->width;
+    out->height = header->height;
+    out->tileWidth = header->tileWidth;
+    out->tileHeight = header->tileHeight;
+
+    const TMXBinaryTileset_t *tilesets = _tmx_binaryRecords(out, header->tilesets, header->numberOfTilesets, sizeof(TMXBinaryTileset_t));
+    const TMXBinaryLayer_t *layers = _tmx_binaryRecords(out, header->layers, header->numberOfLayers, sizeof(TMXBinaryLayer_t));
+    const TMXBinaryObjectGroup_t *objectGroups = _tmx_binaryRecords(out, header->objectGroups, header->numberOfObjectGroups, sizeof(TMXBinaryObjectGroup_t));
+    // Empty sections are stored without records
+    bool valid = (tilesets || header->numberOfTilesets == 0)
+              && (layers || header->numberOfLayers == 0)
+              && (objectGroups || header->numberOfObjectGroups == 0);
+    if(!valid) {
+        dynamo_log("%s is corrupt", aFilename);
+        obj_release(out); // The mapping is released along with the map
+        return NULL;
+    }
+
+    out->numberOfProperties = header->numberOfProperties;
+    out->properties = _tmx_binaryProperties(out, header->properties, &out->numberOfProperties);
+
+    out->numberOfTilesets = header->numberOfTilesets;
+    out->tilesets = malloc(out->numberOfTilesets*sizeof(TMXTileset_t));
+    for(int i = 0; i < out->numberOfTilesets; ++i) {
+        TMXTileset_t tileset = {
+            tilesets[i].firstTileGid, tilesets[i].imageWidth, tilesets[i].imageHeight,
+            tilesets[i].tileWidth, tilesets[i].tileHeight, tilesets[i].spacing, tilesets[i].margin,
+            _tmx_binaryString(out, tilesets[i].imagePath), 0, NULL
+        };
+        // Animation frames are used in place
+        const TMXBinaryAnimation_t *animations = tilesets[i].numberOfAnimations > 0
+            ? _tmx_binaryRecords(out, tilesets[i].animations, tilesets[i].numberOfAnimations, sizeof(TMXBinaryAnimation_t))
+            : NULL;
+        if(animations) {
+            tileset.animations = calloc(tilesets[i].numberOfAnimations, sizeof(TMXTileAnimation_t));
+            for(int j = 0; j < tilesets[i].numberOfAnimations; ++j) {
+                TMXAnimationFrame_t *frames = (TMXAnimationFrame_t *)_tmx_binaryRecords(out, animations[j].frames, animations[j].numberOfFrames, sizeof(TMXAnimationFrame_t));
+                if(!frames)
+                    continue;
+                TMXTileAnimation_t animation = { animations[j].tileId, animations[j].numberOfFrames, frames, animations[j].totalDuration };
+                tileset.animations[tileset.numberOfAnimations++] = animation;
+            }
+        }
+        out->tilesets[i] = tileset;
+    }
+    _tmx_mapBuildGidTable(out);
+
+    out->numberOfLayers = header->numberOfLayers;
+    out->layers = calloc(out->numberOfLayers, sizeof(TMXLayer_t));
+    for(int i = 0; i < out->numberOfLayers; ++i) {
+        TMXLayer_t *layer = &out->layers[i];
+        layer->name = _tmx_binaryString(out, layers[i].name);
+        layer->opacity = layers[i].opacity;
+        layer->isVisible = layers[i].isVisible;
+        layer->numberOfProperties = layers[i].numberOfProperties;
+        layer->properties = _tmx_binaryProperties(out, layers[i].properties, &layer->numberOfProperties);
+
+        // Renderables index tiles by map position, so layers always hold width*height tiles
+        const TMXBinaryTile_t *tiles = _tmx_binaryRecords(out, layers[i].tiles, layers[i].numberOfTiles, sizeof(TMXBinaryTile_t));
+        int tileCount = tiles ? MIN(layers[i].numberOfTiles, out->width*out->height) : 0;
+        layer->numberOfTiles = out->width*out->height;
+        layer->tiles = calloc(MAX(1, layer->numberOfTiles), sizeof(TMXTile_t));
+        for(int j = 0; j < tileCount; ++j)
+            layer->tiles[j] = _tmx_tileFromBinaryTile(out, &tiles[j]);
+    }
+
+    out->numberOfObjectGroups = header->numberOfObjectGroups;
+    out->objectGroups = calloc(out->numberOfObjectGroups, sizeof(TMXObjectGroup_t));
+    for(int i = 0; i < out->numberOfObjectGroups; ++i) {
+        TMXObjectGroup_t *group = &out->objectGroups[i];
+        group->name = _tmx_binaryString(out, objectGroups[i].name);
+        group->numberOfProperties = objectGroups[i].numberOfProperties;
+        group->properties = _tmx_binaryProperties(out, objectGroups[i].properties, &group->numberOfProperties);
+
+        const TMXBinaryObject_t *objects = _tmx_binaryRecords(out, objectGroups[i].objects, objectGroups[i].numberOfObjects, sizeof(TMXBinaryObject_t));
+        group->numberOfObjects = objects ? objectGroups[i].numberOfObjects : 0;
+        group->objects = calloc(MAX(1, group->numberOfObjects), sizeof(TMXObject_t));
+        for(int j = 0; j < group->numberOfObjects; ++j) {
+            TMXObject_t *obj = &group->objects[j];
+            obj->name = _tmx_binaryString(out, objects[j].name);
+            obj->type = _tmx_binaryString(out, objects[j].type);
+            obj->x = objects[j].x;
+            obj->y = objects[j].y;
+            obj->width = objects[j].width;
+            obj->height = objects[j].height;
+            obj->tile = _tmx_tileFromBinaryTile(out, &objects[j].tile);
+            obj->numberOfProperties = objects[j].numberOfProperties;
+            obj->properties = _tmx_binaryProperties(out, objects[j].properties, &obj->numberOfProperties);
+        }
+    }
+
+    return out;
+}
+
+
 #pragma mark - XML Parsing
 
 static char *_mxmlElementCopyAttr(mxml_node_t *aNode, const char *aAttrName)
@@ -316,11 +1005,74 @@ TMXProperty_t *_tmx_readPropertiesFromMxmlNode(mxml_node_t *aParentNode, mxml_no
     return NULL;
 }
 
+// Reads the <animation> of each <tile> in a tileset
+TMXTileAnimation_t *_tmx_readAnimationsFromMxmlNode(mxml_node_t *aTilesetNode, mxml_node_t *aTopNode, int *aoCount)
+{
+    int tileCount;
+    mxml_node_t **tileNodes = _mxmlFindChildren(aTilesetNode, aTopNode, "tile", &tileCount);
+    TMXTileAnimation_t *animations = NULL;
+    *aoCount = 0;
+    for(int i = 0; i < tileCount; ++i) {
+        mxml_node_t *animationNode = mxmlFindElement(tileNodes[i], aTopNode, "animation", NULL, NULL, MXML_DESCEND_FIRST);
+        if(!animationNode)
+            continue;
+        int frameCount;
+        mxml_node_t **frameNodes = _mxmlFindChildren(animationNode, aTopNode, "frame", &frameCount);
+        if(frameCount > 0) {
+            animations = realloc(animations, (*aoCount + 1)*sizeof(TMXTileAnimation_t));
+            TMXTileAnimation_t *animation = &animations[(*aoCount)++];
+            animation->tileId = _mxmlElementGetAttrAsInt(tileNodes[i], "id", 0);
+            animation->numberOfFrames = frameCount;
+            animation->frames = malloc(frameCount*sizeof(TMXAnimationFrame_t));
+            animation->totalDuration = 0;
+            for(int j = 0; j < frameCount; ++j) {
+                animation->frames[j].tileId = _mxmlElementGetAttrAsInt(frameNodes[j], "tileid", 0);
+                animation->frames[j].duration = MAX(0, _mxmlElementGetAttrAsInt(frameNodes[j], "duration", 0));
+                animation->totalDuration += animation->frames[j].duration;
+            }
+        }
+        free(frameNodes);
+    }
+    free(tileNodes);
+    return animations;
+}
+
+// Layers are split into chunks of kTMXChunkSize*kTMXChunkSize tiles so that only the visible part
+// of a map is drawn & so that each chunk can be indexed using 16 bit indices
+#define kTMXChunkSize (32)
+
+struct _TMXChunkVertex {
+    vec2_t loc;
+    vec2_t texCoord;
+};
+
+static void _tmx_advanceAnimations(TMXLayerRenderable_t *aRenderable, GLMFloat aDelta);
+static void _tmx_freeLayerUpload(TMXLayerRenderable_t *aRenderable);
+
 static void tmx_destroyLayerRenderable(TMXLayerRenderable_t *aRenderable)
 {
-    glDeleteBuffers(1, &aRenderable->posVBO);
-    glDeleteBuffers(1, &aRenderable->texCoordVBO);
-    glDeleteBuffers(1, &aRenderable->indexVBO);
+    if(aRenderable->pendingUpload)
+        _tmx_freeLayerUpload(aRenderable);
+    for(int i = 0; i < aRenderable->chunksWide*aRenderable->chunksHigh; ++i) {
+        TMXLayerChunk_t *chunk = &aRenderable->chunks[i];
+        if(chunk->vao)
+            dynamo_glDeleteVertexArrays(1, &chunk->vao);
+        if(chunk->vbo)
+            glDeleteBuffers(1, &chunk->vbo);
+        if(chunk->ibo)
+            glDeleteBuffers(1, &chunk->ibo);
+        free(chunk->pageStarts);
+    }
+    free(aRenderable->chunks);
+    free(aRenderable->animatedTiles);
+    free(aRenderable->tilesetPages);
+    free(aRenderable->tilesetOffsets);
+    for(int i = 0; aRenderable->pages && i < aRenderable->numberOfPages; ++i) {
+        if(aRenderable->pages[i])
+            obj_release(aRenderable->pages[i]);
+    }
+    free(aRenderable->pages);
+    free(aRenderable->pageSizes);
     obj_release(aRenderable->map);
 }
 
@@ -330,27 +1082,98 @@ Class_t Class_TMXLayerRenderable = {
     (Obj_destructor_t)&tmx_destroyLayerRenderable
 };
 
+// Binds the chunk's buffers & points the textured shader's attributes into them
+static void _tmx_setChunkAttributes(TMXLayerChunk_t *aChunk)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, aChunk->vbo);
+    glVertexAttribPointer(gTexturedShader->attributes[kShader_positionAttribute], 2, GL_FLOAT, GL_FALSE, sizeof(struct _TMXChunkVertex), (void*)offsetof(struct _TMXChunkVertex, loc));
+    glEnableVertexAttribArray(gTexturedShader->attributes[kShader_positionAttribute]);
+    glVertexAttribPointer(gTexturedShader->attributes[kShader_texCoord0Attribute], 2, GL_FLOAT, GL_FALSE, sizeof(struct _TMXChunkVertex), (void*)offsetof(struct _TMXChunkVertex, texCoord));
+    glEnableVertexAttribArray(gTexturedShader->attributes[kShader_texCoord0Attribute]);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, aChunk->ibo);
+}
+
+// Computes the range of chunks that intersect the viewport by mapping the clip space rectangle
+// back into layer space (Assumes the world&projection matrices are 2D affine transforms)
+static bool _tmx_visibleChunkRange(Renderer_t *aRenderer, TMXLayerRenderable_t *aRenderable, int *aoMinX, int *aoMinY, int *aoMaxX, int *aoMaxY)
+{
+    mat4_t world = matrix_stack_get_mat4(aRenderer->worldMatrixStack);
+    mat4_t proj  = matrix_stack_get_mat4(aRenderer->projectionMatrixStack);
+    float *m = world.f, *p = proj.f;
+
+    // clip = [a b; d e] * layer + [c; f]
+    float a = p[0]*m[0]  + p[4]*m[1];
+    float b = p[0]*m[4]  + p[4]*m[5];
+    float c = p[0]*m[12] + p[4]*m[13] + p[12];
+    float d = p[1]*m[0]  + p[5]*m[1];
+    float e = p[1]*m[4]  + p[5]*m[5];
+    float f = p[1]*m[12] + p[5]*m[13] + p[13];
+    float det = a*e - b*d;
+    if(fabsf(det) < 1e-12)
+        return false;
+
+    float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+    const float corners[4][2] = { {-1,-1}, {-1,1}, {1,-1}, {1,1} };
+    for(int i = 0; i < 4; ++i) {
+        float x = ( e*(corners[i][0] - c) - b*(corners[i][1] - f)) / det;
+        float y = (-d*(corners[i][0] - c) + a*(corners[i][1] - f)) / det;
+        minX = MIN(minX, x); maxX = MAX(maxX, x);
+        minY = MIN(minY, y); maxY = MAX(maxY, y);
+    }
+    // Pad by a tile since tileset tiles can overhang their cell
+    vec2_t pad = aRenderable->maxTileSize;
+    float chunkW = kTMXChunkSize * aRenderable->map->tileWidth;
+    float chunkH = kTMXChunkSize * aRenderable->map->tileHeight;
+    *aoMinX = MAX(0, (int)floorf((minX - pad.w) / chunkW));
+    *aoMinY = MAX(0, (int)floorf((minY - pad.h) / chunkH));
+    *aoMaxX = MIN(aRenderable->chunksWide - 1, (int)floorf((maxX + pad.w) / chunkW));
+    *aoMaxY = MIN(aRenderable->chunksHigh - 1, (int)floorf((maxY + pad.h) / chunkH));
+    return *aoMinX <= *aoMaxX && *aoMinY <= *aoMaxY;
+}
+
 static void tmx_drawLayerRenderable(Renderer_t *aRenderer, TMXLayerRenderable_t *aRenderable, GLMFloat aTimeSinceLastFrame, GLMFloat aInterpolation)
 {
+    if(aRenderable->pendingUpload)
+        return;
+    _tmx_advanceAnimations(aRenderable, aTimeSinceLastFrame);
+
+    int minX, minY, maxX, maxY;
+    if(!_tmx_visibleChunkRange(aRenderer, aRenderable, &minX, &minY, &maxX, &maxY))
+        return;
+
     shader_makeActive(gTexturedShader);
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, aRenderable->atlas->texture->id);
 
     shader_updateMatrices(gTexturedShader, aRenderer);
     glUniform1i(gTexturedShader->uniforms[kShader_colormap0Uniform], 0);
     vec4_t white = {1.0, 1.0, 1.0, 1.0};
     glUniform4fv(gTexturedShader->uniforms[kShader_colorUniform], 1, white.f);
 
-    glBindBuffer(GL_ARRAY_BUFFER, aRenderable->posVBO);
-    glVertexAttribPointer(gTexturedShader->attributes[kShader_positionAttribute], 2, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(gTexturedShader->attributes[kShader_positionAttribute]);
-
-    glBindBuffer(GL_ARRAY_BUFFER, aRenderable->texCoordVBO);
-    glVertexAttribPointer(gTexturedShader->attributes[kShader_texCoord0Attribute], 2, GL_FLOAT, GL_FALSE, 0, 0);
-    glEnableVertexAttribArray(gTexturedShader->attributes[kShader_texCoord0Attribute]);
-
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, aRenderable->indexVBO);
-    glDrawElements(GL_TRIANGLES, aRenderable->indexCount, GL_UNSIGNED_INT, 0);
+    // A pass per page, each drawing the range of every chunk's indices that uses the page
+    TMXLayerChunk_t *chunk;
+    for(int page = 0; page < aRenderable->numberOfPages; ++page) {
+        if(!aRenderable->pages[page])
+            continue;
+        texture_bind(aRenderable->pages[page]);
+        for(int y = minY; y <= maxY; ++y) {
+            for(int x = minX; x <= maxX; ++x) {
+                chunk = &aRenderable->chunks[y*aRenderable->chunksWide + x];
+                if(chunk->tileCount == 0)
+                    continue;
+                int first = chunk->pageStarts[page], count = chunk->pageStarts[page + 1] - first;
+                if(count == 0)
+                    continue;
+                if(chunk->vao)
+                    dynamo_glBindVertexArray(chunk->vao);
+                else
+                    _tmx_setChunkAttributes(chunk);
+                glDrawElements(GL_TRIANGLES, count*6, GL_UNSIGNED_SHORT, (void *)(first*6*sizeof(GLushort)));
+            }
+        }
+    }
+    if(dynamo_glVAOSupported())
+        dynamo_glBindVertexArray(0);
 
     shader_makeInactive(gTexturedShader);
     glBindTexture(GL_TEXTURE_2D, 0);
@@ -371,78 +1194,710 @@ vec2_t tmx_tileset_texCoordFromId(TMXTileset_t *aTileset, int id)
     return vec2_create(u, v);
 }
 
-TMXLayerRenderable_t *tmx_createRenderableForLayer(TMXMap_t *aMap, unsigned int aLayerIdx)
+static TMXTileAnimation_t *_tmx_tilesetGetAnimation(TMXTileset_t *aTileset, int aTileId)
+{
+    for(int i = 0; i < aTileset->numberOfAnimations; ++i) {
+        if(aTileset->animations[i].tileId == aTileId)
+            return &aTileset->animations[i];
+    }
+    return NULL;
+}
+
+static inline TMXTile_t *_tmx_layerTileAt(TMXLayerRenderable_t *aRenderable, int aX, int aY)
+{
+    return &aRenderable->layer->tiles[(aRenderable->map->height - aY - 1) * aRenderable->map->width + aX];
+}
+
+static inline TMXLayerChunk_t *_tmx_chunkForCell(TMXLayerRenderable_t *aRenderable, int aX, int aY)
+{
+    return &aRenderable->chunks[(aY / kTMXChunkSize)*aRenderable->chunksWide + aX / kTMXChunkSize];
+}
+
+// Generates the quad for the tile at aX,aY (Y growing upwards) displaying aTileId of its tileset
+// Cells without a tile get a degenerate quad
+static void _tmx_tileQuad(TMXLayerRenderable_t *aRenderable, TMXTile_t *aTile, int aTileId, int aX, int aY, struct _TMXChunkVertex *aoVertices)
+{
+    TMXMap_t *map = aRenderable->map;
+    TMXTileset_t *tileset = aTile->tileset;
+    int page = tileset ? aRenderable->tilesetPages[tileset - map->tilesets] : -1;
+    if(page < 0) {
+        memset(aoVertices, 0, 4*sizeof(struct _TMXChunkVertex));
+        return;
+    }
+    vec2_t tileSize = vec2_create(tileset->tileWidth, tileset->tileHeight);
+    vec2_t halfSize = vec2_scalarMul(tileSize, 0.5f);
+    vec2_t center = {
+        (map->tileWidth  * (float)aX) + map->tileWidth  / 2.0f,
+        (map->tileHeight * (float)aY) + map->tileHeight / 2.0f
+    };
+    // The rectangle a texture atlas over the page would give (See texAtlas_getTextureRect), computed from the page's size
+    // since its texture may not have been created yet
+    vec2_t texOffset = tmx_tileset_texCoordFromId(tileset, aTileId);
+    vec2_t pageSize = aRenderable->pageSizes[page];
+    vec2_t origin = {
+        tileset->margin + texOffset.x*(tileSize.w + tileset->spacing),
+        aRenderable->tilesetOffsets[tileset - map->tilesets] + tileset->margin + texOffset.y*(tileSize.h + tileset->spacing)
+    };
+    vec2_t inset = { 0.5f/pageSize.w, 0.5f/pageSize.h };
+    TextureRect_t texRect = textureRectangle_create(inset.w + origin.x/pageSize.w, inset.h + origin.y/pageSize.h,
+                                                    tileSize.w/pageSize.w - inset.w, tileSize.h/pageSize.h - inset.h);
+
+    // Find the corner of the tile's image shown at each corner of the quad. Tiled flips diagonally (Swapping the top right
+    // & bottom left corners) first, then horizontally, then vertically, so they are undone in the reverse order
+    static const int corners[4][2] = { { 0, 0 }, { 0, 1 }, { 1, 1 }, { 1, 0 } };
+    for(int i = 0; i < 4; ++i) {
+        int u = corners[i][0], v = corners[i][1];
+        if(aTile->flippedVertically)   v = 1 - v;
+        if(aTile->flippedHorizontally) u = 1 - u;
+        if(aTile->flippedDiagonally)   { int t = u; u = 1 - v; v = 1 - t; }
+        aoVertices[i] = (struct _TMXChunkVertex){
+            { center.x + (corners[i][0] ? halfSize.w : -halfSize.w), center.y + (corners[i][1] ? halfSize.h : -halfSize.h) },
+            { texRect.origin.u + u*texRect.size.u, texRect.origin.v + v*texRect.size.v }
+        };
+    }
+}
+
+// Returns the index of the page holding the image of a (non empty) tile
+static inline int _tmx_tilePage(TMXLayerRenderable_t *aRenderable, TMXTile_t *aTile)
+{
+    return aRenderable->tilesetPages[aTile->tileset - aRenderable->map->tilesets];
+}
+
+// Lists the indices of the chunk's non empty cells, grouped by page, in a buffer of tileCount*6 indices that must be freed.
+// Each cell's quad is 4 consecutive vertices
+static GLushort *_tmx_chunkIndices(TMXLayerRenderable_t *aRenderable, TMXLayerChunk_t *aChunk, int aFirstX, int aFirstY)
+{
+    if(!aChunk->pageStarts)
+        aChunk->pageStarts = calloc(aRenderable->numberOfPages + 1, sizeof(int));
+    GLushort *indices = malloc(6*MAX(1, aChunk->tileCount)*sizeof(GLushort));
+    int count = 0;
+    for(int page = 0; page < aRenderable->numberOfPages; ++page) {
+        aChunk->pageStarts[page] = count/6;
+        for(int cell = 0; cell < aChunk->cellsWide*aChunk->cellsHigh; ++cell) {
+            TMXTile_t *tile = _tmx_layerTileAt(aRenderable, aFirstX + cell%aChunk->cellsWide, aFirstY + cell/aChunk->cellsWide);
+            if(!tile->tileset || (aRenderable->numberOfPages > 1 && _tmx_tilePage(aRenderable, tile) != page))
+                continue;
+            indices[count++] = 4*cell + 0;
+            indices[count++] = 4*cell + 1;
+            indices[count++] = 4*cell + 2;
+            indices[count++] = 4*cell + 0;
+            indices[count++] = 4*cell + 2;
+            indices[count++] = 4*cell + 3;
+        }
+    }
+    aChunk->pageStarts[aRenderable->numberOfPages] = count/6;
+    return indices;
+}
+
+// Uploads the chunk's indices (Must not be called with a vertex array object bound, since it would capture the index buffer)
+static void _tmx_uploadChunkIndices(TMXLayerChunk_t *aChunk, GLushort *aIndices)
+{
+    if(!aChunk->ibo)
+        glGenBuffers(1, &aChunk->ibo);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, aChunk->ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, aChunk->tileCount*6*sizeof(GLushort), aIndices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+static void _tmx_buildChunkIndices(TMXLayerRenderable_t *aRenderable, TMXLayerChunk_t *aChunk, int aFirstX, int aFirstY)
+{
+    GLushort *indices = _tmx_chunkIndices(aRenderable, aChunk, aFirstX, aFirstY);
+    _tmx_uploadChunkIndices(aChunk, indices);
+    free(indices);
+}
+
+// Generates the vertices for the chunk whose bottom left tile is at aFirstX,aFirstY (Y growing upwards), in a buffer that
+// must be freed. Returns NULL for chunks without any tiles, which are left without buffers until a tile is placed in them.
+// aoAnimated is set if any of the chunk's tiles belongs to a tileset with animations
+static struct _TMXChunkVertex *_tmx_chunkVertices(TMXLayerRenderable_t *aRenderable, TMXLayerChunk_t *aChunk, int aFirstX, int aFirstY, bool *aoAnimated)
+{
+    TMXMap_t *map = aRenderable->map;
+    aChunk->cellsWide = MIN(aFirstX + kTMXChunkSize, map->width)  - aFirstX;
+    aChunk->cellsHigh = MIN(aFirstY + kTMXChunkSize, map->height) - aFirstY;
+
+    aChunk->tileCount = 0;
+    *aoAnimated = false;
+    for(int y = aFirstY; y < aFirstY + aChunk->cellsHigh; ++y) {
+        for(int x = aFirstX; x < aFirstX + aChunk->cellsWide; ++x) {
+            TMXTile_t *tile = _tmx_layerTileAt(aRenderable, x, y);
+            if(!tile->tileset)
+                continue;
+            ++aChunk->tileCount;
+            *aoAnimated |= tile->tileset->numberOfAnimations > 0;
+        }
+    }
+    if(aChunk->tileCount == 0)
+        return NULL;
+
+    struct _TMXChunkVertex *vertices = malloc(4*aChunk->cellsWide*aChunk->cellsHigh*sizeof(struct _TMXChunkVertex));
+    for(int y = 0; y < aChunk->cellsHigh; ++y) {
+        for(int x = 0; x < aChunk->cellsWide; ++x) {
+            TMXTile_t *tile = _tmx_layerTileAt(aRenderable, aFirstX + x, aFirstY + y);
+            _tmx_tileQuad(aRenderable, tile, tile->id, aFirstX + x, aFirstY + y, &vertices[4*(y*aChunk->cellsWide + x)]);
+        }
+    }
+    return vertices;
+}
+
+// Creates the chunk's buffers from its vertices & indices (Animated chunks get updated while drawing)
+static void _tmx_uploadChunk(TMXLayerChunk_t *aChunk, struct _TMXChunkVertex *aVertices, GLushort *aIndices, bool aAnimated)
+{
+    if(!aChunk->vbo)
+        glGenBuffers(1, &aChunk->vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, aChunk->vbo);
+    glBufferData(GL_ARRAY_BUFFER, 4*aChunk->cellsWide*aChunk->cellsHigh*sizeof(struct _TMXChunkVertex), aVertices, aAnimated ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+    _tmx_uploadChunkIndices(aChunk, aIndices);
+
+    if(!aChunk->vao && dynamo_glVAOSupported()) {
+        dynamo_glGenVertexArrays(1, &aChunk->vao);
+        dynamo_glBindVertexArray(aChunk->vao);
+        _tmx_setChunkAttributes(aChunk);
+        dynamo_glBindVertexArray(0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+// Generates & uploads the mesh for the chunk whose bottom left tile is at aFirstX,aFirstY (Y growing upwards)
+static void _tmx_buildLayerChunk(TMXLayerRenderable_t *aRenderable, TMXLayerChunk_t *aChunk, int aFirstX, int aFirstY)
+{
+    bool animated;
+    struct _TMXChunkVertex *vertices = _tmx_chunkVertices(aRenderable, aChunk, aFirstX, aFirstY, &animated);
+    if(!vertices)
+        return;
+    GLushort *indices = _tmx_chunkIndices(aRenderable, aChunk, aFirstX, aFirstY);
+    _tmx_uploadChunk(aChunk, vertices, indices, animated);
+    free(vertices);
+    free(indices);
+}
+
+// Uploads the quad for a single cell (Y growing upwards)
+static void _tmx_updateCell(TMXLayerRenderable_t *aRenderable, int aX, int aY, int aTileId)
+{
+    TMXLayerChunk_t *chunk = _tmx_chunkForCell(aRenderable, aX, aY);
+    if(!chunk->vbo)
+        return;
+    struct _TMXChunkVertex vertices[4];
+    _tmx_tileQuad(aRenderable, _tmx_layerTileAt(aRenderable, aX, aY), aTileId, aX, aY, vertices);
+
+    int cell = (aY % kTMXChunkSize)*chunk->cellsWide + (aX % kTMXChunkSize);
+    glBindBuffer(GL_ARRAY_BUFFER, chunk->vbo);
+    glBufferSubData(GL_ARRAY_BUFFER, 4*cell*sizeof(struct _TMXChunkVertex), sizeof(vertices), vertices);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+#pragma mark - Tile animations
+
+static void _tmx_addAnimatedTile(TMXLayerRenderable_t *aRenderable, int aX, int aY, TMXTileAnimation_t *aAnimation)
+{
+    if(aRenderable->numberOfAnimatedTiles >= aRenderable->animatedTileCapacity) {
+        aRenderable->animatedTileCapacity = MAX(16, aRenderable->animatedTileCapacity*2);
+        aRenderable->animatedTiles = realloc(aRenderable->animatedTiles, aRenderable->animatedTileCapacity*sizeof(TMXAnimatedTile_t));
+    }
+    TMXAnimatedTile_t animatedTile = { aX, aY, aAnimation, -1 };
+    aRenderable->animatedTiles[aRenderable->numberOfAnimatedTiles++] = animatedTile;
+}
+
+static void _tmx_removeAnimatedTile(TMXLayerRenderable_t *aRenderable, int aX, int aY)
+{
+    for(int i = 0; i < aRenderable->numberOfAnimatedTiles; ++i) {
+        if(aRenderable->animatedTiles[i].x == aX && aRenderable->animatedTiles[i].y == aY) {
+            aRenderable->animatedTiles[i] = aRenderable->animatedTiles[--aRenderable->numberOfAnimatedTiles];
+            return;
+        }
+    }
+}
+
+// Advances the layer's animation clock, uploading only the animated tiles whose frame changed
+static void _tmx_advanceAnimations(TMXLayerRenderable_t *aRenderable, GLMFloat aDelta)
+{
+    if(aRenderable->numberOfAnimatedTiles == 0)
+        return;
+    aRenderable->animationTime += aDelta;
+    long ms = (long)(aRenderable->animationTime * 1000.0);
+
+    for(int i = 0; i < aRenderable->numberOfAnimatedTiles; ++i) {
+        TMXAnimatedTile_t *animatedTile = &aRenderable->animatedTiles[i];
+        TMXTileAnimation_t *animation = animatedTile->animation;
+        if(animation->totalDuration <= 0)
+            continue;
+        long t = ms % animation->totalDuration;
+        int frame = 0;
+        while(frame < animation->numberOfFrames - 1 && t >= animation->frames[frame].duration) {
+            t -= animation->frames[frame].duration;
+            ++frame;
+        }
+        if(frame != animatedTile->currentFrame) {
+            animatedTile->currentFrame = frame;
+            _tmx_updateCell(aRenderable, animatedTile->x, animatedTile->y, animation->frames[frame].tileId);
+        }
+    }
+}
+
+#pragma mark -
+
+// Rows left between tilesets merged into a page. Each is filled by extruding the edge of the image next to it, so that
+// filtering at the edge of a tileset does not blend in the one next to it
+#define kTMXTilesetPagePadding (2)
+
+// A texture that tilesets are merged into
+typedef struct _TMXTilesetPage {
+    int width, height;
+    int numberOfTilesets;
+    int tileset; // The last tileset placed in the page
+    unsigned char *pixels; // NULL for pages holding a single tileset, which is loaded as is
+} TMXTilesetPage_t;
+
+// Copies the edges of an image placed at aOffset in a page outwards by a pixel: into the next column if the image is
+// narrower than the page, and into the padding rows above & below it
+static void _tmx_extrudeTilesetImage(TMXTilesetPage_t *aPage, int aOffset, int aWidth, int aHeight)
+{
+    size_t rowBytes = (size_t)aPage->width*4;
+    unsigned char *image = aPage->pixels + aOffset*rowBytes;
+    if(aWidth < aPage->width) {
+        for(int y = 0; y < aHeight; ++y)
+            memcpy(image + y*rowBytes + aWidth*4, image + y*rowBytes + (aWidth - 1)*4, 4);
+    }
+    if(aOffset > 0)
+        memcpy(image - rowBytes, image, rowBytes);
+    if(aOffset + aHeight < aPage->height)
+        memcpy(image + aHeight*rowBytes, image + (aHeight - 1)*rowBytes, rowBytes);
+}
+
+// Stacks the images of the flagged tilesets on top of each other in as few pages as fit within aMaxSize, storing the page &
+// vertical offset of each tileset in aoPages & aoOffsets, then decodes the pages holding more than one (Or every page if
+// aDecodeEveryPage is set). Returns the pages (NULL if an image could not be read), whose pixels must be freed.
+static TMXTilesetPage_t *_tmx_decodeTilesetPages(TMXMap_t *aMap, bool *aUsedTilesets, int aMaxSize, bool aDecodeEveryPage,
+                                                 int *aoPages, int *aoOffsets, int *aoNumberOfPages)
+{
+    char texPath[512];
+    // Read the headers first so that every image can be decoded straight into its place in its page
+    PngDecoder_t *decoders = calloc(aMap->numberOfTilesets, sizeof(PngDecoder_t));
+    TMXTilesetPage_t *pages = calloc(MAX(1, aMap->numberOfTilesets), sizeof(TMXTilesetPage_t));
+    int numberOfPages = 0;
+    bool succeeded = true;
+    for(int i = 0; i < aMap->numberOfTilesets && succeeded; ++i) {
+        if(!aUsedTilesets[i])
+            continue;
+        util_pathForResource(aMap->tilesets[i].imagePath, NULL, NULL, texPath, 512);
+        succeeded = png_openDecoder(&decoders[i], texPath, true);
+        if(!succeeded) {
+            dynamo_log("Unable to load tileset image %s", texPath);
+            break;
+        }
+        int width = decoders[i].width, height = decoders[i].height;
+        if(width > aMaxSize || height > aMaxSize)
+            dynamo_log("Warning: tileset image %s is %dx%d, larger than the maximum supported texture size (%d)",
+                       texPath, width, height, aMaxSize);
+
+        // Start a new page when the tileset does not fit above the ones already placed
+        TMXTilesetPage_t *page = numberOfPages > 0 ? &pages[numberOfPages - 1] : NULL;
+        if(!page || page->height + kTMXTilesetPagePadding + height > aMaxSize)
+            page = &pages[numberOfPages++];
+        aoPages[i] = page - pages;
+        aoOffsets[i] = page->numberOfTilesets > 0 ? page->height + kTMXTilesetPagePadding : 0;
+        page->width = MAX(page->width, width);
+        page->height = aoOffsets[i] + height;
+        page->tileset = i;
+        ++page->numberOfTilesets;
+    }
+
+    // Both the images and the pages are stored bottom row first
+    for(int i = 0; i < numberOfPages && succeeded; ++i) {
+        if(pages[i].numberOfTilesets > 1 || aDecodeEveryPage)
+            pages[i].pixels = calloc((size_t)pages[i].width*pages[i].height, 4);
+    }
+    for(int i = 0; i < aMap->numberOfTilesets; ++i) {
+        if(!aUsedTilesets[i] || !decoders[i].reader)
+            continue;
+        TMXTilesetPage_t *page = &pages[aoPages[i]];
+        if(succeeded && page->pixels) {
+            if(png_decodeInto(&decoders[i], page->pixels + (size_t)aoOffsets[i]*page->width*4, (size_t)page->width*4, true))
+                _tmx_extrudeTilesetImage(page, aoOffsets[i], decoders[i].width, decoders[i].height);
+            else {
+                dynamo_log("Unable to decode tileset image %s", aMap->tilesets[i].imagePath);
+                succeeded = false;
+            }
+        }
+        png_closeDecoder(&decoders[i]);
+    }
+    free(decoders);
+
+    if(!succeeded) {
+        for(int i = 0; i < numberOfPages; ++i)
+            free(pages[i].pixels);
+        free(pages);
+        return NULL;
+    }
+    *aoNumberOfPages = numberOfPages;
+    return pages;
+}
+
+// Creates the texture of a page & frees its pixels. An undecoded page (Holding a single tileset) is loaded through the texture cache
+static Texture_t *_tmx_createTilesetPageTexture(TMXMap_t *aMap, TMXTilesetPage_t *aPage)
+{
+    if(!aPage->pixels) {
+        char texPath[512];
+        util_pathForResource(aMap->tilesets[aPage->tileset].imagePath, NULL, NULL, texPath, 512);
+        return texCache_loadPng(texPath, false, false);
+    }
+    Texture_t *texture = texture_createFromData(aPage->pixels, aPage->width, aPage->height, true, false, false);
+    free(aPage->pixels);
+    aPage->pixels = NULL;
+    return texture;
+}
+
+// The CPU side data of a prepared layer, waiting for tmx_layerUploadStep
+struct _TMXLayerUpload {
+    TMXTilesetPage_t *pages;
+    int numberOfUploadedPages;
+    int nextChunk;
+    // Per chunk, NULL for empty chunks
+    struct _TMXChunkVertex **vertices;
+    GLushort **indices;
+    bool *animated;
+};
+
+static void _tmx_freeLayerUpload(TMXLayerRenderable_t *aRenderable)
+{
+    struct _TMXLayerUpload *upload = aRenderable->pendingUpload;
+    for(int i = 0; i < aRenderable->numberOfPages; ++i)
+        free(upload->pages[i].pixels);
+    free(upload->pages);
+    for(int i = 0; i < aRenderable->chunksWide*aRenderable->chunksHigh; ++i) {
+        free(upload->vertices[i]);
+        free(upload->indices[i]);
+    }
+    free(upload->vertices);
+    free(upload->indices);
+    free(upload->animated);
+    free(upload);
+    aRenderable->pendingUpload = NULL;
+}
+
+static TMXLayerRenderable_t *_tmx_prepareRenderable(TMXMap_t *aMap, unsigned int aLayerIdx, int aMaxTextureSize, bool aDecodeEveryPage)
 {
     dynamo_assert(aMap != NULL, "Invalid map");
     dynamo_assert(aLayerIdx < aMap->numberOfLayers, "Invalid layer index");
     obj_retain(aMap);
 
-    TMXLayerRenderable_t *out = obj_create_autoreleased(&Class_TMXLayerRenderable);
+    TMXLayerRenderable_t *out = obj_create(&Class_TMXLayerRenderable);
     out->map = aMap;
     out->layer = &aMap->layers[aLayerIdx];
     out->displayCallback = (RenderableDisplayCallback_t)&tmx_drawLayerRenderable;
+    out->luaDisplayCallback = -1;
+
+    // Find the tilesets used by the layer
+    bool *usedTilesets = calloc(MAX(1, aMap->numberOfTilesets), sizeof(bool));
+    int usedCount = 0;
+    for(int i = 0; i < out->layer->numberOfTiles; ++i) {
+        TMXTileset_t *tileset = out->layer->tiles[i].tileset;
+        if(tileset && !usedTilesets[tileset - aMap->tilesets]) {
+            usedTilesets[tileset - aMap->tilesets] = true;
+            ++usedCount;
+        }
+    }
+    dynamo_assert(usedCount > 0, "No tileset found");
+
+    // Merge the tileset images into as few pages as possible, with each tileset at a vertical offset in its page
+    out->tilesetPages = malloc(MAX(1, aMap->numberOfTilesets)*sizeof(int));
+    out->tilesetOffsets = calloc(MAX(1, aMap->numberOfTilesets), sizeof(int));
+    out->maxTileSize = GLMVec2_zero;
+    for(int i = 0; i < aMap->numberOfTilesets; ++i) {
+        out->tilesetPages[i] = -1;
+        if(usedTilesets[i])
+            out->maxTileSize = vec2_create(MAX(out->maxTileSize.w, aMap->tilesets[i].tileWidth), MAX(out->maxTileSize.h, aMap->tilesets[i].tileHeight));
+    }
+    TMXTilesetPage_t *pages = _tmx_decodeTilesetPages(aMap, usedTilesets, aMaxTextureSize, aDecodeEveryPage,
+                                                      out->tilesetPages, out->tilesetOffsets, &out->numberOfPages);
+    free(usedTilesets);
+    if(!pages) {
+        dynamo_log("Couldn't load the tilesets of layer %s", out->layer->name);
+        obj_release(out);
+        return NULL;
+    }
+    out->pages = calloc(out->numberOfPages, sizeof(Texture_t *));
+    out->pageSizes = malloc(out->numberOfPages*sizeof(vec2_t));
+    for(int i = 0; i < out->numberOfPages; ++i)
+        out->pageSizes[i] = vec2_create(pages[i].width, pages[i].height);
+
+    // Collect the animated tiles so that the rest of the layer is never touched while animating
+    for(int y = 0; y < aMap->height; ++y) {
+        for(int x = 0; x < aMap->width; ++x) {
+            TMXTile_t *tile = _tmx_layerTileAt(out, x, y);
+            TMXTileAnimation_t *animation = tile->tileset ? _tmx_tilesetGetAnimation(tile->tileset, tile->id) : NULL;
+            if(animation)
+                _tmx_addAnimatedTile(out, x, y, animation);
+        }
+    }
 
-    // Find the first used tile and use its tileset
-    TMXTileset_t *tileset = NULL;
-    for(int i = 0; i < out->layer->numberOfTiles && tileset == NULL; ++i) {
-        tileset = out->layer->tiles[i].tileset;
+    // Generate the chunk meshes
+    out->chunksWide = (out->map->width  + kTMXChunkSize - 1) / kTMXChunkSize;
+    out->chunksHigh = (out->map->height + kTMXChunkSize - 1) / kTMXChunkSize;
+    int chunkCount = out->chunksWide*out->chunksHigh;
+    out->chunks = calloc(chunkCount, sizeof(TMXLayerChunk_t));
+    struct _TMXLayerUpload *upload = calloc(1, sizeof(struct _TMXLayerUpload));
+    upload->pages = pages;
+    upload->vertices = calloc(MAX(1, chunkCount), sizeof(struct _TMXChunkVertex *));
+    upload->indices = calloc(MAX(1, chunkCount), sizeof(GLushort *));
+    upload->animated = calloc(MAX(1, chunkCount), sizeof(bool));
+    for(int i = 0; i < chunkCount; ++i) {
+        int firstX = (i % out->chunksWide)*kTMXChunkSize, firstY = (i / out->chunksWide)*kTMXChunkSize;
+        upload->vertices[i] = _tmx_chunkVertices(out, &out->chunks[i], firstX, firstY, &upload->animated[i]);
+        if(upload->vertices[i])
+            upload->indices[i] = _tmx_chunkIndices(out, &out->chunks[i], firstX, firstY);
     }
-    dynamo_assert(tileset != NULL, "No tileset found");
+    out->pendingUpload = upload;
 
-    // Open a texture atlas for the tileset
-    vec2_t tileSize = vec2_create(out->map->tileWidth, out->map->tileHeight);
-    char texPath[512];
-    util_pathForResource(tileset->imagePath, NULL, NULL, texPath, 512);
-
-    Texture_t *tex = texture_loadFromPng((const char*)texPath, false, false);
-    dynamo_assert(tex != NULL, "Couldn't load layer texture");
-    TextureAtlas_t *atlas = texAtlas_create(tex, vec2_create(tileset->margin, tileset->margin), tileSize);
-    atlas->margin = vec2_create(tileset->spacing, tileset->spacing);
-    dynamo_assert(atlas != NULL, "Could not load layer texture atlas");
-    out->atlas = obj_retain(atlas);
-
-    // Generate & store the tile mesh
-    vec2_t *texOffsets = malloc(sizeof(vec2_t)*out->layer->numberOfTiles);
-    vec2_t *screenCoords = malloc(sizeof(vec2_t)*out->layer->numberOfTiles);
-    for(int y = 0; y < out->map->height; ++y) {
-        for(int x = 0; x < out->map->width; ++x) {
-            int idx = (out->map->height - y - 1) * out->map->width + x;
-            TMXTile_t *tile = &out->layer->tiles[idx];
-            texOffsets[idx] = tmx_tileset_texCoordFromId(tileset, tile->id);
-            screenCoords[idx].x = (out->map->tileWidth * (float)x) + out->map->tileWidth / 2.0f;
-            screenCoords[idx].y = (out->map->tileHeight * (float)y) + out->map->tileWidth / 2.0f;
-        }
-    }
-
-    int numberOfVertices;
-    int numberOfIndices;
-    vec2_t *vertices;
-    vec2_t *texCoords;
-    GLuint *indices;
-    draw_textureAtlas_getVertices(atlas, out->layer->numberOfTiles, texOffsets, screenCoords,
-                                  &vertices, &texCoords, &numberOfVertices, &indices, &numberOfIndices);
-    free(texOffsets);
-    free(screenCoords);
-
-    glGenBuffers(1, &out->posVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, out->posVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vec2_t)*numberOfVertices, vertices, GL_STATIC_DRAW);
-
-    glGenBuffers(1, &out->texCoordVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, out->texCoordVBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vec2_t)*numberOfVertices, texCoords, GL_STATIC_DRAW);
-
-    out->indexCount = numberOfIndices;
-    glGenBuffers(1, &out->indexVBO);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, out->indexVBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(GLuint)*numberOfIndices, indices, GL_STATIC_DRAW);
+    return out;
+}
 
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+TMXLayerRenderable_t *tmx_prepareRenderableForLayer(TMXMap_t *aMap, unsigned int aLayerIdx, int aMaxTextureSize)
+{
+    return _tmx_prepareRenderable(aMap, aLayerIdx, aMaxTextureSize, true);
+}
 
-    free(vertices);
-    free(texCoords);
-    free(indices);
+bool tmx_layerUploadStep(TMXLayerRenderable_t *aLayer)
+{
+    struct _TMXLayerUpload *upload = aLayer->pendingUpload;
+    if(!upload)
+        return true;
+
+    // The pages first, then each chunk that has tiles
+    int chunkCount = aLayer->chunksWide*aLayer->chunksHigh;
+    if(upload->numberOfUploadedPages < aLayer->numberOfPages) {
+        int i = upload->numberOfUploadedPages++;
+        Texture_t *texture = _tmx_createTilesetPageTexture(aLayer->map, &upload->pages[i]);
+        // The tiles on a missing page are left undrawn
+        if(texture)
+            aLayer->pages[i] = obj_retain(texture);
+        else
+            dynamo_log("Couldn't create texture page %d of layer %s", i, aLayer->layer->name);
+    } else if(upload->nextChunk < chunkCount) {
+        int i = upload->nextChunk++;
+        if(upload->vertices[i])
+            _tmx_uploadChunk(&aLayer->chunks[i], upload->vertices[i], upload->indices[i], upload->animated[i]);
+        free(upload->vertices[i]);
+        free(upload->indices[i]);
+        upload->vertices[i] = NULL;
+        upload->indices[i] = NULL;
+    }
+    // Skip the empty chunks so that the layer is complete as soon as its last buffers are created
+    while(upload->nextChunk < chunkCount && !upload->vertices[upload->nextChunk])
+        ++upload->nextChunk;
+    if(upload->numberOfUploadedPages < aLayer->numberOfPages || upload->nextChunk < chunkCount)
+        return false;
+    _tmx_freeLayerUpload(aLayer);
+    return true;
+}
 
-    return out;
+TMXLayerRenderable_t *tmx_createRenderableForLayer(TMXMap_t *aMap, unsigned int aLayerIdx)
+{
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    // Pages holding a single tileset are left undecoded, to be loaded through the texture cache & shared with other layers
+    TMXLayerRenderable_t *out = _tmx_prepareRenderable(aMap, aLayerIdx, maxSize, false);
+    if(!out)
+        return NULL;
+    while(!tmx_layerUploadStep(out));
+    return obj_autorelease(out);
+}
+
+bool tmx_layerSetTile(TMXLayerRenderable_t *aLayer, int aX, int aY, unsigned int aTileGID)
+{
+    TMXMap_t *map = aLayer->map;
+    if(aX < 0 || aY < 0 || aX >= map->width || aY >= map->height)
+        return false;
+    TMXTile_t tile = _tmx_mapCreateTileForTileGID(map, (int)aTileGID);
+    dynamo_assert(!aLayer->pendingUpload, "The layer has not been uploaded yet");
+    if(tile.tileset && aLayer->tilesetPages[tile.tileset - map->tilesets] < 0) {
+        dynamo_log("Tileset %s is not used by the layer", tile.tileset->imagePath);
+        return false;
+    }
+
+    int y = map->height - aY - 1; // Chunks are laid out with Y growing upwards
+    TMXTile_t *cell = _tmx_layerTileAt(aLayer, aX, y);
+    TMXLayerChunk_t *chunk = _tmx_chunkForCell(aLayer, aX, y);
+    int previousPage = cell->tileset ? _tmx_tilePage(aLayer, cell) : -1;
+    int page = tile.tileset ? _tmx_tilePage(aLayer, &tile) : -1;
+    chunk->tileCount += (tile.tileset != NULL) - (cell->tileset != NULL);
+    TMXLayerCollision_t *collision = aLayer->layer->collision;
+    bool solidityChanged = collision && _tmx_tileIsSolid(collision, cell) != _tmx_tileIsSolid(collision, &tile);
+    *cell = tile;
+    if(solidityChanged)
+        _tmx_rebuildCollisionShapesAt(map, aLayer->layer, aX, y);
+
+    _tmx_removeAnimatedTile(aLayer, aX, y);
+    TMXTileAnimation_t *animation = tile.tileset ? _tmx_tilesetGetAnimation(tile.tileset, tile.id) : NULL;
+    if(animation)
+        _tmx_addAnimatedTile(aLayer, aX, y, animation); // Its frame is uploaded when the layer is next drawn
+
+    int firstX = (aX / kTMXChunkSize)*kTMXChunkSize, firstY = (y / kTMXChunkSize)*kTMXChunkSize;
+    if(!chunk->vbo) {
+        if(chunk->tileCount > 0)
+            _tmx_buildLayerChunk(aLayer, chunk, firstX, firstY);
+        return true;
+    }
+    _tmx_updateCell(aLayer, aX, y, tile.id);
+    // Only non empty cells are indexed, grouped by page
+    if(page != previousPage)
+        _tmx_buildChunkIndices(aLayer, chunk, firstX, firstY);
+    return true;
+}
+
+#pragma mark - Collision geometry
+
+static bool _tmx_tileIsSolid(TMXLayerCollision_t *aCollision, TMXTile_t *aTile)
+{
+    if(!aTile->tileset)
+        return false;
+    if(!aCollision->solidGids)
+        return true;
+    unsigned gid = aTile->tileset->firstTileGid + aTile->id;
+    for(int i = 0; i < aCollision->numberOfSolidGids; ++i) {
+        if((aCollision->solidGids[i] & ~kTMXTileFlipFlags) == gid)
+            return true;
+    }
+    return false;
+}
+
+static void _tmx_removeCollisionShapes(TMXLayerCollision_t *aCollision)
+{
+    for(int i = 0; i < aCollision->numberOfShapes; ++i) {
+        worldEnt_removeShape(aCollision->world->staticEntity, aCollision->shapes[i]);
+        obj_release(aCollision->shapes[i]);
+    }
+    free(aCollision->shapes);
+    free(aCollision->shapeRects);
+    aCollision->shapes = NULL;
+    aCollision->shapeRects = NULL;
+    aCollision->numberOfShapes = 0;
+    aCollision->shapeCapacity = 0;
+}
+
+// Covers the cells set in a grid of aWidth*aHeight cells starting at aOriginX,aOriginY with shapes (Y growing upwards).
+// Each uncovered cell is greedily grown into the widest run, then into as many rows as the run fits. Cells are cleared
+// as they get covered
+static void _tmx_coverCells(TMXMap_t *aMap, TMXLayerCollision_t *aCollision, unsigned char *aCells,
+                            int aOriginX, int aOriginY, int aWidth, int aHeight)
+{
+    for(int y = 0; y < aHeight; ++y) {
+        for(int x = 0; x < aWidth; ++x) {
+            if(!aCells[y*aWidth + x])
+                continue;
+            int runWidth = 1;
+            while(x + runWidth < aWidth && aCells[y*aWidth + x + runWidth])
+                ++runWidth;
+            int runHeight = 1;
+            bool canGrow = true;
+            while(canGrow && y + runHeight < aHeight) {
+                for(int i = 0; i < runWidth && canGrow; ++i)
+                    canGrow = aCells[(y + runHeight)*aWidth + x + i];
+                if(canGrow)
+                    ++runHeight;
+            }
+            for(int j = 0; j < runHeight; ++j)
+                memset(&aCells[(y + j)*aWidth + x], 0, runWidth);
+
+            TMXCollisionRect_t rect = { aOriginX + x, aOriginY + y, runWidth, runHeight };
+            float minX = rect.x*aMap->tileWidth, maxX = (rect.x + rect.width)*aMap->tileWidth;
+            float minY = rect.y*aMap->tileHeight, maxY = (rect.y + rect.height)*aMap->tileHeight;
+            vec2_t verts[4] = {
+                { minX, minY }, { maxX, minY }, { maxX, maxY }, { minX, maxY }
+            };
+            if(aCollision->numberOfShapes == aCollision->shapeCapacity) {
+                aCollision->shapeCapacity = MAX(16, aCollision->shapeCapacity*2);
+                aCollision->shapes = realloc(aCollision->shapes, aCollision->shapeCapacity*sizeof(WorldShape_t *));
+                aCollision->shapeRects = realloc(aCollision->shapeRects, aCollision->shapeCapacity*sizeof(TMXCollisionRect_t));
+            }
+            WorldShape_t *shape = worldEnt_addShape(aCollision->world->staticEntity, worldShape_createPoly(4, verts));
+            aCollision->shapeRects[aCollision->numberOfShapes] = rect;
+            aCollision->shapes[aCollision->numberOfShapes++] = obj_retain(shape);
+        }
+    }
+}
+
+static void _tmx_buildCollisionShapes(TMXMap_t *aMap, TMXLayer_t *aLayer)
+{
+    int width = aMap->width, height = aMap->height;
+    unsigned char *solid = calloc(MAX(1, width*height), 1);
+    for(int y = 0; y < height; ++y) {
+        for(int x = 0; x < width; ++x)
+            solid[y*width + x] = _tmx_tileIsSolid(aLayer->collision, &aLayer->tiles[(height - y - 1)*width + x]);
+    }
+    _tmx_coverCells(aMap, aLayer->collision, solid, 0, 0, width, height);
+    free(solid);
+}
+
+// Replaces the shapes crossing the row or column of a cell whose solidity changed (Y growing upwards) so that the cell
+// merges with its neighbours. The cells of the removed shapes & the changed cell are then the only solid cells left
+// uncovered, so the rest of the shapes are kept as they are
+static void _tmx_rebuildCollisionShapesAt(TMXMap_t *aMap, TMXLayer_t *aLayer, int aX, int aY)
+{
+    TMXLayerCollision_t *collision = aLayer->collision;
+    int minX = aX, minY = aY, maxX = aX + 1, maxY = aY + 1;
+    for(int i = 0; i < collision->numberOfShapes; ++i) {
+        TMXCollisionRect_t *rect = &collision->shapeRects[i];
+        if((aX >= rect->x && aX < rect->x + rect->width) || (aY >= rect->y && aY < rect->y + rect->height)) {
+            minX = MIN(minX, rect->x);
+            minY = MIN(minY, rect->y);
+            maxX = MAX(maxX, rect->x + rect->width);
+            maxY = MAX(maxY, rect->y + rect->height);
+        }
+    }
+
+    int width = maxX - minX, height = maxY - minY;
+    unsigned char *uncovered = calloc(width*height, 1);
+    uncovered[(aY - minY)*width + aX - minX] = 1;
+    int kept = 0;
+    for(int i = 0; i < collision->numberOfShapes; ++i) {
+        TMXCollisionRect_t rect = collision->shapeRects[i];
+        if((aX >= rect.x && aX < rect.x + rect.width) || (aY >= rect.y && aY < rect.y + rect.height)) {
+            for(int y = rect.y; y < rect.y + rect.height; ++y)
+                memset(&uncovered[(y - minY)*width + rect.x - minX], 1, rect.width);
+            worldEnt_removeShape(collision->world->staticEntity, collision->shapes[i]);
+            obj_release(collision->shapes[i]);
+        } else {
+            collision->shapes[kept] = collision->shapes[i];
+            collision->shapeRects[kept++] = rect;
+        }
+    }
+    collision->numberOfShapes = kept;
+
+    // Leaves out the changed cell if it was cleared
+    for(int y = minY; y < maxY; ++y) {
+        for(int x = minX; x < maxX; ++x) {
+            unsigned char *cell = &uncovered[(y - minY)*width + x - minX];
+            *cell = *cell && _tmx_tileIsSolid(collision, &aLayer->tiles[(aMap->height - y - 1)*aMap->width + x]);
+        }
+    }
+    _tmx_coverCells(aMap, collision, uncovered, minX, minY, width, height);
+    free(uncovered);
+}
+
+int tmx_createCollisionShapesForLayer(TMXMap_t *aMap, unsigned int aLayerIdx, World_t *aWorld, const unsigned int *aSolidGids, int aSolidGidCount)
+{
+    dynamo_assert(aMap != NULL, "Invalid map");
+    dynamo_assert(aLayerIdx < aMap->numberOfLayers, "Invalid layer index");
+    TMXLayer_t *layer = &aMap->layers[aLayerIdx];
+
+    // Replace the shapes created by a previous call
+    TMXLayerCollision_t *collision = layer->collision;
+    if(collision) {
+        _tmx_removeCollisionShapes(collision);
+        obj_release(collision->world);
+        free(collision->solidGids);
+    } else
+        collision = layer->collision = calloc(1, sizeof(TMXLayerCollision_t));
+
+    collision->world = obj_retain(aWorld);
+    collision->solidGids = NULL;
+    collision->numberOfSolidGids = 0;
+    if(aSolidGids) {
+        collision->solidGids = malloc(MAX(1, aSolidGidCount)*sizeof(unsigned int));
+        memcpy(collision->solidGids, aSolidGids, aSolidGidCount*sizeof(unsigned int));
+        collision->numberOfSolidGids = aSolidGidCount;
+    }
+    _tmx_buildCollisionShapes(aMap, layer);
+    return collision->numberOfShapes;
 }
@@ -5,7 +5,7 @@
 // Ignores the transparency color of images (We use the alpha channel)
 //
 // And probably some other parts. I only implemented what my project required.
-// IMPORTANT: Requires you to save your maps with the data layer as XML (Settable in the preference window)
+// Layer data can be stored as XML, CSV, base64 or base64 compressed using zlib or gzip.
 
 #ifndef _TMXMAP_H_
 #define _TMXMAP_H_
@@ -13,6 +13,8 @@
 #include "object.h"
 #include "renderer.h"
 #include "texture_atlas.h"
+#include "world.h"
+#include "util.h"
 #include <stdbool.h>
 
 typedef enum _TMXMap_orientation {
@@ -25,6 +27,18 @@ typedef struct _TMXProperty {
     char *value;
 } TMXProperty_t;
 
+typedef struct _TMXAnimationFrame {
+    int tileId; // Id of the tile within the tileset
+    int duration; // in milliseconds
+} TMXAnimationFrame_t;
+
+typedef struct _TMXTileAnimation {
+    int tileId; // The animated tile
+    int numberOfFrames;
+    TMXAnimationFrame_t *frames;
+    int totalDuration; // in milliseconds
+} TMXTileAnimation_t;
+
 typedef struct _TMXTileset {
     int firstTileGid;
     int imageWidth, imageHeight;
@@ -32,6 +46,8 @@ typedef struct _TMXTileset {
     int spacing;
     int margin;
     char *imagePath;
+    int numberOfAnimations;
+    TMXTileAnimation_t *animations; // Default NULL
 } TMXTileset_t;
 
 typedef struct _TMXTile {
@@ -39,8 +55,25 @@ typedef struct _TMXTile {
     int id;
     bool flippedVertically;
     bool flippedHorizontally;
+    bool flippedDiagonally; // Applied before the horizontal & vertical flips, as in Tiled
 } TMXTile_t;
 
+// The cells covered by a collision shape (Y growing upwards, as in the layer's chunks)
+typedef struct _TMXCollisionRect {
+    int x, y;
+    int width, height;
+} TMXCollisionRect_t;
+
+// The static shapes covering a layer's solid tiles, kept so that they can be rebuilt as tiles change
+typedef struct _TMXLayerCollision {
+    World_t *world;
+    unsigned int *solidGids; // NULL if every non empty tile is solid
+    int numberOfSolidGids;
+    int numberOfShapes, shapeCapacity;
+    WorldShape_t **shapes; // Attached to the world's static entity
+    TMXCollisionRect_t *shapeRects; // The cells covered by each shape
+} TMXLayerCollision_t;
+
 typedef struct _TMXLayer {
     char *name;
     float opacity;
@@ -49,6 +82,7 @@ typedef struct _TMXLayer {
     TMXTile_t *tiles;
     int numberOfProperties;
     TMXProperty_t *properties; // Default NULL
+    TMXLayerCollision_t *collision; // Default NULL, set by tmx_createCollisionShapesForLayer
 } TMXLayer_t;
 
 typedef struct _TMXObject {
@@ -84,21 +118,76 @@ typedef struct _TMXMap {
     TMXObjectGroup_t *objectGroups;
     int numberOfProperties;
     TMXProperty_t *properties;
+    int gidTableSize;
+    TMXTileset_t **gidTable; // Maps global tile ids to their tilesets
+    MappedFile_t mappedFile; // The file backing a map loaded from a binary map file (Empty otherwise)
 } TMXMap_t;
 
+// A fixed size block of a layer's tiles with its own vertex & index buffers
+// Every cell in the chunk has a quad (Degenerate for empty cells) so that tiles can be updated in place,
+// but only the non empty cells are indexed & drawn
+typedef struct _TMXLayerChunk {
+    GLuint vbo; // 0 if the chunk has never contained a tile
+    GLuint ibo; // 6 indices per non empty cell
+    GLuint vao; // 0 if vertex array objects are unsupported
+    int cellsWide, cellsHigh;
+    int tileCount; // Number of non empty cells
+    int *pageStarts; // The first cell indexed for each of the layer's pages, followed by tileCount
+} TMXLayerChunk_t;
+
+// A cell in a layer whose tile is animated
+typedef struct _TMXAnimatedTile {
+    int x, y; // Cell position (Y growing upwards)
+    TMXTileAnimation_t *animation;
+    int currentFrame; // -1 until the tile has been updated for the first time
+} TMXAnimatedTile_t;
+
 extern Class_t Class_TMXLayerRenderable;
-// A renderable that manages a vbo for drawing a layer
+// A renderable that manages the vbos for drawing a layer
+// Only the chunks intersecting the viewport are drawn
 typedef struct _TMXLayerRenderable {
     OBJ_GUTS
     RENDERABLE_GUTS
     TMXLayer_t *layer;
     TMXMap_t *map; // Reference required so that we can retain it
-    TextureAtlas_t *atlas;
-    GLuint posVBO, texCoordVBO, indexVBO;
-    int indexCount;
+    int numberOfPages;
+    Texture_t **pages; // The images of the tilesets used by the layer, merged into as few textures as fit (Usually one)
+    vec2_t *pageSizes; // Known before the pages' textures are created, so that the meshes can be built without them
+    int *tilesetPages; // The page holding each map tileset's image (Indexed like map->tilesets), -1 for tilesets the layer does not use
+    int *tilesetOffsets; // The vertical offset of each used tileset's image within its page, in pixels
+    struct _TMXLayerUpload *pendingUpload; // The data still to be uploaded by tmx_layerUploadStep, NULL once the layer is drawable
+    vec2_t maxTileSize; // The largest tile size among the layer's tilesets
+    int chunksWide, chunksHigh;
+    TMXLayerChunk_t *chunks; // Row major, starting at the bottom left of the map
+    GLMFloat animationTime; // The layer's animation clock, advanced as the layer is drawn
+    int numberOfAnimatedTiles, animatedTileCapacity;
+    TMXAnimatedTile_t *animatedTiles;
 } TMXLayerRenderable_t;
 
+// Collision geometry
+// Adds static box shapes covering the solid tiles of a layer to the world's static entity.
+// Adjacent solid tiles are merged into rectangles, which keeps the number of shapes & the spatial index small and
+// removes the edges within each rectangle. Edges remain where two rectangles meet, so bodies sliding across such a join
+// can still catch on it.
+// aSolidGids lists the global tile ids that are solid (Flip flags are ignored); if NULL every non empty tile is solid.
+// Shapes are placed in layer space (Origin at the bottom left of the map). Returns the number of shapes created.
+// The shapes are kept in layer->collision: calling this again replaces them, tmx_layerSetTile rebuilds those around a
+// cell whose solidity changes, and they are removed from the world when the map is destroyed.
+// If the world is stepped on a simulation thread, the simulation must be locked around these calls (See gameTimer_lockSimulation)
+extern int tmx_createCollisionShapesForLayer(TMXMap_t *aMap, unsigned int aLayerIdx, World_t *aWorld, const unsigned int *aSolidGids, int aSolidGidCount);
+
+// Loads either a .tmx file or a map baked by tmx_writeBinaryMapFile (Detected from the file contents), NULL if it can't be read
 extern TMXMap_t *tmx_readMapFile(const char *aFilename);
+// Like tmx_readMapFile but returns a retained map without touching the autorelease pool,
+// making it safe to call from threads other than the main one (The caller must release the map)
+extern TMXMap_t *tmx_loadMapFile(const char *aFilename);
+
+// Binary maps
+// A versioned, preresolved form of a map that is loaded by mapping the file into memory.
+// Produced at build time using the tmxbake tool (Tools/tmxbake.c)
+extern const char *kTMXBinaryMagic;
+extern bool tmx_writeBinaryMapFile(TMXMap_t *aMap, const char *aFilename);
+extern TMXMap_t *tmx_readBinaryMapFile(const char *aFilename);
 
 // Lookup helpers
 extern const char *tmx_mapGetPropertyNamed(TMXMap_t *aMap, const char *aPropertyName);
@@ -106,6 +195,20 @@ extern TMXLayer_t *tmx_mapGetLayerNamed(TMXMap_t *aMap, const char *aLayerName);
 extern TMXObjectGroup_t *tmx_mapGetObjectGroupNamed(TMXMap_t *aMap, const char *aGroupName);
 extern TMXObject_t *tmx_objGroupGetObjectNamed(TMXObjectGroup_t *aGroup, const char *aObjName);
 
-// Note: only supports one tileset per layer, uses the tileset set for the first tile which has one.
+// Layers may use any number of tilesets; their images are merged into a single texture at load time
+// so that every visible chunk is still drawn in a single call. Tilesets that do not fit within the maximum texture size
+// are split over several textures (pages), drawn in a pass each. Returns NULL if the tileset images can't be loaded.
 extern TMXLayerRenderable_t *tmx_createRenderableForLayer(TMXMap_t *aMap, unsigned int aLayerIdx);
+// Creates the renderable in two steps so that only the GL calls are made on the GL thread:
+// tmx_prepareRenderableForLayer decodes the tileset images into their pages & builds the chunk meshes without calling GL.
+// It can be called from any thread (aMaxTextureSize being the GL_MAX_TEXTURE_SIZE queried beforehand), and returns a
+// retained renderable without touching the autorelease pool, or NULL if the tileset images can't be decoded.
+// tmx_layerUploadStep then creates a single page texture or chunk's buffers per call on the GL thread, returning true once
+// the layer is complete. The layer must not be drawn or edited before that.
+extern TMXLayerRenderable_t *tmx_prepareRenderableForLayer(TMXMap_t *aMap, unsigned int aLayerIdx, int aMaxTextureSize);
+extern bool tmx_layerUploadStep(TMXLayerRenderable_t *aLayer);
+// Replaces the tile at aX,aY (In tiles, from the top left like in Tiled) of the layer with the given global tile id (0 clears it).
+// Only the tile's quad is uploaded, along with the chunk's indices if the cell is filled or cleared. Returns false if the position is invalid or the tile's tileset is not used by the layer.
+// When the cell becomes solid or stops being so, the layer's collision shapes crossing its row or column, if any, are rebuilt.
+extern bool tmx_layerSetTile(TMXLayerRenderable_t *aLayer, int aX, int aY, unsigned int aTileGID);
 #endif
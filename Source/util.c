@@ -1,6 +1,14 @@
 #include "util.h"
+#include "vfs.h"
 #include <sys/stat.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <unistd.h>
+#if !defined(WIN32)
+    #include <sys/mman.h>
+#endif
 #if defined(__APPLE__)
     #include <CoreFoundation/CoreFoundation.h>
 #endif
@@ -28,6 +36,7 @@ bool util_pathForResource(const char *name, const char *ext, const char *dir, ch
         CFRelease(resUrl);
         APPEND("/")
     #endif
+    size_t rootLength = strlen(output);
     APPEND(dir)
     if(dir && dir[strlen(dir)-1] != '/')
         APPEND("/")
@@ -38,7 +47,16 @@ bool util_pathForResource(const char *name, const char *ext, const char *dir, ch
     }
     
     struct stat unused;
-    return stat(output, &unused) == 0;
+    if(stat(output, &unused) == 0)
+        return true;
+
+    // Fall back on the mounted archives, which are laid out like the resource directory
+    const char *relativePath = output + rootLength;
+    if(!vfs_contains(relativePath) || strlen(kVFSPathPrefix) + strlen(relativePath) >= (size_t)maxLen)
+        return false;
+    memmove(output + strlen(kVFSPathPrefix), relativePath, strlen(relativePath) + 1);
+    memcpy(output, kVFSPathPrefix, strlen(kVFSPathPrefix));
+    return true;
     #undef APPEND
 }
 
@@ -52,24 +70,120 @@ void _dynamo_log(const char *str)
     dynamo_log_min("%s", str);
 }
 
-// TODO: Add graceful error handling (Was failing with a mysterious sigsegv on missing files on android)
 void util_readFile(const char *aFilePath, size_t *aoLength, char **aoOutput)
 {
     dynamo_assert(aoOutput != NULL, "Output buffer required");
-    
-    FILE *fd = fopen(aFilePath, "r");
-    if(!fd) {
-        if(aoLength) *aoLength = 0;
+
+    MappedFile_t file;
+    bool found = util_mapFile(aFilePath, kMappedFileAccess_sequential, &file);
+    if(aoLength)
+        *aoLength = found ? file.length : 0;
+    if(!found)
         return;
+    if(file.length > 0) {
+        // Files that had to be read into a buffer are handed over as they are
+        if(file._buffer || file._archiveBuffer) {
+            *aoOutput = file._buffer ? file._buffer : file._archiveBuffer;
+            file._buffer = file._archiveBuffer = NULL;
+        } else {
+            *aoOutput = malloc(file.length + 1);
+            memcpy(*aoOutput, file.data, file.length + 1); // Including the NUL terminator
+        }
     }
-    
-    fseek(fd, 0, SEEK_END);
-    size_t len = ftell(fd);
-    if(aoLength)
-        *aoLength = len;
-    if(len <= 0) return;
-    rewind(fd);
-    
-    *aoOutput = calloc(len+1, sizeof(char));
-    fread(*aoOutput, sizeof(char), len, fd);
+    util_unmapFile(&file);
+}
+
+#pragma mark - Mapped files
+
+static void _util_advise(const void *aData, size_t aLength, MappedFileAccess_t aAccess)
+{
+#if !defined(WIN32)
+    static const int advice[] = { MADV_NORMAL, MADV_SEQUENTIAL, MADV_RANDOM, MADV_WILLNEED };
+    // Advice applies to whole pages
+    uintptr_t pageSize = sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)aData & ~(pageSize - 1);
+    uintptr_t end = (uintptr_t)aData + aLength;
+    madvise((void *)start, end - start, advice[aAccess]);
+#endif
+}
+
+// Reads a file into a NUL terminated buffer, for files that can not be mapped
+static bool _util_readIntoBuffer(int aFd, size_t aLength, MappedFile_t *aoFile)
+{
+    char *buffer = malloc(aLength + 1);
+    if(!buffer)
+        return false;
+    for(size_t offset = 0; offset < aLength;) {
+        ssize_t count = read(aFd, buffer + offset, aLength - offset);
+        if(count < 0 && errno == EINTR)
+            continue;
+        if(count <= 0) {
+            free(buffer);
+            return false;
+        }
+        offset += count;
+    }
+    buffer[aLength] = '\0';
+    aoFile->data = buffer;
+    aoFile->length = aLength;
+    aoFile->_buffer = buffer;
+    return true;
+}
+
+bool util_mapFile(const char *aPath, MappedFileAccess_t aAccess, MappedFile_t *aoFile)
+{
+    memset(aoFile, 0, sizeof(MappedFile_t));
+    if(vfs_isVirtualPath(aPath)) {
+        VFSData_t data;
+        if(!vfs_read(aPath, &data))
+            return false;
+        aoFile->data = data.data;
+        aoFile->length = data.size;
+        aoFile->_archiveBuffer = data._buffer;
+        // Uncompressed entries are views into the archive's mapping
+        if(!data._buffer && data.size > 0)
+            _util_advise(data.data, data.size, aAccess);
+        return true;
+    }
+
+    int fd = open(aPath, O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) != 0 || !S_ISREG(fileStat.st_mode)) {
+        close(fd);
+        return false;
+    }
+    size_t length = fileStat.st_size;
+    bool succeeded = false;
+#if !defined(WIN32)
+    // The NUL terminator comes from the zero filled remainder of the last page,
+    // so files that end right on a page boundary (And empty ones) are read into a buffer instead
+    if(length > 0 && length % sysconf(_SC_PAGESIZE) != 0) {
+        void *mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(mapping != MAP_FAILED) {
+            _util_advise(mapping, length, aAccess);
+            aoFile->data = mapping;
+            aoFile->length = length;
+            aoFile->_mapping = mapping;
+            aoFile->_mappingLength = length;
+            succeeded = true;
+        }
+    }
+#endif
+    if(!succeeded)
+        succeeded = _util_readIntoBuffer(fd, length, aoFile);
+    close(fd);
+    return succeeded;
+}
+
+void util_unmapFile(MappedFile_t *aFile)
+{
+#if !defined(WIN32)
+    if(aFile->_mapping)
+        munmap(aFile->_mapping, aFile->_mappingLength);
+#endif
+    free(aFile->_buffer);
+    free(aFile->_archiveBuffer);
+    memset(aFile, 0, sizeof(MappedFile_t));
 }
@@ -18,6 +18,7 @@ typedef void (*RemovalCallback_t)(void *aVal);
 
 /*!
     Returns the filesystem path for a given resource.
+    If the resource is not on disk but is contained in a mounted archive, its virtual path is returned instead. (See vfs.h)
 
     @field name The file name of the resource
     @field ext The file extension of the resource
@@ -117,9 +118,49 @@ extern Platform_t util_platform(void);
 extern void _dynamo_log(const char *str);
 
 /*!
-    Reads a file into the passed buffer.
+    Reads a file into the passed buffer. (Either a filesystem or a virtual path)
     You are responsible for freeing the output.
 */
 void util_readFile(const char *aFilePath, size_t *aoLength, char **aoOutput);
 
+#pragma mark - Mapped files
+
+/*!
+    How a mapped file is going to be read, passed on to the kernel so it can schedule reads accordingly.
+*/
+typedef enum {
+    kMappedFileAccess_normal,
+    kMappedFileAccess_sequential, // Read once, front to back (e.g. parsing text); pages are read ahead aggressively
+    kMappedFileAccess_random, // Read in no particular order; no read ahead
+    kMappedFileAccess_prefetch // The whole file is going to be needed soon; starts reading it in right away
+} MappedFileAccess_t;
+
+/*!
+    A read only view of a file's contents.
+
+    @field data The contents of the file, followed by a NUL byte so that text can be parsed in place
+    @field length The length of the file (Excluding the NUL byte)
+*/
+typedef struct _MappedFile {
+    const void *data;
+    size_t length;
+    void *_mapping; // The mmap backing the view (NULL if the file was read into memory)
+    size_t _mappingLength;
+    void *_buffer; // The buffer the file was read into, when it could not be mapped
+    void *_archiveBuffer; // The decompressed copy of a compressed archive entry
+} MappedFile_t;
+
+/*!
+    Maps a file (Either a filesystem or a virtual path) into memory without copying it.
+    Files inside archives are viewed in place (Or decompressed if they are compressed), & files that can not be mapped are read
+    into a buffer instead, so the view is the same regardless of where the file comes from.
+    Returns false if the file could not be read. The view must be released using util_unmapFile.
+    Can be used from any thread.
+*/
+extern bool util_mapFile(const char *aPath, MappedFileAccess_t aAccess, MappedFile_t *aoFile);
+/*!
+    Releases a view created by util_mapFile.
+*/
+extern void util_unmapFile(MappedFile_t *aFile);
+
 #endif
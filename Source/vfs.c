@@ -0,0 +1,272 @@
+#include "vfs.h"
+#include "lz4.h"
+#include "util.h"
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define kVFSMaxPathLength 1024
+
+typedef struct _VFSArchive {
+    void *mapping;
+    size_t mappingLength;
+    const unsigned char *bytes; // The archive within the mapping (Which starts at a page boundary)
+    size_t length;
+    const VFSArchiveHeader_t *header;
+    const VFSArchiveEntry_t *entries;
+    const uint32_t *buckets;
+    const char *names;
+    size_t namesLength;
+    int fd; // Kept open for decoders that read the entries through a descriptor
+    off_t fileOffset; // The offset of the archive within that file
+} VFSArchive_t;
+
+static VFSArchive_t _MountedArchives[kVFSMaxMountedArchives];
+static int _NumberOfMountedArchives = 0;
+
+#pragma mark - Mounting
+
+static bool _vfs_rangeIsValid(const VFSArchive_t *aArchive, uint64_t aOffset, uint64_t aCount, size_t aSize)
+{
+    return aOffset <= aArchive->length && (aArchive->length - aOffset) / aSize >= aCount;
+}
+
+// Checks that everything the index refers to lies within the archive, so that lookups need no bounds checks
+static bool _vfs_validate(VFSArchive_t *aArchive)
+{
+    if(aArchive->length < sizeof(VFSArchiveHeader_t))
+        return false;
+    const VFSArchiveHeader_t *header = (const VFSArchiveHeader_t *)aArchive->bytes;
+    if(memcmp(header->magic, kVFSArchiveMagic, 4) != 0 || header->version != kVFSArchiveVersion)
+        return false;
+    if(header->numberOfBuckets == 0 || (header->numberOfBuckets & (header->numberOfBuckets - 1)) != 0
+       || header->numberOfBuckets < header->numberOfEntries)
+        return false;
+    if(!_vfs_rangeIsValid(aArchive, header->entriesOffset, header->numberOfEntries, sizeof(VFSArchiveEntry_t))
+       || !_vfs_rangeIsValid(aArchive, header->bucketsOffset, header->numberOfBuckets, sizeof(uint32_t))
+       || header->namesOffset >= aArchive->length || aArchive->bytes[aArchive->length - 1] != '\0')
+        return false;
+    if(header->entriesOffset % sizeof(uint64_t) != 0 || header->bucketsOffset % sizeof(uint32_t) != 0)
+        return false;
+
+    aArchive->header = header;
+    aArchive->entries = (const VFSArchiveEntry_t *)(aArchive->bytes + header->entriesOffset);
+    aArchive->buckets = (const uint32_t *)(aArchive->bytes + header->bucketsOffset);
+    aArchive->names = (const char *)aArchive->bytes + header->namesOffset;
+    aArchive->namesLength = aArchive->length - header->namesOffset;
+
+    for(uint32_t i = 0; i < header->numberOfBuckets; ++i) {
+        if(aArchive->buckets[i] > header->numberOfEntries)
+            return false;
+    }
+    for(uint32_t i = 0; i < header->numberOfEntries; ++i) {
+        const VFSArchiveEntry_t *entry = &aArchive->entries[i];
+        // The data is followed by a NUL byte
+        if(!_vfs_rangeIsValid(aArchive, entry->offset, entry->storedSize + 1, 1) || entry->nameOffset >= aArchive->namesLength)
+            return false;
+        if(entry->compression == kVFSCompression_none
+           && (entry->storedSize != entry->size || aArchive->bytes[entry->offset + entry->storedSize] != '\0'))
+            return false;
+        if(entry->compression != kVFSCompression_none && entry->compression != kVFSCompression_lz4)
+            return false;
+    }
+    return true;
+}
+
+bool vfs_mountFd(int aFd, off_t aOffset, size_t aLength)
+{
+    if(_NumberOfMountedArchives >= kVFSMaxMountedArchives) {
+        dynamo_log("Too many archives mounted");
+        return false;
+    }
+    // Mappings have to start at a page boundary
+    long pageSize = sysconf(_SC_PAGESIZE);
+    off_t mappingOffset = aOffset - (aOffset % pageSize);
+    size_t padding = aOffset - mappingOffset;
+
+    VFSArchive_t archive = {0};
+    archive.mappingLength = aLength + padding;
+    archive.mapping = mmap(NULL, archive.mappingLength, PROT_READ, MAP_PRIVATE, aFd, mappingOffset);
+    if(archive.mapping == MAP_FAILED)
+        return false;
+    archive.bytes = (const unsigned char *)archive.mapping + padding;
+    archive.length = aLength;
+    if(!_vfs_validate(&archive)) {
+        dynamo_log("Not a valid archive");
+        munmap(archive.mapping, archive.mappingLength);
+        return false;
+    }
+    archive.fd = dup(aFd);
+    archive.fileOffset = aOffset;
+    _MountedArchives[_NumberOfMountedArchives++] = archive;
+    return true;
+}
+
+bool vfs_mount(const char *aPath)
+{
+    int fd = open(aPath, O_RDONLY);
+    if(fd < 0)
+        return false;
+    struct stat fileStat;
+    bool succeeded = fstat(fd, &fileStat) == 0 && vfs_mountFd(fd, 0, fileStat.st_size);
+    close(fd);
+    if(!succeeded)
+        dynamo_log("Could not mount %s", aPath);
+    return succeeded;
+}
+
+void vfs_unmountAll(void)
+{
+    for(int i = 0; i < _NumberOfMountedArchives; ++i) {
+        munmap(_MountedArchives[i].mapping, _MountedArchives[i].mappingLength);
+        if(_MountedArchives[i].fd >= 0)
+            close(_MountedArchives[i].fd);
+    }
+    _NumberOfMountedArchives = 0;
+}
+
+#pragma mark - Lookup
+
+// Strips the prefix, leading slashes, "./" components & duplicate slashes from a path
+static bool _vfs_normalizePath(const char *aPath, char *aoOutput, size_t *aoLength)
+{
+    if(vfs_isVirtualPath(aPath))
+        aPath += strlen(kVFSPathPrefix);
+    size_t length = 0;
+    const char *cursor = aPath;
+    while(*cursor) {
+        if(*cursor == '/' && (length == 0 || aoOutput[length - 1] == '/')) {
+            ++cursor;
+            continue;
+        }
+        if(cursor[0] == '.' && cursor[1] == '/' && (length == 0 || aoOutput[length - 1] == '/')) {
+            cursor += 2;
+            continue;
+        }
+        if(length >= kVFSMaxPathLength - 1)
+            return false;
+        aoOutput[length++] = *cursor++;
+    }
+    aoOutput[length] = '\0';
+    *aoLength = length;
+    return true;
+}
+
+static const VFSArchiveEntry_t *_vfs_findEntry(const VFSArchive_t *aArchive, const char *aPath, uint64_t aHash)
+{
+    uint32_t mask = aArchive->header->numberOfBuckets - 1;
+    for(uint32_t i = 0, bucket = aHash & mask; i <= mask; ++i, bucket = (bucket + 1) & mask) {
+        uint32_t entryIdx = aArchive->buckets[bucket];
+        if(entryIdx == 0)
+            return NULL;
+        const VFSArchiveEntry_t *entry = &aArchive->entries[entryIdx - 1];
+        // The archive ends with a NUL byte, so the names are all terminated
+        if(entry->hash == aHash && strcmp(aArchive->names + entry->nameOffset, aPath) == 0)
+            return entry;
+    }
+    return NULL;
+}
+
+static const VFSArchiveEntry_t *_vfs_lookup(const char *aPath, const VFSArchive_t **aoArchive)
+{
+    char path[kVFSMaxPathLength];
+    size_t length;
+    if(!_vfs_normalizePath(aPath, path, &length))
+        return NULL;
+    uint64_t hash = vfs_hashPath(path, length);
+    for(int i = _NumberOfMountedArchives - 1; i >= 0; --i) {
+        const VFSArchiveEntry_t *entry = _vfs_findEntry(&_MountedArchives[i], path, hash);
+        if(entry) {
+            *aoArchive = &_MountedArchives[i];
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Directories are not indexed, so look for any entry within it
+static bool _vfs_containsDirectory(const char *aPath)
+{
+    char path[kVFSMaxPathLength];
+    size_t length;
+    if(!_vfs_normalizePath(aPath, path, &length))
+        return false;
+    for(int i = 0; i < _NumberOfMountedArchives; ++i) {
+        const VFSArchive_t *archive = &_MountedArchives[i];
+        for(uint32_t j = 0; j < archive->header->numberOfEntries; ++j) {
+            if(strncmp(archive->names + archive->entries[j].nameOffset, path, length) == 0)
+                return true;
+        }
+    }
+    return false;
+}
+
+#pragma mark - Reading
+
+bool vfs_isVirtualPath(const char *aPath)
+{
+    return aPath && strncmp(aPath, kVFSPathPrefix, strlen(kVFSPathPrefix)) == 0;
+}
+
+bool vfs_contains(const char *aRelativePath)
+{
+    if(_NumberOfMountedArchives == 0)
+        return false;
+    size_t length = strlen(aRelativePath);
+    if(length > 0 && aRelativePath[length - 1] == '/')
+        return _vfs_containsDirectory(aRelativePath);
+    const VFSArchive_t *archive;
+    return _vfs_lookup(aRelativePath, &archive) != NULL;
+}
+
+bool vfs_exists(const char *aPath)
+{
+    return vfs_isVirtualPath(aPath) && vfs_contains(aPath + strlen(kVFSPathPrefix));
+}
+
+bool vfs_read(const char *aPath, VFSData_t *aoData)
+{
+    memset(aoData, 0, sizeof(VFSData_t));
+    const VFSArchive_t *archive;
+    const VFSArchiveEntry_t *entry = vfs_isVirtualPath(aPath) ? _vfs_lookup(aPath, &archive) : NULL;
+    if(!entry)
+        return false;
+
+    const unsigned char *stored = archive->bytes + entry->offset;
+    if(entry->compression == kVFSCompression_none) {
+        aoData->data = stored;
+        aoData->size = entry->size;
+        return true;
+    }
+    unsigned char *buffer = malloc(entry->size + 1);
+    if(!buffer || !lz4_decompress(stored, entry->storedSize, buffer, entry->size)) {
+        dynamo_log("Could not decompress %s", aPath);
+        free(buffer);
+        return false;
+    }
+    buffer[entry->size] = '\0';
+    aoData->data = buffer;
+    aoData->size = entry->size;
+    aoData->_buffer = buffer;
+    return true;
+}
+
+void vfs_release(VFSData_t *aData)
+{
+    free(aData->_buffer);
+    memset(aData, 0, sizeof(VFSData_t));
+}
+
+bool vfs_getFileRange(const char *aPath, int *aoFd, off_t *aoOffset, size_t *aoLength)
+{
+    const VFSArchive_t *archive;
+    const VFSArchiveEntry_t *entry = vfs_isVirtualPath(aPath) ? _vfs_lookup(aPath, &archive) : NULL;
+    if(!entry || entry->compression != kVFSCompression_none || archive->fd < 0)
+        return false;
+    *aoFd = archive->fd;
+    *aoOffset = archive->fileOffset + entry->offset;
+    *aoLength = entry->size;
+    return true;
+}
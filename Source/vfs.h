@@ -0,0 +1,137 @@
+/*!
+    @header Virtual File System
+    @abstract
+    @discussion Serves resources out of packed archives (.dpk files, built with Tools/dpkpack) rather than loose files.
+
+    An archive is a single file holding every resource along with a hashed index of their paths. Mounted archives are
+    mapped into memory, so reading an entry that is stored uncompressed costs no copy: the loaders parse straight out of
+    the mapping. Entries can also be LZ4 compressed, in which case they are decompressed into a buffer when read.
+
+    Files inside archives are referred to by virtual paths: their path relative to the resource directory, prefixed with
+    kVFSPathPrefix. util_pathForResource returns such a path when a resource is missing from disk but present in a
+    mounted archive, and the resource loaders accept them in place of filesystem paths.
+
+    Reading from archives is thread safe; mounting & unmounting must be done from the main thread while no other thread
+    is reading. Views into an archive remain valid until it is unmounted.
+*/
+
+#ifndef _VFS_H_
+#define _VFS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// Virtual paths start with this
+#define kVFSPathPrefix "vfs:"
+#define kVFSMaxMountedArchives 8
+
+#pragma mark - Archive format
+// All values are little endian
+
+#define kVFSArchiveMagic "DPAK"
+#define kVFSArchiveVersion 1
+
+typedef enum {
+    kVFSCompression_none = 0,
+    kVFSCompression_lz4  = 1
+} VFSCompression_t;
+
+typedef struct _VFSArchiveHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t numberOfEntries;
+    uint32_t numberOfBuckets; // A power of 2
+    uint64_t entriesOffset; // VFSArchiveEntry_t[numberOfEntries]
+    uint64_t bucketsOffset; // uint32_t[numberOfBuckets], each holding an entry index + 1 (0 for empty buckets)
+    uint64_t namesOffset; // NUL terminated entry paths
+} VFSArchiveHeader_t;
+
+/*!
+    An entry in an archive. The paths are hashed using 64 bit FNV-1a & looked up by linear probing from bucket hash % numberOfBuckets.
+    The stored data of every entry is followed by a NUL byte (Not counted in its size) so that text can be parsed in place.
+*/
+typedef struct _VFSArchiveEntry {
+    uint64_t hash;
+    uint64_t offset; // Offset of the data from the start of the archive
+    uint64_t storedSize;
+    uint64_t size; // The size once decompressed
+    uint32_t nameOffset; // Offset of the path from namesOffset
+    uint32_t compression;
+} VFSArchiveEntry_t;
+
+/*!
+    Hashes a path the way archives index them.
+*/
+static inline uint64_t vfs_hashPath(const char *aPath, size_t aLength)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for(size_t i = 0; i < aLength; ++i) {
+        hash ^= (unsigned char)aPath[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+#pragma mark - Mounting
+
+/*!
+    Maps the archive at aPath into memory & adds it to the searched archives. Archives mounted last are searched first.
+    Returns false if the file is missing or is not a valid archive.
+*/
+extern bool vfs_mount(const char *aPath);
+/*!
+    Mounts an archive contained in an open file, aLength bytes from aOffset. (Such as an uncompressed asset within an Android APK)
+    The descriptor can be closed once this returns.
+*/
+extern bool vfs_mountFd(int aFd, off_t aOffset, size_t aLength);
+/*!
+    Unmounts every archive.
+*/
+extern void vfs_unmountAll(void);
+
+#pragma mark - Reading
+
+/*!
+    The contents of an archive entry.
+
+    @field data The bytes of the entry, followed by a NUL byte
+    @field size The size of the entry (Excluding the NUL byte)
+*/
+typedef struct _VFSData {
+    const void *data;
+    size_t size;
+    void *_buffer; // The decompressed copy of compressed entries (NULL for views into the mapping)
+} VFSData_t;
+
+/*!
+    Returns true if aPath starts with kVFSPathPrefix.
+*/
+extern bool vfs_isVirtualPath(const char *aPath);
+/*!
+    Returns true if a mounted archive contains the given file, or directory if aRelativePath ends with a '/'.
+    (The path is relative to the resource directory & has no prefix)
+*/
+extern bool vfs_contains(const char *aRelativePath);
+/*!
+    Returns true if the file at the virtual path aPath exists.
+*/
+extern bool vfs_exists(const char *aPath);
+/*!
+    Reads the file at the virtual path aPath. Uncompressed entries are returned in place, others are decompressed.
+    Returns false if the file does not exist or could not be decompressed.
+    The data must be released using vfs_release.
+*/
+extern bool vfs_read(const char *aPath, VFSData_t *aoData);
+/*!
+    Releases data returned by vfs_read.
+*/
+extern void vfs_release(VFSData_t *aData);
+/*!
+    Locates an uncompressed entry within the archive file, for APIs that read from a file descriptor.
+    The descriptor belongs to the archive & stays open until it is unmounted.
+    Returns false if the file does not exist or is compressed.
+*/
+extern bool vfs_getFileRange(const char *aPath, int *aoFd, off_t *aoOffset, size_t *aoLength);
+#endif
@@ -1,6 +1,7 @@
 // Note: Assumes cpFloat is the same type as GLMFloat
 #include "world.h"
 #include "input.h"
+#include "sprite.h"
 #include "luacontext.h"
 
 #define VEC2_TO_CPV(v) ((cpVect){ v.x, v.y })
@@ -13,6 +14,17 @@ static void _removeShapeFromSpace(WorldShape_t *aShape, World_t *aWorld);
 static void _removeEntityFromWorld(WorldEntity_t *aEntity, World_t *aWorld);
 
 static void _callEntityUpdateCallback(WorldEntity_t *aEntity, World_t *aWorld);
+static void _publishOwnerState(WorldEntity_t *aEntity, World_t *aWorld);
+static void _callLuaHandler(World_t *aWorld, int aCallback, WorldEntity_t *aOwner, WorldEntity_t *aArgument, World_CollisionInfo *aCollisionInfo);
+
+// A Lua handler call, queued while the world is stepped on a simulation thread
+typedef struct _WorldScriptEvent {
+    int handler;
+    WorldEntity_t *owner; // Retained, the entity the handler belongs to
+    WorldEntity_t *argument; // Retained, the entity passed to the handler
+    bool hasCollisionInfo;
+    World_CollisionInfo collisionInfo; // a & b are retained
+} WorldScriptEvent_t;
 
 static int collisionWillBegin(cpArbiter *aArbiter, struct cpSpace *aSpace, void *aData);
 static void collisionDidBegin(cpArbiter *aArbiter, struct cpSpace *aSpace, void *aData);
@@ -79,8 +91,74 @@ void world_step(World_t *aWorld, GameTimer_t *aTimer)
     llist_apply(aWorld->entities, (LinkedListApplier_t)&_callEntityUpdateCallback, aWorld);
 }
 
+void world_timerUpdate(GameTimer_t *aTimer)
+{
+    World_t *world = aTimer->updateContext;
+    dynamo_assert(world != NULL, "No world to update");
+    // isThreaded is only changed while the simulation thread is not running
+    world->defersScriptHandlers = aTimer->isThreaded;
+    world_step(world, aTimer);
+    world->defersScriptHandlers = false;
+    // The renderer can't read the simulation's state while it is being stepped, so hand it a snapshot
+    if(aTimer->isThreaded)
+        llist_apply(world->entities, (LinkedListApplier_t)&_publishOwnerState, world);
+}
+
+static void _world_releaseScriptEvent(WorldScriptEvent_t *aEvent)
+{
+    obj_release(aEvent->owner);
+    obj_release(aEvent->argument);
+    if(aEvent->hasCollisionInfo) {
+        obj_release(aEvent->collisionInfo.a);
+        obj_release(aEvent->collisionInfo.b);
+    }
+}
+
+static void _world_queueScriptEvent(World_t *aWorld, int aCallback, WorldEntity_t *aOwner, WorldEntity_t *aArgument, World_CollisionInfo *aCollisionInfo)
+{
+    if(aWorld->scriptEventCount == aWorld->scriptEventCapacity) {
+        aWorld->scriptEventCapacity = MAX(16, aWorld->scriptEventCapacity*2);
+        aWorld->scriptEvents = realloc(aWorld->scriptEvents, aWorld->scriptEventCapacity*sizeof(WorldScriptEvent_t));
+    }
+    WorldScriptEvent_t *event = &aWorld->scriptEvents[aWorld->scriptEventCount++];
+    event->handler = aCallback;
+    event->owner = obj_retain(aOwner);
+    event->argument = obj_retain(aArgument);
+    event->hasCollisionInfo = aCollisionInfo != NULL;
+    if(aCollisionInfo) {
+        event->collisionInfo = *aCollisionInfo;
+        event->collisionInfo.cpArbiter = NULL;
+        obj_retain(event->collisionInfo.a);
+        obj_retain(event->collisionInfo.b);
+    }
+}
+
+static bool _worldEnt_hasLuaHandler(WorldEntity_t *aEntity, int aCallback)
+{
+    return aCallback == aEntity->luaUpdateHandler || aCallback == aEntity->luaPreCollisionHandler
+        || aCallback == aEntity->luaCollisionHandler || aCallback == aEntity->luaPostCollisionHandler;
+}
+
+void world_dispatchScriptHandlers(World_t *aWorld)
+{
+    int count = aWorld->scriptEventCount;
+    for(int i = 0; i < count; ++i) {
+        WorldScriptEvent_t *event = &aWorld->scriptEvents[i];
+        // The handler may have been replaced or removed since it was queued
+        if(_worldEnt_hasLuaHandler(event->owner, event->handler))
+            _callLuaHandler(aWorld, event->handler, event->owner, event->argument,
+                            event->hasCollisionInfo ? &event->collisionInfo : NULL);
+        _world_releaseScriptEvent(event);
+    }
+    aWorld->scriptEventCount = 0;
+}
+
 void world_destroy(World_t *aWorld)
 {
+    for(int i = 0; i < aWorld->scriptEventCount; ++i)
+        _world_releaseScriptEvent(&aWorld->scriptEvents[i]);
+    free(aWorld->scriptEvents), aWorld->scriptEvents = NULL;
+
     llist_apply(aWorld->entities, (LinkedListApplier_t)&_removeEntityFromWorld, aWorld);
     aWorld->staticEntity->cpBody = NULL;
     world_removeEntity(aWorld, aWorld->staticEntity);
@@ -208,6 +286,15 @@ WorldShape_t *worldEnt_addShape(WorldEntity_t *aEntity, WorldShape_t *aShape)
     return aShape;
 }
 
+void worldEnt_removeShape(WorldEntity_t *aEntity, WorldShape_t *aShape)
+{
+    World_t *world = aEntity->world;
+    if(world && cpSpaceContainsShape(world->cpSpace, aShape->cpShape))
+        cpSpaceRemoveShape(world->cpSpace, aShape->cpShape);
+    // The list holds a reference, so the shape may be freed here
+    llist_deleteValue(aEntity->shapes, aShape);
+}
+
 #pragma mark - World entity shapes
 
 WorldShape_t *worldShape_createCircle(vec2_t aCenter, GLMFloat aRadius)
@@ -235,6 +322,7 @@ WorldShape_t *worldShape_createPoly(unsigned aVertCount, vec2_t *aVerts)
 {
     WorldShape_t *out = obj_create_autoreleased(&Class_WorldShape);
     out->cpShape = cpPolyShapeNew(NULL, aVertCount, (cpVect*)aVerts, cpvzero);
+    out->cpShape->data = out;
     return out;
 }
 
@@ -314,14 +402,22 @@ static World_CollisionInfo _collisionInfoForArbiter(cpArbiter *aArbiter)
     };
 }
 
-static void _callLuaCollisionHandler(int aCallback, WorldEntity_t *aCollider, World_CollisionInfo *aCollisionInfo)
+// Calls the Lua handler of aOwner, or queues the call if the world is being stepped off the render thread
+static void _callLuaHandler(World_t *aWorld, int aCallback, WorldEntity_t *aOwner, WorldEntity_t *aArgument, World_CollisionInfo *aCollisionInfo)
 {
     if(aCallback == -1)
         return;
+    if(aWorld->defersScriptHandlers) {
+        _world_queueScriptEvent(aWorld, aCallback, aOwner, aArgument, aCollisionInfo);
+        return;
+    }
     luaCtx_pushScriptHandler(GlobalLuaContext, aCallback);
-    luaCtx_pushlightuserdata(GlobalLuaContext, aCollider);
-    luaCtx_pushlightuserdata(GlobalLuaContext, aCollisionInfo);
-    luaCtx_pcall(GlobalLuaContext, 2, 0, 0);
+    luaCtx_pushlightuserdata(GlobalLuaContext, aArgument);
+    if(aCollisionInfo) {
+        luaCtx_pushlightuserdata(GlobalLuaContext, aCollisionInfo);
+        luaCtx_pcall(GlobalLuaContext, 2, 0, 0);
+    } else
+        luaCtx_pcall(GlobalLuaContext, 1, 0, 0);
 }
 
 static int collisionWillBegin(cpArbiter *aArbiter, struct cpSpace *aSpace, void *aData)
@@ -332,8 +428,8 @@ static int collisionWillBegin(cpArbiter *aArbiter, struct cpSpace *aSpace, void
     if(collInfo.b->preCollisionHandler)
         collInfo.b->preCollisionHandler(collInfo.b, &collInfo);
     
-    _callLuaCollisionHandler(collInfo.a->luaPreCollisionHandler, collInfo.b, &collInfo);
-    _callLuaCollisionHandler(collInfo.b->luaPreCollisionHandler, collInfo.a, &collInfo);
+    _callLuaHandler(aSpace->data, collInfo.a->luaPreCollisionHandler, collInfo.a, collInfo.b, &collInfo);
+    _callLuaHandler(aSpace->data, collInfo.b->luaPreCollisionHandler, collInfo.b, collInfo.a, &collInfo);
 
     return true;
 }
@@ -345,8 +441,8 @@ static void collisionDidBegin(cpArbiter *aArbiter, struct cpSpace *aSpace, void
     if(collInfo.b->collisionHandler)
         collInfo.b->collisionHandler(collInfo.b, &collInfo);
     
-    _callLuaCollisionHandler(collInfo.a->luaCollisionHandler, collInfo.b, &collInfo);
-    _callLuaCollisionHandler(collInfo.b->luaCollisionHandler, collInfo.a, &collInfo);
+    _callLuaHandler(aSpace->data, collInfo.a->luaCollisionHandler, collInfo.a, collInfo.b, &collInfo);
+    _callLuaHandler(aSpace->data, collInfo.b->luaCollisionHandler, collInfo.b, collInfo.a, &collInfo);
 }
 static void collisionDidEnd(cpArbiter *aArbiter, struct cpSpace *aSpace, void *aData)
 {
@@ -356,8 +452,8 @@ static void collisionDidEnd(cpArbiter *aArbiter, struct cpSpace *aSpace, void *a
     if(collInfo.b->postCollisionHandler)
         collInfo.b->postCollisionHandler(collInfo.b, &collInfo);
     
-    _callLuaCollisionHandler(collInfo.a->luaPostCollisionHandler, collInfo.b, &collInfo);
-    _callLuaCollisionHandler(collInfo.b->luaPostCollisionHandler, collInfo.a, &collInfo);
+    _callLuaHandler(aSpace->data, collInfo.a->luaPostCollisionHandler, collInfo.a, collInfo.b, &collInfo);
+    _callLuaHandler(aSpace->data, collInfo.b->luaPostCollisionHandler, collInfo.b, collInfo.a, &collInfo);
 }
 
 #pragma mark -
@@ -381,11 +477,20 @@ static void _callEntityUpdateCallback(WorldEntity_t *aEntity, World_t *aWorld)
 {
     if(aEntity->updateHandler)
         aEntity->updateHandler(aEntity);
-    if(aEntity->luaUpdateHandler != -1) {
-        luaCtx_pushScriptHandler(GlobalLuaContext, aEntity->luaUpdateHandler);
-        luaCtx_pushlightuserdata(GlobalLuaContext, aEntity);
-        luaCtx_pcall(GlobalLuaContext, 1, 0, 0);
-    }
+    _callLuaHandler(aWorld, aEntity->luaUpdateHandler, aEntity, aEntity, NULL);
+}
+
+// Moves a sprite owning the entity onto it and publishes the sprite's state
+static void _publishOwnerState(WorldEntity_t *aEntity, World_t *aWorld)
+{
+    if(!aEntity->owner || !obj_isClass(aEntity->owner, &Class_Sprite))
+        return;
+    Sprite_t *sprite = (Sprite_t *)aEntity->owner;
+    vec2_t location = worldEnt_location(aEntity);
+    sprite->location.x = location.x;
+    sprite->location.y = location.y;
+    sprite->angle = worldEnt_angle(aEntity);
+    sprite_publishState(sprite);
 }
 
 #pragma mark - Joints
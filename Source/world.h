@@ -102,6 +102,8 @@ typedef cpGroup WorldShapeGroup_t;
     Can contain multiple entites
 
     @field staticEntity The static entity of the world. Shapes attached to this entity are static.
+    @field defersScriptHandlers Set while the world is stepped off the render thread. The Lua handlers of entities are
+    then queued until world_dispatchScriptHandlers is called, instead of being called during the step.
 */
 struct _World {
     OBJ_GUTS
@@ -109,6 +111,9 @@ struct _World {
     LinkedList_t *entities;
     WorldEntity_t *staticEntity;
     bool isPaused;
+    bool defersScriptHandlers;
+    struct _WorldScriptEvent *scriptEvents;
+    int scriptEventCount, scriptEventCapacity;
 };
 
 /*!
@@ -159,6 +164,18 @@ extern World_t *world_create(void);
     Steps the world state .
 */
 extern void world_step(World_t *aWorld, GameTimer_t *aTimer);
+/*!
+    A game timer update callback that steps the world in aTimer->updateContext.
+    When the timer runs it on its simulation thread the Lua handlers of the world's entities are queued, to be called on
+    the render thread by world_dispatchScriptHandlers.
+*/
+extern void world_timerUpdate(GameTimer_t *aTimer);
+/*!
+    Calls the Lua handlers queued while the world was stepped on a simulation thread.
+    Must be called from the thread that owns the Lua state, with the simulation locked. (See gameTimer_lockSimulation)
+    Collision info passed to deferred collision handlers has no cpArbiter, as the arbiter only exists during the step.
+*/
+extern void world_dispatchScriptHandlers(World_t *aWorld);
 /*!
     Sets the gravity in a world.
 */
@@ -228,6 +245,10 @@ extern void worldEnt_setVelocity(WorldEntity_t *aEntity, vec2_t aVelocity);
     Adds a shape to an en entity
 */
 extern WorldShape_t *worldEnt_addShape(WorldEntity_t *aEntity, WorldShape_t *aShape);
+/*!
+    Removes a shape from an entity (And from the world's space if it had been added to it)
+*/
+extern void worldEnt_removeShape(WorldEntity_t *aEntity, WorldShape_t *aShape);
 
 /*!
     @functiongroup Shapes
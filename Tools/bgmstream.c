@@ -0,0 +1,70 @@
+// bgmstream
+// Plays an Ogg Vorbis file as BGM through the OpenAL backend (sound_other.c), then plays it again from a seek
+// position with looping on, & reports how long playback took along with the peak memory use of the process. The
+// music is streamed, so the memory use stays the same however long the file is.
+//
+// Usage: bgmstream file.ogg [seconds of looping]
+// With OpenAL Soft no audio device is needed: ALSOFT_DRIVERS=null bgmstream file.ogg
+
+#include "sound.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+static double _now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static long _peakMemory(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss; // Kilobytes
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2) {
+        fprintf(stderr, "Usage: %s file.ogg [seconds of looping]\n", argv[0]);
+        return 1;
+    }
+    double loopDuration = argc > 2 ? atof(argv[2]) : 5.0;
+    Obj_autoReleasePool_t *pool = autoReleasePool_create();
+
+    SoundManager_t *manager = soundManager_create();
+    if(!manager) {
+        fprintf(stderr, "Could not open an audio device\n");
+        return 1;
+    }
+    long memoryBefore = _peakMemory();
+    BackgroundMusic_t *bgm = bgm_load(argv[1]);
+    if(!bgm) {
+        fprintf(stderr, "Could not load %s\n", argv[1]);
+        return 1;
+    }
+
+    double start = _now();
+    bgm_play(bgm);
+    while(bgm_isPlaying(bgm))
+        usleep(10000);
+    printf("Played through in %.2fs\n", _now() - start);
+
+    // Looping carries on from the start of the file without a gap, until stopped
+    bgm_seek(bgm, 1.0f);
+    bgm_setLooping(bgm, true);
+    start = _now();
+    bgm_play(bgm);
+    while(_now() - start < loopDuration && bgm_isPlaying(bgm))
+        usleep(10000);
+    printf("Looped for %.2fs (%s)\n", _now() - start, bgm_isPlaying(bgm) ? "ok" : "STOPPED EARLY");
+    bgm_stop(bgm);
+
+    printf("Peak memory %ldKB, %ldKB more than before loading\n", _peakMemory(), _peakMemory() - memoryBefore);
+    autoReleasePool_drain(pool);
+    return 0;
+}
@@ -0,0 +1,282 @@
+// dpkpack
+// Packs a resource directory into a single archive that the engine can mount (See vfs.h), in place of shipping
+// loose files.
+//
+// Usage: dpkpack [-a alignment] [-A alignment:pattern]... [-c pattern]... output.dpk resource_dir
+//   -a  Default alignment of the entries' data (16 bytes unless specified)
+//   -A  Alignment of the entries whose path matches the shell pattern (e.g. -A 4096:'*.dtmb' to page align binary maps)
+//   -c  LZ4 compresses the entries whose path matches the pattern (e.g. -c '*.lua' -c '*.json' -c '*.tmx')
+//       Entries that would not get any smaller are stored as they are.
+// Paths are matched relative to resource_dir. Hidden files are skipped.
+//
+// Only depends on lz4.c so that it can be built without the engine:
+//   cc -std=gnu99 -O2 -ISource -o dpkpack Tools/dpkpack.c Source/lz4.c
+
+#include "vfs.h"
+#include "lz4.h"
+#include <dirent.h>
+#include <fnmatch.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    #error Archives are written in the host byte order, which must be little endian
+#endif
+
+#define kMaxRules 64
+
+typedef struct {
+    char *path; // Relative to the resource directory
+    VFSArchiveEntry_t entry;
+} PackedFile_t;
+
+typedef struct {
+    const char *pattern;
+    size_t alignment;
+} AlignmentRule_t;
+
+static PackedFile_t *_files = NULL;
+static int _numberOfFiles = 0, _fileCapacity = 0;
+
+static const char *_compressedPatterns[kMaxRules];
+static int _numberOfCompressedPatterns = 0;
+static AlignmentRule_t _alignmentRules[kMaxRules];
+static int _numberOfAlignmentRules = 0;
+static size_t _defaultAlignment = 16;
+
+static int _compareFiles(const void *a, const void *b)
+{
+    return strcmp(((const PackedFile_t *)a)->path, ((const PackedFile_t *)b)->path);
+}
+
+// Collects the regular files under aRoot/aRelativeDir
+static bool _collectFiles(const char *aRoot, const char *aRelativeDir)
+{
+    char dirPath[4096];
+    snprintf(dirPath, sizeof(dirPath), "%s/%s", aRoot, aRelativeDir);
+    DIR *dir = opendir(dirPath);
+    if(!dir) {
+        fprintf(stderr, "Could not open %s\n", dirPath);
+        return false;
+    }
+    struct dirent *dirEntry;
+    bool succeeded = true;
+    while(succeeded && (dirEntry = readdir(dir))) {
+        if(dirEntry->d_name[0] == '.')
+            continue;
+        char relativePath[4096], fullPath[4096];
+        snprintf(relativePath, sizeof(relativePath), "%s%s%s", aRelativeDir, *aRelativeDir ? "/" : "", dirEntry->d_name);
+        snprintf(fullPath, sizeof(fullPath), "%s/%s", aRoot, relativePath);
+        struct stat fileStat;
+        if(stat(fullPath, &fileStat) != 0)
+            continue;
+        if(S_ISDIR(fileStat.st_mode))
+            succeeded = _collectFiles(aRoot, relativePath);
+        else if(S_ISREG(fileStat.st_mode)) {
+            if(_numberOfFiles == _fileCapacity) {
+                _fileCapacity = _fileCapacity ? _fileCapacity*2 : 256;
+                _files = realloc(_files, _fileCapacity*sizeof(PackedFile_t));
+            }
+            memset(&_files[_numberOfFiles], 0, sizeof(PackedFile_t));
+            _files[_numberOfFiles++].path = strdup(relativePath);
+        }
+    }
+    closedir(dir);
+    return succeeded;
+}
+
+static bool _readFile(const char *aPath, unsigned char **aoData, size_t *aoSize)
+{
+    FILE *file = fopen(aPath, "rb");
+    if(!file)
+        return false;
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    rewind(file);
+    *aoData = malloc(size > 0 ? size : 1);
+    bool succeeded = size >= 0 && fread(*aoData, 1, size, file) == (size_t)size;
+    fclose(file);
+    *aoSize = size;
+    return succeeded;
+}
+
+static bool _matchesAny(const char *aPath, const char **aPatterns, int aCount)
+{
+    for(int i = 0; i < aCount; ++i) {
+        if(fnmatch(aPatterns[i], aPath, 0) == 0)
+            return true;
+    }
+    return false;
+}
+
+static size_t _alignmentForPath(const char *aPath)
+{
+    // Later rules take precedence
+    for(int i = _numberOfAlignmentRules - 1; i >= 0; --i) {
+        if(fnmatch(_alignmentRules[i].pattern, aPath, 0) == 0)
+            return _alignmentRules[i].alignment;
+    }
+    return _defaultAlignment;
+}
+
+static bool _parseAlignment(const char *aString, size_t *aoAlignment)
+{
+    char *end;
+    unsigned long alignment = strtoul(aString, &end, 10);
+    // Alignments must be powers of 2
+    if(end == aString || alignment == 0 || (alignment & (alignment - 1)) != 0)
+        return false;
+    *aoAlignment = alignment;
+    return true;
+}
+
+static void _pad(FILE *aFile, uint64_t *aioOffset, size_t aAlignment)
+{
+    while(*aioOffset % aAlignment != 0) {
+        fputc(0, aFile);
+        ++*aioOffset;
+    }
+}
+
+static void _usage(const char *aName)
+{
+    fprintf(stderr, "Usage: %s [-a alignment] [-A alignment:pattern]... [-c pattern]... output.dpk resource_dir\n", aName);
+}
+
+int main(int argc, char **argv)
+{
+    int argIdx = 1;
+    for(; argIdx < argc && argv[argIdx][0] == '-'; ++argIdx) {
+        const char *option = argv[argIdx];
+        if(argIdx + 1 >= argc || option[2] != '\0') {
+            _usage(argv[0]);
+            return 1;
+        }
+        const char *value = argv[++argIdx];
+        if(option[1] == 'a') {
+            if(!_parseAlignment(value, &_defaultAlignment)) {
+                fprintf(stderr, "Invalid alignment %s\n", value);
+                return 1;
+            }
+        } else if(option[1] == 'A' && _numberOfAlignmentRules < kMaxRules) {
+            const char *separator = strchr(value, ':');
+            AlignmentRule_t *rule = &_alignmentRules[_numberOfAlignmentRules++];
+            if(!separator || !_parseAlignment(value, &rule->alignment)) {
+                fprintf(stderr, "Invalid alignment rule %s\n", value);
+                return 1;
+            }
+            rule->pattern = separator + 1;
+        } else if(option[1] == 'c' && _numberOfCompressedPatterns < kMaxRules)
+            _compressedPatterns[_numberOfCompressedPatterns++] = value;
+        else {
+            _usage(argv[0]);
+            return 1;
+        }
+    }
+    if(argc - argIdx != 2) {
+        _usage(argv[0]);
+        return 1;
+    }
+    const char *outputPath = argv[argIdx], *resourceDir = argv[argIdx + 1];
+
+    if(!_collectFiles(resourceDir, ""))
+        return 1;
+    // Sorted so that the same resources always produce the same archive
+    qsort(_files, _numberOfFiles, sizeof(PackedFile_t), &_compareFiles);
+
+    FILE *out = fopen(outputPath, "wb");
+    if(!out) {
+        fprintf(stderr, "Could not write %s\n", outputPath);
+        return 1;
+    }
+    VFSArchiveHeader_t header = { .version = kVFSArchiveVersion, .numberOfEntries = _numberOfFiles };
+    memcpy(header.magic, kVFSArchiveMagic, 4);
+    fwrite(&header, sizeof(header), 1, out); // Rewritten once the offsets are known
+    uint64_t offset = sizeof(header);
+
+    // Data
+    uint64_t totalSize = 0, totalStoredSize = 0;
+    uint32_t nameOffset = 0;
+    for(int i = 0; i < _numberOfFiles; ++i) {
+        PackedFile_t *file = &_files[i];
+        char fullPath[4096];
+        snprintf(fullPath, sizeof(fullPath), "%s/%s", resourceDir, file->path);
+        unsigned char *data;
+        size_t size;
+        if(!_readFile(fullPath, &data, &size)) {
+            fprintf(stderr, "Could not read %s\n", fullPath);
+            fclose(out);
+            return 1;
+        }
+        const unsigned char *stored = data;
+        size_t storedSize = size;
+        unsigned char *compressed = NULL;
+        file->entry.compression = kVFSCompression_none;
+        if(_matchesAny(file->path, _compressedPatterns, _numberOfCompressedPatterns)) {
+            compressed = malloc(lz4_compressBound(size));
+            size_t compressedSize = lz4_compress(data, size, compressed);
+            if(compressedSize > 0 && compressedSize < size) {
+                stored = compressed;
+                storedSize = compressedSize;
+                file->entry.compression = kVFSCompression_lz4;
+            }
+        }
+        _pad(out, &offset, _alignmentForPath(file->path));
+        file->entry.hash = vfs_hashPath(file->path, strlen(file->path));
+        file->entry.offset = offset;
+        file->entry.size = size;
+        file->entry.storedSize = storedSize;
+        file->entry.nameOffset = nameOffset;
+        fwrite(stored, 1, storedSize, out);
+        fputc(0, out);
+        offset += storedSize + 1;
+        nameOffset += strlen(file->path) + 1;
+        totalSize += size;
+        totalStoredSize += storedSize;
+        free(data);
+        free(compressed);
+    }
+
+    // Index
+    _pad(out, &offset, sizeof(uint64_t));
+    header.entriesOffset = offset;
+    for(int i = 0; i < _numberOfFiles; ++i)
+        fwrite(&_files[i].entry, sizeof(VFSArchiveEntry_t), 1, out);
+    offset += (uint64_t)_numberOfFiles*sizeof(VFSArchiveEntry_t);
+
+    // Keep the table at most half full so probe sequences stay short
+    header.numberOfBuckets = 1;
+    while(header.numberOfBuckets < (uint32_t)_numberOfFiles*2)
+        header.numberOfBuckets *= 2;
+    uint32_t *buckets = calloc(header.numberOfBuckets, sizeof(uint32_t));
+    uint32_t mask = header.numberOfBuckets - 1;
+    for(int i = 0; i < _numberOfFiles; ++i) {
+        uint32_t bucket = _files[i].entry.hash & mask;
+        while(buckets[bucket] != 0)
+            bucket = (bucket + 1) & mask;
+        buckets[bucket] = i + 1;
+    }
+    header.bucketsOffset = offset;
+    fwrite(buckets, sizeof(uint32_t), header.numberOfBuckets, out);
+    offset += (uint64_t)header.numberOfBuckets*sizeof(uint32_t);
+    free(buckets);
+
+    header.namesOffset = offset;
+    for(int i = 0; i < _numberOfFiles; ++i)
+        fwrite(_files[i].path, 1, strlen(_files[i].path) + 1, out);
+    // Archives end with a NUL byte even when empty
+    if(_numberOfFiles == 0)
+        fputc(0, out);
+
+    rewind(out);
+    fwrite(&header, sizeof(header), 1, out);
+    if(fclose(out) != 0) {
+        fprintf(stderr, "Could not write %s\n", outputPath);
+        return 1;
+    }
+    printf("%s: %d files, %llu bytes (%llu stored)\n", outputPath, _numberOfFiles,
+           (unsigned long long)totalSize, (unsigned long long)totalStoredSize);
+    return 0;
+}
@@ -0,0 +1,205 @@
+// jsonbench
+// Times parsing JSON into objects (parseJSON) against parsing it into a document (json_document.h), & checks that the
+// document adapter produces the same objects. Then times extracting the frames of packing info with a query
+// (json_query.h), & writing the document back out as JSON & CBOR (json_writer.h).
+//
+// Usage: jsonbench [file.json]
+// (Defaults to a generated texture packer file of about 1MB)
+
+#include "json.h"
+#include "json_document.h"
+#include "json_query.h"
+#include "json_writer.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double _now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static const int kRuns = 10;
+
+// Builds a packing info file like the ones texture_loadPackingInfo reads
+static char *_generatePackingInfo(size_t *aoLength)
+{
+    const int numberOfFrames = 5000;
+    size_t capacity = numberOfFrames*256 + 256, length = 0;
+    char *json = malloc(capacity);
+    length += sprintf(json + length, "{\"frames\": {\n");
+    for(int i = 0; i < numberOfFrames; ++i) {
+        length += sprintf(json + length,
+                          "\t\"sprites/frame_%05d.png\": {\"frame\": {\"x\":%d,\"y\":%d,\"w\":%d,\"h\":%d}, \"rotated\": %s, "
+                          "\"trimmed\": true, \"pivot\": {\"x\":0.5,\"y\":0.25}, \"name\": \"frame \\\"%d\\\"\"}%s\n",
+                          i, (i*37)%4096, (i*91)%4096, 16 + i%64, 16 + i%48, i%3 ? "false" : "true", i,
+                          i + 1 < numberOfFrames ? "," : "");
+    }
+    length += sprintf(json + length, "}, \"meta\": {\"image\": \"sprites.png\", \"size\": {\"w\":4096,\"h\":4096}, \"scale\": \"1\"}}\n");
+    *aoLength = length;
+    return json;
+}
+
+static char *_readFile(const char *aPath, size_t *aoLength)
+{
+    FILE *file = fopen(aPath, "rb");
+    if(!file)
+        return NULL;
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    rewind(file);
+    char *data = malloc(length + 1);
+    if(fread(data, 1, length, file) != (size_t)length) {
+        free(data);
+        data = NULL;
+    } else
+        data[length] = '\0';
+    fclose(file);
+    *aoLength = length;
+    return data;
+}
+
+typedef struct _Frame {
+    float x, y, w, h;
+} Frame_t;
+
+static const JSONQueryField_t _FrameFields[] = {
+    { "frame.x", kJSONField_float, offsetof(Frame_t, x) },
+    { "frame.y", kJSONField_float, offsetof(Frame_t, y) },
+    { "frame.w", kJSONField_float, offsetof(Frame_t, w) },
+    { "frame.h", kJSONField_float, offsetof(Frame_t, h) }
+};
+
+static void _countFrame(JSONQuery_t *aQuery, const JSONQueryMatch_t *aMatch, void *aRecord, uint64_t aFieldsFound, void *aCount)
+{
+    ++*(int *)aCount;
+}
+
+static bool _objectsEqual(Obj_t *a, Obj_t *b);
+
+static void _compareMember(const char *aKey, void *aValue, void *aOther)
+{
+    Obj_t **other = aOther;
+    if(*other && !_objectsEqual(aValue, dict_get(*other, aKey)))
+        *other = NULL;
+}
+
+static void _countMember(const char *aKey, void *aValue, void *aCount)
+{
+    ++*(int *)aCount;
+}
+
+static int _countMembers(Dictionary_t *aDict)
+{
+    int count = 0;
+    dict_apply(aDict, &_countMember, &count);
+    return count;
+}
+
+static bool _objectsEqual(Obj_t *a, Obj_t *b)
+{
+    if(!a || !b || obj_getClass(a) != obj_getClass(b))
+        return false;
+    if(obj_isClass(a, &Class_Number))
+        return ((Number_t *)a)->floatValue == ((Number_t *)b)->floatValue;
+    if(obj_isClass(a, &Class_String))
+        return strcmp(((String_t *)a)->cString, ((String_t *)b)->cString) == 0;
+    if(obj_isClass(a, &Class_Array)) {
+        Array_t *arrayA = a, *arrayB = b;
+        if(arrayA->count != arrayB->count)
+            return false;
+        for(int i = 0; i < arrayA->count; ++i) {
+            if(!_objectsEqual(arrayA->items[i], arrayB->items[i]))
+                return false;
+        }
+        return true;
+    }
+    if(obj_isClass(a, &Class_Dictionary)) {
+        if(_countMembers(a) != _countMembers(b))
+            return false;
+        Obj_t *other = b;
+        dict_apply(a, &_compareMember, &other);
+        return other != NULL;
+    }
+    return false;
+}
+
+int main(int argc, char **argv)
+{
+    size_t length;
+    char *json = argc > 1 ? _readFile(argv[1], &length) : _generatePackingInfo(&length);
+    if(!json) {
+        fprintf(stderr, "Could not read %s\n", argv[1]);
+        return 1;
+    }
+    Obj_autoReleasePool_t *pool = autoReleasePool_create();
+
+    double objTime = 0.0, docTime = 0.0, adapterTime = 0.0, queryTime = 0.0, jsonWriteTime = 0.0, cborWriteTime = 0.0;
+    int numberOfFrames = 0;
+    size_t documentMemory = 0, jsonLength = 0, cborLength = 0;
+    bool matches = true;
+    for(int i = 0; i < kRuns; ++i) {
+        double start = _now();
+        Obj_t *root = parseJSONData(json, length);
+        objTime += _now() - start;
+
+        start = _now();
+        JSONDocument_t *document = jsonDoc_parseData(json, length);
+        docTime += _now() - start;
+        if(!root || !document) {
+            fprintf(stderr, "Invalid JSON\n");
+            return 1;
+        }
+        documentMemory = document->memoryUsed;
+
+        start = _now();
+        Obj_t *adapted = jsonValue_toObj(document->root);
+        adapterTime += _now() - start;
+        if(i == 0)
+            matches = _objectsEqual(root, adapted);
+
+        start = _now();
+        JSONQuery_t *query = jsonQuery_create();
+        numberOfFrames = 0;
+        jsonQuery_addRecord(query, "frames.*", _FrameFields, 4, sizeof(Frame_t), &_countFrame, &numberOfFrames);
+        jsonQuery_runData(query, json, length);
+        obj_release(query);
+        queryTime += _now() - start;
+
+        start = _now();
+        JSONWriter_t *writer = jsonWriter_create(kJSONWriterFormat_json);
+        jsonWriter_value(writer, document->root);
+        jsonWriter_close(writer);
+        jsonWriteTime += _now() - start;
+        jsonLength = writer->bytesWritten;
+        obj_release(writer);
+
+        start = _now();
+        writer = jsonWriter_create(kJSONWriterFormat_cbor);
+        jsonWriter_value(writer, document->root);
+        jsonWriter_close(writer);
+        cborWriteTime += _now() - start;
+        cborLength = writer->bytesWritten;
+        obj_release(writer);
+
+        obj_release(document);
+        autoReleasePool_drain(pool);
+    }
+
+    double megabytes = length/(1024.0*1024.0);
+    printf("%.2fMB of JSON, %zu bytes of document nodes\n", megabytes, documentMemory);
+    printf("parseJSON          %8.2fms  (%7.1f MB/s)\n", objTime/kRuns*1000.0, megabytes*kRuns/objTime);
+    printf("jsonDoc_parseData  %8.2fms  (%7.1f MB/s, %5.2fx)\n", docTime/kRuns*1000.0, megabytes*kRuns/docTime, objTime/docTime);
+    printf("  + jsonValue_toObj %7.2fms  %s\n", adapterTime/kRuns*1000.0, matches ? "ok" : "MISMATCH");
+    printf("jsonQuery (frames) %8.2fms  (%7.1f MB/s, %5.2fx, %d frames)\n", queryTime/kRuns*1000.0, megabytes*kRuns/queryTime,
+           objTime/queryTime, numberOfFrames);
+    printf("jsonWriter (JSON)  %8.2fms  (%7.1f MB/s, %zu bytes)\n", jsonWriteTime/kRuns*1000.0,
+           jsonLength/(1024.0*1024.0)*kRuns/jsonWriteTime, jsonLength);
+    printf("jsonWriter (CBOR)  %8.2fms  (%7.1f MB/s, %zu bytes)\n", cborWriteTime/kRuns*1000.0,
+           cborLength/(1024.0*1024.0)*kRuns/cborWriteTime, cborLength);
+    free(json);
+    return matches ? 0 : 1;
+}
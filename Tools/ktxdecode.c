@@ -0,0 +1,50 @@
+// ktxdecode
+// Decodes the ETC1/ETC2 data of a .ktx file in software using the engine's reference decoder, so that compressed
+// textures can be checked on machines whose GPU does not support them.
+//
+// Usage: ktxdecode input.ktx output.pam [level]
+// (Writes a PAM image, rows in file order)
+
+#include "ktx_loader.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+int main(int argc, char **argv)
+{
+    if(argc != 3 && argc != 4) {
+        fprintf(stderr, "Usage: %s input.ktx output.pam [level]\n", argv[0]);
+        return 1;
+    }
+
+    Ktx_t *ktx = ktx_load(argv[1]);
+    if(!ktx) {
+        fprintf(stderr, "Could not read %s\n", argv[1]);
+        return 1;
+    }
+    int level = argc == 4 ? atoi(argv[3]) : 0;
+    if(level < 0 || level >= ktx->numberOfLevels) {
+        fprintf(stderr, "%s only has %d levels\n", argv[1], ktx->numberOfLevels);
+        return 1;
+    }
+    unsigned char *pixels = ktx_decompressLevel(ktx, level);
+    if(!pixels) {
+        fprintf(stderr, "Format 0x%x can not be decoded in software\n", ktx->glInternalFormat);
+        return 1;
+    }
+
+    FILE *out = fopen(argv[2], "wb");
+    if(!out) {
+        fprintf(stderr, "Could not write %s\n", argv[2]);
+        return 1;
+    }
+    int width = ktx->levels[level].width, height = ktx->levels[level].height;
+    int channels = ktx_formatHasAlpha(ktx->glInternalFormat) ? 4 : 3;
+    fprintf(out, "P7\nWIDTH %d\nHEIGHT %d\nDEPTH %d\nMAXVAL 255\nTUPLTYPE %s\nENDHDR\n",
+            width, height, channels, channels == 4 ? "RGB_ALPHA" : "RGB");
+    fwrite(pixels, channels, (size_t)width*height, out);
+    fclose(out);
+    free(pixels);
+
+    printf("%s: format 0x%x, %dx%d, %d levels\n", argv[1], ktx->glInternalFormat, ktx->width, ktx->height, ktx->numberOfLevels);
+    return 0;
+}
@@ -0,0 +1,107 @@
+// pixelbench
+// Times the load time pixel conversions against their scalar versions & checks that both produce identical output.
+//
+// Usage: pixelbench [width height]
+// (Defaults to a 2048x2048 image of random pixels)
+
+#include "pixel_convert.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef void (*Converter_t)(const unsigned char *aSrc, int aChannels, uint16_t *aoDst, size_t aCount);
+
+static double _now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
+
+static const int kRuns = 10;
+
+static void _report(const char *aName, double aScalar, double aSimd, size_t aPixels, bool aMatches)
+{
+    printf("%-20s scalar %7.2fms  simd %7.2fms  (%5.2fx, %6.0f Mpx/s)  %s\n", aName,
+           aScalar*1000.0, aSimd*1000.0, aScalar/aSimd, aPixels/aSimd/1e6, aMatches ? "ok" : "MISMATCH");
+}
+
+static bool _benchPremultiply(const unsigned char *aPixels, size_t aCount)
+{
+    unsigned char *scalar = malloc(aCount*4), *simd = malloc(aCount*4);
+    double scalarTime = 0.0, simdTime = 0.0;
+    for(int i = 0; i < kRuns; ++i) {
+        memcpy(scalar, aPixels, aCount*4);
+        double start = _now();
+        pixel_premultiplyRGBA8_scalar(scalar, aCount);
+        scalarTime += _now() - start;
+
+        memcpy(simd, aPixels, aCount*4);
+        start = _now();
+        pixel_premultiplyRGBA8(simd, aCount);
+        simdTime += _now() - start;
+    }
+    bool matches = memcmp(scalar, simd, aCount*4) == 0;
+    _report("premultiply RGBA8", scalarTime/kRuns, simdTime/kRuns, aCount, matches);
+    free(scalar);
+    free(simd);
+    return matches;
+}
+
+static bool _benchConversion(const char *aName, Converter_t aScalar, Converter_t aSimd,
+                             const unsigned char *aPixels, int aChannels, size_t aCount)
+{
+    uint16_t *scalar = malloc(aCount*2), *simd = malloc(aCount*2);
+    double scalarTime = 0.0, simdTime = 0.0;
+    for(int i = 0; i < kRuns; ++i) {
+        double start = _now();
+        aScalar(aPixels, aChannels, scalar, aCount);
+        scalarTime += _now() - start;
+
+        start = _now();
+        aSimd(aPixels, aChannels, simd, aCount);
+        simdTime += _now() - start;
+    }
+    bool matches = memcmp(scalar, simd, aCount*2) == 0;
+    char name[32];
+    snprintf(name, sizeof(name), "%s (%s)", aName, aChannels == 4 ? "RGBA" : "RGB");
+    _report(name, scalarTime/kRuns, simdTime/kRuns, aCount, matches);
+    free(scalar);
+    free(simd);
+    return matches;
+}
+
+int main(int argc, char **argv)
+{
+    int width = 2048, height = 2048;
+    if(argc == 3) {
+        width = atoi(argv[1]);
+        height = atoi(argv[2]);
+    } else if(argc != 1) {
+        fprintf(stderr, "Usage: %s [width height]\n", argv[0]);
+        return 1;
+    }
+    if(width <= 0 || height <= 0) {
+        fprintf(stderr, "Invalid image size\n");
+        return 1;
+    }
+
+    // Odd sizes exercise the scalar tails of the SIMD loops
+    size_t count = (size_t)width*height;
+    unsigned char *pixels = malloc(count*4);
+    srand(1);
+    for(size_t i = 0; i < count*4; ++i)
+        pixels[i] = rand() & 0xFF;
+
+    printf("%dx%d pixels, average of %d runs\n", width, height, kRuns);
+    bool ok = _benchPremultiply(pixels, count);
+    for(int channels = 4; channels >= 3; --channels) {
+        ok &= _benchConversion("RGBA4444", &pixel_convertToRGBA4444_scalar, &pixel_convertToRGBA4444, pixels, channels, count);
+        ok &= _benchConversion("RGBA5551", &pixel_convertToRGBA5551_scalar, &pixel_convertToRGBA5551, pixels, channels, count);
+        ok &= _benchConversion("RGB565",   &pixel_convertToRGB565_scalar,   &pixel_convertToRGB565,   pixels, channels, count);
+    }
+    free(pixels);
+    return ok ? 0 : 1;
+}
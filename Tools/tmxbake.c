@@ -0,0 +1,30 @@
+// tmxbake
+// Bakes .tmx maps into Dynamo's binary map format so they can be mapped into memory at runtime
+// instead of being parsed.
+//
+// Usage: tmxbake input.tmx output.dtmb
+// (Tileset image paths are stored as they appear in the .tmx file)
+
+#include "tmx_map.h"
+#include <stdio.h>
+
+int main(int argc, char **argv)
+{
+    if(argc != 3) {
+        fprintf(stderr, "Usage: %s input.tmx output.dtmb\n", argv[0]);
+        return 1;
+    }
+
+    TMXMap_t *map = tmx_readMapFile(argv[1]);
+    if(!map) {
+        fprintf(stderr, "Could not read map %s\n", argv[1]);
+        return 1;
+    }
+    if(!tmx_writeBinaryMapFile(map, argv[2])) {
+        fprintf(stderr, "Could not write %s\n", argv[2]);
+        return 1;
+    }
+    printf("%s: %dx%d tiles, %d layers, %d tilesets, %d object groups\n", argv[2],
+           map->width, map->height, map->numberOfLayers, map->numberOfTilesets, map->numberOfObjectGroups);
+    return 0;
+}
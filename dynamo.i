@@ -177,3 +177,7 @@ extern int luaCtx_tointeger(LuaContext_t *aCtx, int idx);
 extern int luaCtx_toboolean(LuaContext_t *aCtx, int idx);
 extern const char *luaCtx_tostring(LuaContext_t *aCtx, int idx);
 
+/*!
+	Mounts a resource archive contained in an open file, aLength bytes from aOffset. (Such as an uncompressed APK asset)
+*/
+extern bool vfs_mountFd(int aFd, long long aOffset, long long aLength);